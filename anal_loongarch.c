@@ -0,0 +1,774 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <r_types.h>
+#include <r_lib.h>
+#include <r_anal.h>
+
+#include "r_loongarch.h"
+
+/* per-insn analysis info, indexed by insn id */
+struct la_anal_info {
+    ut32 type;
+    ut8 cond;       /* RAnalCond of conditional branches */
+    ut8 access;     /* bytes loaded or stored */
+    bool store;
+    bool fpu;
+};
+
+#define ALU(t) { R_ANAL_OP_TYPE_##t, R_ANAL_COND_AL, 0, false, false }
+#define FPU(t) { R_ANAL_OP_TYPE_##t, R_ANAL_COND_AL, 0, false, true }
+#define BR(c) { R_ANAL_OP_TYPE_CJMP, R_ANAL_COND_##c, 0, false, false }
+#define LD(n) { R_ANAL_OP_TYPE_LOAD, R_ANAL_COND_AL, n, false, false }
+#define ST(n) { R_ANAL_OP_TYPE_STORE, R_ANAL_COND_AL, n, true, false }
+#define FLD(n) { R_ANAL_OP_TYPE_LOAD, R_ANAL_COND_AL, n, false, true }
+#define FST(n) { R_ANAL_OP_TYPE_STORE, R_ANAL_COND_AL, n, true, true }
+
+/*
+ * Insns whose semantic is not known (the ones prefixed with `!` and a few
+ * others) are left as UNK. jalr is refined in loongarch_op.
+ */
+static const struct la_anal_info loongarch_anal_info[LA_INSN_LAST] = {
+    [LA_INSN_SEXT_H] = ALU(MOV),
+    [LA_INSN_SEXT_B] = ALU(MOV),
+    [LA_INSN_ADDW] = ALU(ADD),
+    [LA_INSN_ADD] = ALU(ADD),
+    [LA_INSN_SUBW] = ALU(SUB),
+    [LA_INSN_SUB] = ALU(SUB),
+    [LA_INSN_SELNEZ] = ALU(CMOV),
+    [LA_INSN_SELEQZ] = ALU(CMOV),
+    [LA_INSN_NOR] = ALU(NOR),
+    [LA_INSN_AND] = ALU(AND),
+    [LA_INSN_OR] = ALU(OR),
+    [LA_INSN_XOR] = ALU(XOR),
+    [LA_INSN_SLL] = ALU(SHL),
+    [LA_INSN_SBS] = ALU(CMP),
+    [LA_INSN_SRL] = ALU(SHR),
+    [LA_INSN_MUL] = ALU(MUL),
+    [LA_INSN_SYSCALL] = ALU(SWI),
+    [LA_INSN_OFS_W] = ALU(UNK),
+    [LA_INSN_SLLIW] = ALU(SHL),
+    [LA_INSN_SLLI] = ALU(SHL),
+    [LA_INSN_SRLIW] = ALU(SHR),
+    [LA_INSN_SRLI] = ALU(SHR),
+    [LA_INSN_SRAIW] = ALU(SAR),
+    [LA_INSN_SRAI] = ALU(SAR),
+    [LA_INSN_RORIW] = ALU(ROR),
+    [LA_INSN_RORI] = ALU(ROR),
+    [LA_INSN_EXT_W] = ALU(UNK),
+    [LA_INSN_MASK] = ALU(AND),
+    [LA_INSN_FADD_W] = FPU(ADD),
+    [LA_INSN_FADD_D] = FPU(ADD),
+    [LA_INSN_FSUB_W] = FPU(SUB),
+    [LA_INSN_FSUB_D] = FPU(SUB),
+    [LA_INSN_FMUL_W] = FPU(MUL),
+    [LA_INSN_FMUL_D] = FPU(MUL),
+    [LA_INSN_FDIV_W] = FPU(DIV),
+    [LA_INSN_FDIV_D] = FPU(DIV),
+    [LA_INSN_SLTI] = ALU(CMP),
+    [LA_INSN_SLTIU] = ALU(CMP),
+    [LA_INSN_ADDIW] = ALU(ADD),
+    [LA_INSN_ADDI] = ALU(ADD),
+    [LA_INSN_ATI] = ALU(UNK),
+    [LA_INSN_ANDI] = ALU(AND),
+    [LA_INSN_ORI] = ALU(OR),
+    [LA_INSN_XORI] = ALU(XOR),
+    [LA_INSN_AUI] = ALU(MOV),
+    [LA_INSN_AHI] = ALU(ADD),
+    [LA_INSN_AUIPC] = ALU(LEA),
+    [LA_INSN_LW_2] = LD(4),
+    [LA_INSN_SW_2] = ST(4),
+    [LA_INSN_LD_2] = LD(8),
+    [LA_INSN_SD_2] = ST(8),
+    [LA_INSN_LB] = LD(1),
+    [LA_INSN_LH] = LD(2),
+    [LA_INSN_LW] = LD(4),
+    [LA_INSN_LD] = LD(8),
+    [LA_INSN_SB] = ST(1),
+    [LA_INSN_SH] = ST(2),
+    [LA_INSN_SW] = ST(4),
+    [LA_INSN_SD] = ST(8),
+    [LA_INSN_LBU] = LD(1),
+    [LA_INSN_LHU] = LD(2),
+    [LA_INSN_FLW] = FLD(4),
+    [LA_INSN_FSW] = FST(4),
+    [LA_INSN_FLD] = FLD(8),
+    [LA_INSN_FSD] = FST(8),
+    [LA_INSN_BEQZ] = BR(EQ),
+    [LA_INSN_BNEZ] = BR(NE),
+    [LA_INSN_BFP] = BR(AL),
+    [LA_INSN_JALR] = ALU(RCALL),
+    [LA_INSN_J] = ALU(JMP),
+    [LA_INSN_JAL] = ALU(CALL),
+    [LA_INSN_BEQ] = BR(EQ),
+    [LA_INSN_BNE] = BR(NE),
+    [LA_INSN_BGT] = BR(GT),
+    [LA_INSN_BLE] = BR(LE),
+    [LA_INSN_BGTU] = BR(HI),
+    [LA_INSN_BLEU] = BR(LS),
+    [LA_INSN_UNK] = ALU(ILL),
+};
+
+#undef ALU
+#undef FPU
+#undef BR
+#undef LD
+#undef ST
+#undef FLD
+#undef FST
+
+/* a snapshot written by `la_objdump -S` to take decoded insns from */
+#define SNAPSHOT_ENV "R2_LOONGARCH_SNAPSHOT"
+
+enum region_state {
+    REGION_UNLOADED,
+    REGION_LOADED,
+    REGION_CORRUPT,
+};
+
+struct snapshot_region {
+    ut64 addr;
+    size_t num_insns;
+    enum region_state state;
+    struct la_packed_insns insns;   /* views into the mapping */
+};
+
+/*
+ * Per-RAnal state. r2 analyzes functions and prints listings insn after
+ * insn, so values set by aui/auipc are followed from one insn to the next;
+ * a jump in the addresses asked for, or a branch, call or syscall in the
+ * code, starts over. r2 often asks for the same insn twice in a row, which
+ * gets the answer of the first time instead of starting over, unless its
+ * bytes were patched in between.
+ */
+struct anal_state {
+    struct la_resolver resolver;
+    ut64 last_addr;
+    la_insn_t last_word;
+    bool have_last;
+    bool last_found;
+    struct la_resolved last;
+    struct la_snapshot *snapshot;
+    struct snapshot_region *regions;
+    size_t num_regions;
+};
+
+/* map the snapshot at `path`, its regions are only loaded when used */
+static void open_snapshot(struct anal_state *state, const char *path) {
+    struct la_snapshot *snap = la_snapshot_open(path);
+
+    if (snap == NULL) {
+        fprintf(stderr, "loongarch: snapshot %s not used: %s\n", path, strerror(errno));
+        return;
+    }
+    size_t n = la_snapshot_num_regions(snap);
+    state->regions = calloc(n + 1, sizeof(*state->regions));
+    if (state->regions == NULL) {
+        la_snapshot_close(snap);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t addr;
+        la_snapshot_region_info(snap, i, &addr, &state->regions[i].num_insns);
+        state->regions[i].addr = addr;
+    }
+    state->snapshot = snap;
+    state->num_regions = n;
+}
+
+static bool init(RAnal *anal) {
+    struct anal_state *state = calloc(1, sizeof(*state));
+    const char *path = getenv(SNAPSHOT_ENV);
+
+    if (state == NULL) {
+        return false;
+    }
+    la_resolver_init(&state->resolver, 0);
+    if (path != NULL && *path != '\0') {
+        open_snapshot(state, path);
+    }
+    anal->plugin_data = state;
+    return true;
+}
+
+static bool fini(RAnal *anal) {
+    struct anal_state *state = anal->plugin_data;
+
+    if (state != NULL && state->snapshot != NULL) {
+        la_snapshot_close(state->snapshot);
+        free(state->regions);
+    }
+    free(state);
+    anal->plugin_data = NULL;
+    return true;
+}
+
+/*
+ * Decode the insn at `addr` from the snapshot if it has it, decoded from
+ * this very word, and by matching otherwise.
+ */
+static void decode(struct anal_state *state, ut64 addr, la_insn_t insn_word, struct la_op *la) {
+    for (size_t i = 0; state != NULL && i < state->num_regions; i++) {
+        struct snapshot_region *r = &state->regions[i];
+        size_t k = (addr - r->addr) / INSN_LENGTH_BYTES;
+
+        if (addr < r->addr || k >= r->num_insns || (addr - r->addr) % INSN_LENGTH_BYTES != 0) {
+            continue;
+        }
+        if (r->state == REGION_UNLOADED) {
+            r->state = la_snapshot_region_load(state->snapshot, i, &r->insns, NULL)
+                ? REGION_LOADED
+                : REGION_CORRUPT;
+        }
+        /* the bytes may have been patched since */
+        if (
+            r->state == REGION_LOADED
+            && la_packed_insn_word(&r->insns, k) == insn_word
+            && la_packed_expand(&r->insns, k, la) != 0
+        ) {
+            return;
+        }
+        break;
+    }
+    la_match_insn(insn_word, la);
+}
+
+static bool resolve(
+    struct anal_state *state,
+    const struct la_op *la,
+    ut64 addr,
+    la_insn_t insn_word,
+    struct la_resolved *resolved
+) {
+    /* a patched insn is a new one */
+    if (!state->have_last || addr != state->last_addr || insn_word != state->last_word) {
+        state->last_found = la_resolver_step(&state->resolver, la, addr, &state->last);
+        state->last_addr = addr;
+        state->last_word = insn_word;
+        state->have_last = true;
+    }
+    *resolved = state->last;
+    return state->last_found;
+}
+
+/* data and code references through aui/auipc pairs, for xrefs and `pd` */
+static void analyze_resolved(RAnal *anal, RAnalOp *op, const struct la_op *la, ut64 addr, la_insn_t insn_word) {
+    struct anal_state *state = anal->plugin_data;
+    struct la_resolved resolved;
+
+    if (state == NULL || !resolve(state, la, addr, insn_word, &resolved)) {
+        return;
+    }
+
+    switch (resolved.kind) {
+    case LA_RESOLVED_CONST:
+        op->val = resolved.value;
+        break;
+    case LA_RESOLVED_ADDR:
+    case LA_RESOLVED_LOAD:
+    case LA_RESOLVED_STORE:
+        op->ptr = resolved.value;
+        break;
+    case LA_RESOLVED_JUMP:
+        op->jump = resolved.value;
+        break;
+    }
+}
+
+static void analyze_mem(RAnalOp *op, const struct la_op *la, const struct la_anal_info *info) {
+    la_reg_t base;
+    int32_t disp;
+
+    if (!la_op_mem_operand(la, &base, &disp)) {
+        return;
+    }
+
+    op->direction = info->store ? R_ANAL_OP_DIR_WRITE : R_ANAL_OP_DIR_READ;
+    op->refptr = info->access;
+    op->ptrsize = info->access;
+    op->disp = disp;
+
+    if (base == LA_REG_SP) {
+        op->stackop = info->store ? R_ANAL_STACK_SET : R_ANAL_STACK_GET;
+        op->ptr = disp;
+    } else if (base == LA_REG_ZERO) {
+        op->ptr = disp;
+    }
+}
+
+static void analyze_jalr(RAnalOp *op, const struct la_op *la, ut64 addr) {
+    la_reg_t rd = la_op_rd(la);
+    la_reg_t rj = la_op_rj(la);
+
+    if (rd != LA_REG_ZERO) {
+        op->type = R_ANAL_OP_TYPE_RCALL;
+        op->fail = addr + INSN_LENGTH_BYTES;
+    } else if (rj == LA_REG_RA) {
+        op->type = R_ANAL_OP_TYPE_RET;
+        op->eob = true;
+    } else {
+        op->type = R_ANAL_OP_TYPE_RJMP;
+        op->eob = true;
+    }
+}
+
+static int loongarch_op(
+    RAnal *anal,
+    RAnalOp *op,
+    ut64 addr,
+    const ut8 *buf,
+    int len,
+    RAnalOpMask mask
+) {
+    struct la_op la;
+    const struct la_anal_info *info;
+    la_insn_t insn_word;
+    uint64_t target;
+    int64_t imm = 0;
+
+    if (len < INSN_LENGTH_BYTES) return -1;
+
+    insn_word = la_read_insn_word(buf);
+    decode(anal->plugin_data, addr, insn_word, &la);
+    info = &loongarch_anal_info[la.id];
+
+    op->addr = addr;
+    op->size = INSN_LENGTH_BYTES;
+    op->type = info->type;
+    op->cond = info->cond;
+    op->family = info->fpu ? R_ANAL_OP_FAMILY_FPU : R_ANAL_OP_FAMILY_CPU;
+    op->id = la.id;
+
+    if (la_op_imm(&la, &imm)) {
+        op->val = imm;
+    }
+
+    switch (la.id) {
+    case LA_INSN_J:
+        op->eob = true;
+        break;
+    case LA_INSN_JALR:
+        analyze_jalr(op, &la, addr);
+        break;
+    case LA_INSN_OR:
+        /* mv rd, rk */
+        if (la_op_rj(&la) == LA_REG_ZERO) {
+            op->type = R_ANAL_OP_TYPE_MOV;
+        }
+        break;
+    case LA_INSN_ADDIW:
+        /* li rd, imm */
+        if (la_op_rj(&la) == LA_REG_ZERO) {
+            op->type = R_ANAL_OP_TYPE_MOV;
+        }
+        /* fall through */
+    case LA_INSN_ADDI:
+        if (la_op_rd(&la) == LA_REG_SP && la_op_rj(&la) == LA_REG_SP) {
+            op->stackop = R_ANAL_STACK_INC;
+            op->stackptr = -imm;
+        }
+        break;
+    default:
+        if (la.render_flags & RENDER_FLAG_LOAD_STORE) {
+            analyze_mem(op, &la, info);
+        }
+        break;
+    }
+
+    analyze_resolved(anal, op, &la, addr, insn_word);
+
+    if (la_op_jump_target(&la, addr, &target)) {
+        op->jump = target;
+        if (op->type != R_ANAL_OP_TYPE_JMP) {
+            op->fail = addr + INSN_LENGTH_BYTES;
+        }
+    }
+
+    if (mask & R_ANAL_OP_MASK_ESIL) {
+        char esil[LA_ESIL_TEXT_MAX];
+
+        la_esil_insn(esil, sizeof(esil), &la, addr);
+        r_strbuf_set(&op->esil, esil);
+    }
+
+    if (mask & R_ANAL_OP_MASK_DISASM) {
+        char text[LA_INSN_TEXT_MAX];
+
+        la_print_insn(text, sizeof(text), &la, addr);
+        op->mnemonic = strdup(text);
+    }
+
+    return op->size;
+}
+
+static int archinfo(RAnal *anal, int query) {
+    switch (query) {
+    case R_ANAL_ARCHINFO_ALIGN:
+    case R_ANAL_ARCHINFO_MIN_OP_SIZE:
+    case R_ANAL_ARCHINFO_MAX_OP_SIZE:
+        return INSN_LENGTH_BYTES;
+    default:
+        return -1;
+    }
+}
+
+static bool set_reg_profile(RAnal *anal) {
+    const char *profile =
+        "=PC\tpc\n"
+        "=SP\tsp\n"
+        "=BP\ts9\n"
+        "=A0\ta0\n"
+        "=A1\ta1\n"
+        "=A2\ta2\n"
+        "=A3\ta3\n"
+        "=R0\ta0\n"
+        "=SN\ta7\n"
+        "gpr\tzero\t.64\t0\t0\n"
+        "gpr\tra\t.64\t8\t0\n"
+        "gpr\ttp\t.64\t16\t0\n"
+        "gpr\tsp\t.64\t24\t0\n"
+        "gpr\ta0\t.64\t32\t0\n"
+        "gpr\ta1\t.64\t40\t0\n"
+        "gpr\ta2\t.64\t48\t0\n"
+        "gpr\ta3\t.64\t56\t0\n"
+        "gpr\ta4\t.64\t64\t0\n"
+        "gpr\ta5\t.64\t72\t0\n"
+        "gpr\ta6\t.64\t80\t0\n"
+        "gpr\ta7\t.64\t88\t0\n"
+        "gpr\tt0\t.64\t96\t0\n"
+        "gpr\tt1\t.64\t104\t0\n"
+        "gpr\tt2\t.64\t112\t0\n"
+        "gpr\tt3\t.64\t120\t0\n"
+        "gpr\tt4\t.64\t128\t0\n"
+        "gpr\tt5\t.64\t136\t0\n"
+        "gpr\tt6\t.64\t144\t0\n"
+        "gpr\tat\t.64\t152\t0\n"
+        "gpr\tt8\t.64\t160\t0\n"
+        "gpr\tgp\t.64\t168\t0\n"
+        "gpr\ts9\t.64\t176\t0\n"
+        "gpr\ts0\t.64\t184\t0\n"
+        "gpr\ts1\t.64\t192\t0\n"
+        "gpr\ts2\t.64\t200\t0\n"
+        "gpr\ts3\t.64\t208\t0\n"
+        "gpr\ts4\t.64\t216\t0\n"
+        "gpr\ts5\t.64\t224\t0\n"
+        "gpr\ts6\t.64\t232\t0\n"
+        "gpr\ts7\t.64\t240\t0\n"
+        "gpr\ts8\t.64\t248\t0\n"
+        "gpr\tpc\t.64\t256\t0\n"
+        "fpu\tf0\t.64\t264\t0\n"
+        "fpu\tf1\t.64\t272\t0\n"
+        "fpu\tf2\t.64\t280\t0\n"
+        "fpu\tf3\t.64\t288\t0\n"
+        "fpu\tf4\t.64\t296\t0\n"
+        "fpu\tf5\t.64\t304\t0\n"
+        "fpu\tf6\t.64\t312\t0\n"
+        "fpu\tf7\t.64\t320\t0\n"
+        "fpu\tf8\t.64\t328\t0\n"
+        "fpu\tf9\t.64\t336\t0\n"
+        "fpu\tf10\t.64\t344\t0\n"
+        "fpu\tf11\t.64\t352\t0\n"
+        "fpu\tf12\t.64\t360\t0\n"
+        "fpu\tf13\t.64\t368\t0\n"
+        "fpu\tf14\t.64\t376\t0\n"
+        "fpu\tf15\t.64\t384\t0\n"
+        "fpu\tf16\t.64\t392\t0\n"
+        "fpu\tf17\t.64\t400\t0\n"
+        "fpu\tf18\t.64\t408\t0\n"
+        "fpu\tf19\t.64\t416\t0\n"
+        "fpu\tf20\t.64\t424\t0\n"
+        "fpu\tf21\t.64\t432\t0\n"
+        "fpu\tf22\t.64\t440\t0\n"
+        "fpu\tf23\t.64\t448\t0\n"
+        "fpu\tfs0\t.64\t456\t0\n"
+        "fpu\tfs1\t.64\t464\t0\n"
+        "fpu\tfs2\t.64\t472\t0\n"
+        "fpu\tfs3\t.64\t480\t0\n"
+        "fpu\tfs4\t.64\t488\t0\n"
+        "fpu\tfs5\t.64\t496\t0\n"
+        "fpu\tfs6\t.64\t504\t0\n"
+        "fpu\tfs7\t.64\t512\t0\n";
+
+    return r_reg_set_profile_string(anal->reg, profile);
+}
+
+/*
+ * `a:la.stats` prints the decoder statistics, `a:la.statsj` and
+ * `a:la.statsc` print them as JSON and CSV and `a:la.stats-` resets them.
+ */
+#define STATS_CMD "la.stats"
+
+static int cmd_stats(RAnal *anal, const char *input) {
+    enum la_stats_format format = LA_STATS_TEXT;
+
+    switch (input[sizeof(STATS_CMD) - 1]) {
+    case '\0':
+    case ' ':
+        break;
+    case 'j':
+        format = LA_STATS_JSON;
+        break;
+    case 'c':
+        format = LA_STATS_CSV;
+        break;
+    case '-':
+        la_decode_stats_reset();
+        return true;
+    default:
+        anal->cb_printf("Usage: a:" STATS_CMD "[j|c|-]\n");
+        return true;
+    }
+
+    char *text = la_decode_stats_dump(format);
+    if (text != NULL) {
+        anal->cb_printf("%s", text);
+        free(text);
+    }
+    return true;
+}
+
+/* executable sections looked at by the commands below */
+#define CODE_REGIONS_MAX 64
+
+/* the executable sections, or segments, of the binary, with no bytes yet */
+static size_t code_sections(RAnal *anal, struct la_funcs_region *regions) {
+    RList *sections = anal->binb.get_sections != NULL ? anal->binb.get_sections(anal->binb.bin) : NULL;
+    size_t n = 0;
+
+    for (int segments = 0; segments < 2 && n == 0; segments++) {
+        RListIter *iter;
+        RBinSection *section;
+
+        r_list_foreach (sections, iter, section) {
+            if (
+                section->is_segment != segments
+                || !(section->perm & R_PERM_X)
+                || section->vsize == 0
+                || n == CODE_REGIONS_MAX
+            ) {
+                continue;
+            }
+            regions[n].addr = section->vaddr;
+            regions[n].buf = NULL;
+            regions[n].len = section->vsize;
+            n++;
+        }
+    }
+    return n;
+}
+
+static void free_regions(struct la_funcs_region *regions, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        free((void *)regions[i].buf);
+        regions[i].buf = NULL;
+    }
+}
+
+/*
+ * Read the bytes of `regions`, whole insns only; a region too large or
+ * unreadable is reported and left empty.
+ */
+static bool read_regions(RAnal *anal, struct la_funcs_region *regions, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        struct la_funcs_region *r = &regions[i];
+        ut8 *buf;
+
+        r->len -= r->len % INSN_LENGTH_BYTES;
+        if (r->len > INT_MAX) {
+            anal->cb_printf("0x%" PFMT64x ": too large, skipped\n", (ut64)r->addr);
+            r->len = 0;
+            continue;
+        }
+        buf = malloc(r->len + 1);
+        if (buf == NULL) {
+            free_regions(regions, i);
+            return false;
+        }
+        if (!anal->iob.read_at(anal->iob.io, r->addr, buf, (int)r->len)) {
+            anal->cb_printf("0x%" PFMT64x ": cannot read, skipped\n", (ut64)r->addr);
+            r->len = 0;
+        }
+        r->buf = buf;
+    }
+    return true;
+}
+
+/*
+ * `a:la.funcs` defines and analyzes a function at every function start
+ * found in the executable sections, or the executable segments if there
+ * are no sections; `a:la.funcs addr size` looks at those bytes only. The
+ * scan runs on all cores.
+ */
+#define FUNCS_CMD "la.funcs"
+
+/* define the function at `addr` like `af` does, return whether it is new */
+static bool define_function(RAnal *anal, ut64 addr) {
+    char cmd[64];
+
+    if (r_anal_get_function_at(anal, addr) != NULL) {
+        return false;
+    }
+    if (anal->coreb.cmd != NULL) {
+        snprintf(cmd, sizeof(cmd), "af fcn.%08" PFMT64x " 0x%" PFMT64x, addr, addr);
+        anal->coreb.cmd(anal->coreb.core, cmd);
+    } else {
+        /* no core to analyze it, an empty function at least */
+        char name[32];
+        snprintf(name, sizeof(name), "fcn.%08" PFMT64x, addr);
+        r_anal_create_function(anal, name, addr, R_ANAL_FCN_TYPE_FCN, NULL);
+    }
+    return r_anal_get_function_at(anal, addr) != NULL;
+}
+
+static int cmd_funcs(RAnal *anal, const char *input) {
+    struct la_funcs_region regions[CODE_REGIONS_MAX];
+    struct la_func_list list;
+    const char *args = input + sizeof(FUNCS_CMD) - 1;
+    size_t num_regions;
+    size_t created = 0;
+
+    if (*args == ' ') {
+        char *end;
+        regions[0].addr = strtoull(args, &end, 0);
+        regions[0].buf = NULL;
+        regions[0].len = strtoull(end, &end, 0);
+        if (regions[0].len == 0) {
+            anal->cb_printf("Usage: a:" FUNCS_CMD " [addr size]\n");
+            return true;
+        }
+        num_regions = 1;
+    } else if (*args == '\0') {
+        num_regions = code_sections(anal, regions);
+    } else {
+        anal->cb_printf("Usage: a:" FUNCS_CMD " [addr size]\n");
+        return true;
+    }
+
+    la_func_list_init(&list);
+    if (
+        !read_regions(anal, regions, num_regions)
+        || !la_funcs_scan_regions(&list, regions, num_regions, 0, NULL, NULL)
+    ) {
+        anal->cb_printf("out of memory\n");
+    }
+    free_regions(regions, num_regions);
+
+    for (size_t i = 0; i < list.num_starts; i++) {
+        created += define_function(anal, list.starts[i].addr);
+    }
+    anal->cb_printf("%zu function starts, %zu new functions\n", list.num_starts, created);
+    la_func_list_fini(&list);
+    return true;
+}
+
+/*
+ * `a:la.search PATTERN[; PATTERN...]` lists the insns of the executable
+ * sections matching one of the patterns, written as for `la_objdump -p`.
+ */
+#define SEARCH_CMD "la.search"
+
+static void print_hit(void *user, uint64_t pc, la_insn_t insn_word, unsigned pattern) {
+    RAnal *anal = user;
+    char text[LA_INSN_TEXT_MAX];
+    struct la_op op;
+
+    (void)pattern;
+    la_match_insn(insn_word, &op);
+    la_print_insn(text, sizeof(text), &op, pc);
+    anal->cb_printf("0x%08" PFMT64x "  %s\n", (ut64)pc, text);
+}
+
+static int cmd_search(RAnal *anal, const char *input) {
+    struct la_funcs_region regions[CODE_REGIONS_MAX];
+    struct la_search search;
+    const char *p = input + sizeof(SEARCH_CMD) - 1;
+    size_t hits = 0;
+
+    if (*p != ' ') {
+        anal->cb_printf("Usage: a:" SEARCH_CMD " PATTERN[; PATTERN...]\n");
+        return true;
+    }
+
+    la_search_init(&search);
+    while (*p != '\0') {
+        char pattern[LA_INSN_TEXT_MAX];
+        size_t len;
+        enum la_search_error error;
+
+        p += strspn(p, " ");
+        len = strcspn(p, ";");
+
+        if (len >= sizeof(pattern)) {
+            anal->cb_printf("pattern too long\n");
+            return true;
+        }
+        memcpy(pattern, p, len);
+        pattern[len] = '\0';
+        p += len + (p[len] == ';');
+        if (len == 0) {
+            continue;
+        }
+        error = la_search_add(&search, pattern);
+        if (error != LA_SEARCH_OK) {
+            anal->cb_printf("%s: %s\n", pattern, la_search_error_name(error));
+            return true;
+        }
+    }
+
+    size_t num_regions = code_sections(anal, regions);
+    if (!read_regions(anal, regions, num_regions)) {
+        anal->cb_printf("out of memory\n");
+        return true;
+    }
+    for (size_t i = 0; i < num_regions; i++) {
+        hits += la_search_block(&search, regions[i].buf, regions[i].len, regions[i].addr, print_hit, anal);
+    }
+    free_regions(regions, num_regions);
+    anal->cb_printf("%zu hits\n", hits);
+    return true;
+}
+
+static int cmd_ext(RAnal *anal, const char *input) {
+    while (*input == ' ') {
+        input++;
+    }
+    if (strncmp(input, STATS_CMD, sizeof(STATS_CMD) - 1) == 0) {
+        return cmd_stats(anal, input);
+    }
+    if (strncmp(input, FUNCS_CMD, sizeof(FUNCS_CMD) - 1) == 0) {
+        return cmd_funcs(anal, input);
+    }
+    if (strncmp(input, SEARCH_CMD, sizeof(SEARCH_CMD) - 1) == 0) {
+        return cmd_search(anal, input);
+    }
+    /* not ours, let other plugins have a look */
+    return false;
+}
+
+RAnalPlugin r_anal_plugin_loongarch = {
+    .name = "loongarch",
+    .license = "GPL3",
+    .desc = "LoongArch analysis plugin",
+    .arch = "loongarch",
+    .bits = 64,
+    .esil = true,
+    .init = &init,
+    .fini = &fini,
+    .archinfo = &archinfo,
+    .op = &loongarch_op,
+    .set_reg_profile = &set_reg_profile,
+    .cmd_ext = &cmd_ext
+};
+
+#ifndef R2_PLUGIN_INCORE
+R_API RLibStruct radare_plugin = {
+    .type = R_LIB_TYPE_ANAL,
+    .data = &r_anal_plugin_loongarch,
+    .version = R2_VERSION
+};
+#endif
@@ -1,42 +1,207 @@
 #!/usr/bin/env python3
 
 '''
-input: lines like
+input: insns.txt, lines like
 
-000000 1010 IMM_________ RJ___ RD___   addiw       **4 -- li is sugar for `addiw rd, zero, imm`
+000000 1001 IMM_________ RJ___ RD___    sltiu [HEX]
+000000 1010 IMM_________ RJ___ RD___    addiw       **4 -- li is sugar for `addiw rd, zero, imm`
 
-output: lines like
+the optional bracketed annotation right after the mnemonic lists render flags
+(shorthands below, joined with `|`), register use annotations and/or overrides
+the guessed insn format
 
-{ "sext.h",     RR,     0x00005800, 0xfffffc00, 0 },
+output: a C header holding the matcher table, the decode tree and the
+per-format operand extractors, included by the decoder, and optionally a
+header enumerating the insn ids (matcher table indices) for everyone else
 
-various things are guessed or given sensible defaults, manual adjusts are needed after conversion
+with --profile, the decode tree is shaped after an insn frequency profile
+instead, see build_weighted_decode_tree
 '''
 
+import argparse
 import re
 import sys
 import typing
 
 SPACES = re.compile(r'\s+')
+ANNOTATION = re.compile(r'^\[([^\]]*)\]')
+
+FORMATS = [
+    'UNK',
+    'RR',
+    'RRR',
+    'FFFF',
+    'RRI6',
+    'RRI8',
+    'RRI12',
+    'RRI6I6',
+    'RRI14',
+    'RRI16',
+    'AUI20',
+    'RI21',
+    'I25',
+]
+
+RENDER_FLAGS = {
+    'HEX': ['RENDER_FLAG_PRINT_IMM_HEX'],
+    'JO': ['RENDER_FLAG_IMM_JUMP_OFFSET'],
+    'M32': ['RENDER_FLAG_IMM_MINUS_32'],
+    'SHL2': ['RENDER_FLAG_IMM_SHL_2'],
+    'FD': ['RENDER_FLAG_RD_IS_FPR'],
+    'FJ': ['RENDER_FLAG_RJ_IS_FPR'],
+    'FK': ['RENDER_FLAG_RK_IS_FPR'],
+    'FDJK': ['RENDER_FLAG_RD_IS_FPR', 'RENDER_FLAG_RJ_IS_FPR', 'RENDER_FLAG_RK_IS_FPR'],
+    'LS': ['RENDER_FLAG_LOAD_STORE'],
+}
+
+# register slots, at bits 0, 5, 10 and 15 of the word in every format
+REG_SLOTS = {'RD': 0x1, 'RJ': 0x2, 'RK': 0x4, 'RA': 0x8}
+# writes ra without naming it
+REG_SLOT_LINK = 0x10
+# the slot of a register field, by the bit it starts at
+REG_SLOT_AT = {0: REG_SLOTS['RD'], 5: REG_SLOTS['RJ'], 10: REG_SLOTS['RK'], 15: REG_SLOTS['RA']}
+# the slots each render flag shorthand shows as FPRs
+FPR_RENDER_SLOTS = {
+    'FD': REG_SLOTS['RD'],
+    'FJ': REG_SLOTS['RJ'],
+    'FK': REG_SLOTS['RK'],
+    'FDJK': REG_SLOTS['RD'] | REG_SLOTS['RJ'] | REG_SLOTS['RK'],
+}
+
+FORMAT_REG_SLOTS = {
+    'RR': ['RD', 'RJ'],
+    'RRR': ['RD', 'RJ', 'RK'],
+    'FFFF': ['RD', 'RJ', 'RK', 'RA'],
+    'RRI6': ['RD', 'RJ'],
+    'RRI8': ['RD', 'RJ'],
+    'RRI12': ['RD', 'RJ'],
+    'RRI6I6': ['RD', 'RJ'],
+    'RRI14': ['RD', 'RJ'],
+    'RRI16': ['RD', 'RJ'],
+    'AUI20': ['RD'],
+    'RI21': ['RJ'],
+    'I25': [],
+}
+
+# By default rd is written and the other registers are read, and branches
+# (JO) only read. These say otherwise:
+REG_USE_ANNOTATIONS = {
+    'ST',       # rd is read, not written: stores
+    'RMW',      # rd is read as well as written
+    'LINK',     # ra is written too: calls
+}
+
+# operand fields: list of (lsb, width) slices, most significant slice first
+OPC = [(26, 6)]
+RD = [(0, 5)]
+RJ = [(5, 5)]
+RK = [(10, 5)]
+RA = [(15, 5)]
+
+FORMAT_FIELDS = {
+    'RR': [('opcode', OPC), ('sel', [(10, 16)]), ('rd', RD), ('rj', RJ)],
+    'RRR': [('opcode', OPC), ('sel', [(15, 11)]), ('rd', RD), ('rj', RJ), ('rk', RK)],
+    'FFFF': [('opcode', OPC), ('sel', [(20, 6)]), ('rd', RD), ('rj', RJ), ('rk', RK), ('ra', RA)],
+    'RRI6': [('opcode', OPC), ('sel', [(16, 10)]), ('rd', RD), ('rj', RJ), ('imm', [(10, 6)])],
+    'RRI8': [('opcode', OPC), ('sel', [(18, 8)]), ('rd', RD), ('rj', RJ), ('imm', [(10, 8)])],
+    'RRI12': [('opcode', OPC), ('sel', [(22, 4)]), ('rd', RD), ('rj', RJ), ('imm', [(10, 12)])],
+    'RRI6I6': [
+        ('opcode', OPC), ('sel', [(22, 4)]), ('rd', RD), ('rj', RJ),
+        ('imm1', [(10, 6)]), ('imm2', [(16, 6)]),
+    ],
+    'RRI14': [('opcode', OPC), ('sel', [(24, 2)]), ('rd', RD), ('rj', RJ), ('imm', [(10, 14)])],
+    'RRI16': [('opcode', OPC), ('rd', RD), ('rj', RJ), ('imm', [(10, 16)])],
+    'AUI20': [('opcode', OPC), ('sel', [(25, 1)]), ('rd', RD), ('imm', [(5, 20)])],
+    'RI21': [('opcode', OPC), ('rj', RJ), ('imm', [(0, 5), (10, 16)])],
+    'I25': [('opcode', OPC), ('sel', [(9, 1)]), ('imm', [(0, 9), (10, 16)])],
+}
+
+# keep in sync with LA_MNEMONIC_MAX in r_loongarch.h
+MNEMONIC_MAX = 15
+
+# decode tree parameters, see the comment in the generated header
+DECODE_OPC_SHIFT = 26
+DECODE_OPC_WIDTH = 6
+DECODE_MAX_SEL_WIDTH = 8
+
+# profile-guided decode tree parameters, see build_weighted_decode_tree
+DECODE_MAX_HOT_SEL_WIDTH = 12
+# extra nodes worth one less tree level per word; the tables get this big
+DECODE_DEFAULT_NODE_BUDGET = 4096
+# unprofiled insns still get some weight, so their paths stay sensible
+DECODE_MIN_WEIGHT = 1e-6
+# longest candidate list the profile may leave in a leaf, as unprofiled
+# words and data walk it to the end
+DECODE_MAX_LEAF_CANDS = 4
+
 
 class Matcher:
-    def __init__(self, mnemonics: str, fmt: str, match: int, mask: int) -> None:
+    def __init__(
+        self,
+        lineno: int,
+        mnemonics: str,
+        fmt: str,
+        match: int,
+        mask: int,
+        render_flags: typing.List[str],
+        reg_use: typing.Optional[typing.List[str]] = None,
+        fprs: int = 0,
+    ) -> None:
+        self.lineno = lineno
         self.mnemonics = mnemonics
         self.fmt = fmt
         self.match = match
         self.mask = mask
-        # TODO: render_flag
+        self.render_flags = render_flags
+        self.reads, self.writes = reg_slots(fmt, render_flags, reg_use or [])
+        self.fprs = fprs
 
     def to_c(self) -> str:
         mnemonics_f = f'"{self.mnemonics}", '
-        fmt_f = f'{self.fmt}, '
-        return f'    {{ {mnemonics_f:14}{fmt_f:8}0x{self.match:08x}, 0x{self.mask:08x}, 0 }},'
+        fmt_f = f'LA_INSN_FORMAT_{self.fmt}, '
+        flags = []
+        for shorthand in self.render_flags:
+            flags.extend(RENDER_FLAGS[shorthand])
+        flags_f = ' | '.join(flags) if flags else '0'
+        return (
+            f'    {{ {mnemonics_f:14}{fmt_f:27}0x{self.match:08x}, 0x{self.mask:08x}, '
+            f'0x{self.reads:02x}, 0x{self.writes:02x}, 0x{self.fprs:02x}, {flags_f} }},'
+        )
+
+
+def reg_slots(fmt: str, render_flags: typing.List[str], reg_use: typing.List[str]) -> typing.Tuple[int, int]:
+    '''
+    Get the slots an insn reads and writes, as REG_SLOTS bits.
+    '''
+    present = 0
+    for slot in FORMAT_REG_SLOTS.get(fmt, []):
+        present |= REG_SLOTS[slot]
+    rd = present & REG_SLOTS['RD']
+
+    if 'JO' in render_flags or 'ST' in reg_use:
+        reads, writes = present, 0
+    elif 'RMW' in reg_use:
+        reads, writes = present, rd
+    else:
+        reads, writes = present & ~rd, rd
+    if 'LINK' in reg_use:
+        writes |= REG_SLOT_LINK
+    return reads, writes
+
+
+class DecodeNode:
+    def __init__(self, shift: int = 0, width: int = 0, base: int = 0, count: int = 0) -> None:
+        self.shift = shift
+        self.width = width
+        self.base = base
+        self.count = count
 
 
 def join_bits_to_int(bits: typing.List[int]) -> int:
     return sum((2 ** power) * bit for (power, bit) in enumerate(reversed(bits)))
 
 
-def process_line(l: str) -> Matcher:
+def process_line(lineno: int, l: str) -> Matcher:
     # coalesce spaces
     l = SPACES.sub(' ', l)
     # split into fragments
@@ -46,18 +211,22 @@ def process_line(l: str) -> Matcher:
     mask_bits = []
     bits_collected = 0
     mnemonics = ''
+    rest = ''
     num_seen_regs = 0
     num_seen_imms = 0
     num_seen_imm_bits = 0
     partial_imm_flag = False
-    for frag in frags:
+    # slots of the F* fields, which hold FPRs whether or not they render so
+    fprs = 0
+    for i, frag in enumerate(frags):
         if bits_collected > 32:
-            raise ValueError('malformed line: insn bits more than 32 already')
+            raise ValueError(f'line {lineno}: malformed line: insn bits more than 32 already')
 
         if bits_collected == 32:
             # this fragment must be insn name, record then break
             # all insn names are without spaces
             mnemonics = frag
+            rest = ' '.join(frags[i + 1:])
             break
 
         # this is a fragment describing part of the insn
@@ -78,6 +247,10 @@ def process_line(l: str) -> Matcher:
         # inspect into frag to guess insn format
         if frag[0] in {'R', 'F'}:
             num_seen_regs += 1
+            if frag[0] == 'F':
+                if 32 - bits_collected not in REG_SLOT_AT:
+                    raise ValueError(f'line {lineno}: malformed line: {frag} is not a register field')
+                fprs |= REG_SLOT_AT[32 - bits_collected]
         elif 'IMM' in frag:
             if not partial_imm_flag:
                 num_seen_imms += 1
@@ -85,11 +258,37 @@ def process_line(l: str) -> Matcher:
                     partial_imm_flag = True
             num_seen_imm_bits += len(frag)
 
+    if not mnemonics:
+        raise ValueError(f'line {lineno}: malformed line: no mnemonic after 32 insn bits')
+
     match = join_bits_to_int(match_bits)
     mask = join_bits_to_int(mask_bits)
     fmt = guess_insn_fmt(num_seen_regs, num_seen_imms, num_seen_imm_bits)
 
-    return Matcher(mnemonics, fmt, match, mask)
+    render_flags = []
+    reg_use = []
+    annotation = ANNOTATION.match(rest)
+    if annotation is not None:
+        for tok in annotation.group(1).split('|'):
+            tok = tok.strip()
+            if tok in FORMATS:
+                fmt = tok
+            elif tok in RENDER_FLAGS:
+                render_flags.append(tok)
+            elif tok in REG_USE_ANNOTATIONS:
+                reg_use.append(tok)
+            else:
+                raise ValueError(f'line {lineno}: unknown annotation {tok!r} for {mnemonics}')
+
+    if fmt == 'UNK':
+        raise ValueError(f'line {lineno}: cannot guess format of {mnemonics}, annotate it')
+
+    # FPR operands may render as GPRs, but not the other way around
+    for shorthand, slots in FPR_RENDER_SLOTS.items():
+        if shorthand in render_flags and slots & ~fprs:
+            raise ValueError(f'line {lineno}: {shorthand} of {mnemonics} names a GPR field')
+
+    return Matcher(lineno, mnemonics, fmt, match, mask, render_flags, reg_use, fprs)
 
 
 def guess_insn_fmt(num_regs: int, num_imms: int, total_imm_bits: int) -> str:
@@ -124,11 +323,520 @@ def guess_insn_fmt(num_regs: int, num_imms: int, total_imm_bits: int) -> str:
     return 'UNK'
 
 
+def check_matchers(matchers: typing.List[Matcher]) -> None:
+    '''
+    Reject entries that can never be decoded.
+
+    The table is first-match-wins, so an entry whose encodings are all
+    covered by an earlier entry is dead. Partial overlaps are legal (a more
+    specific entry placed first), but are reported so they are not accidental.
+    '''
+    errors = []
+    seen_mnemonics: typing.Dict[str, Matcher] = {}
+    for m in matchers:
+        if m.match & ~m.mask:
+            errors.append(f'line {m.lineno}: {m.mnemonics}: match bits outside of mask')
+        if len(m.mnemonics) > MNEMONIC_MAX:
+            errors.append(f'line {m.lineno}: {m.mnemonics}: longer than {MNEMONIC_MAX} chars')
+        if m.mnemonics in seen_mnemonics:
+            prev = seen_mnemonics[m.mnemonics]
+            errors.append(f'line {m.lineno}: {m.mnemonics}: duplicate of line {prev.lineno}')
+        seen_mnemonics[m.mnemonics] = m
+
+    for i, a in enumerate(matchers):
+        for b in matchers[i + 1:]:
+            if (a.match ^ b.match) & a.mask & b.mask:
+                # disjoint
+                continue
+            if a.mask & ~b.mask == 0:
+                errors.append(
+                    f'line {b.lineno}: {b.mnemonics}: shadowed by {a.mnemonics} '
+                    f'on line {a.lineno}'
+                )
+            else:
+                print(
+                    f'note: line {b.lineno}: {b.mnemonics} overlaps {a.mnemonics} '
+                    f'on line {a.lineno}, resolved by table order',
+                    file=sys.stderr,
+                )
+
+    if errors:
+        raise ValueError('\n'.join(errors))
+
+
+def build_decode_tree(
+    matchers: typing.List[Matcher],
+) -> typing.Tuple[typing.List[DecodeNode], typing.List[int]]:
+    nodes = [DecodeNode()]
+    cands: typing.List[int] = []
+
+    def build(node: DecodeNode, node_cands: typing.List[int], consumed: int, shift: int, width: int) -> None:
+        if width == 0 and len(node_cands) > 1:
+            # pick the highest run of bits fixed by all candidates
+            common = ~consumed & 0xffffffff
+            for c in node_cands:
+                common &= matchers[c].mask
+            if common:
+                hi = common.bit_length() - 1
+                shift = hi
+                while shift > 0 and common & (1 << (shift - 1)) and hi - shift + 1 < DECODE_MAX_SEL_WIDTH:
+                    shift -= 1
+                width = hi - shift + 1
+
+        if width == 0:
+            node.base = len(cands)
+            node.count = len(node_cands)
+            cands.extend(node_cands)
+            return
+
+        node.shift = shift
+        node.width = width
+        node.base = len(nodes)
+        children = [DecodeNode() for _ in range(1 << width)]
+        nodes.extend(children)
+
+        field_mask = ((1 << width) - 1) << shift
+        for v, child in enumerate(children):
+            child_cands = [c for c in node_cands if (matchers[c].match & field_mask) >> shift == v]
+            build(child, child_cands, consumed | field_mask, 0, 0)
+
+    build(nodes[0], list(range(len(matchers))), 0, DECODE_OPC_SHIFT, DECODE_OPC_WIDTH)
+    if len(nodes) > 0xffff or len(cands) > 0xffff:
+        raise ValueError('decode tree too large')
+    return nodes, cands
+
+
+def read_profile(path: str, matchers: typing.List[Matcher]) -> typing.List[float]:
+    '''
+    Read an insn frequency profile into per-entry weights summing to 1.
+
+    Accepted are `mnemonic count` lines (`#` starts a comment) and the CSV
+    written by a LA_STATS=1 build (R2_LOONGARCH_STATS=profile.csv), of which
+    only the `hit` rows are used.
+    '''
+    index = {m.mnemonics: i for i, m in enumerate(matchers)}
+    counts = [0.0] * len(matchers)
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            if ',' in line:
+                fields = line.split(',')
+                if fields[0] != 'hit':
+                    continue
+                fields = fields[1:3]
+            else:
+                fields = line.split()
+            if len(fields) != 2:
+                raise ValueError(f'{path}:{lineno}: expected a mnemonic and a count')
+            mnemonic, count = fields
+            if mnemonic == 'unk':
+                continue
+            if mnemonic not in index:
+                print(f'note: {path}:{lineno}: {mnemonic} is not in the table, ignored', file=sys.stderr)
+                continue
+            try:
+                counts[index[mnemonic]] += float(count)
+            except ValueError:
+                raise ValueError(f'{path}:{lineno}: bad count {count!r}') from None
+
+    total = sum(counts)
+    if total <= 0:
+        raise ValueError(f'{path}: empty profile')
+    return [max(c / total, DECODE_MIN_WEIGHT) for c in counts]
+
+
+def overlaps(a: Matcher, b: Matcher) -> bool:
+    return not (a.match ^ b.match) & a.mask & b.mask
+
+
+def hot_first(matchers: typing.List[Matcher], weights: typing.List[float], cands: typing.List[int]) -> typing.List[int]:
+    '''
+    Order leaf candidates by weight, except that overlapping entries keep
+    their table order so that the first match still wins.
+    '''
+    left = sorted(cands)
+    out = []
+    while left:
+        ready = [
+            c for c in left
+            if not any(e < c and overlaps(matchers[e], matchers[c]) for e in left)
+        ]
+        best = max(ready, key=lambda c: (weights[c], -c))
+        out.append(best)
+        left.remove(best)
+    return out
+
+
+def build_weighted_decode_tree(
+    matchers: typing.List[Matcher],
+    weights: typing.List[float],
+    node_budget: int,
+) -> typing.Tuple[typing.List[DecodeNode], typing.List[int]]:
+    '''
+    Build the decode tree that minimizes the expected number of nodes visited
+    per word under `weights`, plus a cost per node such that `node_budget`
+    nodes are worth one level for every word.
+
+    Selectors are not limited to bits every candidate fixes: a candidate
+    that leaves selector bits free is copied into every child it can reach,
+    in table order, so hot insns can be picked out with wider selectors near
+    the root. Candidates sharing a leaf are ordered hot first, except that
+    overlapping ones keep their table order, and identical child blocks are
+    emitted once.
+    '''
+    node_cost = 1.0 / node_budget
+    memo: typing.Dict[typing.Tuple[typing.Tuple[int, ...], int], typing.Tuple[float, typing.Any]] = {}
+
+    def share(c: int, consumed: int) -> float:
+        # a candidate's weight spreads evenly over the selector values it fits
+        return weights[c] / (1 << bin(consumed & ~matchers[c].mask & 0xffffffff).count('1'))
+
+    def leaf_cost(cands: typing.Tuple[int, ...], consumed: int) -> typing.Tuple[float, typing.Any]:
+        order = hot_first(matchers, weights, list(cands))
+        # a compare costs about as much as a level
+        cost = sum(share(c, consumed) * i for i, c in enumerate(order))
+        return cost, ('leaf', tuple(order))
+
+    def children_of(cands: typing.Tuple[int, ...], shift: int, width: int) -> typing.List[typing.List[int]]:
+        field_mask = ((1 << width) - 1) << shift
+        children: typing.List[typing.List[int]] = [[] for _ in range(1 << width)]
+        for c in cands:
+            m = matchers[c]
+            fixed = (m.mask & field_mask) >> shift
+            want = (m.match & field_mask) >> shift
+            free = ~fixed & ((1 << width) - 1)
+            # enumerate the selector values the candidate is compatible with
+            v = 0
+            while True:
+                children[want | v].append(c)
+                if v == free:
+                    break
+                v = (v - free) & free
+        return children
+
+    def greedy_field(cands: typing.Tuple[int, ...], fixed: int) -> typing.Tuple[int, int]:
+        # as in build_decode_tree, or on what the first candidate fixes
+        common = fixed
+        for c in cands:
+            common &= matchers[c].mask
+        if not common:
+            common = fixed & matchers[cands[0]].mask or fixed
+        hi = common.bit_length() - 1
+        shift = hi
+        while shift > 0 and common & (1 << (shift - 1)) and hi - shift + 1 < DECODE_MAX_SEL_WIDTH:
+            shift -= 1
+        return shift, hi - shift + 1
+
+    def fields(cands: typing.Tuple[int, ...], fixed: int) -> typing.Iterator[typing.Tuple[int, int]]:
+        # selectors start and end where some candidate's mask does
+        edges = {0, 32}
+        for c in cands:
+            mask = matchers[c].mask & fixed
+            edges.update(i for i in range(1, 32) if (mask >> i & 1) != (mask >> (i - 1) & 1))
+        edges.update(i for i in range(1, 32) if (fixed >> i & 1) != (fixed >> (i - 1) & 1))
+        edges_sorted = sorted(edges)
+        for top in reversed(edges_sorted):
+            for shift in reversed(edges_sorted):
+                width = top - shift
+                if width <= 0:
+                    continue
+                if width > DECODE_MAX_HOT_SEL_WIDTH:
+                    break
+                field_mask = ((1 << width) - 1) << shift
+                if field_mask & ~fixed:
+                    break
+                yield shift, width
+
+    def best(cands: typing.Tuple[int, ...], consumed: int) -> typing.Tuple[float, typing.Any]:
+        union = 0
+        for c in cands:
+            union |= matchers[c].mask
+        fixed = union & ~consumed & 0xffffffff
+        # consumed bits no candidate fixes scale all weights alike
+        key = (cands, consumed & union, bin(consumed & ~union & 0xffffffff).count('1'))
+        if key in memo:
+            return memo[key]
+
+        if len(cands) <= 1 or not fixed:
+            result = leaf_cost(cands, consumed)
+            memo[key] = result
+            return result
+
+        weight = sum(share(c, consumed) for c in cands)
+        if weight < node_cost:
+            # too cold to be worth searching
+            options: typing.Iterable[typing.Tuple[int, int]] = [greedy_field(cands, fixed)]
+            result = (float('inf'), None)
+        else:
+            options = fields(cands, fixed)
+            if len(cands) <= DECODE_MAX_LEAF_CANDS:
+                result = leaf_cost(cands, consumed)
+            else:
+                result = (float('inf'), None)
+
+        for shift, width in options:
+            field_mask = ((1 << width) - 1) << shift
+            cost = weight + node_cost * (1 << width)
+            if cost >= result[0]:
+                continue
+            plans = []
+            for child in children_of(cands, shift, width):
+                child_cost, plan = best(tuple(child), consumed | field_mask)
+                cost += child_cost
+                plans.append(plan)
+                if cost >= result[0]:
+                    break
+            else:
+                result = (cost, ('node', shift, width, plans))
+        memo[key] = result
+        return result
+
+    all_cands = tuple(range(len(matchers)))
+    _, root = best(all_cands, 0)
+
+    nodes = [DecodeNode()]
+    cands: typing.List[int] = []
+    blocks: typing.Dict[typing.Tuple[typing.Tuple[int, int, int, int], ...], int] = {}
+    leaves: typing.Dict[typing.Tuple[int, ...], int] = {}
+
+    def emit(node: DecodeNode, plan: typing.Any) -> None:
+        if plan[0] == 'leaf':
+            order = plan[1]
+            if order not in leaves:
+                leaves[order] = len(cands)
+                cands.extend(order)
+            node.base = leaves[order] if order else 0
+            node.count = len(order)
+            return
+
+        _, shift, width, plans = plan
+        children = [DecodeNode() for _ in plans]
+        for child, child_plan in zip(children, plans):
+            emit(child, child_plan)
+        block = tuple((c.shift, c.width, c.base, c.count) for c in children)
+        if block not in blocks:
+            blocks[block] = len(nodes)
+            nodes.extend(children)
+        node.shift = shift
+        node.width = width
+        node.base = blocks[block]
+
+    emit(nodes[0], root)
+    if len(nodes) > 0xffff or len(cands) > 0xffff:
+        raise ValueError('decode tree too large, lower the node budget')
+    return nodes, cands
+
+
+def tree_depths(
+    nodes: typing.List[DecodeNode],
+    cands: typing.List[int],
+    matchers: typing.List[Matcher],
+) -> typing.List[float]:
+    '''
+    Get the average number of nodes visited to decode each entry, over its
+    encodings.
+    '''
+    depths = [0.0] * len(matchers)
+
+    def walk(i: int, depth: int, consumed: int) -> None:
+        node = nodes[i]
+        if node.width == 0:
+            for c in cands[node.base:node.base + node.count]:
+                free = bin(consumed & ~matchers[c].mask & 0xffffffff).count('1')
+                depths[c] += depth / (1 << free)
+            return
+        field_mask = ((1 << node.width) - 1) << node.shift
+        for v in range(1 << node.width):
+            walk(node.base + v, depth + 1, consumed | field_mask)
+
+    walk(0, 0, 0)
+    return depths
+
+
+def field_expr(slices: typing.List[typing.Tuple[int, int]]) -> str:
+    parts = []
+    pos = sum(width for _, width in slices)
+    for lsb, width in slices:
+        pos -= width
+        part = f'insn_word >> {lsb}' if lsb else 'insn_word'
+        if lsb + width < 32:
+            part = f'({part}) & 0x{(1 << width) - 1:x}U' if lsb else f'{part} & 0x{(1 << width) - 1:x}U'
+        if pos:
+            part = f'({part}) << {pos}'
+        parts.append(part)
+    if len(parts) == 1:
+        return parts[0]
+    return ' | '.join(f'({part})' for part in parts)
+
+
+def emit_extractors() -> typing.List[str]:
+    out = []
+    for fmt, fields in FORMAT_FIELDS.items():
+        lower = fmt.lower()
+        out.append(f'static inline void la_extract_{lower}(la_insn_t insn_word, struct la_op *out) {{')
+        for name, slices in fields:
+            out.append(f'    out->insn.{lower}.{name} = {field_expr(slices)};')
+        out.append('}')
+        out.append('')
+
+    out.append('/**')
+    out.append(' * Fill in the operand fields of `out` according to `fmt`.')
+    out.append(' *')
+    out.append(' * Returns false for an invalid format.')
+    out.append(' */')
+    out.append('static inline bool la_extract_operands(')
+    out.append('    enum la_insn_format_t fmt,')
+    out.append('    la_insn_t insn_word,')
+    out.append('    struct la_op *out')
+    out.append(') {')
+    out.append('    switch (fmt) {')
+    out.append('    case LA_INSN_FORMAT_UNKNOWN:')
+    out.append('        out->insn.unknown = insn_word;')
+    out.append('        return true;')
+    for fmt in FORMAT_FIELDS:
+        out.append(f'    case LA_INSN_FORMAT_{fmt}:')
+        out.append(f'        la_extract_{fmt.lower()}(insn_word, out);')
+        out.append('        return true;')
+    out.append('    default:')
+    out.append('        /* should never happen */')
+    out.append('        return false;')
+    out.append('    }')
+    out.append('}')
+    return out
+
+
+def insn_id_name(mnemonics: str) -> str:
+    return 'LA_INSN_' + re.sub(r'[^A-Z0-9]', '_', mnemonics.lstrip('!').upper())
+
+
+def emit_ids_header(matchers: typing.List[Matcher]) -> str:
+    out = []
+    out.append('/* Generated by gen_match_masks.py from insns.txt, do not edit. */')
+    out.append('')
+    out.append('#ifndef _LOONGARCH_INSN_IDS_H_')
+    out.append('#define _LOONGARCH_INSN_IDS_H_')
+    out.append('')
+    out.append('/* insn ids, equal to the matcher table index */')
+    out.append('enum la_insn_id {')
+    seen = set()
+    for i, m in enumerate(matchers):
+        name = insn_id_name(m.mnemonics)
+        if name in seen:
+            raise ValueError(f'line {m.lineno}: {m.mnemonics}: id {name} is not unique')
+        seen.add(name)
+        out.append(f'    {name} = {i},')
+    out.append('')
+    out.append('    /* sentinel entry, i.e. not matched */')
+    out.append(f'    LA_INSN_UNK = {len(matchers)},')
+    out.append('    LA_INSN_LAST')
+    out.append('};')
+    out.append('')
+    out.append('#endif  /* _LOONGARCH_INSN_IDS_H_ */')
+    return '\n'.join(out) + '\n'
+
+
+def emit_header(
+    matchers: typing.List[Matcher],
+    weights: typing.Optional[typing.List[float]] = None,
+    node_budget: int = DECODE_DEFAULT_NODE_BUDGET,
+) -> str:
+    if weights is None:
+        nodes, cands = build_decode_tree(matchers)
+    else:
+        nodes, cands = build_weighted_decode_tree(matchers, weights, node_budget)
+        expected = sum(w * d for w, d in zip(weights, tree_depths(nodes, cands, matchers)))
+        print(
+            f'note: profile-guided decode tree: {len(nodes)} nodes, '
+            f'{expected:.2f} levels per word expected',
+            file=sys.stderr,
+        )
+
+    out = []
+    out.append('/* Generated by gen_match_masks.py from insns.txt, do not edit. */')
+    out.append('')
+    out.append('#ifndef _LOONGARCH_DECODE_TABLES_H_')
+    out.append('#define _LOONGARCH_DECODE_TABLES_H_')
+    out.append('')
+    out.append(f'#define LA_DECODE_NUM_MATCHERS {len(matchers)}')
+    out.append('')
+    out.append('static const struct la_disasm_matcher loongarch_disasm_data[] = {')
+    for m in matchers:
+        out.append(m.to_c())
+    out.append('')
+    out.append('    /* sentinel & ultimate fallback */')
+    out.append('    { NULL,         LA_INSN_FORMAT_UNKNOWN,    0x00000000, 0x00000000, 0x00, 0x00, 0x00, 0 }')
+    out.append('};')
+    out.append('')
+    out.append('/*')
+    if weights is None:
+        out.append(' * Decode tree: the root selects on the major opcode, inner nodes on the')
+        out.append(' * highest run of bits fixed by all of their candidates. Leaves list')
+        out.append(' * candidates in table order.')
+    else:
+        out.append(' * Decode tree shaped after an insn frequency profile: selectors are picked')
+        out.append(' * to keep hot insns close to the root, and leaves list candidates hot')
+        out.append(' * first, overlapping ones in table order.')
+    out.append(' */')
+    out.append('static const struct la_decode_node loongarch_decode_tree[] = {')
+    for i, n in enumerate(nodes):
+        out.append(f'    /* {i:4} */ {{ {n.shift:2}, {n.width}, {n.base:4}, {n.count} }},')
+    out.append('};')
+    out.append('')
+    out.append('static const uint16_t loongarch_decode_cands[] = {')
+    for i in range(0, len(cands), 8):
+        out.append('    ' + ' '.join(f'{c:3},' for c in cands[i:i + 8]))
+    out.append('};')
+    out.append('')
+    out.extend(emit_extractors())
+    out.append('')
+    out.append('#endif  /* _LOONGARCH_DECODE_TABLES_H_ */')
+    return '\n'.join(out) + '\n'
+
+
 def main() -> None:
-    for line in sys.stdin:
-        # remove final \n
-        line = line.strip()
-        print(process_line(line).to_c())
+    parser = argparse.ArgumentParser(description='Generate the LoongArch decoder tables.')
+    parser.add_argument('input', nargs='?', default='-', help='insns.txt (default: stdin)')
+    parser.add_argument('-o', '--output', default='-', help='output header (default: stdout)')
+    parser.add_argument('--ids-output', help='also write the insn id enum to this header')
+    parser.add_argument('--profile', help='shape the decode tree after this insn frequency profile')
+    parser.add_argument(
+        '--node-budget',
+        type=int,
+        default=DECODE_DEFAULT_NODE_BUDGET,
+        help=f'tree nodes worth one level per word with --profile (default: {DECODE_DEFAULT_NODE_BUDGET})',
+    )
+    args = parser.parse_args()
+
+    infile = sys.stdin if args.input == '-' else open(args.input)
+    matchers = []
+    try:
+        with infile:
+            for lineno, line in enumerate(infile, 1):
+                # remove final \n
+                line = line.strip()
+                if not line:
+                    continue
+                matchers.append(process_line(lineno, line))
+
+        check_matchers(matchers)
+        weights = read_profile(args.profile, matchers) if args.profile else None
+        header = emit_header(matchers, weights, args.node_budget)
+        ids_header = emit_ids_header(matchers)
+    except ValueError as e:
+        print(f'{args.input}: {e}', file=sys.stderr)
+        sys.exit(1)
+
+    if args.output == '-':
+        sys.stdout.write(header)
+    else:
+        with open(args.output, 'w') as f:
+            f.write(header)
+
+    if args.ids_output:
+        with open(args.ids_output, 'w') as f:
+            f.write(ids_header)
 
 
 if __name__ == '__main__':
@@ -0,0 +1,2067 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ * Standalone decoder benchmark, links against the decoder only and does not
+ * need radare2. Run it with `make bench`, or `make bench BENCH_ARGS=...`.
+ *
+ * usage: la_bench [-n NUM_WORDS] [-c CACHE_KIB] [-R] [TEXT_DUMP...]
+ *
+ * Every corpus is synthetic (uniformly random words, and words drawn from
+ * the matcher table so they follow its format mix) or a raw little-endian
+ * .text dump given on the command line. Cycles per insn come from the perf
+ * counters, where available. The passes over each corpus:
+ *
+ * - decode, and decode+render both in batches and with one la_disasm_block()
+ *   call per insn, like the asm plugin's disassemble callback
+ * - scrolling one insn at a time, re-disassembling a screenful every step
+ *   like r2's visual mode does, with and without the insn cache
+ * - classifying with every la_classify_block kernel the CPU supports
+ * - scanning packed insns against an array of struct la_op, and expanding
+ *   packed insns again
+ * - ESIL rendering from the templates, checked against snprintf
+ * - searching a few insn patterns with every la_search kernel, checked
+ *   against matching the disassembly text
+ * - building the CFG of the whole corpus and computing register liveness
+ *
+ * Then a decryption loop is run in the micro-emulator, the stack frames and
+ * jump tables of synthetic functions are recovered and checked, and so are
+ * the function starts of a synthetic stripped image. Unless -R is given, the
+ * custom formatter is also checked against snprintf.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "r_loongarch.h"
+
+#define CORPUS_SIZE 65536
+#define RENDER_ROUNDS 16
+#define DEFAULT_NUM_WORDS (1024 * 1024)
+/* keep at least this many insns per measurement, repeating the corpus */
+#define MIN_MEASURED_INSNS (8 * 1024 * 1024)
+/* insns per la_decode_block/la_disasm_block call */
+#define BLOCK_INSNS 1024
+/* scrolling simulation: insns on screen, and insns shown in total */
+#define SCROLL_WINDOW 64
+#define SCROLL_INSNS (4 * 1024 * 1024)
+#define DEFAULT_CACHE_KIB 256
+
+static const char *format_names[LA_INSN_FORMAT_LAST] = {
+    "UNKNOWN", "RR", "RRR", "FFFF", "RRI6", "RRI8", "RRI12",
+    "RRI6I6", "RRI14", "RRI16", "AUI20", "RI21", "I25",
+};
+
+/*
+ * Reference renderer: la_print_insn as it was when it was built on snprintf,
+ * kept to check the custom formatter against and to measure the difference.
+ */
+static const char *ref_reg_names_gpr[] = {
+    "zero", "ra", "tp", "sp",   /* 0 .. 3 */
+    "a0", "a1", "a2", "a3",     /* 4 .. 7 */
+    "a4", "a5", "a6", "a7",     /* 8 .. 11 */
+    "t0", "t1", "t2", "t3",     /* 12 .. 15 */
+    "t4", "t5", "t6", "at",     /* 16 .. 19 */
+    "t8", "gp", "s9", "s0",     /* 20 .. 23 */
+    "s1", "s2", "s3", "s4",     /* 24 .. 27 */
+    "s5", "s6", "s7", "s8"      /* 28 .. 31 */
+};
+
+static const char *ref_reg_names_fpr[] = {
+    "f0", "f1", "f2", "f3",     /* 0 .. 3 */
+    "f4", "f5", "f6", "f7",     /* 4 .. 7 */
+    "f8", "f9", "f10", "f11",   /* 8 .. 11 */
+    "f12", "f13", "f14", "f15", /* 12 .. 15 */
+    "f16", "f17", "f18", "f19", /* 16 .. 19 */
+    "f20", "f21", "f22", "f23", /* 20 .. 23 */
+    "fs0", "fs1", "fs2", "fs3", /* 24 .. 27 */
+    "fs4", "fs5", "fs6", "fs7"  /* 28 .. 31 */
+};
+
+static int32_t ref_simm_from_uimm(uint32_t uimm, uint8_t width) {
+    uint32_t a = 1 << width;
+    uint32_t b = a >> 1;
+
+    if (uimm < b) {
+        return (int32_t)uimm;
+    } else {
+        return -((int32_t)(a - uimm));
+    }
+}
+
+static int print_insn_snprintf(char *buf, int buflen, const struct la_op *op, uint64_t pc) {
+    bool print_hex = (op->render_flags & RENDER_FLAG_PRINT_IMM_HEX) != 0;
+    bool imm_is_jump_offset = (op->render_flags & RENDER_FLAG_IMM_JUMP_OFFSET) != 0;
+    bool is_load_store = (op->render_flags & RENDER_FLAG_LOAD_STORE) != 0;
+
+    uint32_t imm;
+    uint32_t imm1, imm2;
+    int32_t simm;
+    uint64_t jump_target;
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_UNKNOWN:
+        return snprintf(
+            buf,
+            buflen,
+            "%s 0x%08x",
+            op->mnemonic,
+            op->insn.unknown
+        );
+
+#define GPR(x)          ref_reg_names_gpr[x]
+#define FPR(x)          ref_reg_names_fpr[x]
+#define PRINT_RD(x)     ((op->render_flags & RENDER_FLAG_RD_IS_FPR) ? FPR(x) : GPR(x))
+#define PRINT_RJ(x)     ((op->render_flags & RENDER_FLAG_RJ_IS_FPR) ? FPR(x) : GPR(x))
+#define PRINT_RK(x)     ((op->render_flags & RENDER_FLAG_RK_IS_FPR) ? FPR(x) : GPR(x))
+    case LA_INSN_FORMAT_RR:
+        return snprintf(
+            buf,
+            buflen,
+            "%s %s, %s",
+            op->mnemonic,
+            PRINT_RD(op->insn.rr.rd),
+            PRINT_RJ(op->insn.rr.rj)
+        );
+    case LA_INSN_FORMAT_RRR:
+        return snprintf(
+            buf,
+            buflen,
+            "%s %s, %s, %s",
+            op->mnemonic,
+            PRINT_RD(op->insn.rrr.rd),
+            PRINT_RJ(op->insn.rrr.rj),
+            PRINT_RK(op->insn.rrr.rk)
+        );
+    case LA_INSN_FORMAT_FFFF:
+        return snprintf(
+            buf,
+            buflen,
+            "%s %s, %s, %s, %s",
+            op->mnemonic,
+            FPR(op->insn.ffff.rd),
+            FPR(op->insn.ffff.rj),
+            FPR(op->insn.ffff.rk),
+            FPR(op->insn.ffff.ra)
+        );
+    case LA_INSN_FORMAT_RRI6:
+        imm = op->insn.rri6.imm;
+        if (op->render_flags & RENDER_FLAG_IMM_MINUS_32) {
+            imm -= 32;
+        }
+        return snprintf(
+            buf,
+            buflen,
+            "%s %s, %s, %d",
+            op->mnemonic,
+            PRINT_RD(op->insn.rri6.rd),
+            PRINT_RJ(op->insn.rri6.rj),
+            imm
+        );
+    case LA_INSN_FORMAT_RRI8:
+        return snprintf(
+            buf,
+            buflen,
+            print_hex ? "%s %s, %s, 0x%x" : "%s %s, %s, %d",
+            op->mnemonic,
+            PRINT_RD(op->insn.rri8.rd),
+            PRINT_RJ(op->insn.rri8.rj),
+            op->insn.rri8.imm
+        );
+    case LA_INSN_FORMAT_RRI12:
+        imm = op->insn.rri12.imm;
+        simm = ref_simm_from_uimm(imm, 12);
+        if (is_load_store) {
+            return snprintf(
+                buf,
+                buflen,
+                "%s %s, %d(%s)",
+                op->mnemonic,
+                PRINT_RD(op->insn.rri12.rd),
+                simm,
+                PRINT_RJ(op->insn.rri12.rj)
+            );
+        }
+        return snprintf(
+            buf,
+            buflen,
+            print_hex ? "%s %s, %s, 0x%x" : "%s %s, %s, %d",
+            op->mnemonic,
+            PRINT_RD(op->insn.rri12.rd),
+            PRINT_RJ(op->insn.rri12.rj),
+            print_hex ? imm : simm
+        );
+    case LA_INSN_FORMAT_RRI6I6:
+        imm1 = op->insn.rri6i6.imm1;
+        imm2 = op->insn.rri6i6.imm2;
+        if (op->render_flags & RENDER_FLAG_IMM_MINUS_32) {
+            imm1 -= 32;
+            imm2 -= 32;
+        }
+        return snprintf(
+            buf,
+            buflen,
+            "%s %s, %s, %d, %d",
+            op->mnemonic,
+            PRINT_RD(op->insn.rri6i6.rd),
+            PRINT_RJ(op->insn.rri6i6.rj),
+            imm1,
+            imm2
+        );
+    case LA_INSN_FORMAT_RRI14:
+        imm = op->insn.rri14.imm;
+        simm = ref_simm_from_uimm(imm, 14);
+        if (op->render_flags & RENDER_FLAG_IMM_SHL_2) {
+            imm <<= 2;
+            simm <<= 2;
+        }
+        if (is_load_store) {
+            return snprintf(
+                buf,
+                buflen,
+                "%s %s, %d(%s)",
+                op->mnemonic,
+                PRINT_RD(op->insn.rri14.rd),
+                simm,
+                PRINT_RJ(op->insn.rri14.rj)
+            );
+        }
+        return snprintf(
+            buf,
+            buflen,
+            print_hex ? "%s %s, %s, 0x%x" : "%s %s, %s, %d",
+            op->mnemonic,
+            PRINT_RD(op->insn.rri14.rd),
+            PRINT_RJ(op->insn.rri14.rj),
+            print_hex ? imm : simm
+        );
+    case LA_INSN_FORMAT_RRI16:
+        imm = op->insn.rri16.imm;
+        if (imm_is_jump_offset) {
+            la_op_jump_target(op, pc, &jump_target);
+            return snprintf(
+                buf,
+                buflen,
+                "%s %s, %s, 0x%lx",
+                op->mnemonic,
+                PRINT_RD(op->insn.rri16.rd),
+                PRINT_RJ(op->insn.rri16.rj),
+                jump_target
+            );
+        }
+        return snprintf(
+            buf,
+            buflen,
+            print_hex ? "%s %s, %s, 0x%x" : "%s %s, %s, %d",
+            op->mnemonic,
+            PRINT_RD(op->insn.rri16.rd),
+            PRINT_RJ(op->insn.rri16.rj),
+            imm
+        );
+    case LA_INSN_FORMAT_AUI20:
+        return snprintf(
+            buf,
+            buflen,
+            print_hex ? "%s %s, 0x%x" : "%s %s, %d",
+            op->mnemonic,
+            PRINT_RD(op->insn.aui20.rd),
+            op->insn.aui20.imm
+        );
+    case LA_INSN_FORMAT_RI21:
+        imm = op->insn.ri21.imm;
+        if (imm_is_jump_offset) {
+            la_op_jump_target(op, pc, &jump_target);
+            return snprintf(
+                buf,
+                buflen,
+                "%s %s, 0x%lx",
+                op->mnemonic,
+                PRINT_RJ(op->insn.ri21.rj),
+                jump_target
+            );
+        }
+        return snprintf(
+            buf,
+            buflen,
+            "%s %s, %d",
+            op->mnemonic,
+            PRINT_RJ(op->insn.ri21.rj),
+            imm
+        );
+    case LA_INSN_FORMAT_I25:
+        imm = op->insn.i25.imm;
+        if (imm_is_jump_offset) {
+            la_op_jump_target(op, pc, &jump_target);
+            return snprintf(
+                buf,
+                buflen,
+                "%s 0x%lx",
+                op->mnemonic,
+                jump_target
+            );
+        }
+        return snprintf(
+            buf,
+            buflen,
+            "%s %d",
+            op->mnemonic,
+            imm
+        );
+#undef GPR
+#undef FPR
+#undef PRINT_RD
+#undef PRINT_RJ
+#undef PRINT_RK
+
+    default:
+        /* should never happen */
+        return 0;
+    }
+
+    return 0;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * CPU cycle counter for the calling thread, user space only. Falls back to
+ * reporting nothing when perf events are unavailable (non-Linux, containers,
+ * perf_event_paranoid).
+ */
+struct cycle_counter {
+    int fd;
+};
+
+static void cycle_counter_open(struct cycle_counter *cc) {
+    cc->fd = -1;
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    cc->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static void cycle_counter_start(struct cycle_counter *cc) {
+#ifdef __linux__
+    if (cc->fd >= 0) {
+        ioctl(cc->fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(cc->fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+/* returns 0 if cycles are not available */
+static uint64_t cycle_counter_stop(struct cycle_counter *cc) {
+    uint64_t cycles = 0;
+#ifdef __linux__
+    if (cc->fd >= 0) {
+        ioctl(cc->fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(cc->fd, &cycles, sizeof(cycles)) != sizeof(cycles)) {
+            cycles = 0;
+        }
+    }
+#endif
+    return cycles;
+}
+
+static void cycle_counter_close(struct cycle_counter *cc) {
+    if (cc->fd >= 0) {
+        close(cc->fd);
+    }
+}
+
+/* xorshift64, deterministic so runs are comparable */
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)rng_state;
+}
+
+/* keeps the compiler from dropping benchmarked work */
+static volatile unsigned bench_sink;
+
+struct corpus {
+    struct la_op ops[CORPUS_SIZE];
+    size_t len;
+};
+
+/*
+ * Collect CORPUS_SIZE decoded insns of every format: words are built from
+ * random matcher table entries with random operand bits, plus fully random
+ * words for the unknown format.
+ */
+static void build_format_corpora(struct corpus *corpora) {
+    size_t num_matchers;
+    const struct la_disasm_matcher *matchers = la_matcher_table(&num_matchers);
+    struct la_op op;
+
+    for (uint64_t draws = 0; draws < 16ULL * 1024 * 1024; draws++) {
+        la_insn_t insn_word = rng_next();
+        if (draws & 1) {
+            const struct la_disasm_matcher *m = &matchers[rng_next() % num_matchers];
+            insn_word = m->match | (insn_word & ~m->mask);
+        }
+        la_match_insn(insn_word, &op);
+
+        struct corpus *c = &corpora[op.fmt];
+        if (c->len < CORPUS_SIZE) {
+            c->ops[c->len++] = op;
+        }
+    }
+
+    /* no table entry uses these formats yet, make up operands */
+    for (size_t i = 0; i < CORPUS_SIZE; i++) {
+        la_insn_t r = rng_next();
+
+        op.mnemonic = "ffff";
+        op.fmt = LA_INSN_FORMAT_FFFF;
+        op.render_flags = 0;
+        op.insn.ffff.rd = r & 0x1f;
+        op.insn.ffff.rj = (r >> 5) & 0x1f;
+        op.insn.ffff.rk = (r >> 10) & 0x1f;
+        op.insn.ffff.ra = (r >> 15) & 0x1f;
+        corpora[LA_INSN_FORMAT_FFFF].ops[i] = op;
+
+        op.mnemonic = "rri8";
+        op.fmt = LA_INSN_FORMAT_RRI8;
+        op.render_flags = (r >> 31) ? RENDER_FLAG_PRINT_IMM_HEX : 0;
+        op.insn.rri8.rd = r & 0x1f;
+        op.insn.rri8.rj = (r >> 5) & 0x1f;
+        op.insn.rri8.imm = (r >> 10) & 0xff;
+        corpora[LA_INSN_FORMAT_RRI8].ops[i] = op;
+    }
+    corpora[LA_INSN_FORMAT_FFFF].len = CORPUS_SIZE;
+    corpora[LA_INSN_FORMAT_RRI8].len = CORPUS_SIZE;
+}
+
+static int bench_render(void) {
+    struct corpus *corpora = calloc(LA_INSN_FORMAT_LAST, sizeof(*corpora));
+    char ref_buf[LA_INSN_TEXT_MAX];
+    char fast_buf[LA_INSN_TEXT_MAX];
+    uint64_t pc = 0x120000000ULL;
+    int mismatches = 0;
+
+    if (corpora == NULL) {
+        return 1;
+    }
+
+    build_format_corpora(corpora);
+
+    printf("render: snprintf vs. custom formatter, %d insns per format\n", CORPUS_SIZE);
+    printf("%-8s %8s %14s %14s %8s\n", "format", "insns", "snprintf ns", "custom ns", "speedup");
+    for (int fmt = 0; fmt < LA_INSN_FORMAT_LAST; fmt++) {
+        const struct corpus *c = &corpora[fmt];
+        if (c->len == 0) {
+            printf("%-8s %8s\n", format_names[fmt], "-");
+            continue;
+        }
+
+        /* outputs must be byte-for-byte identical */
+        for (size_t i = 0; i < c->len; i++) {
+            int ref_len = print_insn_snprintf(ref_buf, sizeof(ref_buf), &c->ops[i], pc + i * 4);
+            int fast_len = la_print_insn(fast_buf, sizeof(fast_buf), &c->ops[i], pc + i * 4);
+            if (ref_len != fast_len || strcmp(ref_buf, fast_buf) != 0) {
+                if (mismatches++ < 10) {
+                    fprintf(stderr, "mismatch: \"%s\" vs. \"%s\"\n", ref_buf, fast_buf);
+                }
+            }
+        }
+
+        uint64_t t0 = now_ns();
+        for (int round = 0; round < RENDER_ROUNDS; round++) {
+            for (size_t i = 0; i < c->len; i++) {
+                bench_sink += print_insn_snprintf(ref_buf, sizeof(ref_buf), &c->ops[i], pc + i * 4);
+            }
+        }
+        uint64_t t1 = now_ns();
+        for (int round = 0; round < RENDER_ROUNDS; round++) {
+            for (size_t i = 0; i < c->len; i++) {
+                bench_sink += la_print_insn(fast_buf, sizeof(fast_buf), &c->ops[i], pc + i * 4);
+            }
+        }
+        uint64_t t2 = now_ns();
+
+        double n = (double)c->len * RENDER_ROUNDS;
+        double ref_ns = (t1 - t0) / n;
+        double fast_ns = (t2 - t1) / n;
+        printf(
+            "%-8s %8zu %14.1f %14.1f %7.2fx\n",
+            format_names[fmt],
+            c->len,
+            ref_ns,
+            fast_ns,
+            ref_ns / fast_ns
+        );
+    }
+
+    free(corpora);
+
+    if (mismatches) {
+        fprintf(stderr, "%d rendering mismatches\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Throughput over raw insn streams.
+ */
+struct word_corpus {
+    const char *name;
+    uint8_t *buf;
+    size_t num_words;
+};
+
+enum bench_pass {
+    BENCH_PASS_DECODE,
+    BENCH_PASS_DISASM,
+    /* one la_disasm_block call per insn, as the asm plugin's disassemble does */
+    BENCH_PASS_DISASM_SINGLE,
+};
+
+static void bench_words_pass(
+    const struct word_corpus *c,
+    enum bench_pass pass,
+    struct cycle_counter *cc
+) {
+    static struct la_op ops[BLOCK_INSNS];
+    static char text[BLOCK_INSNS * LA_INSN_TEXT_MAX];
+    uint64_t pc = 0x120000000ULL;
+    size_t rounds = 1;
+
+    if (c->num_words < MIN_MEASURED_INSNS) {
+        rounds = (MIN_MEASURED_INSNS + c->num_words - 1) / c->num_words;
+    }
+
+    size_t len = c->num_words * INSN_LENGTH_BYTES;
+    uint64_t t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t off = 0; off < len; off += BLOCK_INSNS * INSN_LENGTH_BYTES) {
+            size_t n;
+            if (pass == BENCH_PASS_DECODE) {
+                n = la_decode_block(c->buf + off, len - off, ops, BLOCK_INSNS);
+            } else if (pass == BENCH_PASS_DISASM_SINGLE) {
+                size_t end = off + BLOCK_INSNS * INSN_LENGTH_BYTES < len ? off + BLOCK_INSNS * INSN_LENGTH_BYTES : len;
+                n = 0;
+                for (size_t at = off; at < end; at += INSN_LENGTH_BYTES) {
+                    n += la_disasm_block(c->buf + at, len - at, pc + at, ops, 1, text, LA_INSN_TEXT_MAX);
+                }
+            } else {
+                n = la_disasm_block(
+                    c->buf + off,
+                    len - off,
+                    pc + off,
+                    ops,
+                    BLOCK_INSNS,
+                    text,
+                    LA_INSN_TEXT_MAX
+                );
+            }
+            bench_sink += n + ops[0].fmt;
+        }
+    }
+    uint64_t cycles = cycle_counter_stop(cc);
+    uint64_t t1 = now_ns();
+
+    double n = (double)c->num_words * rounds;
+    double ns = (t1 - t0) / n;
+    printf(
+        "%-20.20s %-14s %10zu %9.2f %10.2f",
+        c->name,
+        pass == BENCH_PASS_DECODE ? "decode"
+            : pass == BENCH_PASS_DISASM ? "decode+render"
+            : "disasm 1/call",
+        c->num_words,
+        ns,
+        1e3 / ns
+    );
+    if (cycles != 0) {
+        printf(" %12.2f\n", cycles / n);
+    } else {
+        printf(" %12s\n", "n/a");
+    }
+}
+
+static void bench_classify_pass(
+    const struct word_corpus *c,
+    enum la_classify_kernel kernel,
+    struct cycle_counter *cc
+) {
+    static uint8_t ids[BLOCK_INSNS];
+    static uint8_t rd[BLOCK_INSNS];
+    static uint8_t rj[BLOCK_INSNS];
+    static uint8_t rk[BLOCK_INSNS];
+    static uint32_t imm[BLOCK_INSNS];
+    const struct la_classify_out out = { ids, rd, rj, rk, imm };
+    enum la_classify_kernel prev = la_classify_current_kernel();
+    char pass_name[32];
+    size_t rounds = 1;
+
+    if (!la_classify_use_kernel(kernel)) {
+        return;
+    }
+
+    if (c->num_words < MIN_MEASURED_INSNS) {
+        rounds = (MIN_MEASURED_INSNS + c->num_words - 1) / c->num_words;
+    }
+
+    size_t len = c->num_words * INSN_LENGTH_BYTES;
+    uint64_t t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t off = 0; off < len; off += BLOCK_INSNS * INSN_LENGTH_BYTES) {
+            size_t n = la_classify_block(c->buf + off, len - off, &out, BLOCK_INSNS);
+            bench_sink += n + ids[0] + imm[n - 1];
+        }
+    }
+    uint64_t cycles = cycle_counter_stop(cc);
+    uint64_t t1 = now_ns();
+    la_classify_use_kernel(prev);
+
+    double n = (double)c->num_words * rounds;
+    double ns = (t1 - t0) / n;
+    snprintf(pass_name, sizeof(pass_name), "classify %s", la_classify_kernel_name(kernel));
+    printf(
+        "%-20.20s %-14s %10zu %9.2f %10.2f",
+        c->name,
+        pass_name,
+        c->num_words,
+        ns,
+        1e3 / ns
+    );
+    if (cycles != 0) {
+        printf(" %12.2f\n", cycles / n);
+    } else {
+        printf(" %12s\n", "n/a");
+    }
+}
+
+/* one insn per call, like the asm plugin is driven, optionally cached */
+static void bench_scroll_pass(
+    const struct word_corpus *c,
+    struct la_insn_cache *cache,
+    struct cycle_counter *cc
+) {
+    uint64_t pc = 0x120000000ULL;
+    size_t window = SCROLL_WINDOW;
+    size_t shown = 0;
+
+    if (window > c->num_words) {
+        window = c->num_words;
+    }
+
+    uint64_t t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t top = 0; shown < SCROLL_INSNS; top = (top + 1) % (c->num_words - window + 1)) {
+        for (size_t i = top; i < top + window; i++) {
+            const uint8_t *p = c->buf + i * INSN_LENGTH_BYTES;
+            uint64_t insn_pc = pc + i * INSN_LENGTH_BYTES;
+
+            if (cache != NULL) {
+                const struct la_cached_insn *e = la_insn_cache_lookup(
+                    cache,
+                    insn_pc,
+                    la_read_insn_word(p)
+                );
+                bench_sink += e->text_len;
+            } else {
+                struct la_op op;
+                char text[LA_INSN_TEXT_MAX];
+                la_disasm_block(p, INSN_LENGTH_BYTES, insn_pc, &op, 1, text, sizeof(text));
+                bench_sink += text[0];
+            }
+        }
+        shown += window;
+    }
+    uint64_t cycles = cycle_counter_stop(cc);
+    uint64_t t1 = now_ns();
+
+    double ns = (t1 - t0) / (double)shown;
+    printf(
+        "%-20.20s %-14s %10zu %9.2f %10.2f",
+        c->name,
+        cache != NULL ? "scroll cached" : "scroll",
+        c->num_words,
+        ns,
+        1e3 / ns
+    );
+    if (cycles != 0) {
+        printf(" %12.2f", cycles / (double)shown);
+    } else {
+        printf(" %12s", "n/a");
+    }
+
+    if (cache != NULL) {
+        struct la_insn_cache_stats stats;
+        la_insn_cache_get_stats(cache, &stats);
+        printf(
+            "  %.1f%% hits, %zu entries in %zu KiB\n",
+            100.0 * stats.hits / (stats.hits + stats.misses),
+            stats.capacity,
+            stats.mem_size / 1024
+        );
+    } else {
+        printf("\n");
+    }
+}
+
+static void print_pass(
+    const struct word_corpus *c,
+    const char *pass_name,
+    double n,
+    uint64_t ns,
+    uint64_t cycles
+) {
+    printf(
+        "%-20.20s %-14s %10zu %9.2f %10.2f",
+        c->name,
+        pass_name,
+        c->num_words,
+        ns / n,
+        1e3 * n / ns
+    );
+    if (cycles != 0) {
+        printf(" %12.2f\n", cycles / n);
+    } else {
+        printf(" %12s\n", "n/a");
+    }
+}
+
+/* the kind of question whole-image passes ask: is it a stack adjustment */
+static inline bool is_sp_adjust(uint8_t id, uint8_t rd) {
+    return (id == LA_INSN_ADDI || id == LA_INSN_ADDIW) && rd == LA_REG_SP;
+}
+
+/*
+ * Scan the corpus decoded into struct la_op and into packed insns, and expand
+ * packed insns back, to weigh the memory saved against the cost of expanding.
+ */
+static void bench_packed_pass(const struct word_corpus *c, struct cycle_counter *cc) {
+    size_t len = c->num_words * INSN_LENGTH_BYTES;
+    size_t rounds = 1;
+
+    if (c->num_words < MIN_MEASURED_INSNS) {
+        rounds = (MIN_MEASURED_INSNS + c->num_words - 1) / c->num_words;
+    }
+
+    struct la_op *ops = malloc(c->num_words * sizeof(*ops));
+    struct la_packed_insns *packed = la_packed_new(c->num_words);
+    if (ops == NULL || packed == NULL) {
+        free(ops);
+        la_packed_free(packed);
+        return;
+    }
+    la_decode_block(c->buf, len, ops, c->num_words);
+    la_packed_append(packed, c->buf, len);
+
+    size_t found = 0;
+    uint64_t t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < c->num_words; i++) {
+            found += is_sp_adjust(ops[i].id, la_op_rd(&ops[i]));
+        }
+    }
+    uint64_t cycles = cycle_counter_stop(cc);
+    print_pass(c, "scan la_op", (double)c->num_words * rounds, now_ns() - t0, cycles);
+
+    const uint8_t *ids = packed->insns.ids;
+    const uint8_t *rd = packed->insns.rd;
+    t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < packed->num_insns; i++) {
+            found += is_sp_adjust(ids[i], rd[i]);
+        }
+    }
+    cycles = cycle_counter_stop(cc);
+    print_pass(c, "scan packed", (double)c->num_words * rounds, now_ns() - t0, cycles);
+
+    t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < packed->num_insns; i++) {
+            struct la_op op;
+            la_packed_expand(packed, i, &op);
+            found += op.fmt;
+        }
+    }
+    cycles = cycle_counter_stop(cc);
+    print_pass(c, "expand packed", (double)c->num_words * rounds, now_ns() - t0, cycles);
+
+    printf(
+        "%-20.20s %-14s %10zu  %zu bytes/insn packed, %zu as struct la_op\n",
+        c->name,
+        "memory",
+        c->num_words,
+        LA_PACKED_INSN_SIZE,
+        sizeof(struct la_op)
+    );
+
+    bench_sink += found;
+    free(ops);
+    la_packed_free(packed);
+}
+
+/*
+ * ESIL the way it is usually built, by going through the template and
+ * formatting every operand with snprintf, for comparison.
+ */
+static int esil_snprintf(char *buf, int buflen, const struct la_op *op, uint64_t pc) {
+    const char *t = la_esil_template(op->id, la_op_rd(op) == LA_REG_ZERO);
+    int64_t imm = 0;
+    uint64_t target = 0;
+    int len = 0;
+
+    buf[0] = '\0';
+    if (t == NULL) {
+        return 0;
+    }
+
+    la_op_imm(op, &imm);
+    la_op_jump_target(op, pc, &target);
+    while (*t != '\0' && len < buflen - 1) {
+        if (t[0] == '{' && t[1] != '\0' && t[2] == '}') {
+            switch (t[1]) {
+            case 'd':
+                len += snprintf(buf + len, buflen - len, "%s", la_reg_name(la_op_rd(op), op->render_flags & RENDER_FLAG_RD_IS_FPR));
+                break;
+            case 'j':
+                len += snprintf(buf + len, buflen - len, "%s", la_reg_name(la_op_rj(op), op->render_flags & RENDER_FLAG_RJ_IS_FPR));
+                break;
+            case 'k':
+                len += snprintf(buf + len, buflen - len, "%s", la_reg_name(la_op_rk(op), op->render_flags & RENDER_FLAG_RK_IS_FPR));
+                break;
+            case 'i':
+                len += snprintf(buf + len, buflen - len, "0x%" PRIx64, (uint64_t)imm);
+                break;
+            case 't':
+                len += snprintf(buf + len, buflen - len, "0x%" PRIx64, target);
+                break;
+            case 'n':
+                len += snprintf(buf + len, buflen - len, "0x%" PRIx64, pc + INSN_LENGTH_BYTES);
+                break;
+            case 'p':
+                len += snprintf(buf + len, buflen - len, "0x%" PRIx64, pc);
+                break;
+            }
+            t += 3;
+        } else {
+            buf[len++] = *t++;
+            buf[len] = '\0';
+        }
+    }
+    return len;
+}
+
+/*
+ * ESIL for a long emulation trace: the corpus decoded once, then its ESIL
+ * rendered over and over, from the precompiled templates and with snprintf.
+ * Every FP insn with a template must also render for an rd of f0.
+ */
+static int bench_esil_pass(const struct word_corpus *c, struct cycle_counter *cc) {
+    char ref_buf[LA_ESIL_TEXT_MAX];
+    char fast_buf[LA_ESIL_TEXT_MAX];
+    uint64_t pc = 0x120000000ULL;
+    size_t rounds = 1;
+    int mismatches = 0;
+
+    if (c->num_words < MIN_MEASURED_INSNS) {
+        rounds = (MIN_MEASURED_INSNS + c->num_words - 1) / c->num_words;
+    }
+
+    struct la_op *ops = malloc(c->num_words * sizeof(*ops));
+    if (ops == NULL) {
+        return 0;
+    }
+    la_decode_block(c->buf, c->num_words * INSN_LENGTH_BYTES, ops, c->num_words);
+
+    /* outputs must be byte-for-byte identical */
+    for (size_t i = 0; i < c->num_words; i++) {
+        int ref_len = esil_snprintf(ref_buf, sizeof(ref_buf), &ops[i], pc + i * 4);
+        int fast_len = la_esil_insn(fast_buf, sizeof(fast_buf), &ops[i], pc + i * 4);
+        if (ref_len != fast_len || strcmp(ref_buf, fast_buf) != 0) {
+            if (mismatches++ < 10) {
+                fprintf(stderr, "esil mismatch: \"%s\" vs. \"%s\"\n", ref_buf, fast_buf);
+            }
+        }
+    }
+
+    /* f0 is an ordinary destination, unlike zero */
+    size_t num_matchers;
+    const struct la_disasm_matcher *matchers = la_matcher_table(&num_matchers);
+    for (size_t id = 0; id < num_matchers; id++) {
+        struct la_op op;
+        la_decode_as(id, matchers[id].match, &op);
+        if (
+            (op.render_flags & RENDER_FLAG_RD_IS_FPR)
+            && la_esil_template(id, false) != NULL
+            && la_op_rd(&op) == 0
+        ) {
+            la_esil_insn(fast_buf, sizeof(fast_buf), &op, pc);
+            if (fast_buf[0] == '\0' && mismatches++ < 10) {
+                fprintf(stderr, "esil of %s with rd = f0: \"%s\"\n", op.mnemonic, fast_buf);
+            }
+        }
+    }
+
+    uint64_t t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < c->num_words; i++) {
+            bench_sink += esil_snprintf(ref_buf, sizeof(ref_buf), &ops[i], pc + i * 4);
+        }
+    }
+    uint64_t cycles = cycle_counter_stop(cc);
+    print_pass(c, "esil snprintf", (double)c->num_words * rounds, now_ns() - t0, cycles);
+
+    t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < c->num_words; i++) {
+            bench_sink += la_esil_insn(fast_buf, sizeof(fast_buf), &ops[i], pc + i * 4);
+        }
+    }
+    cycles = cycle_counter_stop(cc);
+    print_pass(c, "esil", (double)c->num_words * rounds, now_ns() - t0, cycles);
+
+    free(ops);
+    return mismatches;
+}
+
+/* the kind of queries la_objdump -p answers, written as the insns render */
+static const char *search_patterns[] = {
+    "syscall",
+    "jalr zero, ra",
+    "addi sp, sp, -16",
+    "sd ra, *(sp)",
+    "ld *, *(gp)",
+    "jal 0x120001000",
+};
+
+/* `*` stands for an operand or part of one, and trailing operands may be
+ * left out, like in the patterns */
+static bool glob_operands(const char *pattern, const char *text) {
+    while (*pattern != '\0') {
+        if (*pattern == '*') {
+            pattern++;
+            while (*text != '\0' && strchr(",()", *text) == NULL) {
+                text++;
+            }
+        } else if (*pattern++ != *text++) {
+            return false;
+        }
+    }
+    return *text == '\0' || *text == ' ' || *text == ',';
+}
+
+struct search_tally {
+    size_t hits;
+    uint64_t pc_sum;
+};
+
+static void tally_hit(void *user, uint64_t pc, la_insn_t insn_word, unsigned pattern) {
+    struct search_tally *tally = user;
+
+    (void)insn_word;
+    (void)pattern;
+    tally->hits++;
+    tally->pc_sum += pc;
+}
+
+/*
+ * Searching for a few patterns at once: disassembling everything and
+ * matching the text, which is also the reference, against each la_search
+ * kernel.
+ */
+static int bench_search_pass(const struct word_corpus *c, struct cycle_counter *cc) {
+    static struct la_op ops[BLOCK_INSNS];
+    static char text[BLOCK_INSNS * LA_INSN_TEXT_MAX];
+    const size_t num_patterns = sizeof(search_patterns) / sizeof(search_patterns[0]);
+    enum la_classify_kernel prev = la_search_current_kernel();
+    uint64_t pc = 0x120000000ULL;
+    size_t len = c->num_words * INSN_LENGTH_BYTES;
+    struct search_tally ref = { 0, 0 };
+    struct la_search search;
+    int mismatches = 0;
+
+    la_search_init(&search);
+    for (size_t i = 0; i < num_patterns; i++) {
+        if (la_search_add(&search, search_patterns[i]) != LA_SEARCH_OK) {
+            fprintf(stderr, "bad search pattern \"%s\"\n", search_patterns[i]);
+            return 1;
+        }
+    }
+
+    uint64_t t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t off = 0; off < len; off += BLOCK_INSNS * INSN_LENGTH_BYTES) {
+        size_t n = la_disasm_block(c->buf + off, len - off, pc + off, ops, BLOCK_INSNS, text, LA_INSN_TEXT_MAX);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t k = 0; k < num_patterns; k++) {
+                if (glob_operands(search_patterns[k], text + i * LA_INSN_TEXT_MAX)) {
+                    ref.hits++;
+                    ref.pc_sum += pc + off + i * INSN_LENGTH_BYTES;
+                    break;
+                }
+            }
+        }
+    }
+    uint64_t cycles = cycle_counter_stop(cc);
+    print_pass(c, "search text", (double)c->num_words, now_ns() - t0, cycles);
+
+    for (int k = 0; k < LA_CLASSIFY_KERNEL_LAST; k++) {
+        char pass_name[32];
+        size_t rounds = 1;
+
+        if (!la_search_use_kernel(k)) {
+            continue;
+        }
+        if (c->num_words < MIN_MEASURED_INSNS) {
+            rounds = (MIN_MEASURED_INSNS + c->num_words - 1) / c->num_words;
+        }
+
+        struct search_tally tally = { 0, 0 };
+        la_search_block(&search, c->buf, len, pc, tally_hit, &tally);
+        if (tally.hits != ref.hits || tally.pc_sum != ref.pc_sum) {
+            fprintf(stderr, "search %s: %zu hits vs. %zu\n", la_classify_kernel_name(k), tally.hits, ref.hits);
+            mismatches++;
+        }
+
+        t0 = now_ns();
+        cycle_counter_start(cc);
+        for (size_t round = 0; round < rounds; round++) {
+            bench_sink += la_search_block(&search, c->buf, len, pc, tally_hit, &tally);
+        }
+        cycles = cycle_counter_stop(cc);
+        uint64_t ns = now_ns() - t0;
+        snprintf(pass_name, sizeof(pass_name), "search %s", la_classify_kernel_name(k));
+        print_pass(c, pass_name, (double)c->num_words * rounds, ns, cycles);
+        printf("  %zu hits, %.2f GB/s\n", ref.hits, (double)len * rounds / ns);
+    }
+    la_search_use_kernel(prev);
+    return mismatches;
+}
+
+/* the CFG of the whole corpus as one image, built from scratch each round */
+static void bench_cfg_pass(const struct word_corpus *c, struct cycle_counter *cc) {
+    size_t rounds = 1;
+    size_t num_blocks = 0;
+    size_t num_edges = 0;
+
+    if (c->num_words < MIN_MEASURED_INSNS) {
+        rounds = (MIN_MEASURED_INSNS + c->num_words - 1) / c->num_words;
+    }
+
+    uint64_t t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        struct la_cfg *cfg = la_cfg_build(c->buf, c->num_words * INSN_LENGTH_BYTES, 0x120000000ULL);
+        if (cfg == NULL) {
+            fprintf(stderr, "%s: cannot build the CFG\n", c->name);
+            return;
+        }
+        num_blocks = cfg->num_blocks;
+        num_edges = cfg->num_edges;
+        la_cfg_free(cfg);
+    }
+    uint64_t cycles = cycle_counter_stop(cc);
+    uint64_t ns = now_ns() - t0;
+
+    print_pass(c, "cfg", (double)c->num_words * rounds, ns, cycles);
+    printf("  %zu blocks, %zu edges, %.2f ms per build\n", num_blocks, num_edges, ns / 1e6 / rounds);
+}
+
+/*
+ * Liveness over the CFG of the whole corpus, and the per-insn use/def sets
+ * it is built on: from the generated slot masks by id, against deriving
+ * them from decoded insns.
+ */
+static void bench_liveness_pass(const struct word_corpus *c, struct cycle_counter *cc) {
+    static uint8_t ids[BLOCK_INSNS];
+    static uint8_t rd[BLOCK_INSNS];
+    static uint8_t rj[BLOCK_INSNS];
+    static uint8_t rk[BLOCK_INSNS];
+    static uint32_t imm[BLOCK_INSNS];
+    static struct la_op ops[BLOCK_INSNS];
+    const struct la_classify_out out = { ids, rd, rj, rk, imm };
+    size_t len = c->num_words * INSN_LENGTH_BYTES;
+    size_t rounds = 1;
+    la_regset_t acc = 0;
+
+    if (c->num_words < MIN_MEASURED_INSNS) {
+        rounds = (MIN_MEASURED_INSNS + c->num_words - 1) / c->num_words;
+    }
+
+    uint64_t t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t off = 0; off < len; off += BLOCK_INSNS * INSN_LENGTH_BYTES) {
+            size_t n = la_decode_block(c->buf + off, len - off, ops, BLOCK_INSNS);
+            for (size_t i = 0; i < n; i++) {
+                la_regset_t use;
+                la_regset_t def;
+                la_op_regs(&ops[i], &use, &def);
+                acc ^= use + def;
+            }
+        }
+    }
+    uint64_t cycles = cycle_counter_stop(cc);
+    print_pass(c, "use/def la_op", (double)c->num_words * rounds, now_ns() - t0, cycles);
+
+    t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t off = 0; off < len; off += BLOCK_INSNS * INSN_LENGTH_BYTES) {
+            size_t n = la_classify_block(c->buf + off, len - off, &out, BLOCK_INSNS);
+            for (size_t i = 0; i < n; i++) {
+                la_regset_t use;
+                la_regset_t def;
+                la_insn_regs(ids[i], la_read_insn_word(c->buf + off + i * INSN_LENGTH_BYTES), &use, &def);
+                acc ^= use + def;
+            }
+        }
+    }
+    cycles = cycle_counter_stop(cc);
+    print_pass(c, "use/def by id", (double)c->num_words * rounds, now_ns() - t0, cycles);
+    bench_sink += acc;
+
+    struct la_cfg *cfg = la_cfg_build(c->buf, len, 0x120000000ULL);
+    if (cfg == NULL) {
+        fprintf(stderr, "%s: cannot build the CFG\n", c->name);
+        return;
+    }
+    unsigned num_passes = 0;
+    t0 = now_ns();
+    cycle_counter_start(cc);
+    for (size_t round = 0; round < rounds; round++) {
+        struct la_liveness *live = la_liveness_compute(cfg, c->buf);
+        if (live == NULL) {
+            fprintf(stderr, "%s: cannot compute liveness\n", c->name);
+            la_cfg_free(cfg);
+            return;
+        }
+        num_passes = live->num_passes;
+        bench_sink += live->live_in[0];
+        la_liveness_free(live);
+    }
+    cycles = cycle_counter_stop(cc);
+    uint64_t ns = now_ns() - t0;
+
+    print_pass(c, "liveness", (double)c->num_words * rounds, ns, cycles);
+    printf("  %zu blocks, %u passes, %.2f ms per image\n", cfg->num_blocks, num_passes, ns / 1e6 / rounds);
+    la_cfg_free(cfg);
+}
+
+static void bench_words(const struct word_corpus *c, size_t cache_kib) {
+    struct cycle_counter cc;
+
+    cycle_counter_open(&cc);
+    bench_words_pass(c, BENCH_PASS_DECODE, &cc);
+    bench_words_pass(c, BENCH_PASS_DISASM, &cc);
+    bench_words_pass(c, BENCH_PASS_DISASM_SINGLE, &cc);
+    for (int k = 0; k < LA_CLASSIFY_KERNEL_LAST; k++) {
+        bench_classify_pass(c, k, &cc);
+    }
+    bench_packed_pass(c, &cc);
+    if (bench_esil_pass(c, &cc) != 0) {
+        fprintf(stderr, "%s: esil mismatches\n", c->name);
+    }
+    if (bench_search_pass(c, &cc) != 0) {
+        fprintf(stderr, "%s: search mismatches\n", c->name);
+    }
+    bench_cfg_pass(c, &cc);
+    bench_liveness_pass(c, &cc);
+    bench_scroll_pass(c, NULL, &cc);
+
+    struct la_insn_cache *cache = la_insn_cache_new(cache_kib * 1024);
+    if (cache != NULL) {
+        bench_scroll_pass(c, cache, &cc);
+        la_insn_cache_free(cache);
+    }
+    cycle_counter_close(&cc);
+}
+
+static void store_word(uint8_t *buf, la_insn_t insn_word) {
+    buf[0] = insn_word;
+    buf[1] = insn_word >> 8;
+    buf[2] = insn_word >> 16;
+    buf[3] = insn_word >> 24;
+}
+
+static bool make_uniform_corpus(struct word_corpus *c, size_t num_words) {
+    c->name = "uniform";
+    c->num_words = num_words;
+    c->buf = malloc(num_words * INSN_LENGTH_BYTES);
+    if (c->buf == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < num_words; i++) {
+        store_word(c->buf + i * INSN_LENGTH_BYTES, rng_next());
+    }
+    return true;
+}
+
+/* every word encodes a random table entry, so formats follow the table's mix */
+static bool make_table_mix_corpus(struct word_corpus *c, size_t num_words) {
+    size_t num_matchers;
+    const struct la_disasm_matcher *matchers = la_matcher_table(&num_matchers);
+
+    c->name = "table-mix";
+    c->num_words = num_words;
+    c->buf = malloc(num_words * INSN_LENGTH_BYTES);
+    if (c->buf == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < num_words; i++) {
+        const struct la_disasm_matcher *m = &matchers[rng_next() % num_matchers];
+        la_insn_t insn_word = m->match | (rng_next() & ~m->mask);
+        store_word(c->buf + i * INSN_LENGTH_BYTES, insn_word);
+    }
+    return true;
+}
+
+/* a raw .text dump, e.g. from `objcopy -O binary -j .text` */
+static bool load_file_corpus(struct word_corpus *c, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    c->name = path;
+    c->buf = NULL;
+    c->num_words = 0;
+
+    size_t cap = 0;
+    size_t len = 0;
+    for (;;) {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 1024 * 1024;
+            uint8_t *buf = realloc(c->buf, cap);
+            if (buf == NULL) {
+                free(c->buf);
+                fclose(f);
+                return false;
+            }
+            c->buf = buf;
+        }
+
+        size_t n = fread(c->buf + len, 1, cap - len, f);
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+    fclose(f);
+
+    c->num_words = len / INSN_LENGTH_BYTES;
+    if (c->num_words == 0) {
+        fprintf(stderr, "%s: no insns\n", path);
+        free(c->buf);
+        return false;
+    }
+    return true;
+}
+
+static la_insn_t match_of(enum la_insn_id id) {
+    size_t num_matchers;
+    return la_matcher_table(&num_matchers)[id].match;
+}
+
+/* encode table entry `id` from its register and 12-bit immediate fields */
+static la_insn_t encode_rri12(enum la_insn_id id, la_reg_t rd, la_reg_t rj, int32_t imm) {
+    return match_of(id) | (imm & 0xfff) << 10 | rj << 5 | rd;
+}
+
+static la_insn_t encode_rrr(enum la_insn_id id, la_reg_t rd, la_reg_t rj, la_reg_t rk) {
+    return match_of(id) | rk << 10 | rj << 5 | rd;
+}
+
+/* `offset` in insns */
+static la_insn_t encode_rri16(enum la_insn_id id, la_reg_t rd, la_reg_t rj, int32_t offset) {
+    return match_of(id) | (offset & 0xffff) << 10 | rj << 5 | rd;
+}
+
+static la_insn_t encode_rri6(enum la_insn_id id, la_reg_t rd, la_reg_t rj, uint32_t imm) {
+    return match_of(id) | (imm & 0x3f) << 10 | rj << 5 | rd;
+}
+
+static la_insn_t encode_aui20(enum la_insn_id id, la_reg_t rd, int32_t imm) {
+    return match_of(id) | (imm & 0xfffff) << 5 | rd;
+}
+
+/* `offset` in insns */
+static la_insn_t encode_ri21(enum la_insn_id id, la_reg_t rj, int32_t offset) {
+    uint32_t imm = offset & 0x1fffff;
+    return match_of(id) | (imm & 0xffff) << 10 | rj << 5 | imm >> 16;
+}
+
+/* `offset` in insns, the bit above the high part repeats the sign */
+static la_insn_t encode_i25(enum la_insn_id id, int32_t offset) {
+    uint32_t imm = offset & 0x1ffffff;
+    return match_of(id) | (imm & 0xffff) << 10 | (imm >> 24) << 9 | (imm >> 16 & 0x1ff);
+}
+
+#define EMU_CODE_ADDR 0x120000000ULL
+#define EMU_DATA_ADDR 0x7ff000000ULL
+#define EMU_DATA_SIZE (256 * 1024)
+#define EMU_ROUNDS 64
+
+/*
+ * The kind of loop the emulator is for: a rolling-key xor decryption of a
+ * buffer in place, emulated over and over and checked against the same
+ * loop in C.
+ */
+static int bench_emu(void) {
+    enum { T0 = 12, A0 = 4, A1 = 5, A2 = 6 };
+    const la_insn_t code[] = {
+        encode_rri12(LA_INSN_LBU, T0, A0, 0),
+        encode_rrr(LA_INSN_XOR, T0, T0, A2),
+        encode_rri12(LA_INSN_SB, T0, A0, 0),
+        encode_rri12(LA_INSN_ADDI, A2, A2, 7),
+        encode_rri12(LA_INSN_ANDI, A2, A2, 0xff),
+        encode_rri12(LA_INSN_ADDI, A0, A0, 1),
+        encode_rri12(LA_INSN_ADDI, A1, A1, -1),
+        encode_ri21(LA_INSN_BNEZ, A1, -7),
+        encode_rrr(LA_INSN_SYSCALL, 0, 0, 0),
+    };
+    uint8_t code_buf[sizeof(code)];
+    uint8_t *data = malloc(EMU_DATA_SIZE);
+    uint8_t *expected = malloc(EMU_DATA_SIZE);
+    struct la_emu *emu = la_emu_new();
+    int ret = 0;
+
+    if (data == NULL || expected == NULL || emu == NULL) {
+        ret = 1;
+        goto out;
+    }
+
+    for (size_t i = 0; i < sizeof(code) / sizeof(code[0]); i++) {
+        store_word(code_buf + i * INSN_LENGTH_BYTES, code[i]);
+    }
+    for (size_t i = 0; i < EMU_DATA_SIZE; i++) {
+        data[i] = expected[i] = rng_next();
+    }
+    if (
+        !la_emu_map(emu, EMU_CODE_ADDR, sizeof(code_buf))
+        || !la_emu_map(emu, EMU_DATA_ADDR, EMU_DATA_SIZE)
+        || !la_emu_mem_write(emu, EMU_CODE_ADDR, code_buf, sizeof(code_buf))
+        || !la_emu_mem_write(emu, EMU_DATA_ADDR, data, EMU_DATA_SIZE)
+    ) {
+        ret = 1;
+        goto out;
+    }
+
+    struct la_emu_regs *regs = la_emu_regs(emu);
+    enum la_emu_stop stop = LA_EMU_SYSCALL;
+    uint64_t t0 = now_ns();
+    for (int round = 0; round < EMU_ROUNDS && stop == LA_EMU_SYSCALL; round++) {
+        regs->pc = EMU_CODE_ADDR;
+        regs->gpr[A0] = EMU_DATA_ADDR;
+        regs->gpr[A1] = EMU_DATA_SIZE;
+        regs->gpr[A2] = round;
+        stop = la_emu_run(emu, UINT64_MAX);
+    }
+    uint64_t ns = now_ns() - t0;
+
+    for (int round = 0; round < EMU_ROUNDS; round++) {
+        uint8_t key = round;
+        for (size_t i = 0; i < EMU_DATA_SIZE; i++, key += 7) {
+            expected[i] ^= key;
+        }
+    }
+
+    struct la_emu_stats stats;
+    la_emu_get_stats(emu, &stats);
+    if (
+        stop != LA_EMU_SYSCALL
+        || !la_emu_mem_read(emu, EMU_DATA_ADDR, data, EMU_DATA_SIZE)
+        || memcmp(data, expected, EMU_DATA_SIZE) != 0
+    ) {
+        fprintf(stderr, "emu: stopped with %s at 0x%" PRIx64 ", or wrong result\n", la_emu_stop_name(stop), regs->pc);
+        ret = 1;
+        goto out;
+    }
+
+    printf(
+        "\nemulated xor loop: %" PRIu64 " insns, %.2f ns/insn, %.1f M insn/s, %" PRIu64 " blocks predecoded\n",
+        stats.insns,
+        (double)ns / stats.insns,
+        1e3 * stats.insns / ns,
+        stats.blocks
+    );
+
+out:
+    la_emu_free(emu);
+    free(expected);
+    free(data);
+    return ret;
+}
+
+#define FRAME_FUNCS 8192
+#define FRAME_ROUNDS 16
+/* save slots and locals are all 8 bytes wide */
+#define FRAME_SLOT 8
+
+struct frame_func {
+    size_t first;       /* insn index */
+    size_t num_insns;
+    struct la_frame expected;
+};
+
+static void emit(la_insn_t *code, size_t *n, la_insn_t insn_word) {
+    code[(*n)++] = insn_word;
+}
+
+/* save or restore the registers in `saved`, in the order of their slots */
+static void emit_saves(la_insn_t *code, size_t *n, const struct la_frame *f, enum la_insn_id id) {
+    for (la_reg_t reg = 0; reg < 32; reg++) {
+        if ((f->saved >> reg) & 1) {
+            emit(code, n, encode_rri12(id, reg, LA_REG_SP, f->save_offset[reg] + f->size));
+        }
+    }
+}
+
+static void emit_epilogue(la_insn_t *code, size_t *n, const struct la_frame *f) {
+    emit_saves(code, n, f, LA_INSN_LD);
+    emit(code, n, encode_rri12(LA_INSN_ADDI, LA_REG_SP, LA_REG_SP, f->size));
+    emit(code, n, encode_rrr(LA_INSN_JALR, LA_REG_ZERO, LA_REG_RA, 0));
+}
+
+static void add_expected_var(struct la_frame *f, int32_t offset, enum la_frame_access access) {
+    for (size_t i = 0; i < f->num_vars; i++) {
+        if (f->vars[i].offset == offset) {
+            f->vars[i].access |= access;
+            return;
+        }
+    }
+    f->vars[f->num_vars++] = (struct la_frame_var){ offset, FRAME_SLOT, access };
+}
+
+/*
+ * Lay out one function the way compilers do: a prologue lowering sp and
+ * saving ra and some of s9, s0 .. s8, optionally setting up s9 as the frame
+ * pointer, a body of ALU insns and 8-byte locals accessed relative to sp or
+ * s9, an early return, and the epilogue. What the frame pass should find is
+ * filled in as it goes.
+ */
+static size_t emit_function(la_insn_t *code, struct la_frame *f) {
+    enum { T0 = 12, NUM_TEMPS = 9 };
+    static const la_reg_t saved_regs[] = { LA_REG_RA, LA_REG_S9, 23, 24, 25, 26, 27 };
+    size_t num_saved = 1 + rng_next() % (sizeof(saved_regs) / sizeof(saved_regs[0]));
+    size_t num_locals = 1 + rng_next() % 24;
+    size_t body = 16 + rng_next() % 96;
+    size_t n = 0;
+
+    la_frame_init(f, 0);
+    f->size = (num_saved + num_locals + 1) * FRAME_SLOT & ~15U;
+    f->uses_fp = rng_next() & 1;
+    emit(code, &n, encode_rri12(LA_INSN_ADDI, LA_REG_SP, LA_REG_SP, -(int32_t)f->size));
+    for (size_t i = 0; i < num_saved; i++) {
+        f->saved |= 1U << saved_regs[i];
+        f->save_offset[saved_regs[i]] = -(int32_t)(i + 1) * FRAME_SLOT;
+    }
+    emit_saves(code, &n, f, LA_INSN_SD);
+    if (f->uses_fp) {
+        emit(code, &n, encode_rri12(LA_INSN_ADDI, LA_REG_S9, LA_REG_SP, f->size));
+    }
+
+    for (size_t i = 0; i < body; i++) {
+        la_reg_t t = T0 + rng_next() % NUM_TEMPS;
+        if (i == body / 2) {
+            emit_epilogue(code, &n, f);
+        } else if (rng_next() % 4 == 0) {
+            /* locals sit below the save slots */
+            int32_t offset = -(int32_t)(num_saved + 1 + rng_next() % num_locals) * FRAME_SLOT;
+            bool store = rng_next() & 1;
+            bool via_fp = f->uses_fp && (rng_next() & 1);
+            la_reg_t base = via_fp ? LA_REG_S9 : LA_REG_SP;
+            int32_t disp = via_fp ? offset : offset + (int32_t)f->size;
+            emit(code, &n, encode_rri12(store ? LA_INSN_SD : LA_INSN_LD, t, base, disp));
+            add_expected_var(f, offset, store ? LA_FRAME_WRITE : LA_FRAME_READ);
+        } else {
+            emit(code, &n, encode_rrr(LA_INSN_ADD, t, T0 + rng_next() % NUM_TEMPS, T0 + rng_next() % NUM_TEMPS));
+        }
+    }
+    /* s9 is set to sp on entry, fp_offset 0 */
+    emit_epilogue(code, &n, f);
+    la_frame_finish(f);
+    return n;
+}
+
+static bool frames_equal(const struct la_frame *a, const struct la_frame *b) {
+    if (
+        a->size != b->size
+        || a->saved != b->saved
+        || a->uses_fp != b->uses_fp
+        || (a->uses_fp && a->fp_offset != b->fp_offset)
+        || a->num_vars != b->num_vars
+        || a->sp_lost
+    ) {
+        return false;
+    }
+    for (la_reg_t reg = 0; reg < 32; reg++) {
+        if (((a->saved >> reg) & 1) && a->save_offset[reg] != b->save_offset[reg]) {
+            return false;
+        }
+    }
+    return memcmp(a->vars, b->vars, a->num_vars * sizeof(a->vars[0])) == 0;
+}
+
+/*
+ * Recover the frames of a corpus of synthetic functions, the way a
+ * whole-binary pass would run over every function r2 knows of.
+ */
+static int bench_frames(void) {
+    /* the longest function emit_function() lays out */
+    const size_t max_insns = 1 + 7 + 1 + 112 + 2 * 9;
+    la_insn_t *code = malloc(FRAME_FUNCS * max_insns * sizeof(*code));
+    struct frame_func *funcs = malloc(FRAME_FUNCS * sizeof(*funcs));
+    size_t num_insns = 0;
+    size_t mismatches = 0;
+    int ret = 0;
+
+    if (code == NULL || funcs == NULL) {
+        ret = 1;
+        goto out;
+    }
+
+    for (size_t i = 0; i < FRAME_FUNCS; i++) {
+        funcs[i].first = num_insns;
+        funcs[i].num_insns = emit_function(code + num_insns, &funcs[i].expected);
+        num_insns += funcs[i].num_insns;
+    }
+    uint8_t *buf = malloc(num_insns * INSN_LENGTH_BYTES);
+    if (buf == NULL) {
+        ret = 1;
+        goto out;
+    }
+    for (size_t i = 0; i < num_insns; i++) {
+        store_word(buf + i * INSN_LENGTH_BYTES, code[i]);
+    }
+
+    struct la_frame frame;
+    uint64_t best = UINT64_MAX;
+    for (int round = 0; round < FRAME_ROUNDS; round++) {
+        uint64_t t0 = now_ns();
+        for (size_t i = 0; i < FRAME_FUNCS; i++) {
+            const struct frame_func *fn = &funcs[i];
+            la_frame_analyze(
+                &frame,
+                buf + fn->first * INSN_LENGTH_BYTES,
+                fn->num_insns * INSN_LENGTH_BYTES,
+                0
+            );
+            if (round == 0 && !frames_equal(&frame, &fn->expected)) {
+                mismatches++;
+            }
+        }
+        uint64_t ns = now_ns() - t0;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    free(buf);
+
+    printf(
+        "\nstack frames: %d functions, %zu insns, %.2f ns/insn, %.2f us/function, %zu mismatches\n",
+        FRAME_FUNCS,
+        num_insns,
+        (double)best / num_insns,
+        best / 1e3 / FRAME_FUNCS,
+        mismatches
+    );
+    if (mismatches != 0) {
+        ret = 1;
+    }
+
+out:
+    free(funcs);
+    free(code);
+    return ret;
+}
+
+#define SWITCH_SITES 4096
+#define SWITCH_CODE_ADDR 0x120000000ULL
+#define SWITCH_ROUNDS 16
+
+enum switch_shape {
+    SWITCH_ABSOLUTE,    /* sltiu, beqz, ld of the target */
+    SWITCH_RELATIVE,    /* bgtu, lw of an offset added to the table base */
+    SWITCH_UNBOUNDED,   /* no bounds check, given up */
+    SWITCH_SPILLED,     /* the target comes from the stack, given up */
+    SWITCH_CALL,        /* absolute, the index kept in s0 across a call */
+};
+
+struct switch_site {
+    size_t site;        /* insn index of the jalr */
+    size_t first_case;
+    size_t num_cases;
+    enum switch_shape shape;
+};
+
+/*
+ * Lay out a function dispatching on a0 through a jump table, as compilers
+ * do, with the table of case addresses or offsets right after its code.
+ */
+static size_t emit_switch(la_insn_t *code, size_t n, struct switch_site *sw) {
+    enum { A0 = 4, T0 = 12, T1 = 13, T2 = 14, T3 = 15, S0 = 23 };
+    size_t num_cases = 2 + rng_next() % 30;
+    bool relative = sw->shape == SWITCH_RELATIVE;
+    unsigned entry_size = relative ? 4 : 8;
+    la_reg_t index = A0;
+
+    if (sw->shape == SWITCH_RELATIVE) {
+        emit(code, &n, encode_rri12(LA_INSN_ADDI, T3, LA_REG_ZERO, num_cases - 1));
+        emit(code, &n, encode_rri16(LA_INSN_BGTU, A0, T3, 0));
+    } else if (sw->shape != SWITCH_UNBOUNDED) {
+        if (sw->shape == SWITCH_CALL) {
+            index = S0;
+            emit(code, &n, encode_rrr(LA_INSN_OR, S0, LA_REG_ZERO, A0));
+        }
+        emit(code, &n, encode_rri12(LA_INSN_SLTIU, T0, index, num_cases));
+        emit(code, &n, encode_ri21(LA_INSN_BEQZ, T0, 0));
+        if (sw->shape == SWITCH_CALL) {
+            /* to the start of the switch, the index is all it keeps */
+            emit(code, &n, encode_i25(LA_INSN_JAL, -3));
+        }
+    }
+    size_t auipc_at = n;
+    emit(code, &n, 0);
+    emit(code, &n, 0);
+    if (sw->shape == SWITCH_SPILLED) {
+        emit(code, &n, encode_rri12(LA_INSN_LD, T2, LA_REG_SP, 8));
+    } else {
+        emit(code, &n, encode_rri6(LA_INSN_SLLI, T2, index, relative ? 2 : 3));
+        emit(code, &n, encode_rrr(LA_INSN_ADD, T2, T1, T2));
+        emit(code, &n, encode_rri12(relative ? LA_INSN_LW : LA_INSN_LD, T2, T2, 0));
+    }
+    if (relative) {
+        emit(code, &n, encode_rrr(LA_INSN_ADD, T2, T2, T1));
+    }
+    sw->site = n;
+    emit(code, &n, encode_rrr(LA_INSN_JALR, LA_REG_ZERO, T2, 0));
+
+    sw->first_case = n;
+    sw->num_cases = num_cases;
+    for (size_t k = 0; k < num_cases; k++) {
+        emit(code, &n, encode_rrr(LA_INSN_ADD, A0, A0, T0 + k % 4));
+        /* odd cases fall through, so only the table makes the next a leader */
+        if (k % 2 == 0 || k == num_cases - 1) {
+            emit(code, &n, encode_rrr(LA_INSN_JALR, LA_REG_ZERO, LA_REG_RA, 0));
+        } else {
+            emit(code, &n, encode_rrr(LA_INSN_ADD, A0, A0, T0));
+        }
+    }
+
+    /* the table, 8-byte aligned, case k at first_case + 2 * k */
+    n += n % 2;
+    uint64_t table = SWITCH_CODE_ADDR + n * INSN_LENGTH_BYTES;
+    for (size_t k = 0; k < num_cases; k++) {
+        uint64_t target = SWITCH_CODE_ADDR + (sw->first_case + 2 * k) * INSN_LENGTH_BYTES;
+        uint64_t entry = relative ? target - table : target;
+        emit(code, &n, entry);
+        if (entry_size == 8) {
+            emit(code, &n, entry >> 32);
+        }
+    }
+
+    int64_t offset = table - (SWITCH_CODE_ADDR + auipc_at * INSN_LENGTH_BYTES);
+    int32_t hi = (offset + 0x800) >> 12;
+    code[auipc_at] = encode_aui20(LA_INSN_AUIPC, T1, hi);
+    code[auipc_at + 1] = encode_rri12(LA_INSN_ADDI, T1, T1, offset - ((int64_t)hi << 12));
+    return n;
+}
+
+/*
+ * Write a snapshot of the `len` bytes at `buf` and check that the leaders
+ * it stores are those of `cfg`, built from the same bytes.
+ */
+static bool snapshot_leaders_match(const uint8_t *buf, size_t len, const struct la_cfg *cfg) {
+    char path[] = "/tmp/la_bench.snap.XXXXXX";
+    struct la_snapshot_region region = { .addr = SWITCH_CODE_ADDR, .buf = buf, .len = len };
+    struct la_snapshot *snap = NULL;
+    const uint64_t *leaders;
+    size_t num_insns = len / INSN_LENGTH_BYTES;
+    bool same = false;
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    if (la_snapshot_write(path, &region, 1, NULL, NULL)) {
+        snap = la_snapshot_open(path);
+    }
+    if (snap != NULL && la_snapshot_region_load(snap, 0, NULL, &leaders)) {
+        same = memcmp(leaders, cfg->leaders, 8 * ((num_insns + 63) / 64)) == 0;
+    }
+    if (snap != NULL) {
+        la_snapshot_close(snap);
+    }
+    unlink(path);
+    return same;
+}
+
+/*
+ * Recover the jump tables of a corpus of synthetic switches, and check the
+ * cases against those laid out; the CFG of the whole corpus is built with
+ * them too, and a snapshot of the corpus must store its leaders.
+ */
+static int bench_switches(void) {
+    /* the longest switch emit_switch() lays out */
+    const size_t max_insns = 11 + 31 * 2 + 1 + 31 * 2;
+    la_insn_t *code = malloc(SWITCH_SITES * max_insns * sizeof(*code));
+    struct switch_site *sites = malloc(SWITCH_SITES * sizeof(*sites));
+    uint8_t *buf = NULL;
+    size_t num_insns = 0;
+    size_t mismatches = 0;
+    int ret = 0;
+
+    if (code == NULL || sites == NULL) {
+        ret = 1;
+        goto out;
+    }
+    for (size_t i = 0; i < SWITCH_SITES; i++) {
+        static const enum switch_shape shapes[8] = {
+            SWITCH_ABSOLUTE, SWITCH_ABSOLUTE, SWITCH_ABSOLUTE, SWITCH_CALL,
+            SWITCH_RELATIVE, SWITCH_RELATIVE, SWITCH_UNBOUNDED, SWITCH_SPILLED,
+        };
+        sites[i].shape = shapes[rng_next() % 8];
+        num_insns = emit_switch(code, num_insns, &sites[i]);
+    }
+    buf = malloc(num_insns * INSN_LENGTH_BYTES);
+    if (buf == NULL) {
+        ret = 1;
+        goto out;
+    }
+    for (size_t i = 0; i < num_insns; i++) {
+        store_word(buf + i * INSN_LENGTH_BYTES, code[i]);
+    }
+
+    size_t len = num_insns * INSN_LENGTH_BYTES;
+    struct la_switch_stats stats = { 0 };
+    struct la_switch sw;
+    uint64_t best = UINT64_MAX;
+    for (int round = 0; round < SWITCH_ROUNDS; round++) {
+        uint64_t t0 = now_ns();
+        for (size_t i = 0; i < SWITCH_SITES; i++) {
+            const struct switch_site *site = &sites[i];
+            enum la_switch_result result = la_switch_resolve(
+                buf,
+                len,
+                SWITCH_CODE_ADDR,
+                site->site,
+                NULL,
+                &sw,
+                round == 0 ? &stats : NULL
+            );
+            if (round != 0) {
+                continue;
+            }
+            bool resolvable = site->shape != SWITCH_UNBOUNDED && site->shape != SWITCH_SPILLED;
+            if ((result == LA_SWITCH_RESOLVED) != resolvable) {
+                mismatches++;
+                continue;
+            }
+            if (result != LA_SWITCH_RESOLVED) {
+                continue;
+            }
+            bool same = sw.num_cases == site->num_cases;
+            for (size_t k = 0; same && k < sw.num_cases; k++) {
+                same = sw.targets[k] == SWITCH_CODE_ADDR + (site->first_case + 2 * k) * INSN_LENGTH_BYTES;
+            }
+            mismatches += !same;
+        }
+        uint64_t ns = now_ns() - t0;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+
+    uint64_t t0 = now_ns();
+    struct la_cfg *cfg = la_cfg_build(buf, len, SWITCH_CODE_ADDR);
+    uint64_t cfg_ns = now_ns() - t0;
+    size_t switch_edges = 0;
+    for (size_t i = 0; cfg != NULL && i < cfg->num_edges; i++) {
+        switch_edges += cfg->edges[i].kind == LA_CFG_EDGE_SWITCH;
+    }
+    bool snapshot_same = cfg != NULL && snapshot_leaders_match(buf, len, cfg);
+
+    printf(
+        "\njump tables: %" PRIu64 " sites, %" PRIu64 " resolved (%" PRIu64 " cases), %" PRIu64 " no bound, %" PRIu64 " no index, "
+        "%.0f ns/site, %.1f insns sliced/site, %zu mismatches\n",
+        stats.sites,
+        stats.results[LA_SWITCH_RESOLVED],
+        stats.cases,
+        stats.results[LA_SWITCH_NO_BOUND],
+        stats.results[LA_SWITCH_NO_INDEX],
+        (double)best / SWITCH_SITES,
+        (double)stats.steps / stats.sites,
+        mismatches
+    );
+    printf(
+        "  CFG with them: %zu blocks, %zu switch edges, %.2f ms, snapshot leaders %s\n",
+        cfg != NULL ? cfg->num_blocks : 0,
+        switch_edges,
+        cfg_ns / 1e6,
+        snapshot_same ? "same" : "differ"
+    );
+    if (mismatches != 0 || cfg == NULL || switch_edges != stats.cases || !snapshot_same) {
+        ret = 1;
+    }
+    la_cfg_free(cfg);
+
+out:
+    free(buf);
+    free(sites);
+    free(code);
+    return ret;
+}
+
+#define FUNCS_COUNT 8192
+#define FUNCS_ROUNDS 16
+/* insns per la_funcs_scan range, to exercise merging ranges */
+#define FUNCS_RANGE_INSNS (64 * 1024)
+
+/*
+ * A stripped image: functions laid out by emit_function(), every fourth a
+ * leaf without a frame, and a last function calling all leaves and every
+ * third of the others. Every function must be found, and nothing else,
+ * e.g. not the insn after an early return.
+ */
+static int bench_funcs(void) {
+    const size_t max_insns = 1 + 7 + 1 + 112 + 2 * 9;
+    la_insn_t *code = malloc((FUNCS_COUNT * (max_insns + 1) + 8) * sizeof(*code));
+    size_t *entries = malloc((FUNCS_COUNT + 1) * sizeof(*entries));
+    uint8_t *buf = NULL;
+    struct la_func_list list;
+    size_t n = 0;
+    int ret = 0;
+
+    la_func_list_init(&list);
+    if (code == NULL || entries == NULL) {
+        ret = 1;
+        goto out;
+    }
+
+    for (size_t i = 0; i < FUNCS_COUNT; i++) {
+        entries[i] = n;
+        if (i % 4 == 3) {
+            size_t body = 4 + rng_next() % 16;
+            for (size_t k = 0; k < body; k++) {
+                emit(code, &n, encode_rrr(LA_INSN_ADD, 12 + rng_next() % 9, 12 + rng_next() % 9, 12 + rng_next() % 9));
+            }
+            emit(code, &n, encode_rrr(LA_INSN_JALR, LA_REG_ZERO, LA_REG_RA, 0));
+        } else {
+            struct la_frame f;
+            n += emit_function(code + n, &f);
+        }
+    }
+    entries[FUNCS_COUNT] = n;
+    emit(code, &n, encode_rri12(LA_INSN_ADDI, LA_REG_SP, LA_REG_SP, -16));
+    emit(code, &n, encode_rri12(LA_INSN_SD, LA_REG_RA, LA_REG_SP, 8));
+    for (size_t i = 0; i < FUNCS_COUNT; i++) {
+        if (i % 4 == 3 || i % 3 == 0) {
+            emit(code, &n, encode_i25(LA_INSN_JAL, (int32_t)entries[i] - (int32_t)n));
+        }
+    }
+    emit(code, &n, encode_rri12(LA_INSN_LD, LA_REG_RA, LA_REG_SP, 8));
+    emit(code, &n, encode_rri12(LA_INSN_ADDI, LA_REG_SP, LA_REG_SP, 16));
+    emit(code, &n, encode_rrr(LA_INSN_JALR, LA_REG_ZERO, LA_REG_RA, 0));
+
+    size_t len = n * INSN_LENGTH_BYTES;
+    buf = malloc(len);
+    if (buf == NULL) {
+        ret = 1;
+        goto out;
+    }
+    for (size_t i = 0; i < n; i++) {
+        store_word(buf + i * INSN_LENGTH_BYTES, code[i]);
+    }
+
+    uint64_t pc = 0x120000000ULL;
+    uint64_t best = UINT64_MAX;
+    for (int round = 0; round < FUNCS_ROUNDS; round++) {
+        struct la_func_list range;
+        bool ok = true;
+
+        la_func_list_fini(&list);
+        uint64_t t0 = now_ns();
+        for (size_t off = 0; ok && off < len; off += FUNCS_RANGE_INSNS * INSN_LENGTH_BYTES) {
+            la_func_list_init(&range);
+            ok = la_funcs_scan(&range, buf, len, pc, off, FUNCS_RANGE_INSNS * INSN_LENGTH_BYTES, NULL)
+                && la_func_list_merge(&list, &range);
+            la_func_list_fini(&range);
+        }
+        la_funcs_finish(&list, NULL);
+        uint64_t ns = now_ns() - t0;
+        if (!ok) {
+            ret = 1;
+            goto out;
+        }
+        if (ns < best) {
+            best = ns;
+        }
+    }
+
+    /* the threaded scan of the whole image must find the same */
+    struct la_funcs_region region = { .addr = pc, .buf = buf, .len = len };
+    struct la_funcs_stats stats = { 0 };
+    struct la_func_list threaded;
+    la_func_list_init(&threaded);
+    bool threaded_same = la_funcs_scan_regions(&threaded, &region, 1, 4, NULL, &stats)
+        && threaded.num_starts == list.num_starts;
+    for (size_t i = 0; threaded_same && i < list.num_starts; i++) {
+        threaded_same = threaded.starts[i].addr == list.starts[i].addr
+            && threaded.starts[i].evidence == list.starts[i].evidence;
+    }
+    la_func_list_fini(&threaded);
+
+    /* both sorted by address */
+    size_t found = 0;
+    size_t false_starts = 0;
+    for (size_t i = 0, k = 0; i < list.num_starts; i++) {
+        uint64_t addr = list.starts[i].addr;
+        while (k <= FUNCS_COUNT && pc + entries[k] * INSN_LENGTH_BYTES < addr) {
+            k++;
+        }
+        if (k <= FUNCS_COUNT && pc + entries[k] * INSN_LENGTH_BYTES == addr) {
+            found++;
+        } else {
+            false_starts++;
+        }
+    }
+
+    printf(
+        "\nfunction starts: %d functions, %zu insns, %.2f ns/insn, %.0f MB/s, %zu found, %zu missed, %zu false\n",
+        FUNCS_COUNT + 1,
+        n,
+        (double)best / n,
+        len * 1e3 / best,
+        found,
+        FUNCS_COUNT + 1 - found,
+        false_starts
+    );
+    printf("  on %u threads: %s\n", stats.threads, threaded_same ? "same" : "differ");
+    if (found != FUNCS_COUNT + 1 || false_starts != 0 || !threaded_same) {
+        ret = 1;
+    }
+
+out:
+    la_func_list_fini(&list);
+    free(buf);
+    free(entries);
+    free(code);
+    return ret;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-n NUM_WORDS] [-c CACHE_KIB] [-R] [TEXT_DUMP...]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    size_t num_words = DEFAULT_NUM_WORDS;
+    size_t cache_kib = DEFAULT_CACHE_KIB;
+    bool compare_render = true;
+    int opt;
+    int ret = 0;
+
+    while ((opt = getopt(argc, argv, "n:c:R")) != -1) {
+        switch (opt) {
+        case 'n':
+            num_words = strtoull(optarg, NULL, 0);
+            if (num_words == 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'c':
+            cache_kib = strtoull(optarg, NULL, 0);
+            break;
+        case 'R':
+            compare_render = false;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    printf(
+        "%-20s %-14s %10s %9s %10s %12s\n",
+        "corpus",
+        "pass",
+        "insns",
+        "ns/insn",
+        "M insn/s",
+        "cycles/insn"
+    );
+
+    struct word_corpus c;
+    if (make_uniform_corpus(&c, num_words)) {
+        bench_words(&c, cache_kib);
+        free(c.buf);
+    }
+    if (make_table_mix_corpus(&c, num_words)) {
+        bench_words(&c, cache_kib);
+        free(c.buf);
+    }
+    for (int i = optind; i < argc; i++) {
+        if (!load_file_corpus(&c, argv[i])) {
+            ret = 1;
+            continue;
+        }
+        bench_words(&c, cache_kib);
+        free(c.buf);
+    }
+
+    if (bench_emu() != 0) {
+        ret = 1;
+    }
+    if (bench_frames() != 0) {
+        ret = 1;
+    }
+    if (bench_switches() != 0) {
+        ret = 1;
+    }
+    if (bench_funcs() != 0) {
+        ret = 1;
+    }
+
+    if (compare_render) {
+        printf("\n");
+        if (bench_render() != 0) {
+            ret = 1;
+        }
+    }
+
+    la_decode_stats_dump_env();
+    return ret;
+}
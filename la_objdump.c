@@ -0,0 +1,1290 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ * Standalone disassembler, links against the decoder only and does not need
+ * radare2.
+ *
+ * usage: la_objdump [-j THREADS] [-s START] [-e END] [-b BASE] [-r | -I | -g json|r2 | -F json|r2 | -f json|r2] [-S SNAPSHOT] [-p PATTERN]... FILE
+ *        la_objdump -X INDEX [-u] [-s START] [-e END] [-b BASE] FILE
+ *        la_objdump -X INDEX [-r] -q ADDR...
+ *
+ * The input is mmapped. For ELF files every executable PROGBITS section is
+ * listed at its address; anything else, or any file when -s/-e are given, is
+ * disassembled raw from file offset START up to END (default: the whole
+ * file) with insn N at address BASE + START + 4 * N. Lines look like
+ * objdump's by default, like r2's pD with -r, and are just the insn text
+ * with -I, which is what r2 prints for the same bytes, as both use the same
+ * decoder and renderer. Except with -I, addresses and constants put together
+ * by aui/auipc and the insns consuming them are added as comments.
+ *
+ * With -g, the basic blocks and control-flow edges of each region are
+ * printed instead, as JSON or as r2 commands: a flag per block in the `cfg`
+ * flag space and a code or call xref per branch, jump and call. Jump tables
+ * behind jalr are recovered, from any section, and add an edge per case;
+ * how many were resolved and why the others were given up goes to stderr.
+ *
+ * With -F, the stack frames of the functions of each region are printed
+ * instead, as JSON or as r2 commands: frame size, save slots and stack
+ * variables (see la_frame_analyze). Functions start at the start of a region
+ * and at every call target, and run up to the next one.
+ *
+ * With -p, only the insns matching one of the PATTERNs are listed, e.g.
+ * `-p 'jal 0x120001000' -p 'ld *, *(gp)' -p syscall` (see la_search_add);
+ * the number of hits and the search rate go to stderr.
+ *
+ * With -f, the function starts found in the regions are printed instead, as
+ * JSON or as r2 commands defining a function at each: jal targets, and
+ * prologues and the insns following returns that score high enough (see
+ * la_funcs_scan). The regions are cut into ranges scanned in parallel.
+ *
+ * With -S, insns are taken from the decoded-image snapshot SNAPSHOT instead
+ * of being decoded, after regions whose bytes changed since it was written,
+ * or all of them if there is no usable snapshot, are decoded into it again.
+ *
+ * With -X, the branch, jump and call xrefs of the regions are written to the
+ * xref index file INDEX instead, or with -u merged into it, replacing those
+ * from the same address ranges; its size and the time taken are reported.
+ * With -q, nothing is disassembled and the xrefs to each ADDR are looked up
+ * in INDEX, and printed as r2 commands with -r.
+ *
+ * The listing is cut into fixed-size chunks handed out to worker threads in
+ * address order. Each worker formats a chunk into its own buffer, and the
+ * main thread writes the buffers out in order with one write each. Only a
+ * bounded window of chunks is in flight, so memory use does not grow with
+ * the input.
+ */
+
+#include <errno.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "r_loongarch.h"
+
+/* insns per chunk */
+#define CHUNK_INSNS (64 * 1024)
+/* chunks in flight per worker */
+#define CHUNKS_PER_WORKER 4
+/* longest line: address, word or bytes, text, comment and separators */
+#define LINE_TEXT_MAX (LA_INSN_TEXT_MAX + 96)
+#define SECTION_HEADER_MAX 256
+#define MAX_REGIONS 256
+
+enum line_style {
+    STYLE_OBJDUMP,
+    STYLE_R2,
+    STYLE_TEXT,
+    STYLE_CFG_JSON,
+    STYLE_CFG_R2,
+    STYLE_FRAME_JSON,
+    STYLE_FRAME_R2,
+    STYLE_FUNCS_JSON,
+    STYLE_FUNCS_R2,
+};
+
+struct region {
+    const char *name;   /* NULL for raw ranges */
+    size_t offset;
+    size_t size;
+    uint64_t addr;
+};
+
+struct chunk {
+    size_t region;
+    size_t offset;      /* into the region */
+    size_t size;
+};
+
+struct slot {
+    char *buf;
+    size_t len;
+    bool ready;
+};
+
+struct objdump {
+    const uint8_t *data;
+    enum line_style style;
+
+    struct region regions[MAX_REGIONS];
+    size_t num_regions;
+    /* non-executable sections of an ELF file */
+    struct region data_regions[MAX_REGIONS];
+    size_t num_data_regions;
+
+    /* list only the hits of the patterns, if any */
+    struct la_search search;
+    size_t num_hits;
+
+    /* regions with no insns in the snapshot decode them */
+    struct la_snapshot *snapshot;
+    struct la_packed_insns snapshot_insns[MAX_REGIONS];
+    struct chunk *chunks;
+    size_t num_chunks;
+
+    /* chunk k is formatted into slots[k % num_slots] */
+    struct slot *slots;
+    size_t num_slots;
+    size_t next_chunk;
+    size_t next_write;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static inline char *put_hex_fixed(char *p, uint64_t v, int digits) {
+    for (int i = digits - 1; i >= 0; i--) {
+        p[i] = hex_digits[v & 0xf];
+        v >>= 4;
+    }
+    return p + digits;
+}
+
+/* digits needed for "%" PRIx64 */
+static inline int hex_width(uint64_t v) {
+    return v != 0 ? (64 - __builtin_clzll(v) + 3) / 4 : 1;
+}
+
+static inline char *put_spaces(char *p, int n) {
+    memset(p, ' ', n);
+    return p + n;
+}
+
+static char *format_line(
+    char *p,
+    enum line_style style,
+    const uint8_t *bytes,
+    uint64_t pc,
+    const struct la_op *op,
+    const struct la_resolved *resolved
+) {
+    int digits = hex_width(pc);
+
+    switch (style) {
+    case STYLE_OBJDUMP:
+        /* "    1000:\t02ffc063 \taddi ...", right-aligned in 8 columns */
+        if (digits < 8) {
+            p = put_spaces(p, 8 - digits);
+        }
+        p = put_hex_fixed(p, pc, digits);
+        *p++ = ':';
+        *p++ = '\t';
+        p = put_hex_fixed(p, la_read_insn_word(bytes), 8);
+        *p++ = ' ';
+        *p++ = '\t';
+        break;
+    case STYLE_R2:
+        /* "            0x00001000      63c0ff02       addi ..." */
+        p = put_spaces(p, 12);
+        *p++ = '0';
+        *p++ = 'x';
+        /* "0x%08" PRIx64 */
+        p = put_hex_fixed(p, pc, digits < 8 ? 8 : digits);
+        p = put_spaces(p, 6);
+        for (int i = 0; i < INSN_LENGTH_BYTES; i++) {
+            p = put_hex_fixed(p, bytes[i], 2);
+        }
+        p = put_spaces(p, 7);
+        break;
+    case STYLE_TEXT:
+    default:
+        break;
+    }
+
+    p += la_print_insn(p, LA_INSN_TEXT_MAX, op, pc);
+    if (resolved != NULL) {
+        p = put_spaces(p, 2);
+        *p++ = style == STYLE_R2 ? ';' : '#';
+        *p++ = ' ';
+        *p++ = '0';
+        *p++ = 'x';
+        p = put_hex_fixed(p, resolved->value, hex_width(resolved->value));
+    }
+    *p++ = '\n';
+    return p;
+}
+
+struct search_out {
+    char *p;
+    enum line_style style;
+    const uint8_t *bytes;
+    uint64_t pc;
+};
+
+static void format_hit(void *user, uint64_t pc, la_insn_t insn_word, unsigned pattern) {
+    struct search_out *out = user;
+    struct la_op op;
+
+    (void)pattern;
+    la_match_insn(insn_word, &op);
+    out->p = format_line(out->p, out->style, out->bytes + (pc - out->pc), pc, &op, NULL);
+}
+
+static void format_chunk(struct objdump *od, size_t k, struct slot *slot, struct la_op *ops) {
+    const struct chunk *c = &od->chunks[k];
+    const struct region *r = &od->regions[c->region];
+    const uint8_t *bytes = od->data + r->offset + c->offset;
+    uint64_t pc = r->addr + c->offset;
+    char *p = slot->buf;
+
+    if (od->search.num_patterns != 0) {
+        struct search_out out = { p, od->style, bytes, pc };
+        size_t hits = la_search_block(&od->search, bytes, c->size, pc, format_hit, &out);
+        __atomic_fetch_add(&od->num_hits, hits, __ATOMIC_RELAXED);
+        slot->len = out.p - slot->buf;
+        return;
+    }
+
+    if (c->offset == 0 && r->name != NULL && od->style != STYLE_TEXT) {
+        p += snprintf(p, SECTION_HEADER_MAX, "%sDisassembly of section %.200s:\n\n", c->region ? "\n" : "", r->name);
+    }
+
+    struct la_resolver resolver;
+    struct la_resolved resolved;
+    bool comments = od->style != STYLE_TEXT;
+
+    la_resolver_init(&resolver, 0);
+    if (comments) {
+        /* pick up values set just before the chunk */
+        size_t warm = c->offset / INSN_LENGTH_BYTES;
+        if (warm > resolver.window) {
+            warm = resolver.window;
+        }
+        for (size_t i = warm; i > 0; i--) {
+            struct la_op op;
+            la_match_insn(la_read_insn_word(bytes - i * INSN_LENGTH_BYTES), &op);
+            la_resolver_step(&resolver, &op, pc - i * INSN_LENGTH_BYTES, &resolved);
+        }
+    }
+
+    const struct la_packed_insns *packed = &od->snapshot_insns[c->region];
+    size_t n;
+    if (packed->insns.ids != NULL) {
+        n = c->size / INSN_LENGTH_BYTES;
+        for (size_t i = 0; i < n; i++) {
+            la_packed_expand(packed, c->offset / INSN_LENGTH_BYTES + i, &ops[i]);
+        }
+    } else {
+        n = la_decode_block(bytes, c->size, ops, CHUNK_INSNS);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t insn_pc = pc + i * INSN_LENGTH_BYTES;
+        bool found = comments && la_resolver_step(&resolver, &ops[i], insn_pc, &resolved);
+        p = format_line(
+            p,
+            od->style,
+            bytes + i * INSN_LENGTH_BYTES,
+            insn_pc,
+            &ops[i],
+            found ? &resolved : NULL
+        );
+    }
+    slot->len = p - slot->buf;
+}
+
+static void *worker_main(void *arg) {
+    struct objdump *od = arg;
+    struct la_op *ops = malloc(CHUNK_INSNS * sizeof(*ops));
+
+    if (ops == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&od->lock);
+        while (od->next_chunk < od->num_chunks && od->next_chunk >= od->next_write + od->num_slots) {
+            pthread_cond_wait(&od->cond, &od->lock);
+        }
+        if (od->next_chunk >= od->num_chunks) {
+            pthread_mutex_unlock(&od->lock);
+            break;
+        }
+        size_t k = od->next_chunk++;
+        pthread_mutex_unlock(&od->lock);
+
+        struct slot *slot = &od->slots[k % od->num_slots];
+        format_chunk(od, k, slot, ops);
+
+        pthread_mutex_lock(&od->lock);
+        slot->ready = true;
+        pthread_cond_broadcast(&od->cond);
+        pthread_mutex_unlock(&od->lock);
+    }
+
+    free(ops);
+    return NULL;
+}
+
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* the main thread writes the chunks out in order as they become ready */
+static bool write_chunks(struct objdump *od) {
+    bool ok = true;
+
+    for (size_t k = 0; k < od->num_chunks; k++) {
+        struct slot *slot = &od->slots[k % od->num_slots];
+
+        pthread_mutex_lock(&od->lock);
+        while (!slot->ready) {
+            pthread_cond_wait(&od->cond, &od->lock);
+        }
+        pthread_mutex_unlock(&od->lock);
+
+        if (ok && !write_all(STDOUT_FILENO, slot->buf, slot->len)) {
+            perror("write");
+            /* keep draining so the workers can finish */
+            ok = false;
+        }
+
+        pthread_mutex_lock(&od->lock);
+        slot->ready = false;
+        od->next_write++;
+        pthread_cond_broadcast(&od->cond);
+        pthread_mutex_unlock(&od->lock);
+    }
+    return ok;
+}
+
+static bool add_region(struct objdump *od, const char *name, size_t offset, size_t size, uint64_t addr) {
+    if (od->num_regions == MAX_REGIONS) {
+        fprintf(stderr, "too many sections\n");
+        return false;
+    }
+    struct region *r = &od->regions[od->num_regions++];
+    r->name = name;
+    r->offset = offset;
+    r->size = size - size % INSN_LENGTH_BYTES;
+    r->addr = addr;
+    return true;
+}
+
+/* data sections beyond MAX_REGIONS are not looked at */
+static void add_data_region(struct objdump *od, const char *name, size_t offset, size_t size, uint64_t addr) {
+    if (od->num_data_regions == MAX_REGIONS) {
+        return;
+    }
+    struct region *r = &od->data_regions[od->num_data_regions++];
+    r->name = name;
+    r->offset = offset;
+    r->size = size;
+    r->addr = addr;
+}
+
+#define ELF_SECTIONS(Ehdr, Shdr)                                                \
+    do {                                                                        \
+        const Ehdr *eh = (const Ehdr *)data;                                    \
+        if (eh->e_shoff == 0 || eh->e_shentsize != sizeof(Shdr)                 \
+            || eh->e_shoff > size                                               \
+            || (size - eh->e_shoff) / sizeof(Shdr) < eh->e_shnum                \
+            || eh->e_shstrndx >= eh->e_shnum) {                                 \
+            fprintf(stderr, "bad ELF section headers\n");                       \
+            return false;                                                       \
+        }                                                                       \
+        const Shdr *sh = (const Shdr *)(data + eh->e_shoff);                    \
+        const Shdr *strtab = &sh[eh->e_shstrndx];                               \
+        for (size_t i = 0; i < eh->e_shnum; i++) {                              \
+            if (sh[i].sh_type != SHT_PROGBITS                                   \
+                || !(sh[i].sh_flags & (SHF_EXECINSTR | SHF_ALLOC))) {           \
+                continue;                                                       \
+            }                                                                   \
+            if (sh[i].sh_offset > size || sh[i].sh_size > size - sh[i].sh_offset \
+                || sh[i].sh_name >= strtab->sh_size                             \
+                || strtab->sh_offset + strtab->sh_size > size) {                \
+                fprintf(stderr, "bad ELF section %zu\n", i);                    \
+                return false;                                                   \
+            }                                                                   \
+            const char *name = (const char *)data + strtab->sh_offset + sh[i].sh_name; \
+            if (memchr(name, '\0', strtab->sh_size - sh[i].sh_name) == NULL) {  \
+                fprintf(stderr, "bad ELF section name %zu\n", i);               \
+                return false;                                                   \
+            }                                                                   \
+            if (!(sh[i].sh_flags & SHF_EXECINSTR)) {                            \
+                /* jump tables may be read from it */                           \
+                add_data_region(od, name, sh[i].sh_offset, sh[i].sh_size, sh[i].sh_addr); \
+                continue;                                                       \
+            }                                                                   \
+            if (!add_region(od, name, sh[i].sh_offset, sh[i].sh_size, sh[i].sh_addr)) { \
+                return false;                                                   \
+            }                                                                   \
+        }                                                                       \
+    } while (0)
+
+/* only little-endian files, LoongArch has no big-endian variant */
+static bool find_elf_sections(struct objdump *od, const uint8_t *data, size_t size) {
+    if (size < EI_NIDENT || data[EI_DATA] != ELFDATA2LSB) {
+        fprintf(stderr, "not a little-endian ELF file\n");
+        return false;
+    }
+
+    if (data[EI_CLASS] == ELFCLASS64 && size >= sizeof(Elf64_Ehdr)) {
+        ELF_SECTIONS(Elf64_Ehdr, Elf64_Shdr);
+    } else if (data[EI_CLASS] == ELFCLASS32 && size >= sizeof(Elf32_Ehdr)) {
+        ELF_SECTIONS(Elf32_Ehdr, Elf32_Shdr);
+    } else {
+        fprintf(stderr, "unsupported ELF class\n");
+        return false;
+    }
+
+    if (od->num_regions == 0) {
+        fprintf(stderr, "no executable sections\n");
+        return false;
+    }
+    return true;
+}
+
+#undef ELF_SECTIONS
+
+static bool make_chunks(struct objdump *od) {
+    size_t num_chunks = 0;
+    for (size_t i = 0; i < od->num_regions; i++) {
+        num_chunks += (od->regions[i].size + CHUNK_INSNS * INSN_LENGTH_BYTES - 1) / (CHUNK_INSNS * INSN_LENGTH_BYTES);
+    }
+
+    od->chunks = calloc(num_chunks, sizeof(*od->chunks));
+    if (num_chunks != 0 && od->chunks == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < od->num_regions; i++) {
+        const struct region *r = &od->regions[i];
+        for (size_t off = 0; off < r->size; off += CHUNK_INSNS * INSN_LENGTH_BYTES) {
+            struct chunk *c = &od->chunks[od->num_chunks++];
+            c->region = i;
+            c->offset = off;
+            c->size = r->size - off < CHUNK_INSNS * INSN_LENGTH_BYTES
+                ? r->size - off
+                : CHUNK_INSNS * INSN_LENGTH_BYTES;
+        }
+    }
+    return true;
+}
+
+static void print_cfg_json(const struct region *r, const struct la_cfg *cfg, bool first) {
+    printf(
+        "%s{\"name\":\"%s\",\"addr\":%" PRIu64 ",\"size\":%zu,\"blocks\":[",
+        first ? "" : ",",
+        r->name != NULL ? r->name : "",
+        r->addr,
+        r->size
+    );
+    for (size_t k = 0; k < cfg->num_blocks; k++) {
+        const struct la_cfg_block *b = &cfg->blocks[k];
+        printf(
+            "%s{\"addr\":%" PRIu64 ",\"size\":%" PRIu32 ",\"ninstr\":%" PRIu32 ",\"end\":\"%s\",\"edges\":[",
+            k == 0 ? "" : ",",
+            b->addr,
+            b->num_insns * INSN_LENGTH_BYTES,
+            b->num_insns,
+            la_cfg_block_end_name(b->end)
+        );
+        for (uint32_t i = 0; i < b->num_edges; i++) {
+            const struct la_cfg_edge *e = &cfg->edges[b->first_edge + i];
+            printf(
+                "%s{\"type\":\"%s\",\"from\":%" PRIu64 ",\"addr\":%" PRIu64,
+                i == 0 ? "" : ",",
+                la_cfg_edge_kind_name(e->kind),
+                e->src,
+                e->target
+            );
+            if (e->to != LA_CFG_NO_BLOCK) {
+                printf(",\"block\":%" PRIu32, e->to);
+            }
+            printf("}");
+        }
+        printf("]}");
+    }
+    printf("]}");
+}
+
+static void print_cfg_r2(const struct la_cfg *cfg) {
+    printf("fs cfg\n");
+    for (size_t k = 0; k < cfg->num_blocks; k++) {
+        const struct la_cfg_block *b = &cfg->blocks[k];
+        printf(
+            "f cfg.bb.%08" PRIx64 " %" PRIu32 " @ 0x%" PRIx64 "\n",
+            b->addr,
+            b->num_insns * INSN_LENGTH_BYTES,
+            b->addr
+        );
+    }
+    /* r2 has no xrefs for falling through */
+    for (size_t i = 0; i < cfg->num_edges; i++) {
+        const struct la_cfg_edge *e = &cfg->edges[i];
+        if (e->kind != LA_CFG_EDGE_FALLTHROUGH) {
+            printf(
+                "%s 0x%" PRIx64 " @ 0x%" PRIx64 "\n",
+                e->kind == LA_CFG_EDGE_CALL ? "axC" : "axc",
+                e->target,
+                e->src
+            );
+        }
+    }
+    printf("fs *\n");
+}
+
+static bool read_from(const struct region *regions, size_t num_regions, const uint8_t *data, uint64_t addr, uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < num_regions; i++) {
+        const struct region *r = &regions[i];
+        if (addr >= r->addr && addr - r->addr <= r->size && len <= r->size - (addr - r->addr)) {
+            memcpy(buf, data + r->offset + (addr - r->addr), len);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* jump tables are read from any section */
+static bool read_table(void *user, uint64_t addr, uint8_t *buf, size_t len) {
+    const struct objdump *od = user;
+    return read_from(od->regions, od->num_regions, od->data, addr, buf, len)
+        || read_from(od->data_regions, od->num_data_regions, od->data, addr, buf, len);
+}
+
+static void print_switch_stats(const struct la_switch_stats *stats) {
+    fprintf(stderr, "jump tables: %" PRIu64 " sites", stats->sites);
+    for (int k = 0; k < LA_SWITCH_RESULT_LAST; k++) {
+        if (stats->results[k] != 0) {
+            fprintf(stderr, ", %" PRIu64 " %s", stats->results[k], la_switch_result_name(k));
+        }
+    }
+    fprintf(stderr, ", %" PRIu64 " cases, %" PRIu64 " insns sliced\n", stats->cases, stats->steps);
+}
+
+static int print_cfgs(const struct objdump *od) {
+    static char out_buf[1 << 20];
+    const struct la_switch_config config = {
+        .read = read_table,
+        .user = (void *)od,
+    };
+    struct la_switch_stats stats = { 0 };
+
+    setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+    if (od->style == STYLE_CFG_JSON) {
+        printf("[");
+    }
+    for (size_t i = 0; i < od->num_regions; i++) {
+        const struct region *r = &od->regions[i];
+        struct la_cfg *cfg = la_cfg_build_switches(od->data + r->offset, r->size, r->addr, &config, &stats);
+        if (cfg == NULL) {
+            fprintf(stderr, "cannot build the CFG of %s\n", r->name != NULL ? r->name : "the input");
+            return 1;
+        }
+        if (od->style == STYLE_CFG_JSON) {
+            print_cfg_json(r, cfg, i == 0);
+        } else {
+            print_cfg_r2(cfg);
+        }
+        la_cfg_free(cfg);
+    }
+    if (od->style == STYLE_CFG_JSON) {
+        printf("]\n");
+    }
+    print_switch_stats(&stats);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
+static bool parse_u64(const char *s, uint64_t *v) {
+    char *end;
+    errno = 0;
+    *v = strtoull(s, &end, 0);
+    return errno == 0 && *s != '\0' && *end == '\0';
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Find the functions of a region, the region start and the call targets in
+ * it, sorted.
+ *
+ * Returns NULL on allocation failure.
+ */
+static uint64_t *find_functions(const struct region *r, const struct la_cfg *cfg, size_t *num_funcs) {
+    uint64_t *entries = malloc((cfg->num_edges + 1) * sizeof(*entries));
+    size_t n = 0;
+
+    if (entries == NULL) {
+        return NULL;
+    }
+    entries[n++] = r->addr;
+    for (size_t i = 0; i < cfg->num_edges; i++) {
+        const struct la_cfg_edge *e = &cfg->edges[i];
+        if (e->kind == LA_CFG_EDGE_CALL && e->to != LA_CFG_NO_BLOCK) {
+            entries[n++] = e->target;
+        }
+    }
+    qsort(entries, n, sizeof(*entries), compare_u64);
+
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (k == 0 || entries[i] != entries[k - 1]) {
+            entries[k++] = entries[i];
+        }
+    }
+    *num_funcs = k;
+    return entries;
+}
+
+static const char *frame_var_type(unsigned size) {
+    switch (size) {
+    case 1:
+        return "int8_t";
+    case 2:
+        return "int16_t";
+    case 4:
+        return "int32_t";
+    default:
+        return "int64_t";
+    }
+}
+
+static void print_frame_json(const struct la_frame *f, bool first) {
+    printf(
+        "%s{\"addr\":%" PRIu64 ",\"framesize\":%" PRIu32 ",\"fp\":",
+        first ? "" : ",",
+        f->addr,
+        f->size
+    );
+    if (f->uses_fp) {
+        printf("%" PRId32, f->fp_offset);
+    } else {
+        printf("null");
+    }
+    printf(",\"sp_lost\":%s,\"saved\":[", f->sp_lost ? "true" : "false");
+
+    bool first_reg = true;
+    for (la_reg_t reg = 0; reg < 32; reg++) {
+        if ((f->saved >> reg) & 1) {
+            printf(
+                "%s{\"reg\":\"%s\",\"offset\":%" PRId32 "}",
+                first_reg ? "" : ",",
+                la_reg_name(reg, false),
+                f->save_offset[reg]
+            );
+            first_reg = false;
+        }
+    }
+    printf("],\"vars\":[");
+    for (size_t i = 0; i < f->num_vars; i++) {
+        const struct la_frame_var *v = &f->vars[i];
+        printf(
+            "%s{\"offset\":%" PRId32 ",\"size\":%u,\"read\":%s,\"write\":%s}",
+            i == 0 ? "" : ",",
+            v->offset,
+            v->size,
+            (v->access & LA_FRAME_READ) ? "true" : "false",
+            (v->access & LA_FRAME_WRITE) ? "true" : "false"
+        );
+    }
+    printf("]}");
+}
+
+/* r2 counts sp-based vars from sp after the prologue */
+static void print_frame_r2(const struct la_frame *f) {
+    printf("af @ 0x%" PRIx64 "\n", f->addr);
+    printf("afS %" PRIu32 " @ 0x%" PRIx64 "\n", f->size, f->addr);
+    for (la_reg_t reg = 0; reg < 32; reg++) {
+        if ((f->saved >> reg) & 1) {
+            printf(
+                "afvs %" PRId64 " saved_%s int64_t @ 0x%" PRIx64 "\n",
+                (int64_t)f->save_offset[reg] + f->size,
+                la_reg_name(reg, false),
+                f->addr
+            );
+        }
+    }
+    for (size_t i = 0; i < f->num_vars; i++) {
+        const struct la_frame_var *v = &f->vars[i];
+        int64_t delta = (int64_t)v->offset + f->size;
+        printf(
+            "afvs %" PRId64 " %s_%" PRIx64 " %s @ 0x%" PRIx64 "\n",
+            delta,
+            v->offset < 0 ? "var" : "arg",
+            (uint64_t)(v->offset < 0 ? -(int64_t)v->offset : v->offset),
+            frame_var_type(v->size),
+            f->addr
+        );
+    }
+}
+
+static int print_frames(const struct objdump *od) {
+    static char out_buf[1 << 20];
+    size_t total = 0;
+    uint64_t t0 = now_ns();
+
+    setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+    if (od->style == STYLE_FRAME_JSON) {
+        printf("[");
+    }
+    for (size_t i = 0; i < od->num_regions; i++) {
+        const struct region *r = &od->regions[i];
+        const uint8_t *buf = od->data + r->offset;
+        struct la_cfg *cfg = la_cfg_build(buf, r->size, r->addr);
+        size_t num_funcs;
+        uint64_t *entries = cfg != NULL ? find_functions(r, cfg, &num_funcs) : NULL;
+
+        if (entries == NULL) {
+            fprintf(stderr, "cannot find the functions of %s\n", r->name != NULL ? r->name : "the input");
+            la_cfg_free(cfg);
+            return 1;
+        }
+        for (size_t k = 0; k < num_funcs; k++) {
+            uint64_t end = k + 1 < num_funcs ? entries[k + 1] : r->addr + r->size;
+            struct la_frame frame;
+
+            la_frame_analyze(&frame, buf + (entries[k] - r->addr), end - entries[k], entries[k]);
+            if (od->style == STYLE_FRAME_JSON) {
+                print_frame_json(&frame, total == 0);
+            } else {
+                print_frame_r2(&frame);
+            }
+            total++;
+        }
+        free(entries);
+        la_cfg_free(cfg);
+    }
+    if (od->style == STYLE_FRAME_JSON) {
+        printf("]\n");
+    }
+    fprintf(stderr, "%zu functions, %.1f ms\n", total, (now_ns() - t0) / 1e6);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
+static void print_func_json(const struct la_func_start *f, bool first) {
+    static const char *const names[] = { "call", "prologue", "frame", "after_return" };
+    bool first_name = true;
+
+    printf(
+        "%s{\"addr\":%" PRIu64 ",\"score\":%d,\"calls\":%" PRIu32 ",\"evidence\":[",
+        first ? "" : ",",
+        f->addr,
+        la_func_score(f),
+        f->calls
+    );
+    for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if ((f->evidence >> i) & 1) {
+            printf("%s\"%s\"", first_name ? "" : ",", names[i]);
+            first_name = false;
+        }
+    }
+    printf("]}");
+}
+
+static int print_funcs(const struct objdump *od, long num_threads) {
+    static char out_buf[1 << 20];
+    struct la_funcs_region regions[MAX_REGIONS];
+    struct la_funcs_stats stats;
+    struct la_func_list list;
+    size_t scanned = 0;
+    uint64_t t0 = now_ns();
+
+    for (size_t i = 0; i < od->num_regions; i++) {
+        const struct region *r = &od->regions[i];
+        regions[i].addr = r->addr;
+        regions[i].buf = od->data + r->offset;
+        regions[i].len = r->size;
+        scanned += r->size;
+    }
+    la_func_list_init(&list);
+    if (!la_funcs_scan_regions(&list, regions, od->num_regions, num_threads, NULL, &stats)) {
+        fprintf(stderr, "out of memory\n");
+        la_func_list_fini(&list);
+        return 1;
+    }
+    uint64_t t1 = now_ns();
+
+    setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+    size_t called = 0;
+    size_t prologues = 0;
+    if (od->style == STYLE_FUNCS_JSON) {
+        printf("[");
+    }
+    for (size_t i = 0; i < list.num_starts; i++) {
+        const struct la_func_start *f = &list.starts[i];
+        called += (f->evidence & LA_FUNC_CALLED) != 0;
+        prologues += (f->evidence & LA_FUNC_PROLOGUE) != 0;
+        if (od->style == STYLE_FUNCS_JSON) {
+            print_func_json(f, i == 0);
+        } else {
+            printf("af fcn.%08" PRIx64 " 0x%" PRIx64 "\n", f->addr, f->addr);
+        }
+    }
+    if (od->style == STYLE_FUNCS_JSON) {
+        printf("]\n");
+    }
+    fprintf(
+        stderr,
+        "%zu candidates, %zu functions (%zu called, %zu with a prologue), %.1f MiB in %.1f ms on %u threads\n",
+        stats.candidates,
+        list.num_starts,
+        called,
+        prologues,
+        scanned / 1048576.0,
+        (t1 - t0) / 1e6,
+        stats.threads
+    );
+    la_func_list_fini(&list);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
+/*
+ * Use the snapshot at `path`, bringing it up to date first.
+ */
+static bool use_snapshot(struct objdump *od, const char *path) {
+    struct la_snapshot_region regions[MAX_REGIONS];
+    struct la_snapshot *old = la_snapshot_open(path);
+    size_t num_rebuilt = 0;
+    uint64_t t0 = now_ns();
+
+    if (old == NULL && errno == ESTALE) {
+        fprintf(stderr, "%s: written with another insn table, decoding everything again\n", path);
+    } else if (old == NULL && errno != ENOENT) {
+        fprintf(stderr, "%s: %s, decoding everything again\n", path, strerror(errno));
+    }
+
+    bool up_to_date = old != NULL && la_snapshot_num_regions(old) == od->num_regions;
+    for (size_t i = 0; i < od->num_regions; i++) {
+        const struct region *r = &od->regions[i];
+        regions[i].addr = r->addr;
+        regions[i].buf = od->data + r->offset;
+        regions[i].len = r->size;
+        if (up_to_date) {
+            up_to_date = la_snapshot_region_matches(old, i, r->addr, regions[i].buf, r->size)
+                && la_snapshot_region_load(old, i, NULL, NULL);
+        }
+    }
+
+    if (up_to_date) {
+        od->snapshot = old;
+    } else {
+        bool ok = la_snapshot_write(path, regions, od->num_regions, old, &num_rebuilt);
+        la_snapshot_close(old);
+        od->snapshot = ok ? la_snapshot_open(path) : NULL;
+        if (od->snapshot == NULL) {
+            perror(path);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < od->num_regions; i++) {
+        if (!la_snapshot_region_load(od->snapshot, i, &od->snapshot_insns[i], NULL)) {
+            fprintf(stderr, "%s: region %zu is corrupt, decoding it\n", path, i);
+            memset(&od->snapshot_insns[i], 0, sizeof(od->snapshot_insns[i]));
+        }
+    }
+
+    fprintf(
+        stderr,
+        "%s: %zu regions, %zu decoded again, in %.1f ms\n",
+        path,
+        od->num_regions,
+        num_rebuilt,
+        (now_ns() - t0) / 1e6
+    );
+    return true;
+}
+
+static int write_xref_index(const struct objdump *od, const char *index_path, bool update) {
+    struct la_xref_list list;
+    uint64_t t0 = now_ns();
+    bool ok = true;
+
+    la_xref_list_init(&list);
+    for (size_t i = 0; ok && i < od->num_regions; i++) {
+        const struct region *r = &od->regions[i];
+        ok = la_xref_collect(&list, od->data + r->offset, r->size, r->addr);
+    }
+    uint64_t t1 = now_ns();
+
+    /* regions never overlap, so updating them one by one or at once is
+     * the same */
+    if (ok && update) {
+        for (size_t i = 0, begin = 0; ok && i < od->num_regions; i++) {
+            const struct region *r = &od->regions[i];
+            size_t end = begin;
+            while (end < list.num_xrefs && list.xrefs[end].src - r->addr < r->size) {
+                end++;
+            }
+            struct la_xref_list range = {
+                .xrefs = list.xrefs + begin,
+                .num_xrefs = end - begin,
+                .capacity = end - begin,
+            };
+            ok = la_xref_index_update(index_path, r->addr, r->addr + r->size, &range);
+            begin = end;
+        }
+    } else if (ok) {
+        ok = la_xref_index_write(index_path, &list);
+    }
+    uint64_t t2 = now_ns();
+    if (!ok) {
+        perror(index_path);
+        la_xref_list_fini(&list);
+        return 1;
+    }
+
+    struct la_xref_index *idx = la_xref_index_open(index_path);
+    if (idx == NULL) {
+        perror(index_path);
+        la_xref_list_fini(&list);
+        return 1;
+    }
+
+    /* look up every target collected, up to a million */
+    struct la_xref found;
+    size_t num_lookups = list.num_xrefs < 1000000 ? list.num_xrefs : 1000000;
+    size_t hits = 0;
+    uint64_t t3 = now_ns();
+    for (size_t i = 0; i < num_lookups; i++) {
+        hits += la_xref_index_lookup(idx, list.xrefs[i * (list.num_xrefs / num_lookups)].target, &found, 1) != 0;
+    }
+    uint64_t t4 = now_ns();
+
+    uint64_t num_xrefs = la_xref_index_num_xrefs(idx);
+    size_t file_size = la_xref_index_file_size(idx);
+    fprintf(
+        stderr,
+        "%s: %" PRIu64 " xrefs, %zu bytes (%.2f per xref), collected in %.1f ms, %s in %.1f ms\n",
+        index_path,
+        num_xrefs,
+        file_size,
+        num_xrefs != 0 ? (double)file_size / num_xrefs : 0.0,
+        (t1 - t0) / 1e6,
+        update ? "merged" : "written",
+        (t2 - t1) / 1e6
+    );
+    if (num_lookups != 0) {
+        fprintf(stderr, "%zu lookups, %.3f us each, %zu found\n", num_lookups, (t4 - t3) / 1e3 / num_lookups, hits);
+    }
+
+    la_xref_index_close(idx);
+    la_xref_list_fini(&list);
+    return 0;
+}
+
+static int query_xref_index(const char *index_path, char **addrs, int num_addrs, bool r2_style) {
+    struct la_xref_index *idx = la_xref_index_open(index_path);
+    struct la_xref *found = NULL;
+    size_t max_found = 0;
+    int ret = 0;
+
+    if (idx == NULL) {
+        perror(index_path);
+        return 1;
+    }
+
+    for (int i = 0; i < num_addrs; i++) {
+        uint64_t target;
+        if (!parse_u64(addrs[i], &target)) {
+            fprintf(stderr, "bad address: %s\n", addrs[i]);
+            ret = 2;
+            continue;
+        }
+
+        size_t n = la_xref_index_lookup(idx, target, found, max_found);
+        if (n > max_found) {
+            struct la_xref *bigger = realloc(found, n * sizeof(*found));
+            if (bigger == NULL) {
+                fprintf(stderr, "out of memory\n");
+                ret = 1;
+                break;
+            }
+            found = bigger;
+            max_found = n;
+            la_xref_index_lookup(idx, target, found, max_found);
+        }
+
+        for (size_t k = 0; k < n; k++) {
+            if (r2_style) {
+                printf(
+                    "%s 0x%" PRIx64 " @ 0x%" PRIx64 "\n",
+                    found[k].kind == LA_XREF_CALL ? "axC" : "axc",
+                    found[k].target,
+                    found[k].src
+                );
+            } else {
+                printf(
+                    "0x%" PRIx64 " %s 0x%" PRIx64 "\n",
+                    found[k].src,
+                    la_xref_kind_name(found[k].kind),
+                    found[k].target
+                );
+            }
+        }
+    }
+
+    free(found);
+    la_xref_index_close(idx);
+    return ret;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-j THREADS] [-s START] [-e END] [-b BASE] [-r | -I | -g json|r2 | -F json|r2 | -f json|r2] [-S SNAPSHOT] [-p PATTERN]... FILE\n", argv0);
+    fprintf(stderr, "       %s -X INDEX [-u] [-s START] [-e END] [-b BASE] FILE\n", argv0);
+    fprintf(stderr, "       %s -X INDEX [-r] -q ADDR...\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    struct objdump od;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t start = 0;
+    uint64_t end = UINT64_MAX;
+    uint64_t base = 0;
+    bool raw = false;
+    const char *index_path = NULL;
+    bool update_index = false;
+    bool query_index = false;
+    const char *snapshot_path = NULL;
+    int opt;
+
+    memset(&od, 0, sizeof(od));
+    od.style = STYLE_OBJDUMP;
+    la_search_init(&od.search);
+
+    while ((opt = getopt(argc, argv, "j:s:e:b:rIg:F:f:X:uqS:p:")) != -1) {
+        switch (opt) {
+        case 'j':
+            num_threads = strtol(optarg, NULL, 0);
+            break;
+        case 's':
+            if (!parse_u64(optarg, &start)) {
+                usage(argv[0]);
+                return 2;
+            }
+            raw = true;
+            break;
+        case 'e':
+            if (!parse_u64(optarg, &end)) {
+                usage(argv[0]);
+                return 2;
+            }
+            raw = true;
+            break;
+        case 'b':
+            if (!parse_u64(optarg, &base)) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'r':
+            od.style = STYLE_R2;
+            break;
+        case 'I':
+            od.style = STYLE_TEXT;
+            break;
+        case 'g':
+            if (strcmp(optarg, "json") == 0) {
+                od.style = STYLE_CFG_JSON;
+            } else if (strcmp(optarg, "r2") == 0) {
+                od.style = STYLE_CFG_R2;
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'F':
+            if (strcmp(optarg, "json") == 0) {
+                od.style = STYLE_FRAME_JSON;
+            } else if (strcmp(optarg, "r2") == 0) {
+                od.style = STYLE_FRAME_R2;
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'f':
+            if (strcmp(optarg, "json") == 0) {
+                od.style = STYLE_FUNCS_JSON;
+            } else if (strcmp(optarg, "r2") == 0) {
+                od.style = STYLE_FUNCS_R2;
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'X':
+            index_path = optarg;
+            break;
+        case 'u':
+            update_index = true;
+            break;
+        case 'q':
+            query_index = true;
+            break;
+        case 'S':
+            snapshot_path = optarg;
+            break;
+        case 'p': {
+            enum la_search_error error = la_search_add(&od.search, optarg);
+            if (error != LA_SEARCH_OK) {
+                fprintf(stderr, "%s: %s\n", optarg, la_search_error_name(error));
+                return 2;
+            }
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (query_index) {
+        if (index_path == NULL || optind == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        return query_xref_index(index_path, argv + optind, argc - optind, od.style == STYLE_R2);
+    }
+    if (optind != argc - 1 || (update_index && index_path == NULL)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    const char *path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return 1;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        return 0;
+    }
+
+    od.data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (od.data == MAP_FAILED) {
+        perror(path);
+        return 1;
+    }
+    close(fd);
+    madvise((void *)od.data, size, MADV_SEQUENTIAL);
+
+    bool is_elf = size >= SELFMAG && memcmp(od.data, ELFMAG, SELFMAG) == 0;
+    if (is_elf && !raw) {
+        if (!find_elf_sections(&od, od.data, size)) {
+            return 1;
+        }
+    } else {
+        if (end > size) {
+            end = size;
+        }
+        if (start >= end) {
+            return 0;
+        }
+        add_region(&od, NULL, start, end - start, base + start);
+    }
+
+    if (index_path != NULL) {
+        return write_xref_index(&od, index_path, update_index);
+    }
+    if (od.style == STYLE_CFG_JSON || od.style == STYLE_CFG_R2) {
+        return print_cfgs(&od);
+    }
+    if (od.style == STYLE_FRAME_JSON || od.style == STYLE_FRAME_R2) {
+        return print_frames(&od);
+    }
+    if (od.style == STYLE_FUNCS_JSON || od.style == STYLE_FUNCS_R2) {
+        return print_funcs(&od, num_threads);
+    }
+    if (snapshot_path != NULL && !use_snapshot(&od, snapshot_path)) {
+        return 1;
+    }
+
+    /* more threads than chunks would only wait */
+    if (!make_chunks(&od)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if ((size_t)num_threads > od.num_chunks) {
+        num_threads = od.num_chunks ? od.num_chunks : 1;
+    }
+
+    od.num_slots = num_threads * CHUNKS_PER_WORKER;
+    od.slots = calloc(od.num_slots, sizeof(*od.slots));
+    if (od.slots == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < od.num_slots; i++) {
+        od.slots[i].buf = malloc(SECTION_HEADER_MAX + (size_t)CHUNK_INSNS * LINE_TEXT_MAX);
+        if (od.slots[i].buf == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    pthread_mutex_init(&od.lock, NULL);
+    pthread_cond_init(&od.cond, NULL);
+
+    uint64_t t0 = now_ns();
+    pthread_t *threads = calloc(num_threads, sizeof(*threads));
+    long started = 0;
+    for (long i = 0; threads != NULL && i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, worker_main, &od) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "cannot start worker threads\n");
+        return 1;
+    }
+
+    bool ok = write_chunks(&od);
+    for (long i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (od.search.num_patterns != 0) {
+        size_t searched = 0;
+        for (size_t i = 0; i < od.num_regions; i++) {
+            searched += od.regions[i].size;
+        }
+        double ms = (now_ns() - t0) / 1e6;
+        fprintf(
+            stderr,
+            "%zu hits in %.1f MiB, %.1f ms, %.2f GB/s\n",
+            od.num_hits,
+            searched / 1048576.0,
+            ms,
+            ms > 0 ? searched / ms / 1e6 : 0.0
+        );
+    }
+
+    la_decode_stats_dump_env();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,588 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ * Exhaustive encoding space sweep, does not need radare2.
+ *
+ * usage: la_sweep [-j THREADS] [-r FIRST-LAST] [-u UNMATCHED_FILE] [-c]
+ *                 [-k KERNEL]
+ *
+ * Every 32-bit word (or those in the -r range, inclusive, in hex) is checked
+ * against every matcher table entry that could match it, and the sweep
+ * reports how many words each entry decodes, which words are matched by more
+ * than one entry (the table is first-match-wins, so later entries are
+ * silently shadowed there), and which ranges fall through to `unk`. The full
+ * list of unmatched ranges is written to UNMATCHED_FILE if given. With -c,
+ * every word is also run through la_match_insn to check the generated decode
+ * tree agrees with the table. With -k, every word is also run through the
+ * given la_classify_block kernel (scalar, sse2 or avx2) to check it agrees
+ * with la_match_insn on the insn and all operand fields, and that the word
+ * can be rebuilt from the packed insn.
+ *
+ * The space is cut into aligned chunks handed out to worker threads through
+ * an atomic counter. Each thread accumulates into its own counters, and each
+ * chunk records its unmatched runs in its own slot, so nothing is locked;
+ * results are merged once all threads are done.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "r_loongarch.h"
+
+#define CHUNK_BITS 20
+#define CHUNK_WORDS ((uint64_t)1 << CHUNK_BITS)
+/* candidate lists are bucketed on this many top bits, must be <= 32 - CHUNK_BITS */
+#define BUCKET_BITS 10
+#define NUM_BUCKETS (1U << BUCKET_BITS)
+#define MAX_MATCHERS 1024
+#define NUM_TOP_RANGES 20
+/* words classified per la_classify_block call when checking a kernel */
+#define CLASSIFY_BLOCK 4096
+
+struct range {
+    uint64_t first;
+    uint64_t last;      /* inclusive */
+};
+
+struct chunk_result {
+    struct range *unmatched;
+    size_t num_unmatched;
+    size_t cap_unmatched;
+};
+
+struct thread_result {
+    uint64_t *hits;             /* per matcher, first match only */
+    uint64_t *ambiguous_pairs;  /* num_matchers^2, (first, other) */
+    la_insn_t *ambiguous_example;
+    uint64_t unmatched;
+    uint64_t ambiguous;
+    uint64_t decoder_mismatches;
+    la_insn_t decoder_mismatch_example;
+    uint64_t classify_mismatches;
+    la_insn_t classify_mismatch_example;
+    bool failed;
+};
+
+struct sweep {
+    const struct la_disasm_matcher *matchers;
+    size_t num_matchers;
+
+    /* matchers compatible with each value of the top BUCKET_BITS bits */
+    uint16_t *bucket_cands[NUM_BUCKETS];
+    size_t bucket_num_cands[NUM_BUCKETS];
+
+    uint64_t first_chunk;
+    uint64_t num_chunks;
+    atomic_uint_fast64_t next_chunk;
+    la_insn_t first_word;
+    la_insn_t last_word;
+    bool check_decoder;
+    bool check_classifier;
+
+    struct chunk_result *chunks;
+};
+
+struct worker {
+    pthread_t thread;
+    struct sweep *sweep;
+    struct thread_result result;
+};
+
+static bool push_range(struct chunk_result *c, uint64_t first, uint64_t last) {
+    if (c->num_unmatched == c->cap_unmatched) {
+        size_t cap = c->cap_unmatched ? c->cap_unmatched * 2 : 64;
+        struct range *r = realloc(c->unmatched, cap * sizeof(*r));
+        if (r == NULL) {
+            return false;
+        }
+        c->unmatched = r;
+        c->cap_unmatched = cap;
+    }
+    c->unmatched[c->num_unmatched].first = first;
+    c->unmatched[c->num_unmatched].last = last;
+    c->num_unmatched++;
+    return true;
+}
+
+/* the immediate field of `op` as packed insns hold it */
+static uint32_t expected_imm(const struct la_op *op) {
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_FFFF:   return op->insn.ffff.ra;
+    case LA_INSN_FORMAT_RRI6:   return op->insn.rri6.imm;
+    case LA_INSN_FORMAT_RRI8:   return op->insn.rri8.imm;
+    case LA_INSN_FORMAT_RRI12:  return op->insn.rri12.imm;
+    case LA_INSN_FORMAT_RRI6I6: return op->insn.rri6i6.imm1 | (uint32_t)op->insn.rri6i6.imm2 << 6;
+    case LA_INSN_FORMAT_RRI14:  return op->insn.rri14.imm;
+    case LA_INSN_FORMAT_RRI16:  return op->insn.rri16.imm;
+    case LA_INSN_FORMAT_AUI20:  return op->insn.aui20.imm;
+    case LA_INSN_FORMAT_RI21:   return op->insn.ri21.imm;
+    case LA_INSN_FORMAT_I25:    return op->insn.i25.imm | (uint32_t)op->insn.i25.sel << 25;
+    case LA_INSN_FORMAT_UNKNOWN: return op->insn.unknown;
+    default:                    return 0;
+    }
+}
+
+static void check_classifier(struct thread_result *r, uint64_t first, uint64_t last) {
+    uint8_t buf[CLASSIFY_BLOCK * INSN_LENGTH_BYTES];
+    uint8_t ids[CLASSIFY_BLOCK];
+    uint8_t rd[CLASSIFY_BLOCK];
+    uint8_t rj[CLASSIFY_BLOCK];
+    uint8_t rk[CLASSIFY_BLOCK];
+    uint32_t imm[CLASSIFY_BLOCK];
+    struct la_packed_insns packed = {
+        .insns = { ids, rd, rj, rk, imm },
+        .capacity = CLASSIFY_BLOCK
+    };
+
+    for (uint64_t w = first; w <= last; w += CLASSIFY_BLOCK) {
+        size_t n = last - w + 1 < CLASSIFY_BLOCK ? last - w + 1 : CLASSIFY_BLOCK;
+        for (size_t i = 0; i < n; i++) {
+            la_insn_t insn_word = (la_insn_t)(w + i);
+            uint8_t *p = buf + i * INSN_LENGTH_BYTES;
+            p[0] = insn_word;
+            p[1] = insn_word >> 8;
+            p[2] = insn_word >> 16;
+            p[3] = insn_word >> 24;
+        }
+
+        packed.num_insns = 0;
+        la_packed_append(&packed, buf, n * INSN_LENGTH_BYTES);
+
+        for (size_t i = 0; i < n; i++) {
+            struct la_op op;
+            la_insn_t insn_word = (la_insn_t)(w + i);
+            la_match_insn(insn_word, &op);
+            if (
+                ids[i] != op.id
+                || rd[i] != la_op_rd(&op)
+                || rj[i] != la_op_rj(&op)
+                || rk[i] != la_op_rk(&op)
+                || imm[i] != expected_imm(&op)
+                || la_packed_insn_word(&packed, i) != insn_word
+            ) {
+                if (r->classify_mismatches++ == 0) {
+                    r->classify_mismatch_example = insn_word;
+                }
+            }
+        }
+    }
+}
+
+static bool sweep_chunk(struct sweep *s, uint64_t chunk, struct thread_result *r) {
+    struct chunk_result *c = &s->chunks[chunk - s->first_chunk];
+    uint64_t first = chunk << CHUNK_BITS;
+    uint64_t last = first + CHUNK_WORDS - 1;
+    if (first < s->first_word) {
+        first = s->first_word;
+    }
+    if (last > s->last_word) {
+        last = s->last_word;
+    }
+
+    /* the bucket is the same for the whole chunk */
+    uint32_t bucket = first >> (32 - BUCKET_BITS);
+    const uint16_t *cands = s->bucket_cands[bucket];
+    size_t num_cands = s->bucket_num_cands[bucket];
+
+    bool in_unmatched = false;
+    uint64_t unmatched_start = 0;
+    for (uint64_t w = first; w <= last; w++) {
+        la_insn_t insn_word = (la_insn_t)w;
+        int first_match = -1;
+        unsigned num_matches = 0;
+
+        for (size_t i = 0; i < num_cands; i++) {
+            const struct la_disasm_matcher *m = &s->matchers[cands[i]];
+            if ((insn_word & m->mask) != m->match) {
+                continue;
+            }
+
+            if (num_matches++ == 0) {
+                first_match = cands[i];
+                r->hits[first_match]++;
+                continue;
+            }
+
+            /* matched again, shadowed by the first match */
+            size_t pair = (size_t)first_match * s->num_matchers + cands[i];
+            if (r->ambiguous_pairs[pair]++ == 0) {
+                r->ambiguous_example[pair] = insn_word;
+            }
+        }
+        r->ambiguous += num_matches > 1;
+
+        if (s->check_decoder) {
+            struct la_op op;
+            la_match_insn(insn_word, &op);
+            const char *expected = first_match >= 0 ? s->matchers[first_match].mnemonic : "unk";
+            if (op.mnemonic != expected && strcmp(op.mnemonic, expected) != 0) {
+                if (r->decoder_mismatches++ == 0) {
+                    r->decoder_mismatch_example = insn_word;
+                }
+            }
+        }
+
+        if (first_match < 0) {
+            r->unmatched++;
+            if (!in_unmatched) {
+                in_unmatched = true;
+                unmatched_start = w;
+            }
+        } else if (in_unmatched) {
+            in_unmatched = false;
+            if (!push_range(c, unmatched_start, w - 1)) {
+                return false;
+            }
+        }
+    }
+
+    if (in_unmatched && !push_range(c, unmatched_start, last)) {
+        return false;
+    }
+
+    if (s->check_classifier) {
+        check_classifier(r, first, last);
+    }
+    return true;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *wk = arg;
+    struct sweep *s = wk->sweep;
+
+    for (;;) {
+        uint64_t i = atomic_fetch_add(&s->next_chunk, 1);
+        if (i >= s->num_chunks) {
+            break;
+        }
+        if (!sweep_chunk(s, s->first_chunk + i, &wk->result)) {
+            wk->result.failed = true;
+            break;
+        }
+    }
+    return NULL;
+}
+
+static bool init_buckets(struct sweep *s) {
+    la_insn_t bucket_mask = ~(la_insn_t)0 << (32 - BUCKET_BITS);
+
+    for (uint32_t b = 0; b < NUM_BUCKETS; b++) {
+        la_insn_t prefix = b << (32 - BUCKET_BITS);
+        s->bucket_cands[b] = malloc(s->num_matchers * sizeof(uint16_t));
+        if (s->bucket_cands[b] == NULL) {
+            return false;
+        }
+
+        /* keep table order, first match is the decoded one */
+        size_t n = 0;
+        for (size_t i = 0; i < s->num_matchers; i++) {
+            const struct la_disasm_matcher *m = &s->matchers[i];
+            if (((prefix ^ m->match) & m->mask & bucket_mask) == 0) {
+                s->bucket_cands[b][n++] = i;
+            }
+        }
+        s->bucket_num_cands[b] = n;
+    }
+    return true;
+}
+
+static bool init_thread_result(struct thread_result *r, size_t num_matchers) {
+    memset(r, 0, sizeof(*r));
+    r->hits = calloc(num_matchers, sizeof(*r->hits));
+    r->ambiguous_pairs = calloc(num_matchers * num_matchers, sizeof(*r->ambiguous_pairs));
+    r->ambiguous_example = calloc(num_matchers * num_matchers, sizeof(*r->ambiguous_example));
+    return r->hits != NULL && r->ambiguous_pairs != NULL && r->ambiguous_example != NULL;
+}
+
+static void fini_thread_result(struct thread_result *r) {
+    free(r->hits);
+    free(r->ambiguous_pairs);
+    free(r->ambiguous_example);
+}
+
+static int cmp_range_size_desc(const void *a, const void *b) {
+    const struct range *ra = a;
+    const struct range *rb = b;
+    uint64_t sa = ra->last - ra->first;
+    uint64_t sb = rb->last - rb->first;
+    if (sa != sb) {
+        return sa < sb ? 1 : -1;
+    }
+    return ra->first < rb->first ? -1 : ra->first > rb->first;
+}
+
+/* write out a merged unmatched range, keeping the largest few in `top` */
+static void emit_range(const struct range *r, FILE *out, struct range *top, size_t *num_top) {
+    if (out != NULL) {
+        fprintf(out, "0x%08" PRIx64 "-0x%08" PRIx64 "\n", r->first, r->last);
+    }
+
+    if (*num_top < NUM_TOP_RANGES) {
+        top[(*num_top)++] = *r;
+    } else if (cmp_range_size_desc(r, &top[*num_top - 1]) < 0) {
+        top[*num_top - 1] = *r;
+    } else {
+        return;
+    }
+    qsort(top, *num_top, sizeof(*top), cmp_range_size_desc);
+}
+
+static void report(struct sweep *s, struct thread_result *total, FILE *unmatched_out, double secs) {
+    uint64_t num_words = (uint64_t)s->last_word - s->first_word + 1;
+
+    printf("swept 0x%08" PRIx32 "-0x%08" PRIx32 ": %" PRIu64 " words in %.1f s\n",
+        s->first_word, s->last_word, num_words, secs);
+    printf("matched:    %12" PRIu64 " (%6.2f%%)\n",
+        num_words - total->unmatched, 100.0 * (num_words - total->unmatched) / num_words);
+    printf("unmatched:  %12" PRIu64 " (%6.2f%%)\n",
+        total->unmatched, 100.0 * total->unmatched / num_words);
+    printf("ambiguous:  %12" PRIu64 "\n", total->ambiguous);
+    if (s->check_decoder) {
+        printf("decoder mismatches: %" PRIu64, total->decoder_mismatches);
+        if (total->decoder_mismatches) {
+            printf(" (e.g. 0x%08" PRIx32 ")", total->decoder_mismatch_example);
+        }
+        printf("\n");
+    }
+    if (s->check_classifier) {
+        printf("classifier mismatches (%s): %" PRIu64,
+            la_classify_kernel_name(la_classify_current_kernel()), total->classify_mismatches);
+        if (total->classify_mismatches) {
+            printf(" (e.g. 0x%08" PRIx32 ")", total->classify_mismatch_example);
+        }
+        printf("\n");
+    }
+
+    printf("\n%-16s %12s %10s\n", "mnemonic", "words", "share");
+    for (size_t i = 0; i < s->num_matchers; i++) {
+        printf("%-16s %12" PRIu64 " %9.5f%%\n",
+            s->matchers[i].mnemonic, total->hits[i], 100.0 * total->hits[i] / num_words);
+    }
+
+    if (total->ambiguous) {
+        printf("\nambiguous encodings (first match wins):\n");
+        for (size_t a = 0; a < s->num_matchers; a++) {
+            for (size_t b = 0; b < s->num_matchers; b++) {
+                size_t pair = a * s->num_matchers + b;
+                if (total->ambiguous_pairs[pair] == 0) {
+                    continue;
+                }
+                printf("  %-12s shadows %-12s %12" PRIu64 " words, e.g. 0x%08" PRIx32 "\n",
+                    s->matchers[a].mnemonic, s->matchers[b].mnemonic,
+                    total->ambiguous_pairs[pair], total->ambiguous_example[pair]);
+            }
+        }
+    }
+
+    /* merge runs across chunk boundaries, in address order */
+    struct range top[NUM_TOP_RANGES];
+    size_t num_top = 0;
+    size_t num_ranges = 0;
+    struct range cur = { 0, 0 };
+    bool have_cur = false;
+    for (uint64_t i = 0; i < s->num_chunks; i++) {
+        const struct chunk_result *c = &s->chunks[i];
+        for (size_t j = 0; j < c->num_unmatched; j++) {
+            if (have_cur && c->unmatched[j].first == cur.last + 1) {
+                cur.last = c->unmatched[j].last;
+                continue;
+            }
+            if (have_cur) {
+                emit_range(&cur, unmatched_out, top, &num_top);
+                num_ranges++;
+            }
+            cur = c->unmatched[j];
+            have_cur = true;
+        }
+    }
+    if (have_cur) {
+        emit_range(&cur, unmatched_out, top, &num_top);
+        num_ranges++;
+    }
+
+    printf("\n%zu unmatched ranges, largest:\n", num_ranges);
+    for (size_t i = 0; i < num_top; i++) {
+        printf("  0x%08" PRIx64 "-0x%08" PRIx64 " %12" PRIu64 " words\n",
+            top[i].first, top[i].last, top[i].last - top[i].first + 1);
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-j THREADS] [-r FIRST-LAST] [-u UNMATCHED_FILE] [-c] [-k KERNEL]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    struct sweep s;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *unmatched_path = NULL;
+    FILE *unmatched_out = NULL;
+    int opt;
+    int ret = 0;
+
+    memset(&s, 0, sizeof(s));
+    s.first_word = 0;
+    s.last_word = 0xffffffff;
+
+    while ((opt = getopt(argc, argv, "j:r:u:ck:")) != -1) {
+        char *end;
+        switch (opt) {
+        case 'j':
+            num_threads = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            errno = 0;
+            s.first_word = strtoul(optarg, &end, 16);
+            if (*end != '-') {
+                usage(argv[0]);
+                return 2;
+            }
+            s.last_word = strtoul(end + 1, &end, 16);
+            if (errno != 0 || *end != '\0' || s.last_word < s.first_word) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'u':
+            unmatched_path = optarg;
+            break;
+        case 'c':
+            s.check_decoder = true;
+            break;
+        case 'k':
+            s.check_classifier = true;
+            for (int k = 0; k < LA_CLASSIFY_KERNEL_LAST; k++) {
+                if (strcmp(optarg, la_classify_kernel_name(k)) == 0) {
+                    if (!la_classify_use_kernel(k)) {
+                        fprintf(stderr, "kernel %s is not supported here\n", optarg);
+                        return 2;
+                    }
+                    break;
+                }
+                if (k == LA_CLASSIFY_KERNEL_LAST - 1) {
+                    usage(argv[0]);
+                    return 2;
+                }
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    s.matchers = la_matcher_table(&s.num_matchers);
+    if (s.num_matchers > MAX_MATCHERS || !init_buckets(&s)) {
+        fprintf(stderr, "cannot set up candidate buckets\n");
+        return 1;
+    }
+
+    s.first_chunk = s.first_word >> CHUNK_BITS;
+    s.num_chunks = (s.last_word >> CHUNK_BITS) - s.first_chunk + 1;
+    atomic_init(&s.next_chunk, 0);
+    s.chunks = calloc(s.num_chunks, sizeof(*s.chunks));
+
+    struct worker *workers = calloc(num_threads, sizeof(*workers));
+    if (s.chunks == NULL || workers == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long started = 0;
+    for (long i = 0; i < num_threads; i++) {
+        workers[i].sweep = &s;
+        if (!init_thread_result(&workers[i].result, s.num_matchers)) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "cannot start worker threads\n");
+        return 1;
+    }
+    for (long i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    /* merge per-thread results */
+    struct thread_result total;
+    if (!init_thread_result(&total, s.num_matchers)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (long i = 0; i < started; i++) {
+        struct thread_result *r = &workers[i].result;
+        if (r->failed) {
+            fprintf(stderr, "out of memory in worker thread\n");
+            return 1;
+        }
+        for (size_t m = 0; m < s.num_matchers; m++) {
+            total.hits[m] += r->hits[m];
+        }
+        for (size_t p = 0; p < s.num_matchers * s.num_matchers; p++) {
+            if (r->ambiguous_pairs[p] != 0 && total.ambiguous_pairs[p] == 0) {
+                total.ambiguous_example[p] = r->ambiguous_example[p];
+            }
+            total.ambiguous_pairs[p] += r->ambiguous_pairs[p];
+        }
+        total.unmatched += r->unmatched;
+        total.ambiguous += r->ambiguous;
+        if (r->decoder_mismatches != 0 && total.decoder_mismatches == 0) {
+            total.decoder_mismatch_example = r->decoder_mismatch_example;
+        }
+        total.decoder_mismatches += r->decoder_mismatches;
+        if (r->classify_mismatches != 0 && total.classify_mismatches == 0) {
+            total.classify_mismatch_example = r->classify_mismatch_example;
+        }
+        total.classify_mismatches += r->classify_mismatches;
+    }
+
+    if (unmatched_path != NULL) {
+        unmatched_out = fopen(unmatched_path, "w");
+        if (unmatched_out == NULL) {
+            perror(unmatched_path);
+            ret = 1;
+        }
+    }
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    report(&s, &total, unmatched_out, secs);
+
+    if (unmatched_out != NULL) {
+        fclose(unmatched_out);
+    }
+    if (total.decoder_mismatches != 0 || total.classify_mismatches != 0) {
+        ret = 1;
+    }
+
+    for (long i = 0; i < started; i++) {
+        fini_thread_result(&workers[i].result);
+    }
+    fini_thread_result(&total);
+    for (uint64_t i = 0; i < s.num_chunks; i++) {
+        free(s.chunks[i].unmatched);
+    }
+    for (uint32_t b = 0; b < NUM_BUCKETS; b++) {
+        free(s.bucket_cands[b]);
+    }
+    free(s.chunks);
+    free(workers);
+    return ret;
+}
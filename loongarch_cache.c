@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "r_loongarch.h"
+
+#define LA_CACHE_WAYS 2
+
+/*
+ * Two-way set-associative, the set is picked by the insn address so
+ * consecutive insns never evict each other. Each set remembers which way
+ * was used last and a miss replaces the other one.
+ */
+struct la_cache_set {
+    struct la_cached_insn ways[LA_CACHE_WAYS];
+    bool valid[LA_CACHE_WAYS];
+    uint8_t mru;
+};
+
+struct la_insn_cache {
+    struct la_cache_set *sets;
+    size_t set_mask;
+    struct la_insn_cache_stats stats;
+};
+
+static inline struct la_cache_set *set_of(const struct la_insn_cache *cache, uint64_t pc) {
+    return &cache->sets[(pc / INSN_LENGTH_BYTES) & cache->set_mask];
+}
+
+struct la_insn_cache *la_insn_cache_new(size_t max_bytes) {
+    struct la_insn_cache *cache = calloc(1, sizeof(*cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    /* round down to a power of two number of sets, but have at least one */
+    size_t num_sets = 1;
+    while (num_sets * 2 * sizeof(struct la_cache_set) <= max_bytes) {
+        num_sets *= 2;
+    }
+
+    cache->sets = calloc(num_sets, sizeof(struct la_cache_set));
+    if (cache->sets == NULL) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->set_mask = num_sets - 1;
+    cache->stats.capacity = num_sets * LA_CACHE_WAYS;
+    cache->stats.mem_size = sizeof(*cache) + num_sets * sizeof(struct la_cache_set);
+    return cache;
+}
+
+void la_insn_cache_free(struct la_insn_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    free(cache->sets);
+    free(cache);
+}
+
+const struct la_cached_insn *la_insn_cache_lookup(
+    struct la_insn_cache *cache,
+    uint64_t pc,
+    la_insn_t insn_word
+) {
+    struct la_cache_set *set = set_of(cache, pc);
+
+    for (int w = 0; w < LA_CACHE_WAYS; w++) {
+        struct la_cached_insn *e = &set->ways[w];
+        if (set->valid[w] && e->pc == pc && e->insn_word == insn_word) {
+            set->mru = w;
+            cache->stats.hits++;
+            return e;
+        }
+    }
+
+    /*
+     * Miss. An entry for the same pc but a different word (patched bytes)
+     * is stale, reuse its slot so it can never be hit again.
+     */
+    int victim = !set->mru;
+    for (int w = 0; w < LA_CACHE_WAYS; w++) {
+        if (set->valid[w] && set->ways[w].pc == pc) {
+            victim = w;
+            cache->stats.stale++;
+            break;
+        }
+    }
+
+    struct la_cached_insn *e = &set->ways[victim];
+    if (set->valid[victim] && e->pc != pc) {
+        cache->stats.evictions++;
+    }
+
+    e->pc = pc;
+    e->insn_word = insn_word;
+    la_match_insn(insn_word, &e->op);
+    e->text_len = la_print_insn(e->text, sizeof(e->text), &e->op, pc);
+
+    set->valid[victim] = true;
+    set->mru = victim;
+    cache->stats.misses++;
+    return e;
+}
+
+void la_insn_cache_invalidate(struct la_insn_cache *cache, uint64_t from, uint64_t to) {
+    if (to <= from) {
+        return;
+    }
+
+    /* a range larger than the cache covers every set anyway */
+    if (to - from >= (cache->set_mask + 1) * INSN_LENGTH_BYTES) {
+        la_insn_cache_clear(cache);
+        return;
+    }
+
+    for (uint64_t pc = from & ~(uint64_t)(INSN_LENGTH_BYTES - 1); pc < to; pc += INSN_LENGTH_BYTES) {
+        struct la_cache_set *set = set_of(cache, pc);
+        for (int w = 0; w < LA_CACHE_WAYS; w++) {
+            if (set->valid[w] && set->ways[w].pc == pc) {
+                set->valid[w] = false;
+                cache->stats.invalidations++;
+            }
+        }
+    }
+}
+
+void la_insn_cache_clear(struct la_insn_cache *cache) {
+    for (size_t i = 0; i <= cache->set_mask; i++) {
+        struct la_cache_set *set = &cache->sets[i];
+        for (int w = 0; w < LA_CACHE_WAYS; w++) {
+            cache->stats.invalidations += set->valid[w];
+            set->valid[w] = false;
+        }
+    }
+}
+
+void la_insn_cache_get_stats(const struct la_insn_cache *cache, struct la_insn_cache_stats *stats) {
+    *stats = cache->stats;
+}
@@ -0,0 +1,487 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "r_loongarch.h"
+
+/*
+ * Linear-sweep CFG builder.
+ *
+ * The first pass classifies the image in chunks, keeps the insn ids (one
+ * byte per insn) and sets a bit in the leader bitmap for the image start,
+ * every branch, jump and call target inside the image and every insn after
+ * a branch, jump or jalr zero, ... Only the few control-flow insns are fully
+ * decoded, to get their targets. Jump tables behind jalr zero, rj are
+ * recovered then too, and their cases become leaders.
+ *
+ * The second pass walks the set bits of the bitmap, so every block is the run
+ * of insns up to the next leader, and fills in the block and edge arrays in
+ * address order, decoding the control-flow insns again. Block indices of
+ * targets come from a rank over the bitmap, with no lookups.
+ */
+
+/* insns classified at a time in the first pass */
+#define CLASSIFY_CHUNK 4096
+
+enum flow {
+    FLOW_NONE,
+    FLOW_BRANCH,    /* conditional, ends the block */
+    FLOW_JUMP,      /* j */
+    FLOW_CALL,      /* jal */
+    FLOW_JALR,
+};
+
+static const uint8_t flow_of[LA_INSN_LAST] = {
+    [LA_INSN_BEQZ] = FLOW_BRANCH,
+    [LA_INSN_BNEZ] = FLOW_BRANCH,
+    [LA_INSN_BFP] = FLOW_BRANCH,
+    [LA_INSN_BEQ] = FLOW_BRANCH,
+    [LA_INSN_BNE] = FLOW_BRANCH,
+    [LA_INSN_BGT] = FLOW_BRANCH,
+    [LA_INSN_BLE] = FLOW_BRANCH,
+    [LA_INSN_BGTU] = FLOW_BRANCH,
+    [LA_INSN_BLEU] = FLOW_BRANCH,
+    [LA_INSN_J] = FLOW_JUMP,
+    [LA_INSN_JAL] = FLOW_CALL,
+    [LA_INSN_JALR] = FLOW_JALR,
+};
+
+/* jump tables found by the first pass, in address order */
+struct switch_list {
+    size_t *sites;          /* insn index of the jalr */
+    uint32_t *first_target; /* into targets, num_sites + 1 of them */
+    uint64_t *targets;
+    size_t num_sites;
+    size_t num_targets;
+    size_t capacity;        /* of sites */
+    size_t target_capacity;
+    size_t next;            /* the next one the second pass looks for */
+};
+
+static bool switch_list_add(struct switch_list *list, size_t site, const struct la_switch *sw) {
+    if (list->num_sites + 1 >= list->capacity) {
+        size_t capacity = list->capacity != 0 ? list->capacity * 2 : 64;
+        size_t *sites = realloc(list->sites, capacity * sizeof(*sites));
+        if (sites == NULL) {
+            return false;
+        }
+        list->sites = sites;
+        uint32_t *first_target = realloc(list->first_target, capacity * sizeof(*first_target));
+        if (first_target == NULL) {
+            return false;
+        }
+        list->first_target = first_target;
+        list->capacity = capacity;
+    }
+    if (list->num_targets + sw->num_cases > list->target_capacity) {
+        size_t capacity = list->target_capacity * 2 + sw->num_cases;
+        uint64_t *targets = realloc(list->targets, capacity * sizeof(*targets));
+        if (targets == NULL) {
+            return false;
+        }
+        list->targets = targets;
+        list->target_capacity = capacity;
+    }
+
+    list->sites[list->num_sites] = site;
+    list->first_target[list->num_sites] = list->num_targets;
+    memcpy(list->targets + list->num_targets, sw->targets, sw->num_cases * sizeof(*sw->targets));
+    list->num_targets += sw->num_cases;
+    list->num_sites++;
+    list->first_target[list->num_sites] = list->num_targets;
+    return true;
+}
+
+static void switch_list_free(struct switch_list *list) {
+    free(list->sites);
+    free(list->first_target);
+    free(list->targets);
+}
+
+static inline void set_bit(uint64_t *bitmap, size_t i) {
+    bitmap[i / 64] |= 1ULL << (i % 64);
+}
+
+/* insn index of `target`, or false if it is outside the image */
+static inline bool insn_index(const struct la_cfg *cfg, uint64_t target, size_t *index) {
+    if (target < cfg->pc || (target - cfg->pc) / INSN_LENGTH_BYTES >= cfg->num_insns) {
+        return false;
+    }
+    *index = (target - cfg->pc) / INSN_LENGTH_BYTES;
+    return true;
+}
+
+/* block index of the leader at insn `i`: set bits before it */
+static inline uint32_t rank(const struct la_cfg *cfg, const uint32_t *word_ranks, size_t i) {
+    uint64_t below = cfg->leaders[i / 64] & ((1ULL << (i % 64)) - 1);
+    return word_ranks[i / 64] + __builtin_popcountll(below);
+}
+
+/*
+ * Decode control-flow insn `i` for its flow, and target where it has one.
+ */
+static enum flow decode_flow(
+    const struct la_cfg *cfg,
+    const uint8_t *buf,
+    const uint8_t *ids,
+    size_t i,
+    uint64_t *target,
+    bool *jalr_links
+) {
+    struct la_op op;
+    la_decode_as(ids[i], la_read_insn_word(buf + i * INSN_LENGTH_BYTES), &op);
+
+    enum flow flow = flow_of[ids[i]];
+    if (flow == FLOW_JALR) {
+        *jalr_links = la_op_rd(&op) != LA_REG_ZERO;
+        *target = la_op_rj(&op);
+    } else {
+        la_op_jump_target(&op, cfg->pc + i * INSN_LENGTH_BYTES, target);
+    }
+    return flow;
+}
+
+/*
+ * Recover the jump table of the jalr at insn `i` and make its cases leaders.
+ *
+ * Returns false on allocation failure.
+ */
+static bool find_switch(
+    struct la_cfg *cfg,
+    const uint8_t *buf,
+    size_t i,
+    const struct la_switch_config *config,
+    struct la_switch_stats *stats,
+    struct switch_list *switches
+) {
+    struct la_switch sw;
+    size_t index;
+
+    if (la_switch_resolve(buf, cfg->num_insns * INSN_LENGTH_BYTES, cfg->pc, i, config, &sw, stats) != LA_SWITCH_RESOLVED) {
+        return true;
+    }
+    for (size_t k = 0; k < sw.num_cases; k++) {
+        if (insn_index(cfg, sw.targets[k], &index)) {
+            set_bit(cfg->leaders, index);
+        }
+    }
+    return switch_list_add(switches, i, &sw);
+}
+
+static bool find_leaders(
+    struct la_cfg *cfg,
+    const uint8_t *buf,
+    uint8_t *ids,
+    const struct la_switch_config *config,
+    struct la_switch_stats *stats,
+    struct switch_list *switches,
+    size_t *max_edges
+) {
+    uint8_t rd[CLASSIFY_CHUNK];
+    uint8_t rj[CLASSIFY_CHUNK];
+    uint8_t rk[CLASSIFY_CHUNK];
+    uint32_t imm[CLASSIFY_CHUNK];
+    size_t num_flow = 0;
+
+    if (cfg->num_insns != 0) {
+        set_bit(cfg->leaders, 0);
+    }
+
+    for (size_t base = 0; base < cfg->num_insns; base += CLASSIFY_CHUNK) {
+        const struct la_classify_out out = {
+            .ids = ids + base,
+            .rd = rd,
+            .rj = rj,
+            .rk = rk,
+            .imm = imm,
+        };
+        size_t n = la_classify_block(
+            buf + base * INSN_LENGTH_BYTES,
+            (cfg->num_insns - base) * INSN_LENGTH_BYTES,
+            &out,
+            CLASSIFY_CHUNK
+        );
+
+        for (size_t k = 0; k < n; k++) {
+            size_t i = base + k;
+            if (flow_of[ids[i]] == FLOW_NONE) {
+                continue;
+            }
+            num_flow++;
+
+            uint64_t target;
+            size_t index;
+            bool jalr_links = false;
+            enum flow flow = decode_flow(cfg, buf, ids, i, &target, &jalr_links);
+            if (flow != FLOW_JALR && insn_index(cfg, target, &index)) {
+                set_bit(cfg->leaders, index);
+            }
+            if ((flow == FLOW_JALR && !jalr_links) || flow == FLOW_BRANCH || flow == FLOW_JUMP) {
+                if (i + 1 < cfg->num_insns) {
+                    set_bit(cfg->leaders, i + 1);
+                }
+            }
+            /* for jalr, `target` is rj */
+            if (flow == FLOW_JALR && !jalr_links && target != LA_REG_RA) {
+                if (!find_switch(cfg, buf, i, config, stats, switches)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    /* one edge per control-flow insn and per case, plus a fall-through edge
+     * per block, which is added by the caller */
+    *max_edges = num_flow + switches->num_targets;
+    return true;
+}
+
+static void add_edge(
+    struct la_cfg *cfg,
+    const uint32_t *word_ranks,
+    uint32_t from,
+    enum la_cfg_edge_kind kind,
+    uint64_t src,
+    uint64_t target
+) {
+    struct la_cfg_edge *e = &cfg->edges[cfg->num_edges++];
+    size_t index;
+
+    e->src = src;
+    e->target = target;
+    e->from = from;
+    e->to = insn_index(cfg, target, &index) ? rank(cfg, word_ranks, index) : LA_CFG_NO_BLOCK;
+    e->kind = kind;
+}
+
+static void add_block_edges(
+    struct la_cfg *cfg,
+    const uint8_t *buf,
+    const uint8_t *ids,
+    const uint32_t *word_ranks,
+    struct switch_list *switches,
+    uint32_t k,
+    size_t start,
+    size_t end
+) {
+    struct la_cfg_block *b = &cfg->blocks[k];
+
+    b->first_edge = cfg->num_edges;
+    b->end = end < cfg->num_insns ? LA_CFG_END_FALLTHROUGH : LA_CFG_END_IMAGE;
+
+    /* only the last insn can end the block, but calls may come before it */
+    for (size_t i = start; i < end; i++) {
+        if (flow_of[ids[i]] == FLOW_NONE) {
+            continue;
+        }
+
+        uint64_t src = cfg->pc + i * INSN_LENGTH_BYTES;
+        uint64_t target;
+        bool jalr_links = false;
+        switch (decode_flow(cfg, buf, ids, i, &target, &jalr_links)) {
+        case FLOW_BRANCH:
+            add_edge(cfg, word_ranks, k, LA_CFG_EDGE_TAKEN, src, target);
+            b->end = LA_CFG_END_BRANCH;
+            break;
+        case FLOW_JUMP:
+            add_edge(cfg, word_ranks, k, LA_CFG_EDGE_JUMP, src, target);
+            b->end = LA_CFG_END_JUMP;
+            break;
+        case FLOW_CALL:
+            add_edge(cfg, word_ranks, k, LA_CFG_EDGE_CALL, src, target);
+            break;
+        case FLOW_JALR:
+            if (jalr_links) {
+                break;
+            }
+            b->end = target == LA_REG_RA ? LA_CFG_END_RETURN : LA_CFG_END_INDIRECT;
+            if (switches->next < switches->num_sites && switches->sites[switches->next] == i) {
+                size_t n = switches->next++;
+                for (uint32_t t = switches->first_target[n]; t < switches->first_target[n + 1]; t++) {
+                    add_edge(cfg, word_ranks, k, LA_CFG_EDGE_SWITCH, src, switches->targets[t]);
+                }
+                b->end = LA_CFG_END_SWITCH;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    bool falls_through = b->end == LA_CFG_END_FALLTHROUGH || b->end == LA_CFG_END_BRANCH;
+    if (falls_through && end < cfg->num_insns) {
+        add_edge(
+            cfg,
+            word_ranks,
+            k,
+            LA_CFG_EDGE_FALLTHROUGH,
+            cfg->pc + (end - 1) * INSN_LENGTH_BYTES,
+            cfg->pc + end * INSN_LENGTH_BYTES
+        );
+    }
+    b->num_edges = cfg->num_edges - b->first_edge;
+}
+
+static void finish_block(
+    struct la_cfg *cfg,
+    const uint8_t *buf,
+    const uint8_t *ids,
+    const uint32_t *word_ranks,
+    struct switch_list *switches,
+    size_t start,
+    size_t end
+) {
+    cfg->blocks[cfg->num_blocks - 1].num_insns = end - start;
+    add_block_edges(cfg, buf, ids, word_ranks, switches, cfg->num_blocks - 1, start, end);
+}
+
+static void form_blocks(
+    struct la_cfg *cfg,
+    const uint8_t *buf,
+    const uint8_t *ids,
+    const uint32_t *word_ranks,
+    struct switch_list *switches
+) {
+    size_t num_words = (cfg->num_insns + 63) / 64;
+    size_t prev = 0;
+
+    /* a block is finished once the next leader is found */
+    for (size_t w = 0; w < num_words; w++) {
+        for (uint64_t bits = cfg->leaders[w]; bits != 0; bits &= bits - 1) {
+            size_t start = w * 64 + __builtin_ctzll(bits);
+            if (cfg->num_blocks != 0) {
+                finish_block(cfg, buf, ids, word_ranks, switches, prev, start);
+            }
+            cfg->blocks[cfg->num_blocks++].addr = cfg->pc + start * INSN_LENGTH_BYTES;
+            prev = start;
+        }
+    }
+    if (cfg->num_blocks != 0) {
+        finish_block(cfg, buf, ids, word_ranks, switches, prev, cfg->num_insns);
+    }
+}
+
+struct la_cfg *la_cfg_build(const uint8_t *buf, size_t len, uint64_t pc) {
+    return la_cfg_build_switches(buf, len, pc, NULL, NULL);
+}
+
+struct la_cfg *la_cfg_build_switches(
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    const struct la_switch_config *config,
+    struct la_switch_stats *stats
+) {
+    struct switch_list switches = { 0 };
+    size_t num_insns = len / INSN_LENGTH_BYTES;
+    size_t num_words = (num_insns + 63) / 64;
+    struct la_cfg *cfg = NULL;
+    uint8_t *ids = NULL;
+    uint32_t *word_ranks = NULL;
+    size_t max_edges;
+
+    /* block and edge indices are 32 bits */
+    if (num_insns >= UINT32_MAX / 2) {
+        return NULL;
+    }
+
+    cfg = calloc(1, sizeof(*cfg));
+    ids = malloc(num_insns + 1);
+    word_ranks = malloc((num_words + 1) * sizeof(*word_ranks));
+    if (cfg == NULL || ids == NULL || word_ranks == NULL) {
+        goto fail;
+    }
+    cfg->pc = pc;
+    cfg->num_insns = num_insns;
+    cfg->leaders = calloc(num_words + 1, sizeof(*cfg->leaders));
+    if (cfg->leaders == NULL) {
+        goto fail;
+    }
+    if (!find_leaders(cfg, buf, ids, config, stats, &switches, &max_edges)) {
+        goto fail;
+    }
+
+    size_t num_blocks = 0;
+    for (size_t w = 0; w < num_words; w++) {
+        word_ranks[w] = num_blocks;
+        num_blocks += __builtin_popcountll(cfg->leaders[w]);
+    }
+    word_ranks[num_words] = num_blocks;
+
+    max_edges += num_blocks;
+    cfg->blocks = malloc((num_blocks + 1) * sizeof(*cfg->blocks));
+    cfg->edges = malloc((max_edges + 1) * sizeof(*cfg->edges));
+    if (cfg->blocks == NULL || cfg->edges == NULL) {
+        goto fail;
+    }
+
+    form_blocks(cfg, buf, ids, word_ranks, &switches);
+
+    switch_list_free(&switches);
+    free(word_ranks);
+    free(ids);
+    return cfg;
+
+fail:
+    switch_list_free(&switches);
+    free(word_ranks);
+    free(ids);
+    la_cfg_free(cfg);
+    return NULL;
+}
+
+void la_cfg_free(struct la_cfg *cfg) {
+    if (cfg == NULL) {
+        return;
+    }
+
+    free(cfg->leaders);
+    free(cfg->blocks);
+    free(cfg->edges);
+    free(cfg);
+}
+
+uint32_t la_cfg_block_at(const struct la_cfg *cfg, uint64_t addr) {
+    size_t lo = 0;
+    size_t hi = cfg->num_blocks;
+
+    if (addr < cfg->pc || (addr - cfg->pc) / INSN_LENGTH_BYTES >= cfg->num_insns) {
+        return LA_CFG_NO_BLOCK;
+    }
+
+    /* last block starting at or before addr */
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cfg->blocks[mid].addr <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+const char *la_cfg_edge_kind_name(enum la_cfg_edge_kind kind) {
+    switch (kind) {
+    case LA_CFG_EDGE_FALLTHROUGH: return "fallthrough";
+    case LA_CFG_EDGE_TAKEN:       return "taken";
+    case LA_CFG_EDGE_JUMP:        return "jump";
+    case LA_CFG_EDGE_CALL:        return "call";
+    case LA_CFG_EDGE_SWITCH:      return "switch";
+    default:                      return "?";
+    }
+}
+
+const char *la_cfg_block_end_name(enum la_cfg_block_end end) {
+    switch (end) {
+    case LA_CFG_END_FALLTHROUGH: return "fallthrough";
+    case LA_CFG_END_BRANCH:      return "branch";
+    case LA_CFG_END_JUMP:        return "jump";
+    case LA_CFG_END_RETURN:      return "return";
+    case LA_CFG_END_INDIRECT:    return "indirect";
+    case LA_CFG_END_SWITCH:      return "switch";
+    case LA_CFG_END_IMAGE:       return "image";
+    default:                     return "?";
+    }
+}
@@ -0,0 +1,539 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LA_CLASSIFY_X86 1
+#endif
+
+#include "r_loongarch.h"
+#include "loongarch_decode_tables.h"
+
+/*
+ * Bulk classifier.
+ *
+ * The AVX2 kernel walks the decode tree for 8 words at a time, gathering
+ * each word's next node until all of them sit at a leaf, and then applies the
+ * mask/match pairs of the leaf candidates, first match first. SSE2 has no
+ * gathers, so that kernel walks the tree one word at a time and only does the
+ * operand extraction in vectors. Either way the result is that of
+ * la_match_insn(), which the scalar reference kernel calls directly.
+ *
+ * Tree nodes are repacked into one word each for the gathers:
+ *
+ *   bits  0..4   selector shift
+ *   bits  5..8   selector width, 0 for leaves
+ *   bits  9..15  number of leaf candidates
+ *   bits 16..31  first child node, or first leaf candidate
+ *
+ * Operand extraction is driven by one parameter word per insn id:
+ *
+ *   bits  0..4   shift of the low immediate slice
+ *   bits  8..12  width of the low immediate slice
+ *   bits 16..25  mask of the high immediate slice, which is at bit 0 of the
+ *                word and ends up at bit 16 of the immediate
+ *   bit  26..28  the format has rd, rj, rk
+ */
+#define PARAM_HAS_SHIFT 26
+#define PARAM_HAS_RD (1U << 26)
+#define PARAM_HAS_RJ (1U << 27)
+#define PARAM_HAS_RK (1U << 28)
+#define PARAM_HI_MASK 0x3ff
+
+#define NODE_WIDTH_SHIFT 5
+#define NODE_COUNT_SHIFT 9
+#define NODE_BASE_SHIFT 16
+#define NODE_COUNT_MAX 0x7f
+
+#define NUM_NODES (sizeof(loongarch_decode_tree) / sizeof(loongarch_decode_tree[0]))
+#define NUM_CANDS (sizeof(loongarch_decode_cands) / sizeof(loongarch_decode_cands[0]))
+
+static uint32_t classify_params[LA_INSN_LAST];
+
+/* repacked decode tree, and candidates widened for 32-bit gathers */
+static uint32_t packed_nodes[NUM_NODES];
+static uint32_t packed_cands[NUM_CANDS];
+static uint32_t max_leaf_cands;
+static bool tree_packed;
+
+/* mask and match by insn id */
+static la_insn_t id_mask[LA_INSN_LAST];
+static la_insn_t id_match[LA_INSN_LAST];
+
+static size_t classify_scalar(const uint8_t *buf, size_t n, const struct la_classify_out *out);
+static size_t (*classify_kernel)(const uint8_t *, size_t, const struct la_classify_out *) = classify_scalar;
+static enum la_classify_kernel classify_kernel_id = LA_CLASSIFY_SCALAR;
+
+static uint32_t format_params(enum la_insn_format_t fmt) {
+    const uint32_t rd = PARAM_HAS_RD;
+    const uint32_t rj = PARAM_HAS_RJ;
+    const uint32_t rk = PARAM_HAS_RK;
+
+#define IMM(shift, width) ((shift) | ((width) << 8))
+#define IMM_HI(mask) ((mask) << 16)
+    switch (fmt) {
+    case LA_INSN_FORMAT_RR:     return rd | rj;
+    case LA_INSN_FORMAT_RRR:    return rd | rj | rk;
+    /* ra goes in imm */
+    case LA_INSN_FORMAT_FFFF:   return rd | rj | rk | IMM(15, 5);
+    case LA_INSN_FORMAT_RRI6:   return rd | rj | IMM(10, 6);
+    case LA_INSN_FORMAT_RRI8:   return rd | rj | IMM(10, 8);
+    case LA_INSN_FORMAT_RRI12:  return rd | rj | IMM(10, 12);
+    /* imm1 | imm2 << 6 */
+    case LA_INSN_FORMAT_RRI6I6: return rd | rj | IMM(10, 12);
+    case LA_INSN_FORMAT_RRI14:  return rd | rj | IMM(10, 14);
+    case LA_INSN_FORMAT_RRI16:  return rd | rj | IMM(10, 16);
+    case LA_INSN_FORMAT_AUI20:  return rd | IMM(5, 20);
+    case LA_INSN_FORMAT_RI21:   return rj | IMM(10, 16) | IMM_HI(0x1f);
+    /* the '?' bit 9 goes in imm bit 25 so that packed insns are lossless */
+    case LA_INSN_FORMAT_I25:    return IMM(10, 16) | IMM_HI(0x3ff);
+    default:                    return 0;
+    }
+#undef IMM
+#undef IMM_HI
+}
+
+static inline void extract_scalar(la_insn_t w, uint8_t id, const struct la_classify_out *out, size_t i) {
+    uint32_t p = classify_params[id];
+    uint32_t lo_mask = (1U << ((p >> 8) & 0x1f)) - 1;
+
+    out->ids[i] = id;
+    out->rd[i] = (p & PARAM_HAS_RD) ? (w & 0x1f) : LA_REG_NONE;
+    out->rj[i] = (p & PARAM_HAS_RJ) ? ((w >> 5) & 0x1f) : LA_REG_NONE;
+    out->rk[i] = (p & PARAM_HAS_RK) ? ((w >> 10) & 0x1f) : LA_REG_NONE;
+    out->imm[i] = ((w >> (p & 0x1f)) & lo_mask) | ((w & (p >> 16) & PARAM_HI_MASK) << 16);
+}
+
+/* la_match_insn without filling in a struct la_op, on the packed tree */
+static inline uint32_t walk_tree(la_insn_t w) {
+    uint32_t nd = packed_nodes[0];
+    uint32_t width;
+
+    while ((width = (nd >> NODE_WIDTH_SHIFT) & 0xf) != 0) {
+        uint32_t sel = (w >> (nd & 0x1f)) & ((1U << width) - 1);
+        nd = packed_nodes[(nd >> NODE_BASE_SHIFT) + sel];
+    }
+
+    uint32_t first = nd >> NODE_BASE_SHIFT;
+    uint32_t count = (nd >> NODE_COUNT_SHIFT) & NODE_COUNT_MAX;
+    for (uint32_t j = 0; j < count; j++) {
+        uint32_t id = packed_cands[first + j];
+        if ((w & id_mask[id]) == id_match[id]) {
+            return id;
+        }
+    }
+    return LA_INSN_UNK;
+}
+
+static size_t classify_scalar(const uint8_t *buf, size_t n, const struct la_classify_out *out) {
+    struct la_op op;
+
+    for (size_t i = 0; i < n; i++) {
+        la_insn_t w = la_read_insn_word(buf + i * INSN_LENGTH_BYTES);
+        la_match_insn(w, &op);
+        extract_scalar(w, op.id, out, i);
+    }
+    return n;
+}
+
+#ifdef LA_CLASSIFY_X86
+
+static inline void store_bytes4(uint8_t *dst, uint32_t v) {
+    memcpy(dst, &v, sizeof(v));
+}
+
+static size_t classify_sse2(const uint8_t *buf, size_t n, const struct la_classify_out *out) {
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i w = _mm_loadu_si128((const __m128i *)(buf + i * INSN_LENGTH_BYTES));
+        uint32_t id[4];
+
+        for (int lane = 0; lane < 4; lane++) {
+            id[lane] = walk_tree(la_read_insn_word(buf + (i + lane) * INSN_LENGTH_BYTES));
+        }
+        __m128i ids = _mm_loadu_si128((const __m128i *)id);
+
+        /* no gathers in SSE2, look the parameters up one by one */
+        __m128i p = _mm_set_epi32(
+            classify_params[id[3]],
+            classify_params[id[2]],
+            classify_params[id[1]],
+            classify_params[id[0]]
+        );
+
+        /* regs packed as rd | rj << 8 | rk << 16, absent ones LA_REG_NONE */
+        const __m128i reg_mask = _mm_set1_epi32(0x1f);
+        __m128i regs = _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(w, reg_mask),
+                _mm_and_si128(_mm_slli_epi32(w, 3), _mm_slli_epi32(reg_mask, 8))
+            ),
+            _mm_and_si128(_mm_slli_epi32(w, 6), _mm_slli_epi32(reg_mask, 16))
+        );
+        __m128i keep = _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(
+                    _mm_cmpeq_epi32(_mm_and_si128(p, _mm_set1_epi32(PARAM_HAS_RD)), _mm_set1_epi32(PARAM_HAS_RD)),
+                    _mm_set1_epi32(0xff)
+                ),
+                _mm_and_si128(
+                    _mm_cmpeq_epi32(_mm_and_si128(p, _mm_set1_epi32(PARAM_HAS_RJ)), _mm_set1_epi32(PARAM_HAS_RJ)),
+                    _mm_set1_epi32(0xff00)
+                )
+            ),
+            _mm_and_si128(
+                _mm_cmpeq_epi32(_mm_and_si128(p, _mm_set1_epi32(PARAM_HAS_RK)), _mm_set1_epi32(PARAM_HAS_RK)),
+                _mm_set1_epi32(0xff0000)
+            )
+        );
+        regs = _mm_or_si128(
+            _mm_and_si128(regs, keep),
+            _mm_andnot_si128(keep, _mm_set1_epi32(0xffffff))
+        );
+
+        /* the low slice starts at bit 5, 10 or 15 */
+        __m128i shift = _mm_and_si128(p, _mm_set1_epi32(0x1f));
+        __m128i is5 = _mm_cmpeq_epi32(shift, _mm_set1_epi32(5));
+        __m128i is15 = _mm_cmpeq_epi32(shift, _mm_set1_epi32(15));
+        __m128i lo = _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(is5, _mm_srli_epi32(w, 5)),
+                _mm_and_si128(is15, _mm_srli_epi32(w, 15))
+            ),
+            _mm_andnot_si128(_mm_or_si128(is5, is15), _mm_srli_epi32(w, 10))
+        );
+        /* (1 << width) - 1, width <= 20 is exact as a float exponent */
+        __m128i width = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0x1f));
+        __m128i pow2 = _mm_castps_si128(_mm_castsi128_ps(
+            _mm_slli_epi32(_mm_add_epi32(width, _mm_set1_epi32(127)), 23)
+        ));
+        __m128i lo_mask = _mm_sub_epi32(_mm_cvttps_epi32(_mm_castsi128_ps(pow2)), _mm_set1_epi32(1));
+        __m128i hi_mask = _mm_and_si128(_mm_srli_epi32(p, 16), _mm_set1_epi32(PARAM_HI_MASK));
+        __m128i imm = _mm_or_si128(
+            _mm_and_si128(lo, lo_mask),
+            _mm_slli_epi32(_mm_and_si128(w, hi_mask), 16)
+        );
+        _mm_storeu_si128((__m128i *)(out->imm + i), imm);
+
+        /* transpose id | regs << 8 into the four byte arrays */
+        __m128i packed = _mm_or_si128(ids, _mm_slli_epi32(regs, 8));
+        __m128i t = _mm_unpacklo_epi8(packed, _mm_srli_si128(packed, 4));
+        __m128i u = _mm_unpacklo_epi8(_mm_srli_si128(packed, 8), _mm_srli_si128(packed, 12));
+        __m128i v = _mm_unpacklo_epi16(t, u);
+        store_bytes4(out->ids + i, (uint32_t)_mm_cvtsi128_si32(v));
+        store_bytes4(out->rd + i, (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 4)));
+        store_bytes4(out->rj + i, (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 8)));
+        store_bytes4(out->rk + i, (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 12)));
+    }
+
+    /* tail */
+    struct la_classify_out rest = {
+        out->ids + i, out->rd + i, out->rj + i, out->rk + i, out->imm + i
+    };
+    return i + classify_scalar(buf + i * INSN_LENGTH_BYTES, n - i, &rest);
+}
+
+__attribute__((target("avx2")))
+static size_t classify_avx2(const uint8_t *buf, size_t n, const struct la_classify_out *out) {
+    const __m256i all = _mm256_set1_epi32(-1);
+    /* within each 128-bit half: bytes 0 of all lanes, then 1, 2 and 3 */
+    const __m256i transpose = _mm256_setr_epi8(
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15
+    );
+    const __m256i halves = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i one = _mm256_set1_epi32(1);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i w = _mm256_loadu_si256((const __m256i *)(buf + i * INSN_LENGTH_BYTES));
+        __m256i node = _mm256_setzero_si256();
+        __m256i nd = _mm256_set1_epi32(packed_nodes[0]);
+
+        /* descend until every word is at a leaf */
+        for (;;) {
+            __m256i width = _mm256_and_si256(_mm256_srli_epi32(nd, NODE_WIDTH_SHIFT), _mm256_set1_epi32(0xf));
+            __m256i inner = _mm256_xor_si256(_mm256_cmpeq_epi32(width, _mm256_setzero_si256()), all);
+            if (_mm256_testz_si256(inner, inner)) {
+                break;
+            }
+            __m256i sel = _mm256_and_si256(
+                _mm256_srlv_epi32(w, _mm256_and_si256(nd, _mm256_set1_epi32(0x1f))),
+                _mm256_sub_epi32(_mm256_sllv_epi32(one, width), one)
+            );
+            __m256i child = _mm256_add_epi32(_mm256_srli_epi32(nd, NODE_BASE_SHIFT), sel);
+            node = _mm256_blendv_epi8(node, child, inner);
+            nd = _mm256_i32gather_epi32((const int *)packed_nodes, node, 4);
+        }
+
+        /* match the leaf candidates in order, first match wins */
+        __m256i first = _mm256_srli_epi32(nd, NODE_BASE_SHIFT);
+        __m256i count = _mm256_and_si256(_mm256_srli_epi32(nd, NODE_COUNT_SHIFT), _mm256_set1_epi32(NODE_COUNT_MAX));
+        __m256i ids = _mm256_set1_epi32(LA_INSN_UNK);
+        __m256i pending = all;
+        for (uint32_t j = 0; j < max_leaf_cands; j++) {
+            __m256i valid = _mm256_and_si256(_mm256_cmpgt_epi32(count, _mm256_set1_epi32(j)), pending);
+            if (_mm256_testz_si256(valid, valid)) {
+                break;
+            }
+            __m256i cand = _mm256_mask_i32gather_epi32(
+                all, (const int *)packed_cands, _mm256_add_epi32(first, _mm256_set1_epi32(j)), valid, 4
+            );
+            __m256i mask = _mm256_mask_i32gather_epi32(
+                _mm256_setzero_si256(), (const int *)id_mask, cand, valid, 4
+            );
+            __m256i match = _mm256_mask_i32gather_epi32(
+                all, (const int *)id_match, cand, valid, 4
+            );
+            __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(w, mask), match), valid);
+            ids = _mm256_blendv_epi8(ids, cand, hit);
+            pending = _mm256_andnot_si256(hit, pending);
+        }
+
+        __m256i p = _mm256_i32gather_epi32((const int *)classify_params, ids, 4);
+
+        /* regs packed as rd | rj << 8 | rk << 16, absent ones LA_REG_NONE */
+        const __m256i reg_mask = _mm256_set1_epi32(0x1f);
+        __m256i regs = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_and_si256(w, reg_mask),
+                _mm256_and_si256(_mm256_slli_epi32(w, 3), _mm256_slli_epi32(reg_mask, 8))
+            ),
+            _mm256_and_si256(_mm256_slli_epi32(w, 6), _mm256_slli_epi32(reg_mask, 16))
+        );
+        /* move the has_* bits to the sign bit of their byte and widen */
+        __m256i has = _mm256_srli_epi32(p, PARAM_HAS_SHIFT);
+        __m256i keep = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(has, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)), _mm256_set1_epi32(0xff)),
+                _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(has, _mm256_set1_epi32(2)), _mm256_set1_epi32(2)), _mm256_set1_epi32(0xff00))
+            ),
+            _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(has, _mm256_set1_epi32(4)), _mm256_set1_epi32(4)), _mm256_set1_epi32(0xff0000))
+        );
+        regs = _mm256_or_si256(
+            _mm256_and_si256(regs, keep),
+            _mm256_andnot_si256(keep, _mm256_set1_epi32(0xffffff))
+        );
+
+        __m256i shift = _mm256_and_si256(p, _mm256_set1_epi32(0x1f));
+        __m256i width = _mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0x1f));
+        __m256i lo_mask = _mm256_sub_epi32(_mm256_sllv_epi32(_mm256_set1_epi32(1), width), _mm256_set1_epi32(1));
+        __m256i hi_mask = _mm256_and_si256(_mm256_srli_epi32(p, 16), _mm256_set1_epi32(PARAM_HI_MASK));
+        __m256i imm = _mm256_or_si256(
+            _mm256_and_si256(_mm256_srlv_epi32(w, shift), lo_mask),
+            _mm256_slli_epi32(_mm256_and_si256(w, hi_mask), 16)
+        );
+        _mm256_storeu_si256((__m256i *)(out->imm + i), imm);
+
+        /* transpose id | regs << 8 into the four byte arrays */
+        __m256i packed = _mm256_or_si256(ids, _mm256_slli_epi32(regs, 8));
+        packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(packed, transpose), halves);
+        _mm_storel_epi64((__m128i *)(out->ids + i), _mm256_castsi256_si128(packed));
+        _mm_storel_epi64((__m128i *)(out->rd + i), _mm_srli_si128(_mm256_castsi256_si128(packed), 8));
+        _mm_storel_epi64((__m128i *)(out->rj + i), _mm256_extracti128_si256(packed, 1));
+        _mm_storel_epi64((__m128i *)(out->rk + i), _mm_srli_si128(_mm256_extracti128_si256(packed, 1), 8));
+    }
+
+    /* tail */
+    struct la_classify_out rest = {
+        out->ids + i, out->rd + i, out->rj + i, out->rk + i, out->imm + i
+    };
+    return i + classify_scalar(buf + i * INSN_LENGTH_BYTES, n - i, &rest);
+}
+
+#endif  /* LA_CLASSIFY_X86 */
+
+static bool pack_tree(void) {
+    for (size_t i = 0; i < NUM_NODES; i++) {
+        const struct la_decode_node *node = &loongarch_decode_tree[i];
+        if (node->shift > 0x1f || node->width > 0xf || node->count > NODE_COUNT_MAX) {
+            return false;
+        }
+        packed_nodes[i] = node->shift
+            | (uint32_t)node->width << NODE_WIDTH_SHIFT
+            | (uint32_t)node->count << NODE_COUNT_SHIFT
+            | (uint32_t)node->base << NODE_BASE_SHIFT;
+        if (node->width == 0 && node->count > max_leaf_cands) {
+            max_leaf_cands = node->count;
+        }
+    }
+    for (size_t i = 0; i < NUM_CANDS; i++) {
+        packed_cands[i] = loongarch_decode_cands[i];
+    }
+    return true;
+}
+
+static bool kernel_supported(enum la_classify_kernel kernel) {
+    switch (kernel) {
+    case LA_CLASSIFY_SCALAR:
+        return true;
+#ifdef LA_CLASSIFY_X86
+    case LA_CLASSIFY_SSE2:
+        return tree_packed && __builtin_cpu_supports("sse2");
+    case LA_CLASSIFY_AVX2:
+        return tree_packed && __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+__attribute__((constructor))
+static void classify_init(void) {
+    for (size_t i = 0; i < LA_DECODE_NUM_MATCHERS; i++) {
+        const struct la_disasm_matcher *m = &loongarch_disasm_data[i];
+        classify_params[i] = format_params(m->fmt);
+        id_mask[i] = m->mask;
+        id_match[i] = m->match;
+    }
+    classify_params[LA_INSN_UNK] = 0;
+
+    tree_packed = pack_tree();
+
+#ifdef LA_CLASSIFY_X86
+    __builtin_cpu_init();
+#endif
+    /* pick the best supported kernel */
+    for (int k = LA_CLASSIFY_KERNEL_LAST - 1; k >= 0; k--) {
+        if (la_classify_use_kernel(k)) {
+            break;
+        }
+    }
+}
+
+bool la_classify_use_kernel(enum la_classify_kernel kernel) {
+    if (!kernel_supported(kernel)) {
+        return false;
+    }
+
+    switch (kernel) {
+#ifdef LA_CLASSIFY_X86
+    case LA_CLASSIFY_SSE2:
+        classify_kernel = classify_sse2;
+        break;
+    case LA_CLASSIFY_AVX2:
+        classify_kernel = classify_avx2;
+        break;
+#endif
+    default:
+        classify_kernel = classify_scalar;
+        break;
+    }
+    classify_kernel_id = kernel;
+    return true;
+}
+
+enum la_classify_kernel la_classify_current_kernel(void) {
+    return classify_kernel_id;
+}
+
+const char *la_classify_kernel_name(enum la_classify_kernel kernel) {
+    switch (kernel) {
+    case LA_CLASSIFY_SCALAR: return "scalar";
+    case LA_CLASSIFY_SSE2:   return "sse2";
+    case LA_CLASSIFY_AVX2:   return "avx2";
+    default:                 return "?";
+    }
+}
+
+size_t la_classify_block(
+    const uint8_t *buf,
+    size_t len,
+    const struct la_classify_out *out,
+    size_t max_insns
+) {
+    size_t n = len / INSN_LENGTH_BYTES;
+    if (n > max_insns) {
+        n = max_insns;
+    }
+
+    return classify_kernel(buf, n, out);
+}
+
+struct la_packed_insns *la_packed_new(size_t capacity) {
+    struct la_packed_insns *packed = calloc(1, sizeof(*packed));
+    if (packed == NULL) {
+        return NULL;
+    }
+
+    /* one allocation, the immediates first to keep them aligned */
+    uint8_t *mem = malloc(capacity * LA_PACKED_INSN_SIZE);
+    if (mem == NULL) {
+        free(packed);
+        return NULL;
+    }
+
+    packed->insns.imm = (uint32_t *)mem;
+    packed->insns.ids = mem + capacity * sizeof(uint32_t);
+    packed->insns.rd = packed->insns.ids + capacity;
+    packed->insns.rj = packed->insns.rd + capacity;
+    packed->insns.rk = packed->insns.rj + capacity;
+    packed->capacity = capacity;
+    return packed;
+}
+
+void la_packed_free(struct la_packed_insns *packed) {
+    if (packed == NULL) {
+        return;
+    }
+
+    free(packed->insns.imm);
+    free(packed);
+}
+
+size_t la_packed_append(struct la_packed_insns *packed, const uint8_t *buf, size_t len) {
+    size_t base = packed->num_insns;
+    const struct la_classify_out out = {
+        packed->insns.ids + base,
+        packed->insns.rd + base,
+        packed->insns.rj + base,
+        packed->insns.rk + base,
+        packed->insns.imm + base
+    };
+
+    size_t n = la_classify_block(buf, len, &out, packed->capacity - base);
+
+    /* unk has no operand fields, keep the word so it can be rebuilt */
+    for (size_t i = 0; i < n; i++) {
+        if (out.ids[i] == LA_INSN_UNK) {
+            out.imm[i] = la_read_insn_word(buf + i * INSN_LENGTH_BYTES);
+        }
+    }
+
+    packed->num_insns += n;
+    return n;
+}
+
+la_insn_t la_packed_insn_word(const struct la_packed_insns *packed, size_t i) {
+    uint8_t id = packed->insns.ids[i];
+    uint32_t imm = packed->insns.imm[i];
+
+    if (id == LA_INSN_UNK) {
+        return imm;
+    }
+
+    /* extract_scalar() backwards; fields inside the mask agree with match */
+    uint32_t p = classify_params[id];
+    uint32_t lo_mask = (1U << ((p >> 8) & 0x1f)) - 1;
+    la_insn_t w = id_match[id]
+        | (imm & lo_mask) << (p & 0x1f)
+        | ((imm >> 16) & (p >> 16) & PARAM_HI_MASK);
+
+    if (packed->insns.rd[i] != LA_REG_NONE) {
+        w |= packed->insns.rd[i];
+    }
+    if (packed->insns.rj[i] != LA_REG_NONE) {
+        w |= (la_insn_t)packed->insns.rj[i] << 5;
+    }
+    if (packed->insns.rk[i] != LA_REG_NONE) {
+        w |= (la_insn_t)packed->insns.rk[i] << 10;
+    }
+    return w;
+}
+
+int la_packed_expand(const struct la_packed_insns *packed, size_t i, struct la_op *out) {
+    return la_decode_as(packed->insns.ids[i], la_packed_insn_word(packed, i), out);
+}
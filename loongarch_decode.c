@@ -0,0 +1,700 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "r_loongarch.h"
+
+/* register names are at most 4 chars, stored with their lengths */
+struct la_reg_name {
+    char name[5];       /* NUL-terminated for la_reg_name() */
+    uint8_t len;
+};
+
+#define R(x) { x, sizeof(x) - 1 }
+static const struct la_reg_name loongarch_reg_names_gpr[] = {
+    R("zero"), R("ra"), R("tp"), R("sp"),   /* 0 .. 3 */
+    R("a0"), R("a1"), R("a2"), R("a3"),     /* 4 .. 7 */
+    R("a4"), R("a5"), R("a6"), R("a7"),     /* 8 .. 11 */
+    R("t0"), R("t1"), R("t2"), R("t3"),     /* 12 .. 15 */
+    R("t4"), R("t5"), R("t6"), R("at"),     /* 16 .. 19 */
+    R("t8"), R("gp"), R("s9"), R("s0"),     /* 20 .. 23 */
+    R("s1"), R("s2"), R("s3"), R("s4"),     /* 24 .. 27 */
+    R("s5"), R("s6"), R("s7"), R("s8")      /* 28 .. 31 */
+};
+
+static const struct la_reg_name loongarch_reg_names_fpr[] = {
+    R("f0"), R("f1"), R("f2"), R("f3"),     /* 0 .. 3 */
+    R("f4"), R("f5"), R("f6"), R("f7"),     /* 4 .. 7 */
+    R("f8"), R("f9"), R("f10"), R("f11"),   /* 8 .. 11 */
+    R("f12"), R("f13"), R("f14"), R("f15"), /* 12 .. 15 */
+    R("f16"), R("f17"), R("f18"), R("f19"), /* 16 .. 19 */
+    R("f20"), R("f21"), R("f22"), R("f23"), /* 20 .. 23 */
+    R("fs0"), R("fs1"), R("fs2"), R("fs3"), /* 24 .. 27 */
+    R("fs4"), R("fs5"), R("fs6"), R("fs7")  /* 28 .. 31 */
+};
+#undef R
+
+/* matcher table, decode tree and operand extractors, see insns.txt */
+#include "loongarch_decode_tables.h"
+
+#ifdef LA_DECODE_STATS
+static inline struct la_decode_stats *stats_local(void) {
+    struct la_decode_stats *s = la_stats_local;
+    return s != NULL ? s : la_stats_register();
+}
+
+/* only the owning thread writes, relaxed so that readers may sum */
+#define STATS_ADD(field, n) \
+    __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED)
+
+static inline void stats_count_match(enum la_insn_id id, size_t probes) {
+    struct la_decode_stats *s = stats_local();
+    STATS_ADD(s->hits[id], 1);
+    STATS_ADD(s->probes[probes < LA_STATS_PROBES_MAX ? probes : LA_STATS_PROBES_MAX], 1);
+}
+#define STATS_MATCH(id, probes) stats_count_match(id, probes)
+#else
+#define STATS_MATCH(id, probes) ((void)0)
+#endif
+
+static int32_t simm_from_uimm(uint32_t uimm, uint8_t width) {
+    uint32_t a = 1 << width;
+    uint32_t b = a >> 1;
+
+    if (uimm < b) {
+        return (int32_t)uimm;
+    } else {
+        return -((int32_t)(a - uimm));
+    }
+}
+
+static int fill_op(
+    const struct la_disasm_matcher *m,
+    la_insn_t insn_word,
+    struct la_op *out
+) {
+    /* fill in output */
+    out->mnemonic = m->mnemonic;
+    out->id = m - loongarch_disasm_data;
+    out->fmt = m->fmt;
+    out->render_flags = m->render_flags;
+    if (!la_extract_operands(m->fmt, insn_word, out)) {
+        return 0;
+    }
+
+    /* indicate success */
+    return 4;
+}
+
+static int fill_unk(la_insn_t insn_word, struct la_op *out) {
+    out->mnemonic = "unk";
+    out->id = LA_INSN_UNK;
+    out->fmt = LA_INSN_FORMAT_UNKNOWN;
+    out->render_flags = 0;
+    out->insn.unknown = insn_word;
+    return 4;
+}
+
+int la_match_insn(la_insn_t insn_word, struct la_op *out) {
+    const struct la_decode_node *node = loongarch_decode_tree;
+    while (node->width != 0) {
+        la_insn_t sel = (insn_word >> node->shift) & ((1U << node->width) - 1);
+        node = &loongarch_decode_tree[node->base + sel];
+    }
+
+    const uint16_t *cand = &loongarch_decode_cands[node->base];
+    for (size_t i = 0; i < node->count; i++) {
+        const struct la_disasm_matcher *ptr = &loongarch_disasm_data[cand[i]];
+        if ((insn_word & ptr->mask) == ptr->match) {
+            STATS_MATCH(cand[i], i + 1);
+            return fill_op(ptr, insn_word, out);
+        }
+    }
+
+    /* all matches missed */
+    STATS_MATCH(LA_INSN_UNK, node->count);
+    return fill_unk(insn_word, out);
+}
+
+int la_decode_as(enum la_insn_id id, la_insn_t insn_word, struct la_op *out) {
+    if (id >= LA_DECODE_NUM_MATCHERS) {
+        return fill_unk(insn_word, out);
+    }
+    return fill_op(&loongarch_disasm_data[id], insn_word, out);
+}
+
+const struct la_disasm_matcher *la_matcher_table(size_t *num_matchers) {
+    *num_matchers = LA_DECODE_NUM_MATCHERS;
+    return loongarch_disasm_data;
+}
+
+static inline uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t la_matcher_table_hash(void) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    /* field by field, padding would make it differ between builds */
+    for (size_t i = 0; i < LA_DECODE_NUM_MATCHERS; i++) {
+        const struct la_disasm_matcher *m = &loongarch_disasm_data[i];
+        uint32_t fields[5] = {
+            m->fmt, m->match, m->mask, m->render_flags,
+            m->reads | m->writes << 8 | (uint32_t)m->fprs << 16,
+        };
+        h = fnv1a(h, m->mnemonic, strlen(m->mnemonic) + 1);
+        h = fnv1a(h, fields, sizeof(fields));
+    }
+    return h;
+}
+
+la_reg_t la_op_rd(const struct la_op *op) {
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_RR:     return op->insn.rr.rd;
+    case LA_INSN_FORMAT_RRR:    return op->insn.rrr.rd;
+    case LA_INSN_FORMAT_FFFF:   return op->insn.ffff.rd;
+    case LA_INSN_FORMAT_RRI6:   return op->insn.rri6.rd;
+    case LA_INSN_FORMAT_RRI8:   return op->insn.rri8.rd;
+    case LA_INSN_FORMAT_RRI12:  return op->insn.rri12.rd;
+    case LA_INSN_FORMAT_RRI6I6: return op->insn.rri6i6.rd;
+    case LA_INSN_FORMAT_RRI14:  return op->insn.rri14.rd;
+    case LA_INSN_FORMAT_RRI16:  return op->insn.rri16.rd;
+    case LA_INSN_FORMAT_AUI20:  return op->insn.aui20.rd;
+    default:                    return LA_REG_NONE;
+    }
+}
+
+la_reg_t la_op_rj(const struct la_op *op) {
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_RR:     return op->insn.rr.rj;
+    case LA_INSN_FORMAT_RRR:    return op->insn.rrr.rj;
+    case LA_INSN_FORMAT_FFFF:   return op->insn.ffff.rj;
+    case LA_INSN_FORMAT_RRI6:   return op->insn.rri6.rj;
+    case LA_INSN_FORMAT_RRI8:   return op->insn.rri8.rj;
+    case LA_INSN_FORMAT_RRI12:  return op->insn.rri12.rj;
+    case LA_INSN_FORMAT_RRI6I6: return op->insn.rri6i6.rj;
+    case LA_INSN_FORMAT_RRI14:  return op->insn.rri14.rj;
+    case LA_INSN_FORMAT_RRI16:  return op->insn.rri16.rj;
+    case LA_INSN_FORMAT_RI21:   return op->insn.ri21.rj;
+    default:                    return LA_REG_NONE;
+    }
+}
+
+la_reg_t la_op_rk(const struct la_op *op) {
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_RRR:    return op->insn.rrr.rk;
+    case LA_INSN_FORMAT_FFFF:   return op->insn.ffff.rk;
+    default:                    return LA_REG_NONE;
+    }
+}
+
+/*
+ * Registers of the given slots, the fields packed as in the insn word (rd at
+ * bit 0, rj at 5, rk at 10, ra at 15). Branch-free, as which slots are used
+ * changes from insn to insn.
+ */
+static inline la_regset_t slot_regs(unsigned slots, unsigned fpr, uint32_t fields) {
+    la_regset_t set = 0;
+#define SLOT_REG(i) \
+    set |= ((la_regset_t)1 << (((fields >> (5 * (i))) & 0x1f) + ((fpr >> (i) & 1) << 5))) \
+        & -(la_regset_t)(slots >> (i) & 1)
+    SLOT_REG(0);
+    SLOT_REG(1);
+    SLOT_REG(2);
+    SLOT_REG(3);
+#undef SLOT_REG
+    set |= LA_REGSET_GPR(LA_REG_RA) & -(la_regset_t)(slots >> 4 & 1);
+    return set & ~LA_REGSET_GPR(LA_REG_ZERO);
+}
+
+void la_insn_regs(enum la_insn_id id, la_insn_t insn_word, la_regset_t *use, la_regset_t *def) {
+    if (id >= LA_INSN_LAST) {
+        id = LA_INSN_UNK;
+    }
+
+    /* the sentinel entry of unk reads and writes nothing */
+    const struct la_disasm_matcher *m = &loongarch_disasm_data[id];
+
+    *use = slot_regs(m->reads, m->fprs, insn_word);
+    *def = slot_regs(m->writes, m->fprs, insn_word);
+}
+
+void la_op_regs(const struct la_op *op, la_regset_t *use, la_regset_t *def) {
+    const struct la_disasm_matcher *m = &loongarch_disasm_data[op->id < LA_INSN_LAST ? op->id : LA_INSN_UNK];
+    /* LA_REG_NONE of a missing slot is masked off, the slot is unused */
+    uint32_t fields = (la_op_rd(op) & 0x1f)
+        | (uint32_t)(la_op_rj(op) & 0x1f) << 5
+        | (uint32_t)(la_op_rk(op) & 0x1f) << 10
+        | (op->fmt == LA_INSN_FORMAT_FFFF ? (uint32_t)op->insn.ffff.ra << 15 : 0);
+
+    /* slots the format lacks are never read or written */
+    *use = slot_regs(m->reads, m->fprs, fields);
+    *def = slot_regs(m->writes, m->fprs, fields);
+}
+
+void la_insn_abi_regs(enum la_insn_id id, la_insn_t insn_word, la_regset_t *use, la_regset_t *def) {
+    la_insn_regs(id, insn_word, use, def);
+
+    /* rd at bit 0 and rj at 5, as in every format */
+    la_reg_t rd = insn_word & 0x1f;
+    la_reg_t rj = (insn_word >> 5) & 0x1f;
+    if (id == LA_INSN_JAL || (id == LA_INSN_JALR && rd != LA_REG_ZERO)) {
+        /* calls return, but not with the others as they were */
+        *use |= LA_ABI_ARGS;
+        *def |= LA_ABI_CALL_CLOBBERED;
+    } else if (id == LA_INSN_JALR && rj == LA_REG_RA) {
+        *use |= LA_ABI_RESULTS | LA_ABI_CALL_PRESERVED;
+    }
+}
+
+const char *la_reg_name(la_reg_t reg, bool fpr) {
+    if (reg >= 32) {
+        return NULL;
+    }
+    return fpr ? loongarch_reg_names_fpr[reg].name : loongarch_reg_names_gpr[reg].name;
+}
+
+bool la_op_imm(const struct la_op *op, int64_t *imm) {
+    bool print_hex = (op->render_flags & RENDER_FLAG_PRINT_IMM_HEX) != 0;
+    bool minus_32 = (op->render_flags & RENDER_FLAG_IMM_MINUS_32) != 0;
+    bool shl_2 = (op->render_flags & RENDER_FLAG_IMM_SHL_2) != 0;
+
+    if (op->render_flags & RENDER_FLAG_IMM_JUMP_OFFSET) {
+        return false;
+    }
+
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_RRI6:
+        *imm = (int64_t)op->insn.rri6.imm - (minus_32 ? 32 : 0);
+        return true;
+    case LA_INSN_FORMAT_RRI8:
+        *imm = op->insn.rri8.imm;
+        return true;
+    case LA_INSN_FORMAT_RRI12:
+        *imm = print_hex
+            ? op->insn.rri12.imm
+            : simm_from_uimm(op->insn.rri12.imm, 12);
+        return true;
+    case LA_INSN_FORMAT_RRI14:
+        *imm = print_hex
+            ? op->insn.rri14.imm
+            : simm_from_uimm(op->insn.rri14.imm, 14);
+        if (shl_2) {
+            *imm *= 4;
+        }
+        return true;
+    case LA_INSN_FORMAT_RRI16:
+        *imm = op->insn.rri16.imm;
+        return true;
+    case LA_INSN_FORMAT_AUI20:
+        *imm = op->insn.aui20.imm;
+        return true;
+    case LA_INSN_FORMAT_RI21:
+        *imm = op->insn.ri21.imm;
+        return true;
+    case LA_INSN_FORMAT_I25:
+        *imm = op->insn.i25.imm;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool la_op_mem_operand(const struct la_op *op, la_reg_t *base, int32_t *disp) {
+    if ((op->render_flags & RENDER_FLAG_LOAD_STORE) == 0) {
+        return false;
+    }
+
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_RRI12:
+        *base = op->insn.rri12.rj;
+        *disp = simm_from_uimm(op->insn.rri12.imm, 12);
+        return true;
+    case LA_INSN_FORMAT_RRI14:
+        *base = op->insn.rri14.rj;
+        *disp = simm_from_uimm(op->insn.rri14.imm, 14);
+        if (op->render_flags & RENDER_FLAG_IMM_SHL_2) {
+            *disp *= 4;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool la_op_jump_target(const struct la_op *op, uint64_t pc, uint64_t *target) {
+    int32_t simm;
+
+    if ((op->render_flags & RENDER_FLAG_IMM_JUMP_OFFSET) == 0) {
+        return false;
+    }
+
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_RRI16:
+        simm = simm_from_uimm(op->insn.rri16.imm, 16);
+        break;
+    case LA_INSN_FORMAT_RI21:
+        simm = simm_from_uimm(op->insn.ri21.imm, 21);
+        break;
+    case LA_INSN_FORMAT_I25:
+        simm = simm_from_uimm(op->insn.i25.imm, 25);
+        break;
+    default:
+        return false;
+    }
+
+    *target = pc + (int64_t)simm * INSN_LENGTH_BYTES;
+    return true;
+}
+
+/*
+ * Text rendering.
+ *
+ * Insns are rendered with a handful of purpose-built appenders instead of
+ * snprintf, whose format string parsing used to dominate rendering time. Each
+ * appender writes at a cursor and returns the advanced cursor; they never
+ * check for space, so la_print_insn always renders into a buffer of at least
+ * LA_INSN_TEXT_MAX bytes, which every insn fits in (mnemonics are limited to
+ * LA_MNEMONIC_MAX chars by gen_match_masks.py).
+ */
+static const char hex_digits[] = "0123456789abcdef";
+
+static const char dec_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static inline char *put_char(char *p, char c) {
+    *p = c;
+    return p + 1;
+}
+
+static inline char *put_str(char *p, const char *s) {
+    while (*s != '\0') {
+        *p++ = *s++;
+    }
+    return p;
+}
+
+static inline char *put_sep(char *p) {
+    p[0] = ',';
+    p[1] = ' ';
+    return p + 2;
+}
+
+static inline char *put_reg(char *p, const struct la_reg_name *reg) {
+    /* all names fit in 4 bytes, copy them whole */
+    memcpy(p, reg->name, 4);
+    return p + reg->len;
+}
+
+/* like printf("%u") */
+static char *put_udec(char *p, uint32_t v) {
+    char tmp[10];
+    char *t = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        uint32_t pair = (v % 100) * 2;
+        v /= 100;
+        t -= 2;
+        t[0] = dec_digit_pairs[pair];
+        t[1] = dec_digit_pairs[pair + 1];
+    }
+    if (v >= 10) {
+        t -= 2;
+        t[0] = dec_digit_pairs[v * 2];
+        t[1] = dec_digit_pairs[v * 2 + 1];
+    } else {
+        *--t = '0' + v;
+    }
+
+    size_t n = tmp + sizeof(tmp) - t;
+    memcpy(p, t, n);
+    return p + n;
+}
+
+/* like printf("%d") */
+static char *put_dec(char *p, int32_t v) {
+    if (v < 0) {
+        *p++ = '-';
+        return put_udec(p, -(uint32_t)v);
+    }
+    return put_udec(p, v);
+}
+
+/* like printf("0x%0*" PRIx64, min_digits) */
+static char *put_hex(char *p, uint64_t v, int min_digits) {
+    int n = v != 0 ? (64 - __builtin_clzll(v) + 3) / 4 : 1;
+    if (n < min_digits) {
+        n = min_digits;
+    }
+
+    p[0] = '0';
+    p[1] = 'x';
+    p += 2;
+    for (int i = n - 1; i >= 0; i--) {
+        p[i] = hex_digits[v & 0xf];
+        v >>= 4;
+    }
+    return p + n;
+}
+
+/* `imm` printed the way the HEX render flag asks for */
+static inline char *put_imm(char *p, bool print_hex, uint32_t imm, int32_t simm) {
+    return print_hex ? put_hex(p, imm, 1) : put_dec(p, simm);
+}
+
+/* `disp(base)` operand of loads and stores */
+static inline char *put_mem(char *p, int32_t disp, const struct la_reg_name *base) {
+    p = put_dec(p, disp);
+    p = put_char(p, '(');
+    p = put_reg(p, base);
+    return put_char(p, ')');
+}
+
+static char *render_insn(char *p, const struct la_op *op, uint64_t pc) {
+    bool print_hex = (op->render_flags & RENDER_FLAG_PRINT_IMM_HEX) != 0;
+    bool is_load_store = (op->render_flags & RENDER_FLAG_LOAD_STORE) != 0;
+
+    uint32_t imm;
+    uint32_t imm1, imm2;
+    int32_t simm;
+    uint64_t jump_target;
+
+    p = put_str(p, op->mnemonic);
+    p = put_char(p, ' ');
+
+    switch (op->fmt) {
+    case LA_INSN_FORMAT_UNKNOWN:
+        return put_hex(p, op->insn.unknown, 8);
+
+#define GPR(x)          (&loongarch_reg_names_gpr[x])
+#define FPR(x)          (&loongarch_reg_names_fpr[x])
+#define PRINT_RD(x)     ((op->render_flags & RENDER_FLAG_RD_IS_FPR) ? FPR(x) : GPR(x))
+#define PRINT_RJ(x)     ((op->render_flags & RENDER_FLAG_RJ_IS_FPR) ? FPR(x) : GPR(x))
+#define PRINT_RK(x)     ((op->render_flags & RENDER_FLAG_RK_IS_FPR) ? FPR(x) : GPR(x))
+    case LA_INSN_FORMAT_RR:
+        p = put_reg(p, PRINT_RD(op->insn.rr.rd));
+        p = put_sep(p);
+        return put_reg(p, PRINT_RJ(op->insn.rr.rj));
+    case LA_INSN_FORMAT_RRR:
+        p = put_reg(p, PRINT_RD(op->insn.rrr.rd));
+        p = put_sep(p);
+        p = put_reg(p, PRINT_RJ(op->insn.rrr.rj));
+        p = put_sep(p);
+        return put_reg(p, PRINT_RK(op->insn.rrr.rk));
+    case LA_INSN_FORMAT_FFFF:
+        p = put_reg(p, FPR(op->insn.ffff.rd));
+        p = put_sep(p);
+        p = put_reg(p, FPR(op->insn.ffff.rj));
+        p = put_sep(p);
+        p = put_reg(p, FPR(op->insn.ffff.rk));
+        p = put_sep(p);
+        return put_reg(p, FPR(op->insn.ffff.ra));
+    case LA_INSN_FORMAT_RRI6:
+        imm = op->insn.rri6.imm;
+        if (op->render_flags & RENDER_FLAG_IMM_MINUS_32) {
+            imm -= 32;
+        }
+        p = put_reg(p, PRINT_RD(op->insn.rri6.rd));
+        p = put_sep(p);
+        p = put_reg(p, PRINT_RJ(op->insn.rri6.rj));
+        p = put_sep(p);
+        return put_dec(p, (int32_t)imm);
+    case LA_INSN_FORMAT_RRI8:
+        imm = op->insn.rri8.imm;
+        p = put_reg(p, PRINT_RD(op->insn.rri8.rd));
+        p = put_sep(p);
+        p = put_reg(p, PRINT_RJ(op->insn.rri8.rj));
+        p = put_sep(p);
+        return put_imm(p, print_hex, imm, imm);
+    case LA_INSN_FORMAT_RRI12:
+        imm = op->insn.rri12.imm;
+        simm = simm_from_uimm(imm, 12);
+        p = put_reg(p, PRINT_RD(op->insn.rri12.rd));
+        p = put_sep(p);
+        if (is_load_store) {
+            return put_mem(p, simm, PRINT_RJ(op->insn.rri12.rj));
+        }
+        p = put_reg(p, PRINT_RJ(op->insn.rri12.rj));
+        p = put_sep(p);
+        return put_imm(p, print_hex, imm, simm);
+    case LA_INSN_FORMAT_RRI6I6:
+        imm1 = op->insn.rri6i6.imm1;
+        imm2 = op->insn.rri6i6.imm2;
+        if (op->render_flags & RENDER_FLAG_IMM_MINUS_32) {
+            imm1 -= 32;
+            imm2 -= 32;
+        }
+        p = put_reg(p, PRINT_RD(op->insn.rri6i6.rd));
+        p = put_sep(p);
+        p = put_reg(p, PRINT_RJ(op->insn.rri6i6.rj));
+        p = put_sep(p);
+        p = put_dec(p, (int32_t)imm1);
+        p = put_sep(p);
+        return put_dec(p, (int32_t)imm2);
+    case LA_INSN_FORMAT_RRI14:
+        imm = op->insn.rri14.imm;
+        simm = simm_from_uimm(imm, 14);
+        if (op->render_flags & RENDER_FLAG_IMM_SHL_2) {
+            imm <<= 2;
+            simm <<= 2;
+        }
+        p = put_reg(p, PRINT_RD(op->insn.rri14.rd));
+        p = put_sep(p);
+        if (is_load_store) {
+            return put_mem(p, simm, PRINT_RJ(op->insn.rri14.rj));
+        }
+        p = put_reg(p, PRINT_RJ(op->insn.rri14.rj));
+        p = put_sep(p);
+        return put_imm(p, print_hex, imm, simm);
+    case LA_INSN_FORMAT_RRI16:
+        imm = op->insn.rri16.imm;
+        p = put_reg(p, PRINT_RD(op->insn.rri16.rd));
+        p = put_sep(p);
+        p = put_reg(p, PRINT_RJ(op->insn.rri16.rj));
+        p = put_sep(p);
+        if (la_op_jump_target(op, pc, &jump_target)) {
+            return put_hex(p, jump_target, 1);
+        }
+        return put_imm(p, print_hex, imm, imm);
+    case LA_INSN_FORMAT_AUI20:
+        imm = op->insn.aui20.imm;
+        p = put_reg(p, PRINT_RD(op->insn.aui20.rd));
+        p = put_sep(p);
+        return put_imm(p, print_hex, imm, imm);
+    case LA_INSN_FORMAT_RI21:
+        imm = op->insn.ri21.imm;
+        p = put_reg(p, PRINT_RJ(op->insn.ri21.rj));
+        p = put_sep(p);
+        if (la_op_jump_target(op, pc, &jump_target)) {
+            return put_hex(p, jump_target, 1);
+        }
+        return put_dec(p, imm);
+    case LA_INSN_FORMAT_I25:
+        imm = op->insn.i25.imm;
+        if (la_op_jump_target(op, pc, &jump_target)) {
+            return put_hex(p, jump_target, 1);
+        }
+        return put_dec(p, imm);
+#undef GPR
+#undef FPR
+#undef PRINT_RD
+#undef PRINT_RJ
+#undef PRINT_RK
+
+    default:
+        /* should never happen */
+        return NULL;
+    }
+}
+
+int la_print_insn(char *buf, int buflen, const struct la_op *op, uint64_t pc) {
+    char scratch[LA_INSN_TEXT_MAX];
+    char *out = buflen >= LA_INSN_TEXT_MAX ? buf : scratch;
+
+#ifdef LA_DECODE_STATS
+    /* reading the clock costs about as much as rendering, so sample */
+    struct la_decode_stats *s = stats_local();
+    uint64_t n = s->render_count[op->fmt];
+    STATS_ADD(s->render_count[op->fmt], 1);
+    bool timed = n % LA_STATS_RENDER_SAMPLE == 0;
+    uint64_t start = timed ? la_stats_ticks() : 0;
+    char *end = render_insn(out, op, pc);
+    if (timed) {
+        STATS_ADD(s->render_ns[op->fmt], la_stats_ticks() - start);
+        STATS_ADD(s->render_timed[op->fmt], 1);
+    }
+#else
+    char *end = render_insn(out, op, pc);
+#endif
+    if (end == NULL) {
+        if (buflen > 0) {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+    *end = '\0';
+
+    int len = end - out;
+    if (out == scratch && buflen > 0) {
+        /* truncate like snprintf would */
+        int n = len < buflen ? len : buflen - 1;
+        memcpy(buf, scratch, n);
+        buf[n] = '\0';
+    }
+    return len;
+}
+
+size_t la_decode_block(
+    const uint8_t *buf,
+    size_t len,
+    struct la_op *ops,
+    size_t max_ops
+) {
+    size_t n = len / INSN_LENGTH_BYTES;
+    if (n > max_ops) {
+        n = max_ops;
+    }
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+        la_insn_t insn_word = la_read_insn_word(buf + i * INSN_LENGTH_BYTES);
+        if (la_match_insn(insn_word, &ops[i]) == 0) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+void la_render_block(
+    const struct la_op *ops,
+    size_t num_ops,
+    uint64_t pc,
+    char *text,
+    size_t text_stride
+) {
+    for (size_t i = 0; i < num_ops; i++) {
+        la_print_insn(
+            text + i * text_stride,
+            text_stride,
+            &ops[i],
+            pc + i * INSN_LENGTH_BYTES
+        );
+    }
+}
+
+size_t la_disasm_block(
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    struct la_op *ops,
+    size_t max_ops,
+    char *text,
+    size_t text_stride
+) {
+    size_t n = la_decode_block(buf, len, ops, max_ops);
+
+    if (text != NULL) {
+        /* render in a second pass, keeping the decode loop tight */
+        la_render_block(ops, n, pc, text, text_stride);
+    }
+
+    return n;
+}
@@ -0,0 +1,713 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "r_loongarch.h"
+
+/*
+ * Micro-emulator.
+ *
+ * Code is predecoded into basic blocks of struct emu_insn, found by address
+ * in a direct-mapped block cache, and run with computed-goto dispatch on the
+ * insn id. Operands are resolved when a block is predecoded: immediates come
+ * sign-extended and scaled, aui/auipc/ahi/ati values and branch targets are
+ * precomputed, and writes to zero are redirected to a scratch register, so
+ * handlers are one or two lines each and never check for zero.
+ *
+ * Guest memory is a hash table of 4 KiB pages allocated when mapped, with a
+ * small direct-mapped TLB in front for loads and one for stores. Pages code
+ * has been predecoded from are kept out of the store TLB; a store to one
+ * takes the slow path, which has the block cache flushed once the current
+ * block is done.
+ */
+
+#define PAGE_BITS 12
+#define PAGE_SIZE ((uint64_t)1 << PAGE_BITS)
+#define PAGE_MASK (PAGE_SIZE - 1)
+#define TLB_SIZE 64
+#define BLOCK_CACHE_SIZE 4096
+#define BLOCK_INSNS_MAX 64
+#define SCRATCH_REG 32
+
+/* the insns the emulator runs; everything else stops it as unsupported */
+#define EMU_INSNS(X) \
+    X(SEXT_H) X(SEXT_B) X(ADDW) X(ADD) X(SUBW) X(SUB) X(SELNEZ) X(SELEQZ) \
+    X(AND) X(OR) X(XOR) X(SLL) X(SBS) X(SRL) X(MUL) X(SYSCALL) \
+    X(SLLIW) X(SLLI) X(SRLIW) X(SRLI) X(SRAIW) X(SRAI) X(RORIW) X(RORI) \
+    X(SLTI) X(SLTIU) X(ADDIW) X(ADDI) X(ATI) X(ANDI) X(ORI) X(XORI) \
+    X(AUI) X(AHI) X(AUIPC) \
+    X(LW_2) X(SW_2) X(LD_2) X(SD_2) X(LB) X(LH) X(LW) X(LD) \
+    X(SB) X(SH) X(SW) X(SD) X(LBU) X(LHU) X(FLW) X(FSW) X(FLD) X(FSD) \
+    X(BEQZ) X(BNEZ) X(JALR) X(J) X(JAL) \
+    X(BEQ) X(BNE) X(BGT) X(BLE) X(BGTU) X(BLEU)
+
+#define SUPPORTED(name) [LA_INSN_##name] = true,
+static const bool emu_supported[LA_INSN_LAST] = { EMU_INSNS(SUPPORTED) };
+#undef SUPPORTED
+
+struct emu_page {
+    uint64_t page_no;
+    uint8_t *data;      /* NULL for free hash slots */
+    bool code;          /* blocks were predecoded from it */
+};
+
+struct emu_tlb_entry {
+    uint64_t page_no;
+    uint8_t *data;      /* NULL if invalid */
+};
+
+struct emu_insn {
+    uint8_t id;
+    uint8_t rd;
+    uint8_t rj;
+    uint8_t rk;
+    la_insn_t insn_word;
+    int64_t imm;        /* or the branch target */
+};
+
+struct emu_block {
+    uint64_t pc;
+    uint32_t num_insns;
+    struct emu_insn insns[];
+};
+
+struct la_emu {
+    struct la_emu_regs regs;
+
+    struct emu_page *pages;
+    size_t num_pages;
+    size_t page_slots;  /* power of two */
+    struct emu_tlb_entry load_tlb[TLB_SIZE];
+    struct emu_tlb_entry store_tlb[TLB_SIZE];
+
+    struct emu_block *blocks[BLOCK_CACHE_SIZE];
+    bool code_dirty;
+
+    la_emu_mem_hook mem_hook;
+    void *mem_hook_user;
+    la_emu_trace_fn trace;
+    void *trace_user;
+
+    uint64_t fault_addr;
+    struct la_emu_stats stats;
+};
+
+static inline uint64_t sext(uint64_t value, unsigned bits) {
+    uint64_t sign = 1ULL << (bits - 1);
+    value &= (sign << 1) - 1;
+    return (value ^ sign) - sign;
+}
+
+/*
+ * Memory.
+ */
+
+static inline size_t page_hash(const struct la_emu *emu, uint64_t page_no) {
+    return (page_no * 0x9e3779b97f4a7c15ULL) >> 32 & (emu->page_slots - 1);
+}
+
+static struct emu_page *find_page(const struct la_emu *emu, uint64_t page_no) {
+    for (size_t i = page_hash(emu, page_no);; i = (i + 1) & (emu->page_slots - 1)) {
+        struct emu_page *page = &emu->pages[i];
+        if (page->data == NULL) {
+            return NULL;
+        }
+        if (page->page_no == page_no) {
+            return page;
+        }
+    }
+}
+
+static bool grow_pages(struct la_emu *emu) {
+    struct emu_page *old = emu->pages;
+    size_t old_slots = emu->page_slots;
+
+    emu->page_slots = old_slots != 0 ? old_slots * 2 : 64;
+    emu->pages = calloc(emu->page_slots, sizeof(*emu->pages));
+    if (emu->pages == NULL) {
+        emu->pages = old;
+        emu->page_slots = old_slots;
+        return false;
+    }
+
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old[i].data == NULL) {
+            continue;
+        }
+        size_t j = page_hash(emu, old[i].page_no);
+        while (emu->pages[j].data != NULL) {
+            j = (j + 1) & (emu->page_slots - 1);
+        }
+        emu->pages[j] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static struct emu_page *map_page(struct la_emu *emu, uint64_t page_no) {
+    struct emu_page *page = emu->page_slots != 0 ? find_page(emu, page_no) : NULL;
+    if (page != NULL) {
+        return page;
+    }
+
+    /* keep the table at most half full */
+    if ((emu->num_pages + 1) * 2 > emu->page_slots && !grow_pages(emu)) {
+        return NULL;
+    }
+
+    uint8_t *data = calloc(1, PAGE_SIZE);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    size_t i = page_hash(emu, page_no);
+    while (emu->pages[i].data != NULL) {
+        i = (i + 1) & (emu->page_slots - 1);
+    }
+    page = &emu->pages[i];
+    page->page_no = page_no;
+    page->data = data;
+    page->code = false;
+    emu->num_pages++;
+    return page;
+}
+
+static inline uint64_t get_le(const uint8_t *p, unsigned size) {
+    uint64_t v = 0;
+    for (unsigned i = 0; i < size; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static inline void put_le(uint8_t *p, unsigned size, uint64_t v) {
+    for (unsigned i = 0; i < size; i++) {
+        p[i] = v >> (8 * i);
+    }
+}
+
+static bool load_slow(struct la_emu *emu, uint64_t addr, unsigned size, uint64_t *value) {
+    uint8_t bytes[8];
+
+    for (unsigned i = 0; i < size; i++) {
+        uint64_t a = addr + i;
+        struct emu_page *page = find_page(emu, a >> PAGE_BITS);
+        if (page == NULL) {
+            emu->fault_addr = a;
+            return false;
+        }
+        bytes[i] = page->data[a & PAGE_MASK];
+
+        struct emu_tlb_entry *e = &emu->load_tlb[page->page_no % TLB_SIZE];
+        e->page_no = page->page_no;
+        e->data = page->data;
+    }
+    *value = get_le(bytes, size);
+
+    if (emu->mem_hook != NULL && !emu->mem_hook(emu->mem_hook_user, addr, size, false, *value)) {
+        emu->fault_addr = addr;
+        return false;
+    }
+    return true;
+}
+
+static bool store_slow(struct la_emu *emu, uint64_t addr, unsigned size, uint64_t value) {
+    if (emu->mem_hook != NULL && !emu->mem_hook(emu->mem_hook_user, addr, size, true, value)) {
+        emu->fault_addr = addr;
+        return false;
+    }
+
+    /* all or nothing */
+    for (unsigned i = 0; i < size; i++) {
+        if (find_page(emu, (addr + i) >> PAGE_BITS) == NULL) {
+            emu->fault_addr = addr + i;
+            return false;
+        }
+    }
+
+    for (unsigned i = 0; i < size; i++) {
+        uint64_t a = addr + i;
+        struct emu_page *page = find_page(emu, a >> PAGE_BITS);
+        page->data[a & PAGE_MASK] = value >> (8 * i);
+
+        if (page->code) {
+            emu->code_dirty = true;
+        } else {
+            struct emu_tlb_entry *e = &emu->store_tlb[page->page_no % TLB_SIZE];
+            e->page_no = page->page_no;
+            e->data = page->data;
+        }
+    }
+    return true;
+}
+
+static inline bool load(struct la_emu *emu, uint64_t addr, unsigned size, uint64_t *value) {
+    uint64_t page_no = addr >> PAGE_BITS;
+    const struct emu_tlb_entry *e = &emu->load_tlb[page_no % TLB_SIZE];
+
+    if (
+        e->page_no == page_no && e->data != NULL
+        && (addr & PAGE_MASK) + size <= PAGE_SIZE
+        && emu->mem_hook == NULL
+    ) {
+        *value = get_le(e->data + (addr & PAGE_MASK), size);
+        return true;
+    }
+    return load_slow(emu, addr, size, value);
+}
+
+static inline bool store(struct la_emu *emu, uint64_t addr, unsigned size, uint64_t value) {
+    uint64_t page_no = addr >> PAGE_BITS;
+    const struct emu_tlb_entry *e = &emu->store_tlb[page_no % TLB_SIZE];
+
+    if (
+        e->page_no == page_no && e->data != NULL
+        && (addr & PAGE_MASK) + size <= PAGE_SIZE
+        && emu->mem_hook == NULL
+    ) {
+        put_le(e->data + (addr & PAGE_MASK), size, value);
+        return true;
+    }
+    return store_slow(emu, addr, size, value);
+}
+
+/*
+ * Block cache.
+ */
+
+static void flush_blocks(struct la_emu *emu) {
+    for (size_t i = 0; i < BLOCK_CACHE_SIZE; i++) {
+        free(emu->blocks[i]);
+        emu->blocks[i] = NULL;
+    }
+    for (size_t i = 0; i < emu->page_slots; i++) {
+        emu->pages[i].code = false;
+    }
+    emu->code_dirty = false;
+    emu->stats.flushes++;
+}
+
+static inline size_t block_slot(uint64_t pc) {
+    return (pc / INSN_LENGTH_BYTES) & (BLOCK_CACHE_SIZE - 1);
+}
+
+static bool ends_block(enum la_insn_id id) {
+    switch (id) {
+    case LA_INSN_SYSCALL:
+    case LA_INSN_BEQZ:
+    case LA_INSN_BNEZ:
+    case LA_INSN_JALR:
+    case LA_INSN_J:
+    case LA_INSN_JAL:
+    case LA_INSN_BEQ:
+    case LA_INSN_BNE:
+    case LA_INSN_BGT:
+    case LA_INSN_BLE:
+    case LA_INSN_BGTU:
+    case LA_INSN_BLEU:
+    case LA_INSN_UNK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void predecode(struct emu_insn *ins, la_insn_t insn_word, uint64_t pc) {
+    struct la_op op;
+    int64_t imm = 0;
+    uint64_t target;
+
+    la_match_insn(insn_word, &op);
+    la_op_imm(&op, &imm);
+
+    ins->id = emu_supported[op.id] ? op.id : LA_INSN_UNK;
+    ins->insn_word = insn_word;
+    ins->rd = la_op_rd(&op) & 0x1f;
+    ins->rj = la_op_rj(&op) & 0x1f;
+    ins->rk = la_op_rk(&op) & 0x1f;
+
+    switch (op.id) {
+    case LA_INSN_AUI:
+        ins->imm = sext((uint64_t)imm << 12, 32);
+        break;
+    case LA_INSN_AUIPC:
+        ins->imm = pc + sext((uint64_t)imm << 12, 32);
+        break;
+    case LA_INSN_AHI:
+        ins->imm = sext(imm, 20) << 32;
+        break;
+    case LA_INSN_ATI:
+        ins->imm = (uint64_t)imm << 52;
+        break;
+    default:
+        ins->imm = la_op_jump_target(&op, pc, &target) ? (int64_t)target : imm;
+        break;
+    }
+
+    /* writes to zero go to the scratch register */
+    size_t num_matchers;
+    const struct la_disasm_matcher *m = la_matcher_table(&num_matchers);
+    bool writes_rd = op.id < num_matchers
+        && (m[op.id].writes & LA_REG_SLOT_RD) != 0
+        && (op.render_flags & RENDER_FLAG_RD_IS_FPR) == 0;
+    if (writes_rd && ins->rd == LA_REG_ZERO) {
+        ins->rd = SCRATCH_REG;
+    }
+}
+
+static struct emu_block *translate(struct la_emu *emu, uint64_t pc) {
+    struct emu_insn insns[BLOCK_INSNS_MAX];
+    size_t n = 0;
+
+    if (pc % INSN_LENGTH_BYTES != 0) {
+        return NULL;
+    }
+
+    while (n < BLOCK_INSNS_MAX) {
+        uint64_t insn_pc = pc + n * INSN_LENGTH_BYTES;
+        struct emu_page *page = find_page(emu, insn_pc >> PAGE_BITS);
+        if (page == NULL) {
+            break;
+        }
+
+        /* stores to it must now go through store_slow() */
+        if (!page->code) {
+            page->code = true;
+            emu->store_tlb[page->page_no % TLB_SIZE].data = NULL;
+        }
+
+        predecode(&insns[n], la_read_insn_word(page->data + (insn_pc & PAGE_MASK)), insn_pc);
+        if (ends_block(insns[n++].id)) {
+            break;
+        }
+    }
+    if (n == 0) {
+        return NULL;
+    }
+
+    struct emu_block *block = malloc(sizeof(*block) + n * sizeof(block->insns[0]));
+    if (block == NULL) {
+        return NULL;
+    }
+    block->pc = pc;
+    block->num_insns = n;
+    memcpy(block->insns, insns, n * sizeof(insns[0]));
+
+    size_t slot = block_slot(pc);
+    free(emu->blocks[slot]);
+    emu->blocks[slot] = block;
+    emu->stats.blocks++;
+    return block;
+}
+
+/*
+ * Public API.
+ */
+
+struct la_emu *la_emu_new(void) {
+    struct la_emu *emu = calloc(1, sizeof(*emu));
+    if (emu == NULL) {
+        return NULL;
+    }
+
+    if (!grow_pages(emu)) {
+        free(emu);
+        return NULL;
+    }
+    return emu;
+}
+
+void la_emu_free(struct la_emu *emu) {
+    if (emu == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < BLOCK_CACHE_SIZE; i++) {
+        free(emu->blocks[i]);
+    }
+    for (size_t i = 0; i < emu->page_slots; i++) {
+        free(emu->pages[i].data);
+    }
+    free(emu->pages);
+    free(emu);
+}
+
+struct la_emu_regs *la_emu_regs(struct la_emu *emu) {
+    return &emu->regs;
+}
+
+bool la_emu_map(struct la_emu *emu, uint64_t addr, uint64_t size) {
+    if (size == 0) {
+        return true;
+    }
+
+    uint64_t last = (addr + size - 1) >> PAGE_BITS;
+    for (uint64_t page_no = addr >> PAGE_BITS; page_no <= last; page_no++) {
+        if (map_page(emu, page_no) == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool la_emu_mem_write(struct la_emu *emu, uint64_t addr, const void *buf, size_t len) {
+    const uint8_t *src = buf;
+
+    for (size_t i = 0; i < len; i++) {
+        struct emu_page *page = find_page(emu, (addr + i) >> PAGE_BITS);
+        if (page == NULL) {
+            return false;
+        }
+        page->data[(addr + i) & PAGE_MASK] = src[i];
+        if (page->code) {
+            emu->code_dirty = true;
+        }
+    }
+    return true;
+}
+
+bool la_emu_mem_read(struct la_emu *emu, uint64_t addr, void *buf, size_t len) {
+    uint8_t *dst = buf;
+
+    for (size_t i = 0; i < len; i++) {
+        const struct emu_page *page = find_page(emu, (addr + i) >> PAGE_BITS);
+        if (page == NULL) {
+            return false;
+        }
+        dst[i] = page->data[(addr + i) & PAGE_MASK];
+    }
+    return true;
+}
+
+void la_emu_set_mem_hook(struct la_emu *emu, la_emu_mem_hook hook, void *user) {
+    emu->mem_hook = hook;
+    emu->mem_hook_user = user;
+}
+
+void la_emu_set_trace(struct la_emu *emu, la_emu_trace_fn trace, void *user) {
+    emu->trace = trace;
+    emu->trace_user = user;
+}
+
+uint64_t la_emu_fault_addr(const struct la_emu *emu) {
+    return emu->fault_addr;
+}
+
+void la_emu_get_stats(const struct la_emu *emu, struct la_emu_stats *stats) {
+    *stats = emu->stats;
+}
+
+const char *la_emu_stop_name(enum la_emu_stop stop) {
+    switch (stop) {
+    case LA_EMU_BUDGET:      return "budget";
+    case LA_EMU_FAULT:       return "fault";
+    case LA_EMU_UNSUPPORTED: return "unsupported";
+    case LA_EMU_SYSCALL:     return "syscall";
+    case LA_EMU_HOOK:        return "hook";
+    default:                 return "?";
+    }
+}
+
+enum la_emu_stop la_emu_run(struct la_emu *emu, uint64_t max_insns) {
+#define LABEL(name) [LA_INSN_##name] = &&op_##name,
+    static void *const dispatch[LA_INSN_LAST] = {
+        EMU_INSNS(LABEL)
+        [LA_INSN_UNK] = &&op_UNK,
+    };
+#undef LABEL
+
+    uint64_t *const G = emu->regs.gpr;
+    uint64_t *const F = emu->regs.fpr;
+    uint64_t budget = max_insns;
+    const struct emu_block *block;
+    const struct emu_insn *ins;
+    const struct emu_insn *end;
+    enum la_emu_stop stop;
+    uint64_t next_pc;
+    uint64_t v;
+
+#define PC_OF(i) (block->pc + (uint64_t)((i) - block->insns) * INSN_LENGTH_BYTES)
+#define DISPATCH() do { \
+        if (emu->trace != NULL) { \
+            emu->trace(emu->trace_user, PC_OF(ins), ins->insn_word); \
+        } \
+        goto *dispatch[ins->id]; \
+    } while (0)
+#define NEXT() do { \
+        if (++ins == end) { \
+            goto block_end; \
+        } \
+        DISPATCH(); \
+    } while (0)
+#define JUMP(target) do { \
+        next_pc = (target); \
+        ins++; \
+        goto block_jump; \
+    } while (0)
+#define BRANCH(cond) do { \
+        if (cond) { \
+            JUMP(ins->imm); \
+        } \
+        NEXT(); \
+    } while (0)
+#define RD G[ins->rd]
+#define RJ G[ins->rj]
+#define RK G[ins->rk]
+#define IMM ins->imm
+#define LOAD(size, conv) do { \
+        if (!load(emu, RJ + IMM, size, &v)) { \
+            goto fault; \
+        } \
+        RD = conv; \
+        NEXT(); \
+    } while (0)
+#define STORE(size, value) do { \
+        if (!store(emu, RJ + IMM, size, value)) { \
+            goto fault; \
+        } \
+        NEXT(); \
+    } while (0)
+
+next_block:
+    if (emu->code_dirty) {
+        flush_blocks(emu);
+    }
+    if (budget == 0) {
+        return LA_EMU_BUDGET;
+    }
+
+    block = emu->blocks[block_slot(emu->regs.pc)];
+    if (block == NULL || block->pc != emu->regs.pc) {
+        block = translate(emu, emu->regs.pc);
+        if (block == NULL) {
+            emu->fault_addr = emu->regs.pc;
+            return LA_EMU_FAULT;
+        }
+    }
+    ins = block->insns;
+    end = ins + (block->num_insns < budget ? block->num_insns : budget);
+    DISPATCH();
+
+op_SEXT_H: RD = (int64_t)(int16_t)RJ; NEXT();
+op_SEXT_B: RD = (int64_t)(int8_t)RJ; NEXT();
+op_ADDW:   RD = sext(RJ + RK, 32); NEXT();
+op_ADD:    RD = RJ + RK; NEXT();
+op_SUBW:   RD = sext(RJ - RK, 32); NEXT();
+op_SUB:    RD = RJ - RK; NEXT();
+op_SELNEZ: RD = RK != 0 ? RJ : 0; NEXT();
+op_SELEQZ: RD = RK == 0 ? RJ : 0; NEXT();
+op_AND:    RD = RJ & RK; NEXT();
+op_OR:     RD = RJ | RK; NEXT();
+op_XOR:    RD = RJ ^ RK; NEXT();
+op_SLL:    RD = RJ << (RK & 0x3f); NEXT();
+op_SBS:    RD = (RJ & RK) != 0; NEXT();
+op_SRL:    RD = RJ >> (RK & 0x3f); NEXT();
+op_MUL:    RD = RJ * RK; NEXT();
+
+op_SLLIW:  RD = sext(RJ << IMM, 32); NEXT();
+op_SLLI:   RD = RJ << IMM; NEXT();
+op_SRLIW:  RD = sext((uint32_t)RJ >> IMM, 32); NEXT();
+op_SRLI:   RD = RJ >> IMM; NEXT();
+op_SRAIW:  RD = (int64_t)(int32_t)RJ >> IMM; NEXT();
+op_SRAI:   RD = (int64_t)RJ >> IMM; NEXT();
+op_RORIW:  v = (uint32_t)RJ; RD = sext(v >> IMM | v << ((32 - IMM) & 0x1f), 32); NEXT();
+op_RORI:   RD = RJ >> IMM | RJ << ((64 - IMM) & 0x3f); NEXT();
+
+op_SLTI:   RD = (int64_t)RJ < IMM; NEXT();
+op_SLTIU:  RD = RJ < (uint64_t)IMM; NEXT();
+op_ADDIW:  RD = sext(RJ + IMM, 32); NEXT();
+op_ADDI:   RD = RJ + IMM; NEXT();
+op_ATI:    RD = (RJ & ((1ULL << 52) - 1)) | IMM; NEXT();
+op_ANDI:   RD = RJ & IMM; NEXT();
+op_ORI:    RD = RJ | IMM; NEXT();
+op_XORI:   RD = RJ ^ IMM; NEXT();
+op_AUI:    RD = IMM; NEXT();
+op_AHI:    RD = (RD & 0xffffffffULL) | IMM; NEXT();
+op_AUIPC:  RD = IMM; NEXT();
+
+op_LW_2:   LOAD(4, sext(v, 32));
+op_SW_2:   STORE(4, RD);
+op_LD_2:   LOAD(8, v);
+op_SD_2:   STORE(8, RD);
+op_LB:     LOAD(1, sext(v, 8));
+op_LH:     LOAD(2, sext(v, 16));
+op_LW:     LOAD(4, sext(v, 32));
+op_LD:     LOAD(8, v);
+op_SB:     STORE(1, RD);
+op_SH:     STORE(2, RD);
+op_SW:     STORE(4, RD);
+op_SD:     STORE(8, RD);
+op_LBU:    LOAD(1, v);
+op_LHU:    LOAD(2, v);
+/* FPRs are loaded and stored as bits */
+op_FLW:
+    if (!load(emu, RJ + IMM, 4, &v)) {
+        goto fault;
+    }
+    F[ins->rd] = v;
+    NEXT();
+op_FSW:    STORE(4, F[ins->rd]);
+op_FLD:
+    if (!load(emu, RJ + IMM, 8, &v)) {
+        goto fault;
+    }
+    F[ins->rd] = v;
+    NEXT();
+op_FSD:    STORE(8, F[ins->rd]);
+
+op_BEQZ:   BRANCH(RJ == 0);
+op_BNEZ:   BRANCH(RJ != 0);
+/* rd may be rj */
+op_JALR:   next_pc = RJ; RD = PC_OF(ins + 1); ins++; goto block_jump;
+op_J:      JUMP(IMM);
+op_JAL:    G[LA_REG_RA] = PC_OF(ins + 1); JUMP(IMM);
+op_BEQ:    BRANCH(RD == RJ);
+op_BNE:    BRANCH(RD != RJ);
+op_BGT:    BRANCH((int64_t)RD > (int64_t)RJ);
+op_BLE:    BRANCH((int64_t)RD <= (int64_t)RJ);
+op_BGTU:   BRANCH(RD > RJ);
+op_BLEU:   BRANCH(RD <= RJ);
+
+op_SYSCALL:
+    /* done, resume after it */
+    stop = LA_EMU_SYSCALL;
+    ins++;
+    goto stopped;
+
+op_UNK:
+    stop = LA_EMU_UNSUPPORTED;
+    goto stopped;
+
+fault:
+    /* the memory hook asked to stop, or nothing is mapped there */
+    stop = emu->mem_hook != NULL && find_page(emu, emu->fault_addr >> PAGE_BITS) != NULL
+        ? LA_EMU_HOOK
+        : LA_EMU_FAULT;
+    goto stopped;
+
+block_end:
+    next_pc = PC_OF(ins);
+block_jump:
+    budget -= ins - block->insns;
+    emu->stats.insns += ins - block->insns;
+    emu->regs.pc = next_pc;
+    goto next_block;
+
+stopped:
+    emu->stats.insns += ins - block->insns;
+    emu->regs.pc = PC_OF(ins);
+    return stop;
+
+#undef PC_OF
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef BRANCH
+#undef RD
+#undef RJ
+#undef RK
+#undef IMM
+#undef LOAD
+#undef STORE
+}
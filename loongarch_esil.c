@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <string.h>
+
+#include "r_loongarch.h"
+
+/*
+ * ESIL templates.
+ *
+ * Every insn id has a template with slots for its operands:
+ *
+ *   {d} {j} {k}  rd, rj, rk, named as rendered (GPR or FPR)
+ *   {i}          the immediate as la_op_imm() gives it, i.e. sign-extended,
+ *                scaled for SHL2 and less 32 for M32, as a 64-bit hex number
+ *   {t}          the branch target
+ *   {n}          the address of the next insn
+ *   {p}          the address of the insn
+ *
+ * Templates are split into literal runs and slots once, at load time, so
+ * rendering an insn is a handful of memcpys and no parsing. Insns writing rd
+ * have a second template for rd = zero, usually empty, as zero is an
+ * ordinary register to ESIL; those writing an FPR do not, f0 is no zero. Insns without a template (the `!` ones and
+ * those whose semantic is not known) render as an empty string.
+ *
+ * ESIL compares unsigned; signed comparisons flip the sign bits first.
+ */
+
+struct esil_template {
+    const char *esil;
+    const char *esil_rd_zero;   /* NULL if rd is not written */
+};
+
+#define SIGN "0x8000000000000000,"
+/* writes rd, nothing to do for rd = zero */
+#define W(s) { s, "" }
+/* does not write rd */
+#define N(s) { s, NULL }
+/* writes an FPR rd, f0 is as good as any */
+#define F(s) { s, NULL }
+/* sign-extend the low 32 bits and store in rd */
+#define W32(s) W(s ",0xffffffff,&,32,~,{d},=")
+#define LOAD(n) W("{i},{j},+,[" #n "],{d},=")
+#define LOADS(n, bits) W("{i},{j},+,[" #n "]," #bits ",~,{d},=")
+#define STORE(n) N("{d},{i},{j},+,=[" #n "]")
+#define BRANCH(cond) N(cond ",?{,{t},pc,=,}")
+
+static const struct esil_template loongarch_esil_templates[LA_INSN_LAST] = {
+    [LA_INSN_SEXT_H] = W("0xffff,{j},&,16,~,{d},="),
+    [LA_INSN_SEXT_B] = W("0xff,{j},&,8,~,{d},="),
+    [LA_INSN_ADDW] = W32("{k},{j},+"),
+    [LA_INSN_ADD] = W("{k},{j},+,{d},="),
+    [LA_INSN_SUBW] = W32("{k},{j},-"),
+    [LA_INSN_SUB] = W("{k},{j},-,{d},="),
+    /* rd = rk ? rj : 0, and the other way round */
+    [LA_INSN_SELNEZ] = W("{k},!,!,0,-,{j},&,{d},="),
+    [LA_INSN_SELEQZ] = W("{k},!,0,-,{j},&,{d},="),
+    [LA_INSN_AND] = W("{k},{j},&,{d},="),
+    [LA_INSN_OR] = W("{k},{j},|,{d},="),
+    [LA_INSN_XOR] = W("{k},{j},^,{d},="),
+    [LA_INSN_SLL] = W("0x3f,{k},&,{j},<<,{d},="),
+    [LA_INSN_SBS] = W("{k},{j},&,!,!,{d},="),
+    [LA_INSN_SRL] = W("0x3f,{k},&,{j},>>,{d},="),
+    [LA_INSN_MUL] = W("{k},{j},*,{d},="),
+    [LA_INSN_SYSCALL] = N("0,$"),
+    /* the shift amounts of the M32 variants are already less 32 in {i} */
+    [LA_INSN_SLLIW] = W32("{i},{j},<<"),
+    [LA_INSN_SLLI] = W("{i},{j},<<,{d},="),
+    [LA_INSN_SRLIW] = W32("{i},0xffffffff,{j},&,>>"),
+    [LA_INSN_SRLI] = W("{i},{j},>>,{d},="),
+    [LA_INSN_SRAIW] = W("{i},0xffffffff,{j},&,32,~,>>>>,{d},="),
+    [LA_INSN_SRAI] = W("{i},{j},>>>>,{d},="),
+    [LA_INSN_RORIW] = W32("{i},0xffffffff,{j},&,>>,{i},32,-,0xffffffff,{j},&,<<,|"),
+    [LA_INSN_RORI] = W("{i},{j},>>>,{d},="),
+    /* no single precision in ESIL */
+    [LA_INSN_FADD_D] = F("{k},{j},F+,{d},="),
+    [LA_INSN_FSUB_D] = F("{k},{j},F-,{d},="),
+    [LA_INSN_FMUL_D] = F("{k},{j},F*,{d},="),
+    [LA_INSN_FDIV_D] = F("{k},{j},F/,{d},="),
+    [LA_INSN_SLTI] = W(SIGN "{i},^," SIGN "{j},^,<,{d},="),
+    [LA_INSN_SLTIU] = W("{i},{j},<,{d},="),
+    [LA_INSN_ADDIW] = W32("{i},{j},+"),
+    [LA_INSN_ADDI] = W("{i},{j},+,{d},="),
+    /* bits 52..63 */
+    [LA_INSN_ATI] = W("52,{i},<<,0xfffffffffffff,{j},&,|,{d},="),
+    [LA_INSN_ANDI] = W("{i},{j},&,{d},="),
+    [LA_INSN_ORI] = W("{i},{j},|,{d},="),
+    [LA_INSN_XORI] = W("{i},{j},^,{d},="),
+    [LA_INSN_AUI] = W("12,{i},<<,32,~,{d},="),
+    /* bits 32..51, sign-extended */
+    [LA_INSN_AHI] = W("0xffffffff,{d},&,32,{i},20,~,<<,|,{d},="),
+    [LA_INSN_AUIPC] = W("{p},12,{i},<<,32,~,+,{d},="),
+    [LA_INSN_LW_2] = LOADS(4, 32),
+    [LA_INSN_SW_2] = STORE(4),
+    [LA_INSN_LD_2] = LOAD(8),
+    [LA_INSN_SD_2] = STORE(8),
+    [LA_INSN_LB] = LOADS(1, 8),
+    [LA_INSN_LH] = LOADS(2, 16),
+    [LA_INSN_LW] = LOADS(4, 32),
+    [LA_INSN_LD] = LOAD(8),
+    [LA_INSN_SB] = STORE(1),
+    [LA_INSN_SH] = STORE(2),
+    [LA_INSN_SW] = STORE(4),
+    [LA_INSN_SD] = STORE(8),
+    [LA_INSN_LBU] = LOAD(1),
+    [LA_INSN_LHU] = LOAD(2),
+    [LA_INSN_FLW] = F("{i},{j},+,[4],{d},="),
+    [LA_INSN_FSW] = STORE(4),
+    [LA_INSN_FLD] = F("{i},{j},+,[8],{d},="),
+    [LA_INSN_FSD] = STORE(8),
+    [LA_INSN_BEQZ] = BRANCH("{j},!"),
+    [LA_INSN_BNEZ] = BRANCH("{j},!,!"),
+    /* pc first, rd may be rj */
+    [LA_INSN_JALR] = { "{j},pc,=,{n},{d},=", "{j},pc,=" },
+    [LA_INSN_J] = N("{t},pc,="),
+    [LA_INSN_JAL] = N("{n},ra,=,{t},pc,="),
+    /* rd, rj as rendered, e.g. bgt is rd > rj */
+    [LA_INSN_BEQ] = BRANCH("{j},{d},==,$z"),
+    [LA_INSN_BNE] = BRANCH("{j},{d},==,$z,!"),
+    [LA_INSN_BGT] = BRANCH(SIGN "{d},^," SIGN "{j},^,<"),
+    [LA_INSN_BLE] = BRANCH(SIGN "{j},^," SIGN "{d},^,<="),
+    [LA_INSN_BGTU] = BRANCH("{d},{j},<"),
+    [LA_INSN_BLEU] = BRANCH("{j},{d},<="),
+};
+
+#undef SIGN
+#undef W
+#undef N
+#undef F
+#undef W32
+#undef LOAD
+#undef LOADS
+#undef STORE
+#undef BRANCH
+
+enum esil_slot {
+    SLOT_LITERAL,
+    SLOT_RD,
+    SLOT_RJ,
+    SLOT_RK,
+    SLOT_IMM,
+    SLOT_TARGET,
+    SLOT_NEXT,
+    SLOT_PC,
+};
+
+/* a literal run of the template, then a slot */
+struct esil_segment {
+    uint8_t slot;
+    uint8_t len;
+    uint16_t offset;    /* of the literal in the template */
+};
+
+#define MAX_SEGMENTS 24
+/* "0x" and 16 digits */
+#define MAX_SLOT_LEN 18
+
+struct esil_compiled {
+    const char *text;
+    struct esil_segment segments[MAX_SEGMENTS];
+    uint8_t num_segments;
+};
+
+static struct esil_compiled compiled[LA_INSN_LAST][2];
+
+struct esil_reg_name {
+    char name[4];
+    uint8_t len;
+};
+
+static struct esil_reg_name reg_names[2][32];
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static bool compile(const char *esil, struct esil_compiled *out) {
+    const char *lit = esil;
+    const char *p = esil;
+    size_t max_len = 0;
+
+    out->text = esil;
+    out->num_segments = 0;
+    if (esil == NULL) {
+        return true;
+    }
+
+    for (;;) {
+        enum esil_slot slot = SLOT_LITERAL;
+        const char *next = p + 1;
+
+        if (*p == '{' && p[1] != '\0' && p[2] == '}') {
+            switch (p[1]) {
+            case 'd': slot = SLOT_RD; break;
+            case 'j': slot = SLOT_RJ; break;
+            case 'k': slot = SLOT_RK; break;
+            case 'i': slot = SLOT_IMM; break;
+            case 't': slot = SLOT_TARGET; break;
+            case 'n': slot = SLOT_NEXT; break;
+            case 'p': slot = SLOT_PC; break;
+            default: return false;
+            }
+            next = p + 3;
+        }
+
+        if (slot != SLOT_LITERAL || *p == '\0') {
+            if (out->num_segments == MAX_SEGMENTS || p - lit > UINT8_MAX) {
+                return false;
+            }
+            struct esil_segment *seg = &out->segments[out->num_segments++];
+            seg->slot = slot;
+            seg->len = p - lit;
+            seg->offset = lit - esil;
+            max_len += seg->len + (slot != SLOT_LITERAL ? MAX_SLOT_LEN : 0);
+            if (*p == '\0') {
+                break;
+            }
+            lit = next;
+        }
+        p = next;
+    }
+
+    return max_len < LA_ESIL_TEXT_MAX;
+}
+
+__attribute__((constructor))
+static void esil_init(void) {
+    for (int fpr = 0; fpr < 2; fpr++) {
+        for (la_reg_t reg = 0; reg < 32; reg++) {
+            const char *name = la_reg_name(reg, fpr);
+            reg_names[fpr][reg].len = strlen(name);
+            memcpy(reg_names[fpr][reg].name, name, reg_names[fpr][reg].len);
+        }
+    }
+
+    for (size_t id = 0; id < LA_INSN_LAST; id++) {
+        const struct esil_template *t = &loongarch_esil_templates[id];
+        /* a template that does not fit is dropped rather than overflowing */
+        if (!compile(t->esil, &compiled[id][0])) {
+            compiled[id][0].text = NULL;
+        }
+        if (!compile(t->esil_rd_zero, &compiled[id][1])) {
+            compiled[id][1].text = NULL;
+        }
+    }
+}
+
+static inline char *put_reg(char *p, la_reg_t reg, bool fpr) {
+    const struct esil_reg_name *name = &reg_names[fpr][reg & 0x1f];
+    memcpy(p, name->name, sizeof(name->name));
+    return p + name->len;
+}
+
+static char *put_hex(char *p, uint64_t v) {
+    int n = v != 0 ? (64 - __builtin_clzll(v) + 3) / 4 : 1;
+
+    p[0] = '0';
+    p[1] = 'x';
+    p += 2;
+    for (int i = n - 1; i >= 0; i--) {
+        p[i] = hex_digits[v & 0xf];
+        v >>= 4;
+    }
+    return p + n;
+}
+
+static char *render_esil(char *p, const struct la_op *op, uint64_t pc) {
+    la_reg_t rd = la_op_rd(op);
+    const struct esil_compiled *c = &compiled[op->id][0];
+    int64_t imm = 0;
+    uint64_t target = 0;
+
+    if (rd == LA_REG_ZERO && loongarch_esil_templates[op->id].esil_rd_zero != NULL) {
+        c = &compiled[op->id][1];
+    }
+    if (c->text == NULL) {
+        return p;
+    }
+
+    la_op_imm(op, &imm);
+    la_op_jump_target(op, pc, &target);
+
+    for (size_t i = 0; i < c->num_segments; i++) {
+        const struct esil_segment *seg = &c->segments[i];
+        memcpy(p, c->text + seg->offset, seg->len);
+        p += seg->len;
+
+        switch (seg->slot) {
+        case SLOT_RD:
+            p = put_reg(p, rd, op->render_flags & RENDER_FLAG_RD_IS_FPR);
+            break;
+        case SLOT_RJ:
+            p = put_reg(p, la_op_rj(op), op->render_flags & RENDER_FLAG_RJ_IS_FPR);
+            break;
+        case SLOT_RK:
+            p = put_reg(p, la_op_rk(op), op->render_flags & RENDER_FLAG_RK_IS_FPR);
+            break;
+        case SLOT_IMM:
+            p = put_hex(p, (uint64_t)imm);
+            break;
+        case SLOT_TARGET:
+            p = put_hex(p, target);
+            break;
+        case SLOT_NEXT:
+            p = put_hex(p, pc + INSN_LENGTH_BYTES);
+            break;
+        case SLOT_PC:
+            p = put_hex(p, pc);
+            break;
+        default:
+            break;
+        }
+    }
+    return p;
+}
+
+int la_esil_insn(char *buf, int buflen, const struct la_op *op, uint64_t pc) {
+    char scratch[LA_ESIL_TEXT_MAX];
+    char *out = buflen >= LA_ESIL_TEXT_MAX ? buf : scratch;
+
+    char *end = render_esil(out, op, pc);
+    *end = '\0';
+
+    int len = end - out;
+    if (out == scratch && buflen > 0) {
+        /* truncate like snprintf would */
+        int n = len < buflen ? len : buflen - 1;
+        memcpy(buf, scratch, n);
+        buf[n] = '\0';
+    }
+    return len;
+}
+
+const char *la_esil_template(enum la_insn_id id, bool rd_zero) {
+    if (id >= LA_INSN_LAST) {
+        return NULL;
+    }
+
+    const struct esil_template *t = &loongarch_esil_templates[id];
+    return rd_zero && t->esil_rd_zero != NULL ? t->esil_rd_zero : t->esil;
+}
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "r_loongarch.h"
+
+static unsigned access_size(enum la_insn_id id) {
+    switch (id) {
+    case LA_INSN_LB:
+    case LA_INSN_LBU:
+    case LA_INSN_SB:
+        return 1;
+    case LA_INSN_LH:
+    case LA_INSN_LHU:
+    case LA_INSN_SH:
+        return 2;
+    case LA_INSN_LW:
+    case LA_INSN_SW:
+    case LA_INSN_LW_2:
+    case LA_INSN_SW_2:
+    case LA_INSN_FLW:
+    case LA_INSN_FSW:
+        return 4;
+    default:
+        return 8;
+    }
+}
+
+/* rd = rj + imm, or a move, which is or rd, zero, rj */
+static bool is_offset_of(const struct la_op *op, la_reg_t rj, int64_t *imm) {
+    switch (op->id) {
+    case LA_INSN_ADDI:
+    case LA_INSN_ADDIW:
+        return la_op_rj(op) == rj && la_op_imm(op, imm);
+    case LA_INSN_OR:
+        *imm = 0;
+        return (la_op_rj(op) == LA_REG_ZERO && la_op_rk(op) == rj)
+            || (la_op_rk(op) == LA_REG_ZERO && la_op_rj(op) == rj);
+    default:
+        return false;
+    }
+}
+
+static void add_var(struct la_frame *frame, int32_t offset, unsigned size, enum la_frame_access access) {
+    for (size_t i = 0; i < frame->num_vars; i++) {
+        struct la_frame_var *var = &frame->vars[i];
+        if (var->offset == offset) {
+            if (size > var->size) {
+                var->size = size;
+            }
+            var->access |= access;
+            return;
+        }
+    }
+    if (frame->num_vars == LA_FRAME_VARS_MAX) {
+        frame->num_dropped++;
+        return;
+    }
+    frame->vars[frame->num_vars++] = (struct la_frame_var){
+        .offset = offset,
+        .size = size,
+        .access = access,
+    };
+}
+
+static bool is_save_slot(const struct la_frame *frame, int32_t offset) {
+    uint32_t saved = frame->saved;
+
+    while (saved != 0) {
+        unsigned reg = __builtin_ctz(saved);
+        saved &= saved - 1;
+        if (frame->save_offset[reg] == offset) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void track_access(struct la_frame *frame, const struct la_disasm_matcher *m, const struct la_op *op) {
+    la_reg_t base;
+    int32_t disp;
+    int64_t offset;
+
+    if (!la_op_mem_operand(op, &base, &disp)) {
+        return;
+    }
+    if (base == LA_REG_SP && frame->sp_known) {
+        offset = frame->sp + disp;
+    } else if (base == LA_REG_S9 && frame->fp_known) {
+        offset = frame->fp + disp;
+    } else {
+        return;
+    }
+
+    bool store = (m->writes & LA_REG_SLOT_RD) == 0;
+    la_reg_t rd = la_op_rd(op);
+    bool gpr = (op->render_flags & RENDER_FLAG_RD_IS_FPR) == 0;
+
+    /* a callee-saved register stored before the function changed it */
+    if (
+        store
+        && gpr
+        && ((LA_FRAME_CALLEE_SAVED >> rd) & 1)
+        && ((frame->written | frame->saved) >> rd & 1) == 0
+    ) {
+        frame->saved |= 1U << rd;
+        frame->save_offset[rd] = offset;
+        return;
+    }
+    /* restoring it, or storing it again */
+    if (gpr && ((frame->saved >> rd) & 1) && frame->save_offset[rd] == offset) {
+        return;
+    }
+    if (is_save_slot(frame, offset)) {
+        return;
+    }
+    add_var(frame, offset, access_size(op->id), store ? LA_FRAME_WRITE : LA_FRAME_READ);
+}
+
+/* the GPRs written, which takes less than la_op_regs() as only rd is ever written */
+static uint32_t gprs_written(const struct la_disasm_matcher *m, const struct la_op *op) {
+    uint32_t def = (m->writes & LA_REG_SLOT_LINK) ? 1U << LA_REG_RA : 0;
+
+    if ((m->writes & LA_REG_SLOT_RD) && (op->render_flags & RENDER_FLAG_RD_IS_FPR) == 0) {
+        def |= 1U << la_op_rd(op);
+    }
+    return def & ~(1U << LA_REG_ZERO);
+}
+
+static void track_regs(struct la_frame *frame, const struct la_disasm_matcher *m, const struct la_op *op) {
+    uint32_t def = gprs_written(m, op);
+    int64_t imm;
+
+    if (def & LA_REGSET_GPR(LA_REG_SP)) {
+        if (frame->sp_known && is_offset_of(op, LA_REG_SP, &imm)) {
+            frame->sp += imm;
+        } else if (frame->fp_known && is_offset_of(op, LA_REG_S9, &imm)) {
+            frame->sp = frame->fp + imm;
+            frame->sp_known = true;
+        } else {
+            frame->sp_known = false;
+            frame->sp_lost = true;
+        }
+        if (frame->sp_known && -frame->sp > (int64_t)frame->size) {
+            frame->size = -frame->sp;
+        }
+    }
+
+    if (def & LA_REGSET_GPR(LA_REG_S9)) {
+        frame->fp_known = frame->sp_known && is_offset_of(op, LA_REG_SP, &imm);
+        if (frame->fp_known) {
+            frame->fp = frame->sp + imm;
+            if (!frame->uses_fp) {
+                frame->uses_fp = true;
+                frame->fp_offset = frame->fp;
+            }
+        }
+    }
+
+    frame->written |= def;
+}
+
+void la_frame_init(struct la_frame *frame, uint64_t entry) {
+    memset(frame, 0, sizeof(*frame));
+    frame->addr = entry;
+    frame->sp_known = true;
+}
+
+void la_frame_step(struct la_frame *frame, const struct la_op *op) {
+    size_t num_matchers;
+    const struct la_disasm_matcher *m = la_matcher_table(&num_matchers);
+
+    if (op->id >= LA_INSN_UNK) {
+        return;
+    }
+
+    if (op->render_flags & RENDER_FLAG_LOAD_STORE) {
+        track_access(frame, &m[op->id], op);
+    }
+    track_regs(frame, &m[op->id], op);
+
+    /* whatever comes next is reached with the frame set up */
+    if (op->id == LA_INSN_J || (op->id == LA_INSN_JALR && la_op_rd(op) == LA_REG_ZERO)) {
+        frame->sp = -(int64_t)frame->size;
+        frame->sp_known = true;
+        frame->fp = frame->fp_offset;
+        frame->fp_known = frame->uses_fp;
+    }
+}
+
+static int compare_vars(const void *a, const void *b) {
+    const struct la_frame_var *x = a;
+    const struct la_frame_var *y = b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+void la_frame_finish(struct la_frame *frame) {
+    qsort(frame->vars, frame->num_vars, sizeof(frame->vars[0]), compare_vars);
+}
+
+void la_frame_analyze(struct la_frame *frame, const uint8_t *buf, size_t len, uint64_t pc) {
+    la_frame_init(frame, pc);
+    for (size_t off = 0; off + INSN_LENGTH_BYTES <= len; off += INSN_LENGTH_BYTES) {
+        struct la_op op;
+        la_match_insn(la_read_insn_word(buf + off), &op);
+        la_frame_step(frame, &op);
+    }
+    la_frame_finish(frame);
+}
@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "r_loongarch.h"
+
+/* what each kind of evidence is worth */
+#define SCORE_CALLED 4
+#define SCORE_PROLOGUE 3
+#define SCORE_FRAME 1
+#define SCORE_AFTER_RETURN 2
+
+/* zero words and nops skipped after a return, alignment padding */
+#define PADDING_MAX 16
+
+/* bytes scanned per task by la_funcs_scan_regions() */
+#define RANGE_BYTES (1 << 20)
+
+enum {
+    PATTERN_FRAME,
+    PATTERN_CALL,
+    PATTERN_RETURN,
+};
+
+static const char *const patterns[] = {
+    [PATTERN_FRAME] = "addi sp, sp, *",
+    [PATTERN_CALL] = "jal",
+    [PATTERN_RETURN] = "jalr zero, ra",
+};
+
+struct scan {
+    struct la_func_list *list;
+    const uint8_t *buf;
+    size_t len;
+    uint64_t pc;
+    unsigned window;
+    /* sd ra, *(sp) */
+    la_insn_t save_mask;
+    la_insn_t save_match;
+    la_insn_t nop;
+    bool ok;
+};
+
+void la_func_list_init(struct la_func_list *list) {
+    memset(list, 0, sizeof(*list));
+}
+
+void la_func_list_fini(struct la_func_list *list) {
+    free(list->starts);
+    la_func_list_init(list);
+}
+
+static bool add_start(struct la_func_list *list, uint64_t addr, uint32_t evidence, uint32_t calls) {
+    if (list->num_starts == list->capacity) {
+        size_t capacity = list->capacity != 0 ? list->capacity * 2 : 1024;
+        struct la_func_start *starts = realloc(list->starts, capacity * sizeof(*starts));
+        if (starts == NULL) {
+            return false;
+        }
+        list->starts = starts;
+        list->capacity = capacity;
+    }
+
+    struct la_func_start *s = &list->starts[list->num_starts++];
+    s->addr = addr;
+    s->evidence = evidence;
+    s->calls = calls;
+    return true;
+}
+
+static void found_frame(struct scan *scan, uint64_t pc, la_insn_t insn_word) {
+    struct la_op op;
+    int64_t imm;
+
+    la_decode_as(LA_INSN_ADDI, insn_word, &op);
+    if (!la_op_imm(&op, &imm) || imm >= 0) {
+        return;
+    }
+
+    /* is ra saved before long */
+    size_t off = pc - scan->pc;
+    uint32_t evidence = LA_FUNC_FRAME;
+    for (unsigned i = 1; i <= scan->window && off + (i + 1) * INSN_LENGTH_BYTES <= scan->len; i++) {
+        la_insn_t w = la_read_insn_word(scan->buf + off + i * INSN_LENGTH_BYTES);
+        if ((w & scan->save_mask) == scan->save_match) {
+            evidence = LA_FUNC_PROLOGUE;
+            break;
+        }
+    }
+    scan->ok &= add_start(scan->list, pc, evidence, 0);
+}
+
+static void found_call(struct scan *scan, uint64_t pc, la_insn_t insn_word) {
+    struct la_op op;
+    uint64_t target;
+
+    la_decode_as(LA_INSN_JAL, insn_word, &op);
+    if (la_op_jump_target(&op, pc, &target)) {
+        scan->ok &= add_start(scan->list, target, LA_FUNC_CALLED, 1);
+    }
+}
+
+static void found_return(struct scan *scan, uint64_t pc) {
+    size_t off = pc - scan->pc + INSN_LENGTH_BYTES;
+
+    for (unsigned i = 0; off + INSN_LENGTH_BYTES <= scan->len; i++, off += INSN_LENGTH_BYTES) {
+        la_insn_t w = la_read_insn_word(scan->buf + off);
+        if (w != 0 && w != scan->nop) {
+            scan->ok &= add_start(scan->list, scan->pc + off, LA_FUNC_AFTER_RETURN, 0);
+            return;
+        }
+        if (i == PADDING_MAX) {
+            return;
+        }
+    }
+}
+
+static void found(void *user, uint64_t pc, la_insn_t insn_word, unsigned pattern) {
+    struct scan *scan = user;
+
+    switch (pattern) {
+    case PATTERN_FRAME:
+        found_frame(scan, pc, insn_word);
+        break;
+    case PATTERN_CALL:
+        found_call(scan, pc, insn_word);
+        break;
+    case PATTERN_RETURN:
+        found_return(scan, pc);
+        break;
+    }
+}
+
+bool la_funcs_scan(
+    struct la_func_list *list,
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    size_t offset,
+    size_t size,
+    const struct la_funcs_config *config
+) {
+    struct la_search search;
+    struct la_search save;
+    size_t num_matchers;
+
+    /* pattern numbers must line up with PATTERN_* */
+    la_search_init(&search);
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        if (la_search_add(&search, patterns[i]) != LA_SEARCH_OK) {
+            return false;
+        }
+    }
+    la_search_init(&save);
+    if (la_search_add(&save, "sd ra, *(sp)") != LA_SEARCH_OK) {
+        return false;
+    }
+
+    struct scan scan = {
+        .list = list,
+        .buf = buf,
+        .len = len,
+        .pc = pc,
+        .window = config != NULL && config->window != 0 ? config->window : LA_FUNCS_WINDOW_DEFAULT,
+        .save_mask = save.masks[0],
+        .save_match = save.matches[0],
+        /* addi zero, zero, 0 */
+        .nop = la_matcher_table(&num_matchers)[LA_INSN_ADDI].match,
+        .ok = true,
+    };
+
+    if (offset > len) {
+        return true;
+    }
+    if (size > len - offset) {
+        size = len - offset;
+    }
+    la_search_block(&search, buf + offset, size, pc + offset, found, &scan);
+    return scan.ok;
+}
+
+bool la_func_list_merge(struct la_func_list *dst, struct la_func_list *src) {
+    size_t num_starts = dst->num_starts + src->num_starts;
+
+    if (num_starts > dst->capacity) {
+        struct la_func_start *starts = realloc(dst->starts, num_starts * sizeof(*starts));
+        if (starts == NULL) {
+            return false;
+        }
+        dst->starts = starts;
+        dst->capacity = num_starts;
+    }
+    if (src->num_starts != 0) {
+        memcpy(dst->starts + dst->num_starts, src->starts, src->num_starts * sizeof(*src->starts));
+    }
+    dst->num_starts = num_starts;
+    la_func_list_fini(src);
+    return true;
+}
+
+int la_func_score(const struct la_func_start *start) {
+    int score = 0;
+
+    if (start->evidence & LA_FUNC_CALLED) {
+        score += SCORE_CALLED;
+    }
+    /* saving ra says more than lowering sp alone */
+    if (start->evidence & LA_FUNC_PROLOGUE) {
+        score += SCORE_PROLOGUE;
+    } else if (start->evidence & LA_FUNC_FRAME) {
+        score += SCORE_FRAME;
+    }
+    if (start->evidence & LA_FUNC_AFTER_RETURN) {
+        score += SCORE_AFTER_RETURN;
+    }
+    return score;
+}
+
+static int compare_starts(const void *a, const void *b) {
+    const struct la_func_start *x = a;
+    const struct la_func_start *y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+void la_funcs_finish(struct la_func_list *list, const struct la_funcs_config *config) {
+    int min_score = config != NULL && config->min_score != 0 ? config->min_score : LA_FUNCS_MIN_SCORE_DEFAULT;
+    size_t k = 0;
+
+    qsort(list->starts, list->num_starts, sizeof(*list->starts), compare_starts);
+    for (size_t i = 0; i < list->num_starts; ) {
+        struct la_func_start start = list->starts[i++];
+        while (i < list->num_starts && list->starts[i].addr == start.addr) {
+            start.evidence |= list->starts[i].evidence;
+            start.calls += list->starts[i].calls;
+            i++;
+        }
+        if (la_func_score(&start) >= min_score) {
+            list->starts[k++] = start;
+        }
+    }
+    list->num_starts = k;
+}
+
+struct range {
+    size_t region;
+    size_t offset;      /* into the region */
+    size_t size;
+    struct la_func_list list;
+    bool ok;
+};
+
+struct regions_scan {
+    const struct la_funcs_region *regions;
+    const struct la_funcs_config *config;
+    struct range *ranges;
+    size_t num_ranges;
+    size_t next_range;
+};
+
+static void *scan_worker_main(void *arg) {
+    struct regions_scan *scan = arg;
+
+    for (;;) {
+        size_t k = __atomic_fetch_add(&scan->next_range, 1, __ATOMIC_RELAXED);
+        if (k >= scan->num_ranges) {
+            break;
+        }
+        struct range *r = &scan->ranges[k];
+        const struct la_funcs_region *region = &scan->regions[r->region];
+        r->ok = la_funcs_scan(&r->list, region->buf, region->len, region->addr, r->offset, r->size, scan->config);
+    }
+    return NULL;
+}
+
+static int compare_region_addrs(const void *a, const void *b) {
+    const struct la_funcs_region *x = a;
+    const struct la_funcs_region *y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/* drop the starts outside the regions, e.g. calls into other images */
+static bool keep_in_regions(const struct la_funcs_region *regions, size_t num_regions, struct la_func_list *list) {
+    struct la_funcs_region *sorted = malloc(num_regions * sizeof(*sorted) + 1);
+    size_t k = 0;
+
+    if (sorted == NULL) {
+        return false;
+    }
+    memcpy(sorted, regions, num_regions * sizeof(*sorted));
+    qsort(sorted, num_regions, sizeof(*sorted), compare_region_addrs);
+    for (size_t i = 0, j = 0; i < list->num_starts; i++) {
+        uint64_t addr = list->starts[i].addr;
+        while (j < num_regions && addr >= sorted[j].addr && addr - sorted[j].addr >= sorted[j].len) {
+            j++;
+        }
+        if (j < num_regions && addr - sorted[j].addr < sorted[j].len) {
+            list->starts[k++] = list->starts[i];
+        }
+    }
+    list->num_starts = k;
+    free(sorted);
+    return true;
+}
+
+bool la_funcs_scan_regions(
+    struct la_func_list *list,
+    const struct la_funcs_region *regions,
+    size_t num_regions,
+    unsigned num_threads,
+    const struct la_funcs_config *config,
+    struct la_funcs_stats *stats
+) {
+    struct regions_scan scan = { .regions = regions, .config = config };
+
+    for (size_t i = 0; i < num_regions; i++) {
+        scan.num_ranges += (regions[i].len + RANGE_BYTES - 1) / RANGE_BYTES;
+    }
+    scan.ranges = calloc(scan.num_ranges + 1, sizeof(*scan.ranges));
+    if (scan.ranges == NULL) {
+        return false;
+    }
+    for (size_t i = 0, k = 0; i < num_regions; i++) {
+        for (size_t off = 0; off < regions[i].len; off += RANGE_BYTES) {
+            struct range *r = &scan.ranges[k++];
+            r->region = i;
+            r->offset = off;
+            r->size = regions[i].len - off < RANGE_BYTES ? regions[i].len - off : RANGE_BYTES;
+            la_func_list_init(&r->list);
+        }
+    }
+
+    /* the ranges are scanned by address, in parallel, this thread too */
+    if (num_threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = online > 0 ? online : 1;
+    }
+    if (num_threads > scan.num_ranges) {
+        num_threads = scan.num_ranges != 0 ? scan.num_ranges : 1;
+    }
+    pthread_t *threads = calloc(num_threads, sizeof(*threads));
+    unsigned started = 0;
+    for (unsigned i = 0; threads != NULL && i < num_threads - 1; i++) {
+        if (pthread_create(&threads[i], NULL, scan_worker_main, &scan) != 0) {
+            break;
+        }
+        started++;
+    }
+    scan_worker_main(&scan);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    size_t num_candidates = 0;
+    bool ok = true;
+    for (size_t k = 0; k < scan.num_ranges; k++) {
+        num_candidates += scan.ranges[k].list.num_starts;
+        ok = ok && scan.ranges[k].ok && la_func_list_merge(list, &scan.ranges[k].list);
+        la_func_list_fini(&scan.ranges[k].list);
+    }
+    free(scan.ranges);
+    if (!ok) {
+        return false;
+    }
+    la_funcs_finish(list, config);
+    if (stats != NULL) {
+        stats->candidates = num_candidates;
+        stats->threads = started + 1;
+    }
+    return keep_in_regions(regions, num_regions, list);
+}
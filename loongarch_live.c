@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <stdlib.h>
+
+#include "r_loongarch.h"
+
+/*
+ * Register liveness over the blocks of a linear-sweep CFG.
+ *
+ * The image is classified once; every block's use-before-def (gen) and def
+ * (kill) sets then come from one backward walk over its insns, with the
+ * read and write sets of each insn looked up by id. The sets are iterated
+ * to a fixed point in reverse address order, which for the mostly forward
+ * code of a sweep settles in a few passes.
+ */
+
+/* insns classified at a time */
+#define CLASSIFY_CHUNK 4096
+
+static uint8_t *classify_image(const uint8_t *buf, size_t num_insns) {
+    uint8_t rd[CLASSIFY_CHUNK];
+    uint8_t rj[CLASSIFY_CHUNK];
+    uint8_t rk[CLASSIFY_CHUNK];
+    uint32_t imm[CLASSIFY_CHUNK];
+    uint8_t *ids = malloc(num_insns + 1);
+
+    if (ids == NULL) {
+        return NULL;
+    }
+
+    for (size_t base = 0; base < num_insns; base += CLASSIFY_CHUNK) {
+        const struct la_classify_out out = {
+            .ids = ids + base,
+            .rd = rd,
+            .rj = rj,
+            .rk = rk,
+            .imm = imm,
+        };
+        la_classify_block(
+            buf + base * INSN_LENGTH_BYTES,
+            (num_insns - base) * INSN_LENGTH_BYTES,
+            &out,
+            CLASSIFY_CHUNK
+        );
+    }
+    return ids;
+}
+
+struct la_liveness *la_liveness_compute(const struct la_cfg *cfg, const uint8_t *buf) {
+    struct la_liveness *live = calloc(1, sizeof(*live));
+    uint8_t *ids = classify_image(buf, cfg->num_insns);
+    la_regset_t *gen = malloc(cfg->num_blocks * sizeof(*gen) + 1);
+    la_regset_t *kill = malloc(cfg->num_blocks * sizeof(*kill) + 1);
+
+    if (live == NULL || ids == NULL || gen == NULL || kill == NULL) {
+        goto fail;
+    }
+    live->num_blocks = cfg->num_blocks;
+    live->live_in = calloc(cfg->num_blocks + 1, sizeof(*live->live_in));
+    live->live_out = calloc(cfg->num_blocks + 1, sizeof(*live->live_out));
+    if (live->live_in == NULL || live->live_out == NULL) {
+        goto fail;
+    }
+
+    size_t first = 0;
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        size_t end = first + cfg->blocks[b].num_insns;
+        la_regset_t g = 0;
+        la_regset_t k = 0;
+        for (size_t i = end; i-- > first;) {
+            la_regset_t use;
+            la_regset_t def;
+            la_insn_abi_regs(ids[i], la_read_insn_word(buf + i * INSN_LENGTH_BYTES), &use, &def);
+            g = (g & ~def) | use;
+            k |= def;
+        }
+        gen[b] = g;
+        kill[b] = k;
+        live->live_in[b] = g;
+        first = end;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        live->num_passes++;
+        for (size_t b = cfg->num_blocks; b-- > 0;) {
+            const struct la_cfg_block *block = &cfg->blocks[b];
+            la_regset_t out = 0;
+            for (uint32_t e = 0; e < block->num_edges; e++) {
+                const struct la_cfg_edge *edge = &cfg->edges[block->first_edge + e];
+                /* calls return to the next insn of the same block */
+                if (edge->kind != LA_CFG_EDGE_CALL && edge->to != LA_CFG_NO_BLOCK) {
+                    out |= live->live_in[edge->to];
+                }
+            }
+            la_regset_t in = gen[b] | (out & ~kill[b]);
+            if (out != live->live_out[b] || in != live->live_in[b]) {
+                live->live_out[b] = out;
+                live->live_in[b] = in;
+                changed = true;
+            }
+        }
+    }
+
+    free(ids);
+    free(gen);
+    free(kill);
+    return live;
+
+fail:
+    free(ids);
+    free(gen);
+    free(kill);
+    la_liveness_free(live);
+    return NULL;
+}
+
+void la_liveness_free(struct la_liveness *live) {
+    if (live == NULL) {
+        return;
+    }
+    free(live->live_in);
+    free(live->live_out);
+    free(live);
+}
+
+la_regset_t la_liveness_before(
+    const struct la_liveness *live,
+    const struct la_cfg *cfg,
+    const uint8_t *buf,
+    uint64_t addr
+) {
+    uint32_t b = la_cfg_block_at(cfg, addr);
+    if (b == LA_CFG_NO_BLOCK) {
+        return 0;
+    }
+
+    const struct la_cfg_block *block = &cfg->blocks[b];
+    size_t first = (block->addr - cfg->pc) / INSN_LENGTH_BYTES;
+    size_t at = (addr - cfg->pc) / INSN_LENGTH_BYTES;
+    size_t end = first + block->num_insns;
+    la_regset_t after = live->live_out[b];
+
+    /* decode the tail of the block again, it is short */
+    for (size_t i = end; i-- > at;) {
+        la_insn_t word = la_read_insn_word(buf + i * INSN_LENGTH_BYTES);
+        struct la_op op;
+        la_regset_t use;
+        la_regset_t def;
+        la_match_insn(word, &op);
+        la_insn_abi_regs(op.id, word, &use, &def);
+        after = (after & ~def) | use;
+    }
+    return after;
+}
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <string.h>
+
+#include "r_loongarch.h"
+
+static inline uint64_t sext(uint64_t value, unsigned bits) {
+    uint64_t sign = 1ULL << (bits - 1);
+    value &= (sign << 1) - 1;
+    return (value ^ sign) - sign;
+}
+
+static inline bool is_known(const struct la_resolver *r, la_reg_t reg) {
+    return reg < 32 && (r->known >> reg) & 1;
+}
+
+static inline void forget(struct la_resolver *r, la_reg_t reg) {
+    if (reg < 32) {
+        r->known &= ~(1U << reg);
+        r->pc_relative &= ~(1U << reg);
+    }
+}
+
+static void track(struct la_resolver *r, la_reg_t reg, uint64_t value, uint64_t origin, bool pc_relative) {
+    if (reg == LA_REG_ZERO || reg >= 32) {
+        return;
+    }
+
+    r->value[reg] = value;
+    r->origin[reg] = origin;
+    r->set_at[reg] = r->count;
+    r->known |= 1U << reg;
+    if (pc_relative) {
+        r->pc_relative |= 1U << reg;
+    } else {
+        r->pc_relative &= ~(1U << reg);
+    }
+}
+
+/* `rd` = some function of the tracked `src`, which may be `rd` itself */
+static bool derive(
+    struct la_resolver *r,
+    la_reg_t rd,
+    la_reg_t src,
+    uint64_t value,
+    struct la_resolved *out
+) {
+    bool pc_relative = (r->pc_relative >> src) & 1;
+    uint64_t origin = r->origin[src];
+
+    if (rd == LA_REG_ZERO) {
+        return false;
+    }
+
+    track(r, rd, value, origin, pc_relative);
+    out->kind = pc_relative ? LA_RESOLVED_ADDR : LA_RESOLVED_CONST;
+    out->value = value;
+    out->origin = origin;
+    out->reg = rd;
+    return true;
+}
+
+static void expire(struct la_resolver *r) {
+    uint32_t regs = r->known;
+
+    while (regs != 0) {
+        unsigned reg = __builtin_ctz(regs);
+        regs &= regs - 1;
+        if (r->count - r->set_at[reg] > r->window) {
+            forget(r, reg);
+        }
+    }
+}
+
+static bool is_store(enum la_insn_id id) {
+    switch (id) {
+    case LA_INSN_SW_2:
+    case LA_INSN_SD_2:
+    case LA_INSN_SB:
+    case LA_INSN_SH:
+    case LA_INSN_SW:
+    case LA_INSN_SD:
+    case LA_INSN_FSW:
+    case LA_INSN_FSD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* whether rd is a GPR the insn overwrites */
+static bool writes_rd(const struct la_op *op) {
+    if (op->render_flags & (RENDER_FLAG_IMM_JUMP_OFFSET | RENDER_FLAG_RD_IS_FPR)) {
+        return false;
+    }
+    return !is_store(op->id);
+}
+
+void la_resolver_init(struct la_resolver *r, unsigned window) {
+    memset(r, 0, sizeof(*r));
+    r->window = window != 0 ? window : LA_RESOLVE_WINDOW_DEFAULT;
+}
+
+void la_resolver_reset(struct la_resolver *r) {
+    r->known = 0;
+    r->pc_relative = 0;
+}
+
+bool la_resolver_step(
+    struct la_resolver *r,
+    const struct la_op *op,
+    uint64_t pc,
+    struct la_resolved *out
+) {
+    la_reg_t rd = la_op_rd(op);
+    la_reg_t rj = la_op_rj(op);
+    int64_t imm = 0;
+    bool found = false;
+
+    if (pc != r->next_pc) {
+        la_resolver_reset(r);
+    }
+    r->next_pc = pc + INSN_LENGTH_BYTES;
+    r->count++;
+    expire(r);
+
+    la_op_imm(op, &imm);
+
+    switch (op->id) {
+    case LA_INSN_AUI:
+        track(r, rd, sext((uint64_t)imm << 12, 32), pc, false);
+        return false;
+    case LA_INSN_AUIPC:
+        track(r, rd, pc + sext((uint64_t)imm << 12, 32), pc, true);
+        return false;
+    case LA_INSN_AHI:
+        /* bits 32..51, sign-extended */
+        if (is_known(r, rd)) {
+            uint64_t value = (r->value[rd] & 0xffffffffULL) | sext(imm, 20) << 32;
+            return derive(r, rd, rd, value, out);
+        }
+        break;
+    case LA_INSN_ATI:
+        /* bits 52..63 */
+        if (is_known(r, rj)) {
+            uint64_t value = (r->value[rj] & ((1ULL << 52) - 1)) | (uint64_t)imm << 52;
+            return derive(r, rd, rj, value, out);
+        }
+        break;
+    case LA_INSN_ADDI:
+        if (is_known(r, rj)) {
+            return derive(r, rd, rj, r->value[rj] + imm, out);
+        }
+        break;
+    case LA_INSN_ADDIW:
+        if (is_known(r, rj)) {
+            return derive(r, rd, rj, sext(r->value[rj] + imm, 32), out);
+        }
+        break;
+    case LA_INSN_ORI:
+        if (is_known(r, rj)) {
+            return derive(r, rd, rj, r->value[rj] | (uint64_t)imm, out);
+        }
+        break;
+    case LA_INSN_JALR:
+        if (is_known(r, rj)) {
+            out->kind = LA_RESOLVED_JUMP;
+            out->value = r->value[rj];
+            out->origin = r->origin[rj];
+            out->reg = rj;
+            found = true;
+        }
+        la_resolver_reset(r);
+        return found;
+    case LA_INSN_J:
+    case LA_INSN_JAL:
+    case LA_INSN_SYSCALL:
+        la_resolver_reset(r);
+        return false;
+    default:
+        if (op->render_flags & RENDER_FLAG_LOAD_STORE) {
+            la_reg_t base;
+            int32_t disp;
+            if (la_op_mem_operand(op, &base, &disp) && is_known(r, base)) {
+                out->kind = is_store(op->id) ? LA_RESOLVED_STORE : LA_RESOLVED_LOAD;
+                out->value = r->value[base] + disp;
+                out->origin = r->origin[base];
+                out->reg = base;
+                found = true;
+            }
+        }
+        break;
+    }
+
+    if (writes_rd(op)) {
+        forget(r, rd);
+    }
+    return found;
+}
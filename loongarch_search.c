@@ -0,0 +1,656 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LA_SEARCH_X86 1
+#endif
+
+#include "r_loongarch.h"
+
+/*
+ * Pattern search.
+ *
+ * Every kernel tests a block of words against all pairs with one and/cmpeq
+ * per pair, and a mask shared by consecutive pairs is applied once. Blocks
+ * no pair matches, nearly all of them, cost nothing more; the words of the
+ * others go through the scalar checks one by one, which also pick the
+ * pattern reported. The kernels differ only in the block size.
+ */
+
+#define PATTERN_TEXT_MAX 128
+#define OPERANDS_MAX 4
+
+typedef size_t (*search_kernel_fn)(
+    const struct la_search *search,
+    const uint8_t *buf,
+    size_t n,
+    uint64_t pc,
+    la_search_hit_fn hit,
+    void *user
+);
+
+static search_kernel_fn search_kernel;
+static enum la_classify_kernel search_kernel_id;
+
+/* where the rendered operands of a format come from */
+enum slot_kind {
+    SLOT_REG,
+    SLOT_MEM,
+    SLOT_IMM,
+    SLOT_IMM2,
+    SLOT_TARGET,
+};
+
+struct slot {
+    enum slot_kind kind;
+    unsigned shift;     /* of the register field, or the base for SLOT_MEM */
+    bool fpr;
+};
+
+static size_t format_slots(const struct la_disasm_matcher *m, struct slot *slots) {
+    la_render_flag_t flags = m->render_flags;
+    bool rd_fpr = (flags & RENDER_FLAG_RD_IS_FPR) != 0;
+    bool rj_fpr = (flags & RENDER_FLAG_RJ_IS_FPR) != 0;
+    bool rk_fpr = (flags & RENDER_FLAG_RK_IS_FPR) != 0;
+    enum slot_kind imm = (flags & RENDER_FLAG_IMM_JUMP_OFFSET) ? SLOT_TARGET : SLOT_IMM;
+
+#define S(k, s, f) (struct slot){ k, s, f }
+    switch (m->fmt) {
+    case LA_INSN_FORMAT_RR:
+        slots[0] = S(SLOT_REG, 0, rd_fpr);
+        slots[1] = S(SLOT_REG, 5, rj_fpr);
+        return 2;
+    case LA_INSN_FORMAT_RRR:
+        slots[0] = S(SLOT_REG, 0, rd_fpr);
+        slots[1] = S(SLOT_REG, 5, rj_fpr);
+        slots[2] = S(SLOT_REG, 10, rk_fpr);
+        return 3;
+    case LA_INSN_FORMAT_FFFF:
+        slots[0] = S(SLOT_REG, 0, true);
+        slots[1] = S(SLOT_REG, 5, true);
+        slots[2] = S(SLOT_REG, 10, true);
+        slots[3] = S(SLOT_REG, 15, true);
+        return 4;
+    case LA_INSN_FORMAT_RRI6:
+    case LA_INSN_FORMAT_RRI8:
+    case LA_INSN_FORMAT_RRI12:
+    case LA_INSN_FORMAT_RRI14:
+    case LA_INSN_FORMAT_RRI16:
+        slots[0] = S(SLOT_REG, 0, rd_fpr);
+        if (flags & RENDER_FLAG_LOAD_STORE) {
+            slots[1] = S(SLOT_MEM, 5, rj_fpr);
+            return 2;
+        }
+        slots[1] = S(SLOT_REG, 5, rj_fpr);
+        slots[2] = S(imm, 0, false);
+        return 3;
+    case LA_INSN_FORMAT_RRI6I6:
+        slots[0] = S(SLOT_REG, 0, rd_fpr);
+        slots[1] = S(SLOT_REG, 5, rj_fpr);
+        slots[2] = S(SLOT_IMM, 0, false);
+        slots[3] = S(SLOT_IMM2, 0, false);
+        return 4;
+    case LA_INSN_FORMAT_AUI20:
+        slots[0] = S(SLOT_REG, 0, rd_fpr);
+        slots[1] = S(imm, 0, false);
+        return 2;
+    case LA_INSN_FORMAT_RI21:
+        slots[0] = S(SLOT_REG, 5, rj_fpr);
+        slots[1] = S(imm, 0, false);
+        return 2;
+    case LA_INSN_FORMAT_I25:
+        slots[0] = S(imm, 0, false);
+        return 1;
+    default:
+        return 0;
+    }
+#undef S
+}
+
+static char *trim(char *s) {
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t')) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+static bool parse_reg(const char *s, bool fpr, la_reg_t *reg) {
+    for (la_reg_t r = 0; r < 32; r++) {
+        if (strcmp(s, la_reg_name(r, fpr)) == 0) {
+            *reg = r;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* negative numbers as such, anything else unsigned so targets fit */
+static bool parse_num(const char *s, int64_t *v) {
+    char *end;
+
+    if (*s == '\0') {
+        return false;
+    }
+    *v = *s == '-' ? strtoll(s, &end, 0) : (int64_t)strtoull(s, &end, 0);
+    return *end == '\0';
+}
+
+static bool fold_reg(la_insn_t *mask, la_insn_t *match, unsigned shift, la_reg_t reg) {
+    la_insn_t field = (la_insn_t)0x1f << shift;
+
+    /* a fixed field, e.g. of syscall, must agree */
+    if ((*mask & field) == field && ((*match >> shift) & 0x1f) != reg) {
+        return false;
+    }
+    *mask |= field;
+    *match = (*match & ~field) | (la_insn_t)reg << shift;
+    return true;
+}
+
+static void add_check(struct la_search_pair *pair, enum la_search_check_kind kind, int64_t value) {
+    pair->checks[pair->num_checks].kind = kind;
+    pair->checks[pair->num_checks].value = value;
+    pair->num_checks++;
+}
+
+static bool compile_operand(
+    struct la_search_pair *pair,
+    la_insn_t *mask,
+    la_insn_t *match,
+    const struct slot *slot,
+    char *text
+) {
+    la_reg_t reg;
+    int64_t value;
+
+    if (strcmp(text, "*") == 0) {
+        return true;
+    }
+
+    switch (slot->kind) {
+    case SLOT_REG:
+        return parse_reg(text, slot->fpr, &reg) && fold_reg(mask, match, slot->shift, reg);
+    case SLOT_MEM: {
+        char *open = strchr(text, '(');
+        size_t len = strlen(text);
+        if (open == NULL || text[len - 1] != ')') {
+            return false;
+        }
+        *open = '\0';
+        text[len - 1] = '\0';
+        char *disp = trim(text);
+        char *base = trim(open + 1);
+        if (strcmp(base, "*") != 0) {
+            if (!parse_reg(base, slot->fpr, &reg) || !fold_reg(mask, match, slot->shift, reg)) {
+                return false;
+            }
+        }
+        if (strcmp(disp, "*") != 0) {
+            if (!parse_num(disp, &value)) {
+                return false;
+            }
+            add_check(pair, LA_SEARCH_CHECK_DISP, value);
+        }
+        return true;
+    }
+    case SLOT_IMM:
+    case SLOT_IMM2:
+    case SLOT_TARGET:
+        if (!parse_num(text, &value)) {
+            return false;
+        }
+        add_check(
+            pair,
+            slot->kind == SLOT_IMM ? LA_SEARCH_CHECK_IMM
+                : slot->kind == SLOT_IMM2 ? LA_SEARCH_CHECK_IMM2
+                : LA_SEARCH_CHECK_TARGET,
+            value
+        );
+        return true;
+    }
+    return false;
+}
+
+static bool insert_pair(struct la_search *search, la_insn_t mask, la_insn_t match, const struct la_search_pair *pair) {
+    size_t at = search->num_pairs;
+
+    if (at == LA_SEARCH_PATTERNS_MAX) {
+        return false;
+    }
+    /* after the last pair with the same mask, if any */
+    for (size_t i = search->num_pairs; i > 0; i--) {
+        if (search->masks[i - 1] == mask) {
+            at = i;
+            break;
+        }
+    }
+    size_t tail = search->num_pairs - at;
+    memmove(&search->masks[at + 1], &search->masks[at], tail * sizeof(search->masks[0]));
+    memmove(&search->matches[at + 1], &search->matches[at], tail * sizeof(search->matches[0]));
+    memmove(&search->pairs[at + 1], &search->pairs[at], tail * sizeof(search->pairs[0]));
+    search->masks[at] = mask;
+    search->matches[at] = match;
+    search->pairs[at] = *pair;
+    search->num_pairs++;
+    return true;
+}
+
+/* does a matcher earlier in decode order take some of the words */
+static bool is_shadowed(const struct la_disasm_matcher *table, enum la_insn_id id, la_insn_t mask, la_insn_t match) {
+    for (size_t i = 0; i < (size_t)id; i++) {
+        if (((table[i].match ^ match) & table[i].mask & mask) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool same_mnemonic(const char *name, const char *mnemonic) {
+    /* "!nor" and the like may be searched for without the mark */
+    return strcmp(name, mnemonic) == 0 || (mnemonic[0] == '!' && strcmp(name, mnemonic + 1) == 0);
+}
+
+void la_search_init(struct la_search *search) {
+    memset(search, 0, sizeof(*search));
+}
+
+enum la_search_error la_search_add(struct la_search *search, const char *pattern) {
+    char text[PATTERN_TEXT_MAX];
+    struct la_search saved = *search;
+    unsigned index = search->num_patterns;
+
+    if (index == LA_SEARCH_PATTERNS_MAX) {
+        return LA_SEARCH_TOO_MANY_PATTERNS;
+    }
+    if (strlen(pattern) >= sizeof(text)) {
+        return LA_SEARCH_BAD_OPERAND;
+    }
+    strcpy(text, pattern);
+    char *mnemonic = trim(text);
+
+    /* MATCH/MASK */
+    if (*mnemonic >= '0' && *mnemonic <= '9') {
+        char *slash = strchr(mnemonic, '/');
+        int64_t match, mask;
+        if (slash == NULL) {
+            return LA_SEARCH_BAD_OPERAND;
+        }
+        *slash = '\0';
+        if (!parse_num(trim(mnemonic), &match) || !parse_num(trim(slash + 1), &mask)) {
+            return LA_SEARCH_BAD_OPERAND;
+        }
+        struct la_search_pair pair = { .pattern = index, .id = LA_INSN_UNK };
+        if (!insert_pair(search, (la_insn_t)mask, (la_insn_t)(match & mask), &pair)) {
+            return LA_SEARCH_TOO_MANY_PATTERNS;
+        }
+        search->num_patterns++;
+        return LA_SEARCH_OK;
+    }
+
+    /* split off the operands */
+    char *operands[OPERANDS_MAX];
+    size_t num_operands = 0;
+    char *rest = mnemonic + strcspn(mnemonic, " \t");
+    if (*rest != '\0') {
+        *rest++ = '\0';
+        rest = trim(rest);
+        while (*rest != '\0') {
+            if (num_operands == OPERANDS_MAX) {
+                return LA_SEARCH_TOO_MANY_OPERANDS;
+            }
+            char *comma = strchr(rest, ',');
+            if (comma != NULL) {
+                *comma = '\0';
+            }
+            operands[num_operands++] = trim(rest);
+            rest = comma != NULL ? comma + 1 : rest + strlen(rest);
+        }
+    }
+
+    size_t num_matchers;
+    const struct la_disasm_matcher *table = la_matcher_table(&num_matchers);
+    enum la_search_error error = LA_SEARCH_BAD_MNEMONIC;
+    bool added = false;
+
+    for (size_t i = 0; i < num_matchers; i++) {
+        const struct la_disasm_matcher *m = &table[i];
+        struct slot slots[OPERANDS_MAX];
+        char operand[PATTERN_TEXT_MAX];
+
+        if (!same_mnemonic(mnemonic, m->mnemonic)) {
+            continue;
+        }
+        size_t num_slots = format_slots(m, slots);
+        if (num_operands > num_slots) {
+            error = LA_SEARCH_TOO_MANY_OPERANDS;
+            continue;
+        }
+
+        struct la_search_pair pair = { .pattern = index, .id = i };
+        la_insn_t mask = m->mask;
+        la_insn_t match = m->match;
+        bool ok = true;
+        for (size_t k = 0; ok && k < num_operands; k++) {
+            /* parsing a memory operand writes to it */
+            strcpy(operand, operands[k]);
+            ok = compile_operand(&pair, &mask, &match, &slots[k], operand);
+        }
+        if (!ok) {
+            error = LA_SEARCH_BAD_OPERAND;
+            continue;
+        }
+        pair.verify = is_shadowed(table, i, mask, match);
+        if (!insert_pair(search, mask, match, &pair)) {
+            *search = saved;
+            return LA_SEARCH_TOO_MANY_PATTERNS;
+        }
+        added = true;
+    }
+
+    if (!added) {
+        return error;
+    }
+    search->num_patterns++;
+    return LA_SEARCH_OK;
+}
+
+static bool check_pair(const struct la_search_pair *pair, la_insn_t insn_word, uint64_t pc) {
+    struct la_op op;
+
+    if (pair->verify) {
+        la_match_insn(insn_word, &op);
+        if (op.id != pair->id) {
+            return false;
+        }
+    } else if (pair->num_checks != 0) {
+        la_decode_as(pair->id, insn_word, &op);
+    }
+
+    for (unsigned i = 0; i < pair->num_checks; i++) {
+        int64_t value;
+        uint64_t target;
+        la_reg_t base;
+        int32_t disp;
+
+        switch (pair->checks[i].kind) {
+        case LA_SEARCH_CHECK_IMM:
+            if (op.fmt == LA_INSN_FORMAT_RRI6I6) {
+                value = (int64_t)op.insn.rri6i6.imm1
+                    - ((op.render_flags & RENDER_FLAG_IMM_MINUS_32) ? 32 : 0);
+            } else if (!la_op_imm(&op, &value)) {
+                return false;
+            }
+            break;
+        case LA_SEARCH_CHECK_IMM2:
+            value = (int64_t)op.insn.rri6i6.imm2
+                - ((op.render_flags & RENDER_FLAG_IMM_MINUS_32) ? 32 : 0);
+            break;
+        case LA_SEARCH_CHECK_TARGET:
+            if (!la_op_jump_target(&op, pc, &target)) {
+                return false;
+            }
+            value = target;
+            break;
+        case LA_SEARCH_CHECK_DISP:
+            if (!la_op_mem_operand(&op, &base, &disp)) {
+                return false;
+            }
+            value = disp;
+            break;
+        default:
+            return false;
+        }
+        if (value != pair->checks[i].value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* report the word if a pattern matches it, the lowest numbered one */
+static size_t report_word(
+    const struct la_search *search,
+    la_insn_t insn_word,
+    uint64_t pc,
+    la_search_hit_fn hit,
+    void *user
+) {
+    unsigned pattern = LA_SEARCH_PATTERNS_MAX;
+
+    for (size_t p = 0; p < search->num_pairs; p++) {
+        if (
+            (insn_word & search->masks[p]) == search->matches[p]
+            && search->pairs[p].pattern < pattern
+            && check_pair(&search->pairs[p], insn_word, pc)
+        ) {
+            pattern = search->pairs[p].pattern;
+        }
+    }
+    if (pattern == LA_SEARCH_PATTERNS_MAX) {
+        return 0;
+    }
+    hit(user, pc, insn_word, pattern);
+    return 1;
+}
+
+static size_t search_scalar(
+    const struct la_search *search,
+    const uint8_t *buf,
+    size_t n,
+    uint64_t pc,
+    la_search_hit_fn hit,
+    void *user
+) {
+    size_t hits = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        la_insn_t w = la_read_insn_word(buf + i * INSN_LENGTH_BYTES);
+        for (size_t p = 0; p < search->num_pairs; p++) {
+            if ((w & search->masks[p]) == search->matches[p]) {
+                hits += report_word(search, w, pc + i * INSN_LENGTH_BYTES, hit, user);
+                break;
+            }
+        }
+    }
+    return hits;
+}
+
+/* the words of a block some pair matched, `lanes` a bit per word */
+static size_t report_lanes(
+    const struct la_search *search,
+    const uint8_t *buf,
+    uint32_t lanes,
+    uint64_t pc,
+    la_search_hit_fn hit,
+    void *user
+) {
+    size_t hits = 0;
+
+    while (lanes != 0) {
+        unsigned i = __builtin_ctz(lanes);
+        lanes &= lanes - 1;
+        hits += report_word(
+            search,
+            la_read_insn_word(buf + i * INSN_LENGTH_BYTES),
+            pc + i * INSN_LENGTH_BYTES,
+            hit,
+            user
+        );
+    }
+    return hits;
+}
+
+#ifdef LA_SEARCH_X86
+
+static size_t search_sse2(
+    const struct la_search *search,
+    const uint8_t *buf,
+    size_t n,
+    uint64_t pc,
+    la_search_hit_fn hit,
+    void *user
+) {
+    size_t hits = 0;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        const uint8_t *p = buf + i * INSN_LENGTH_BYTES;
+        __m128i w0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i w1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        __m128i any0 = _mm_setzero_si128();
+        __m128i any1 = _mm_setzero_si128();
+        __m128i m0 = w0;
+        __m128i m1 = w1;
+
+        for (size_t k = 0; k < search->num_pairs; k++) {
+            if (k == 0 || search->masks[k] != search->masks[k - 1]) {
+                __m128i mask = _mm_set1_epi32(search->masks[k]);
+                m0 = _mm_and_si128(w0, mask);
+                m1 = _mm_and_si128(w1, mask);
+            }
+            __m128i match = _mm_set1_epi32(search->matches[k]);
+            any0 = _mm_or_si128(any0, _mm_cmpeq_epi32(m0, match));
+            any1 = _mm_or_si128(any1, _mm_cmpeq_epi32(m1, match));
+        }
+
+        uint32_t lanes = _mm_movemask_ps(_mm_castsi128_ps(any0))
+            | _mm_movemask_ps(_mm_castsi128_ps(any1)) << 4;
+        if (lanes != 0) {
+            hits += report_lanes(search, p, lanes, pc + i * INSN_LENGTH_BYTES, hit, user);
+        }
+    }
+
+    /* tail */
+    return hits + search_scalar(search, buf + i * INSN_LENGTH_BYTES, n - i, pc + i * INSN_LENGTH_BYTES, hit, user);
+}
+
+__attribute__((target("avx2")))
+static size_t search_avx2(
+    const struct la_search *search,
+    const uint8_t *buf,
+    size_t n,
+    uint64_t pc,
+    la_search_hit_fn hit,
+    void *user
+) {
+    size_t hits = 0;
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        const uint8_t *p = buf + i * INSN_LENGTH_BYTES;
+        __m256i w0 = _mm256_loadu_si256((const __m256i *)p);
+        __m256i w1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+        __m256i any0 = _mm256_setzero_si256();
+        __m256i any1 = _mm256_setzero_si256();
+        __m256i m0 = w0;
+        __m256i m1 = w1;
+
+        for (size_t k = 0; k < search->num_pairs; k++) {
+            if (k == 0 || search->masks[k] != search->masks[k - 1]) {
+                __m256i mask = _mm256_set1_epi32(search->masks[k]);
+                m0 = _mm256_and_si256(w0, mask);
+                m1 = _mm256_and_si256(w1, mask);
+            }
+            __m256i match = _mm256_set1_epi32(search->matches[k]);
+            any0 = _mm256_or_si256(any0, _mm256_cmpeq_epi32(m0, match));
+            any1 = _mm256_or_si256(any1, _mm256_cmpeq_epi32(m1, match));
+        }
+
+        uint32_t lanes = _mm256_movemask_ps(_mm256_castsi256_ps(any0))
+            | _mm256_movemask_ps(_mm256_castsi256_ps(any1)) << 8;
+        if (lanes != 0) {
+            hits += report_lanes(search, p, lanes, pc + i * INSN_LENGTH_BYTES, hit, user);
+        }
+    }
+
+    /* tail */
+    return hits + search_scalar(search, buf + i * INSN_LENGTH_BYTES, n - i, pc + i * INSN_LENGTH_BYTES, hit, user);
+}
+
+#endif  /* LA_SEARCH_X86 */
+
+static bool kernel_supported(enum la_classify_kernel kernel) {
+    switch (kernel) {
+    case LA_CLASSIFY_SCALAR:
+        return true;
+#ifdef LA_SEARCH_X86
+    case LA_CLASSIFY_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case LA_CLASSIFY_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+__attribute__((constructor))
+static void search_init(void) {
+#ifdef LA_SEARCH_X86
+    __builtin_cpu_init();
+#endif
+    /* pick the best supported kernel */
+    for (int k = LA_CLASSIFY_KERNEL_LAST - 1; k >= 0; k--) {
+        if (la_search_use_kernel(k)) {
+            break;
+        }
+    }
+}
+
+bool la_search_use_kernel(enum la_classify_kernel kernel) {
+    if (!kernel_supported(kernel)) {
+        return false;
+    }
+
+    switch (kernel) {
+#ifdef LA_SEARCH_X86
+    case LA_CLASSIFY_SSE2:
+        search_kernel = search_sse2;
+        break;
+    case LA_CLASSIFY_AVX2:
+        search_kernel = search_avx2;
+        break;
+#endif
+    default:
+        search_kernel = search_scalar;
+        break;
+    }
+    search_kernel_id = kernel;
+    return true;
+}
+
+enum la_classify_kernel la_search_current_kernel(void) {
+    return search_kernel_id;
+}
+
+size_t la_search_block(
+    const struct la_search *search,
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    la_search_hit_fn hit,
+    void *user
+) {
+    if (search->num_pairs == 0) {
+        return 0;
+    }
+    return search_kernel(search, buf, len / INSN_LENGTH_BYTES, pc, hit, user);
+}
+
+const char *la_search_error_name(enum la_search_error error) {
+    switch (error) {
+    case LA_SEARCH_OK:                  return "ok";
+    case LA_SEARCH_BAD_MNEMONIC:        return "unknown mnemonic";
+    case LA_SEARCH_BAD_OPERAND:         return "bad operand";
+    case LA_SEARCH_TOO_MANY_OPERANDS:   return "too many operands";
+    case LA_SEARCH_TOO_MANY_PATTERNS:   return "too many patterns";
+    default:                            return "?";
+    }
+}
@@ -0,0 +1,429 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "r_loongarch.h"
+
+/*
+ * Snapshot file.
+ *
+ *   header         SNAP_HEADER_SIZE bytes
+ *   region table   SNAP_REGION_SIZE bytes per region
+ *   region data    per region, 8-byte aligned: the packed insn arrays
+ *                  (ids, rd, rj, rk, then imm 4-byte aligned) and the
+ *                  leader bitmap of la_cfg_build() (8-byte aligned)
+ *
+ * The header holds the format version, the hash of the matcher table the
+ * insns were decoded with, a byte order mark, and a checksum of the region
+ * table. Each region table entry holds the hash of the bytes the region was
+ * decoded from, and a checksum of its data, which is verified the first
+ * time the region is loaded rather than when the file is opened.
+ *
+ * Region data is stored in host byte order so it can be used in place; a
+ * file written on a host of the other byte order is rejected.
+ */
+
+#define SNAP_MAGIC "LASNAP\0\0"
+/* 2: jump table cases are leaders, 3: found at the region's address */
+#define SNAP_VERSION 3
+#define SNAP_BYTE_ORDER 0x0102030405060708ULL
+#define SNAP_HEADER_SIZE 48
+#define SNAP_REGION_SIZE 48
+
+struct snap_header {
+    char magic[8];
+    uint64_t version;
+    uint64_t byte_order;
+    uint64_t table_hash;
+    uint64_t num_regions;
+    uint64_t regions_checksum;
+};
+
+struct snap_region {
+    uint64_t addr;
+    uint64_t num_insns;
+    uint64_t bytes_hash;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t data_checksum;
+};
+
+enum region_state {
+    REGION_UNCHECKED,
+    REGION_OK,
+    REGION_CORRUPT,
+};
+
+struct la_snapshot {
+    const uint8_t *map;
+    size_t map_size;
+    const struct snap_region *regions;
+    size_t num_regions;
+    uint8_t *states;    /* enum region_state */
+};
+
+_Static_assert(sizeof(struct snap_header) == SNAP_HEADER_SIZE, "snapshot header layout");
+_Static_assert(sizeof(struct snap_region) == SNAP_REGION_SIZE, "snapshot region layout");
+
+static inline size_t align_up(size_t v, size_t align) {
+    return (v + align - 1) & ~(align - 1);
+}
+
+static inline uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * A 64-bit hash of `len` bytes at a few GB/s, for telling whether bytes
+ * changed rather than for adversarial input.
+ */
+uint64_t la_snapshot_hash(const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint64_t lanes[4] = {
+        0x9e3779b97f4a7c15ULL,
+        0xc2b2ae3d27d4eb4fULL,
+        0x165667b19e3779f9ULL,
+        0x27d4eb2f165667c5ULL ^ len,
+    };
+    size_t i = 0;
+
+    /* four independent multiply chains */
+    for (; i + 32 <= len; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            uint64_t w;
+            memcpy(&w, p + i + 8 * k, 8);
+            lanes[k] = (lanes[k] ^ w) * 0x9e3779b97f4a7c15ULL;
+            lanes[k] ^= lanes[k] >> 29;
+        }
+    }
+
+    uint64_t h = lanes[0] ^ mix(lanes[1]) ^ mix(mix(lanes[2])) ^ mix(mix(mix(lanes[3])));
+    for (; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return mix(h);
+}
+
+/* layout of the data of a region of `n` insns */
+static size_t imm_offset(size_t n) {
+    return align_up(4 * n, 4);
+}
+
+static size_t leaders_offset(size_t n) {
+    return align_up(imm_offset(n) + 4 * n, 8);
+}
+
+static size_t region_data_size(size_t n) {
+    return leaders_offset(n) + 8 * ((n + 63) / 64);
+}
+
+/*
+ * Decode the `n` insns at `buf`, located at `addr`, into `out`, which has
+ * region_data_size(n) bytes of room.
+ */
+static bool build_region_data(const uint8_t *buf, size_t n, uint64_t addr, uint8_t *out) {
+    if (n == 0) {
+        return true;
+    }
+
+    struct la_packed_insns *packed = la_packed_new(n);
+    struct la_cfg *cfg = la_cfg_build(buf, n * INSN_LENGTH_BYTES, addr);
+    bool ok = packed != NULL && cfg != NULL;
+
+    if (ok) {
+        la_packed_append(packed, buf, n * INSN_LENGTH_BYTES);
+        memcpy(out, packed->insns.ids, n);
+        memcpy(out + n, packed->insns.rd, n);
+        memcpy(out + 2 * n, packed->insns.rj, n);
+        memcpy(out + 3 * n, packed->insns.rk, n);
+        memset(out + 4 * n, 0, imm_offset(n) - 4 * n);
+        memcpy(out + imm_offset(n), packed->insns.imm, 4 * n);
+        memset(out + imm_offset(n) + 4 * n, 0, leaders_offset(n) - imm_offset(n) - 4 * n);
+        memcpy(out + leaders_offset(n), cfg->leaders, 8 * ((n + 63) / 64));
+    }
+
+    la_cfg_free(cfg);
+    la_packed_free(packed);
+    return ok;
+}
+
+/* the region of `old` decoded from exactly these bytes, if any */
+static const struct snap_region *find_reusable(
+    const struct la_snapshot *old,
+    const struct la_snapshot_region *r,
+    uint64_t bytes_hash
+) {
+    if (old == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < old->num_regions; i++) {
+        const struct snap_region *o = &old->regions[i];
+        if (
+            o->addr == r->addr
+            && o->num_insns == r->len / INSN_LENGTH_BYTES
+            && o->bytes_hash == bytes_hash
+            && la_snapshot_region_load(old, i, NULL, NULL)
+        ) {
+            return o;
+        }
+    }
+    return NULL;
+}
+
+bool la_snapshot_write(
+    const char *path,
+    const struct la_snapshot_region *regions,
+    size_t num_regions,
+    const struct la_snapshot *old,
+    size_t *num_rebuilt
+) {
+    struct snap_header header;
+    struct snap_region *table = calloc(num_regions + 1, sizeof(*table));
+    uint8_t *data = NULL;
+    size_t data_size = 0;
+    char tmp_path[4096];
+    bool ok = false;
+
+    if (num_rebuilt != NULL) {
+        *num_rebuilt = 0;
+    }
+    if (table == NULL) {
+        return false;
+    }
+
+    size_t table_end = SNAP_HEADER_SIZE + num_regions * SNAP_REGION_SIZE;
+    size_t data_start = align_up(table_end, 8);
+    size_t offset = data_start;
+    for (size_t i = 0; i < num_regions; i++) {
+        size_t n = regions[i].len / INSN_LENGTH_BYTES;
+        table[i].addr = regions[i].addr;
+        table[i].num_insns = n;
+        table[i].bytes_hash = la_snapshot_hash(regions[i].buf, n * INSN_LENGTH_BYTES);
+        table[i].data_offset = offset;
+        table[i].data_size = region_data_size(n);
+        offset += align_up(table[i].data_size, 8);
+    }
+    data_size = offset - data_start;
+
+    data = calloc(1, data_size + 1);
+    if (data == NULL) {
+        goto out;
+    }
+
+    for (size_t i = 0; i < num_regions; i++) {
+        struct snap_region *t = &table[i];
+        uint8_t *out = data + (t->data_offset - data_start);
+        const struct snap_region *o = find_reusable(old, &regions[i], t->bytes_hash);
+
+        if (o != NULL) {
+            memcpy(out, old->map + o->data_offset, t->data_size);
+        } else {
+            if (!build_region_data(regions[i].buf, t->num_insns, t->addr, out)) {
+                errno = ENOMEM;
+                goto out;
+            }
+            if (num_rebuilt != NULL) {
+                (*num_rebuilt)++;
+            }
+        }
+        t->data_checksum = la_snapshot_hash(out, t->data_size);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAP_MAGIC, 8);
+    header.version = SNAP_VERSION;
+    header.byte_order = SNAP_BYTE_ORDER;
+    header.table_hash = la_matcher_table_hash();
+    header.num_regions = num_regions;
+    header.regions_checksum = la_snapshot_hash(table, num_regions * SNAP_REGION_SIZE);
+
+    /* replace the file atomically, it may be mapped by someone else */
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+        errno = ENAMETOOLONG;
+        goto out;
+    }
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        goto out;
+    }
+    static const uint8_t zeros[8];
+    ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(table, SNAP_REGION_SIZE, num_regions, f) == num_regions
+        && fwrite(zeros, 1, data_start - table_end, f) == data_start - table_end
+        && fwrite(data, 1, data_size, f) == data_size;
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (ok && rename(tmp_path, path) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        int saved_errno = errno;
+        unlink(tmp_path);
+        errno = saved_errno;
+    }
+
+out:
+    free(data);
+    free(table);
+    return ok;
+}
+
+struct la_snapshot *la_snapshot_open(const char *path) {
+    struct la_snapshot *snap = NULL;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0) {
+        goto fail;
+    }
+    if ((size_t)st.st_size < SNAP_HEADER_SIZE) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    snap = calloc(1, sizeof(*snap));
+    if (snap == NULL) {
+        goto fail;
+    }
+    snap->map_size = st.st_size;
+    snap->map = mmap(NULL, snap->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (snap->map == MAP_FAILED) {
+        snap->map = NULL;
+        goto fail;
+    }
+    close(fd);
+    fd = -1;
+
+    const struct snap_header *h = (const struct snap_header *)snap->map;
+    if (
+        memcmp(h->magic, SNAP_MAGIC, 8) != 0
+        || h->version != SNAP_VERSION
+        || h->byte_order != SNAP_BYTE_ORDER
+        || h->num_regions > (snap->map_size - SNAP_HEADER_SIZE) / SNAP_REGION_SIZE
+    ) {
+        errno = EINVAL;
+        goto fail;
+    }
+    /* decoded by another table: everything in it may be wrong */
+    if (h->table_hash != la_matcher_table_hash()) {
+        errno = ESTALE;
+        goto fail;
+    }
+
+    snap->num_regions = h->num_regions;
+    snap->regions = (const struct snap_region *)(snap->map + SNAP_HEADER_SIZE);
+    if (la_snapshot_hash(snap->regions, snap->num_regions * SNAP_REGION_SIZE) != h->regions_checksum) {
+        errno = EINVAL;
+        goto fail;
+    }
+    for (size_t i = 0; i < snap->num_regions; i++) {
+        const struct snap_region *r = &snap->regions[i];
+        if (
+            r->num_insns > SIZE_MAX / 8
+            || r->data_size != region_data_size(r->num_insns)
+            || r->data_offset % 8 != 0
+            || r->data_offset > snap->map_size
+            || r->data_size > snap->map_size - r->data_offset
+        ) {
+            errno = EINVAL;
+            goto fail;
+        }
+    }
+
+    snap->states = calloc(snap->num_regions + 1, 1);
+    if (snap->states == NULL) {
+        goto fail;
+    }
+    return snap;
+
+fail:
+    if (fd >= 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+    }
+    la_snapshot_close(snap);
+    return NULL;
+}
+
+void la_snapshot_close(struct la_snapshot *snap) {
+    if (snap == NULL) {
+        return;
+    }
+
+    if (snap->map != NULL) {
+        munmap((void *)snap->map, snap->map_size);
+    }
+    free(snap->states);
+    free(snap);
+}
+
+size_t la_snapshot_num_regions(const struct la_snapshot *snap) {
+    return snap->num_regions;
+}
+
+void la_snapshot_region_info(const struct la_snapshot *snap, size_t i, uint64_t *addr, size_t *num_insns) {
+    *addr = snap->regions[i].addr;
+    *num_insns = snap->regions[i].num_insns;
+}
+
+bool la_snapshot_region_matches(const struct la_snapshot *snap, size_t i, uint64_t addr, const uint8_t *buf, size_t len) {
+    const struct snap_region *r = &snap->regions[i];
+
+    return (
+        r->addr == addr
+        && r->num_insns == len / INSN_LENGTH_BYTES
+        && r->bytes_hash == la_snapshot_hash(buf, r->num_insns * INSN_LENGTH_BYTES)
+    );
+}
+
+bool la_snapshot_region_load(
+    const struct la_snapshot *snap,
+    size_t i,
+    struct la_packed_insns *insns,
+    const uint64_t **leaders
+) {
+    const struct snap_region *r = &snap->regions[i];
+    const uint8_t *data = snap->map + r->data_offset;
+    size_t n = r->num_insns;
+
+    /* only touch the pages of regions actually used */
+    if (snap->states[i] == REGION_UNCHECKED) {
+        snap->states[i] = la_snapshot_hash(data, r->data_size) == r->data_checksum
+            ? REGION_OK
+            : REGION_CORRUPT;
+    }
+    if (snap->states[i] != REGION_OK) {
+        return false;
+    }
+
+    /* read-only views of the mapping */
+    if (insns != NULL) {
+        insns->insns.ids = (uint8_t *)data;
+        insns->insns.rd = (uint8_t *)data + n;
+        insns->insns.rj = (uint8_t *)data + 2 * n;
+        insns->insns.rk = (uint8_t *)data + 3 * n;
+        insns->insns.imm = (uint32_t *)(data + imm_offset(n));
+        insns->num_insns = n;
+        insns->capacity = n;
+    }
+    if (leaders != NULL) {
+        *leaders = (const uint64_t *)(data + leaders_offset(n));
+    }
+    return true;
+}
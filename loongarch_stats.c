@@ -0,0 +1,333 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "r_loongarch.h"
+
+/*
+ * Decoder statistics.
+ *
+ * Only built with -DLA_DECODE_STATS (`make LA_STATS=1`); otherwise the
+ * hooks in the decoder compile to nothing and the functions below report
+ * that there are no statistics.
+ *
+ * Every thread counts into its own block, allocated the first time it
+ * decodes and linked into a global list, so the hot path is a TLS load and
+ * a few plain increments. Blocks outlive their threads, so nothing counted
+ * is lost. Render times are kept in timestamp counter ticks where there is
+ * one and converted to ns when read; only one in LA_STATS_RENDER_SAMPLE
+ * renders is timed, as reading the clock costs about as much as rendering.
+ */
+
+#ifdef LA_DECODE_STATS
+
+#include <pthread.h>
+
+struct stats_block {
+    struct la_decode_stats stats;
+    struct stats_block *next;
+};
+
+__attribute__((tls_model("initial-exec")))
+_Thread_local struct la_decode_stats *la_stats_local;
+
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_block *blocks;
+/* for converting ticks to ns */
+static uint64_t base_ticks;
+static uint64_t base_ns;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t la_stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+struct la_decode_stats *la_stats_register(void) {
+    struct stats_block *b = calloc(1, sizeof(*b));
+    static struct la_decode_stats dummy;
+
+    /* count into a shared block rather than not at all */
+    if (b == NULL) {
+        return la_stats_local = &dummy;
+    }
+
+    pthread_mutex_lock(&blocks_lock);
+    if (blocks == NULL) {
+        base_ticks = la_stats_ticks();
+        base_ns = now_ns();
+    }
+    b->next = blocks;
+    blocks = b;
+    pthread_mutex_unlock(&blocks_lock);
+    return la_stats_local = &b->stats;
+}
+
+bool la_decode_stats_get(struct la_decode_stats *out) {
+    uint64_t ticks;
+    uint64_t ns;
+
+    memset(out, 0, sizeof(*out));
+
+    pthread_mutex_lock(&blocks_lock);
+    for (const struct stats_block *b = blocks; b != NULL; b = b->next) {
+        const uint64_t *src = (const uint64_t *)&b->stats;
+        uint64_t *dst = (uint64_t *)out;
+        for (size_t i = 0; i < sizeof(*out) / sizeof(uint64_t); i++) {
+            dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+    }
+    ticks = la_stats_ticks() - base_ticks;
+    ns = now_ns() - base_ns;
+    pthread_mutex_unlock(&blocks_lock);
+
+    if (ticks != 0) {
+        for (int f = 0; f < LA_INSN_FORMAT_LAST; f++) {
+            out->render_ns[f] = (uint64_t)((double)out->render_ns[f] * ns / ticks);
+        }
+    }
+    return true;
+}
+
+void la_decode_stats_reset(void) {
+    pthread_mutex_lock(&blocks_lock);
+    for (struct stats_block *b = blocks; b != NULL; b = b->next) {
+        uint64_t *p = (uint64_t *)&b->stats;
+        for (size_t i = 0; i < sizeof(b->stats) / sizeof(uint64_t); i++) {
+            __atomic_store_n(&p[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+#else
+
+bool la_decode_stats_get(struct la_decode_stats *out) {
+    memset(out, 0, sizeof(*out));
+    return false;
+}
+
+void la_decode_stats_reset(void) {
+}
+
+#endif  /* LA_DECODE_STATS */
+
+static const char *format_names[LA_INSN_FORMAT_LAST] = {
+    "unknown", "rr", "rrr", "ffff", "rri6", "rri8", "rri12",
+    "rri6i6", "rri14", "rri16", "aui20", "ri21", "i25",
+};
+
+struct out_buf {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool failed;
+};
+
+static void out_printf(struct out_buf *o, const char *fmt, ...) {
+    va_list ap;
+
+    for (;;) {
+        va_start(ap, fmt);
+        int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            o->failed = true;
+            return;
+        }
+        if ((size_t)n < o->cap - o->len) {
+            o->len += n;
+            return;
+        }
+
+        size_t cap = o->cap * 2 > o->len + n + 1 ? o->cap * 2 : o->len + n + 1;
+        char *buf = realloc(o->buf, cap);
+        if (buf == NULL) {
+            o->failed = true;
+            return;
+        }
+        o->buf = buf;
+        o->cap = cap;
+    }
+}
+
+static const char *mnemonic_of(int id) {
+    size_t num_matchers;
+    const struct la_disasm_matcher *matchers = la_matcher_table(&num_matchers);
+    return (size_t)id < num_matchers ? matchers[id].mnemonic : "unk";
+}
+
+/* one row per counter: kind, key, count, and timed renders and their ns */
+static void dump_csv(struct out_buf *o, const struct la_decode_stats *s) {
+    out_printf(o, "kind,key,count,timed,ns\n");
+    for (int id = 0; id < LA_INSN_LAST; id++) {
+        if (s->hits[id] != 0) {
+            out_printf(o, "hit,%s,%" PRIu64 ",,\n", mnemonic_of(id), s->hits[id]);
+        }
+    }
+    for (int d = 0; d <= LA_STATS_PROBES_MAX; d++) {
+        if (s->probes[d] != 0) {
+            out_printf(o, "probes,%d%s,%" PRIu64 ",,\n", d, d == LA_STATS_PROBES_MAX ? "+" : "", s->probes[d]);
+        }
+    }
+    for (int f = 0; f < LA_INSN_FORMAT_LAST; f++) {
+        if (s->render_count[f] != 0) {
+            out_printf(
+                o,
+                "render,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                format_names[f],
+                s->render_count[f],
+                s->render_timed[f],
+                s->render_ns[f]
+            );
+        }
+    }
+}
+
+static void dump_json(struct out_buf *o, const struct la_decode_stats *s) {
+    const char *sep = "";
+
+    out_printf(o, "{\"hits\":{");
+    for (int id = 0; id < LA_INSN_LAST; id++) {
+        if (s->hits[id] != 0) {
+            out_printf(o, "%s\"%s\":%" PRIu64, sep, mnemonic_of(id), s->hits[id]);
+            sep = ",";
+        }
+    }
+    out_printf(o, "},\"probes\":[");
+    for (int d = 0; d <= LA_STATS_PROBES_MAX; d++) {
+        out_printf(o, "%s%" PRIu64, d != 0 ? "," : "", s->probes[d]);
+    }
+    out_printf(o, "],\"render\":{");
+    sep = "";
+    for (int f = 0; f < LA_INSN_FORMAT_LAST; f++) {
+        if (s->render_count[f] != 0) {
+            out_printf(
+                o,
+                "%s\"%s\":{\"count\":%" PRIu64 ",\"timed\":%" PRIu64 ",\"ns\":%" PRIu64 "}",
+                sep,
+                format_names[f],
+                s->render_count[f],
+                s->render_timed[f],
+                s->render_ns[f]
+            );
+            sep = ",";
+        }
+    }
+    out_printf(o, "}}\n");
+}
+
+static void dump_text(struct out_buf *o, const struct la_decode_stats *s) {
+    uint64_t words = 0;
+    uint64_t probes = 0;
+
+    for (int id = 0; id < LA_INSN_LAST; id++) {
+        words += s->hits[id];
+    }
+    for (int d = 0; d <= LA_STATS_PROBES_MAX; d++) {
+        probes += d * s->probes[d];
+    }
+
+    out_printf(
+        o,
+        "%" PRIu64 " words decoded, %.2f%% unk, %.2f candidates compared per word\n",
+        words,
+        words != 0 ? 100.0 * s->hits[LA_INSN_UNK] / words : 0.0,
+        words != 0 ? (double)probes / words : 0.0
+    );
+    for (int id = 0; id < LA_INSN_LAST; id++) {
+        if (s->hits[id] != 0) {
+            out_printf(o, "  %-12s %12" PRIu64 " %6.2f%%\n", mnemonic_of(id), s->hits[id], 100.0 * s->hits[id] / words);
+        }
+    }
+    out_printf(o, "candidates compared:\n");
+    for (int d = 0; d <= LA_STATS_PROBES_MAX; d++) {
+        if (s->probes[d] != 0) {
+            out_printf(o, "  %2d%s %12" PRIu64 "\n", d, d == LA_STATS_PROBES_MAX ? "+" : " ", s->probes[d]);
+        }
+    }
+    out_printf(o, "render time by format:\n");
+    for (int f = 0; f < LA_INSN_FORMAT_LAST; f++) {
+        if (s->render_timed[f] != 0) {
+            out_printf(
+                o,
+                "  %-8s %12" PRIu64 " insns %8.1f ns/insn\n",
+                format_names[f],
+                s->render_count[f],
+                (double)s->render_ns[f] / s->render_timed[f]
+            );
+        }
+    }
+}
+
+char *la_decode_stats_dump(enum la_stats_format format) {
+    struct la_decode_stats stats;
+    struct out_buf o = { .buf = malloc(4096), .cap = 4096 };
+
+    if (o.buf == NULL) {
+        return NULL;
+    }
+    o.buf[0] = '\0';
+
+    if (!la_decode_stats_get(&stats)) {
+        out_printf(&o, "decoder statistics are not compiled in, build with LA_STATS=1\n");
+    } else if (format == LA_STATS_CSV) {
+        dump_csv(&o, &stats);
+    } else if (format == LA_STATS_JSON) {
+        dump_json(&o, &stats);
+    } else {
+        dump_text(&o, &stats);
+    }
+
+    if (o.failed) {
+        free(o.buf);
+        return NULL;
+    }
+    return o.buf;
+}
+
+bool la_decode_stats_dump_env(void) {
+    const char *path = getenv(LA_STATS_ENV);
+    enum la_stats_format format = LA_STATS_TEXT;
+
+    if (path == NULL || *path == '\0') {
+        return true;
+    }
+
+    size_t len = strlen(path);
+    if (len >= 5 && strcmp(path + len - 5, ".json") == 0) {
+        format = LA_STATS_JSON;
+    } else if (len >= 4 && strcmp(path + len - 4, ".csv") == 0) {
+        format = LA_STATS_CSV;
+    }
+
+    char *text = la_decode_stats_dump(format);
+    if (text == NULL) {
+        return false;
+    }
+
+    bool ok;
+    if (strcmp(path, "-") == 0) {
+        ok = fputs(text, stderr) >= 0;
+    } else {
+        FILE *f = fopen(path, "w");
+        ok = f != NULL && fputs(text, f) >= 0;
+        if (f != NULL && fclose(f) != 0) {
+            ok = false;
+        }
+    }
+    free(text);
+    return ok;
+}
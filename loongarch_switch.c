@@ -0,0 +1,457 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <string.h>
+
+#include "r_loongarch.h"
+
+/* how deep register values are followed, e.g. auipc, addi, or */
+#define VALUE_DEPTH_MAX 6
+#define NO_DEF SIZE_MAX
+
+struct slicer {
+    const uint8_t *buf;
+    size_t len;
+    uint64_t pc;
+    size_t lo;              /* first insn the slice may look at */
+    unsigned steps;
+    unsigned max_steps;
+    bool out_of_budget;
+};
+
+static inline uint64_t sext(uint64_t value, unsigned bits) {
+    uint64_t sign = 1ULL << (bits - 1);
+    value &= (sign << 1) - 1;
+    return (value ^ sign) - sign;
+}
+
+static inline uint64_t addr_of(const struct slicer *s, size_t i) {
+    return s->pc + i * INSN_LENGTH_BYTES;
+}
+
+/* decode insn `i`, counting it against the budget */
+static bool decode(struct slicer *s, size_t i, struct la_op *op) {
+    if (s->steps == s->max_steps) {
+        s->out_of_budget = true;
+        return false;
+    }
+    s->steps++;
+    la_match_insn(la_read_insn_word(s->buf + i * INSN_LENGTH_BYTES), op);
+    return true;
+}
+
+/*
+ * Control only reaches the insns before a jump by branching, and what a
+ * syscall writes is not known.
+ */
+static bool is_barrier(const struct la_op *op) {
+    switch (op->id) {
+    case LA_INSN_J:
+    case LA_INSN_SYSCALL:
+        return true;
+    case LA_INSN_JALR:
+        return la_op_rd(op) == LA_REG_ZERO;
+    default:
+        return false;
+    }
+}
+
+/* the GPRs written by insn `i`, a call writing those it does not preserve */
+static la_regset_t defs_of(const struct slicer *s, size_t i, const struct la_op *op) {
+    la_regset_t use;
+    la_regset_t def;
+
+    la_insn_abi_regs(op->id, la_read_insn_word(s->buf + i * INSN_LENGTH_BYTES), &use, &def);
+    return def;
+}
+
+/*
+ * Find the last insn before insn `before` writing GPR `reg`.
+ *
+ * Returns its index, or NO_DEF.
+ */
+static size_t find_def(struct slicer *s, la_reg_t reg, size_t before, struct la_op *op) {
+    if (reg == LA_REG_ZERO || reg >= 32) {
+        return NO_DEF;
+    }
+
+    for (size_t i = before; i-- > s->lo;) {
+        if (!decode(s, i, op) || is_barrier(op)) {
+            return NO_DEF;
+        }
+        if (defs_of(s, i, op) & LA_REGSET_GPR(reg)) {
+            return i;
+        }
+    }
+    return NO_DEF;
+}
+
+/*
+ * Get the value of `reg` right before insn `before`, if it is put together
+ * from constants by aui/auipc, ahi/ati, addi/addiw/ori and moves.
+ */
+static bool find_value(struct slicer *s, la_reg_t reg, size_t before, unsigned depth, uint64_t *value) {
+    struct la_op op;
+    int64_t imm = 0;
+    uint64_t src;
+
+    if (reg == LA_REG_ZERO) {
+        *value = 0;
+        return true;
+    }
+    if (depth == VALUE_DEPTH_MAX) {
+        return false;
+    }
+
+    size_t i = find_def(s, reg, before, &op);
+    if (i == NO_DEF) {
+        return false;
+    }
+    la_op_imm(&op, &imm);
+
+    switch (op.id) {
+    case LA_INSN_AUI:
+        *value = sext((uint64_t)imm << 12, 32);
+        return true;
+    case LA_INSN_AUIPC:
+        *value = addr_of(s, i) + sext((uint64_t)imm << 12, 32);
+        return true;
+    case LA_INSN_AHI:
+        if (!find_value(s, la_op_rd(&op), i, depth + 1, &src)) {
+            return false;
+        }
+        *value = (src & 0xffffffffULL) | sext(imm, 20) << 32;
+        return true;
+    case LA_INSN_ATI:
+        if (!find_value(s, la_op_rj(&op), i, depth + 1, &src)) {
+            return false;
+        }
+        *value = (src & ((1ULL << 52) - 1)) | (uint64_t)imm << 52;
+        return true;
+    case LA_INSN_ADDI:
+        if (!find_value(s, la_op_rj(&op), i, depth + 1, &src)) {
+            return false;
+        }
+        *value = src + imm;
+        return true;
+    case LA_INSN_ADDIW:
+        if (!find_value(s, la_op_rj(&op), i, depth + 1, &src)) {
+            return false;
+        }
+        *value = sext(src + imm, 32);
+        return true;
+    case LA_INSN_ORI:
+        if (!find_value(s, la_op_rj(&op), i, depth + 1, &src)) {
+            return false;
+        }
+        *value = src | (uint64_t)imm;
+        return true;
+    case LA_INSN_OR:
+        /* mv rd, rk */
+        if (la_op_rj(&op) == LA_REG_ZERO) {
+            return find_value(s, la_op_rk(&op), i, depth + 1, value);
+        }
+        if (la_op_rk(&op) == LA_REG_ZERO) {
+            return find_value(s, la_op_rj(&op), i, depth + 1, value);
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+static unsigned entry_size_of(enum la_insn_id id) {
+    switch (id) {
+    case LA_INSN_LD:
+    case LA_INSN_LD_2:
+        return 8;
+    case LA_INSN_LW:
+    case LA_INSN_LW_2:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+/* whether insn `i` is beqz/bnez on `reg`, for some i in [from, to), before `reg` is written */
+static bool tests_flag(struct slicer *s, la_reg_t reg, size_t from, size_t to) {
+    struct la_op op;
+
+    for (size_t i = from; i < to; i++) {
+        if (!decode(s, i, &op)) {
+            return false;
+        }
+        if ((op.id == LA_INSN_BEQZ || op.id == LA_INSN_BNEZ) && la_op_rj(&op) == reg) {
+            return true;
+        }
+        if (defs_of(s, i, &op) & LA_REGSET_GPR(reg)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/*
+ * Find the bounds check of `index` before insn `before`: sltiu c, index, n
+ * tested by beqz/bnez c, or bgtu/bleu of index against a constant.
+ *
+ * Returns the number of cases, 0 if there is no check.
+ */
+static uint64_t find_bound(struct slicer *s, la_reg_t index, size_t before, size_t site) {
+    struct la_op op;
+    uint64_t limit;
+
+    for (size_t i = before; i-- > s->lo;) {
+        if (!decode(s, i, &op) || is_barrier(&op)) {
+            return 0;
+        }
+
+        switch (op.id) {
+        case LA_INSN_SLTIU: {
+            int64_t imm;
+            if (la_op_rj(&op) == index && la_op_imm(&op, &imm) && imm > 0 && tests_flag(s, la_op_rd(&op), i + 1, site)) {
+                return imm;
+            }
+            break;
+        }
+        /* bgtu taken if rd > rj, bleu taken if rd <= rj */
+        case LA_INSN_BGTU:
+        case LA_INSN_BLEU:
+            if (la_op_rd(&op) == index && find_value(s, la_op_rj(&op), i, 0, &limit)) {
+                return limit + 1;
+            }
+            if (la_op_rj(&op) == index && find_value(s, la_op_rd(&op), i, 0, &limit)) {
+                return limit;
+            }
+            break;
+        default:
+            break;
+        }
+
+        /* a check before the index was set checks something else */
+        if (defs_of(s, i, &op) & LA_REGSET_GPR(index)) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Match the load address, base + (index << log2(entry_size)).
+ */
+static enum la_switch_result find_index(
+    struct slicer *s,
+    la_reg_t addr_reg,
+    size_t before,
+    struct la_switch *out,
+    size_t *scaled_at
+) {
+    struct la_op add;
+    struct la_op shift;
+
+    size_t i = find_def(s, addr_reg, before, &add);
+    if (i == NO_DEF || add.id != LA_INSN_ADD) {
+        return LA_SWITCH_NO_INDEX;
+    }
+
+    const la_reg_t regs[2] = { la_op_rj(&add), la_op_rk(&add) };
+    enum la_switch_result result = LA_SWITCH_NO_INDEX;
+    for (int k = 0; k < 2; k++) {
+        size_t j = find_def(s, regs[k], i, &shift);
+        int64_t amount;
+        if (
+            j == NO_DEF
+            || shift.id != LA_INSN_SLLI
+            || !la_op_imm(&shift, &amount)
+            || amount > 3
+            || (1U << amount) != out->entry_size
+        ) {
+            continue;
+        }
+        if (!find_value(s, regs[1 - k], i, 0, &out->table)) {
+            result = LA_SWITCH_NO_BASE;
+            continue;
+        }
+        out->index = la_op_rj(&shift);
+        *scaled_at = j;
+        return LA_SWITCH_RESOLVED;
+    }
+    return result;
+}
+
+/*
+ * Match the target, loaded from the table or loaded and added to a base.
+ */
+static enum la_switch_result find_load(struct slicer *s, la_reg_t target, size_t site, struct la_op *load, size_t *load_at, struct la_switch *out) {
+    struct la_op op;
+
+    size_t i = find_def(s, target, site, &op);
+    if (i == NO_DEF) {
+        return LA_SWITCH_NO_LOAD;
+    }
+    if (entry_size_of(op.id) != 0) {
+        *load = op;
+        *load_at = i;
+        out->relative = false;
+        return LA_SWITCH_RESOLVED;
+    }
+    if (op.id != LA_INSN_ADD) {
+        return LA_SWITCH_NO_LOAD;
+    }
+
+    const la_reg_t regs[2] = { la_op_rj(&op), la_op_rk(&op) };
+    for (int k = 0; k < 2; k++) {
+        size_t j = find_def(s, regs[k], i, load);
+        if (j != NO_DEF && entry_size_of(load->id) != 0) {
+            if (!find_value(s, regs[1 - k], i, 0, &out->base)) {
+                return LA_SWITCH_NO_BASE;
+            }
+            *load_at = j;
+            out->relative = true;
+            return LA_SWITCH_RESOLVED;
+        }
+    }
+    return LA_SWITCH_NO_LOAD;
+}
+
+static bool read_table(
+    const struct slicer *s,
+    const struct la_switch_config *config,
+    uint64_t addr,
+    uint8_t *out,
+    size_t size
+) {
+    if (config->read != NULL) {
+        return config->read(config->user, addr, out, size);
+    }
+    if (addr < s->pc || addr - s->pc > s->len || size > s->len - (addr - s->pc)) {
+        return false;
+    }
+    memcpy(out, s->buf + (addr - s->pc), size);
+    return true;
+}
+
+static enum la_switch_result resolve(
+    struct slicer *s,
+    const struct la_switch_config *config,
+    size_t site,
+    struct la_switch *out
+) {
+    struct la_op op;
+    struct la_op load;
+    size_t load_at;
+    size_t scaled_at;
+    la_reg_t base;
+    int32_t disp;
+    enum la_switch_result result;
+
+    if (!decode(s, site, &op) || op.id != LA_INSN_JALR || la_op_rd(&op) != LA_REG_ZERO || la_op_rj(&op) == LA_REG_RA) {
+        return LA_SWITCH_NO_LOAD;
+    }
+    out->site = addr_of(s, site);
+
+    result = find_load(s, la_op_rj(&op), site, &load, &load_at, out);
+    if (result != LA_SWITCH_RESOLVED) {
+        return result;
+    }
+    out->entry_size = entry_size_of(load.id);
+    la_op_mem_operand(&load, &base, &disp);
+
+    result = find_index(s, base, load_at, out, &scaled_at);
+    if (result != LA_SWITCH_RESOLVED) {
+        return result;
+    }
+    out->table += disp;
+
+    uint64_t num_cases = find_bound(s, out->index, scaled_at, site);
+    if (num_cases == 0) {
+        return LA_SWITCH_NO_BOUND;
+    }
+    unsigned max_cases = config->max_cases != 0 && config->max_cases < LA_SWITCH_CASES_MAX
+        ? config->max_cases
+        : LA_SWITCH_CASES_MAX;
+    if (num_cases > max_cases) {
+        return LA_SWITCH_BAD_TABLE;
+    }
+
+    uint8_t table[LA_SWITCH_CASES_MAX * 8];
+    if (!read_table(s, config, out->table, table, num_cases * out->entry_size)) {
+        return LA_SWITCH_BAD_TABLE;
+    }
+    for (size_t k = 0; k < num_cases; k++) {
+        const uint8_t *entry = table + k * out->entry_size;
+        uint64_t value = la_read_insn_word(entry);
+        uint64_t target;
+
+        if (out->entry_size == 8) {
+            value |= (uint64_t)la_read_insn_word(entry + 4) << 32;
+        } else {
+            value = sext(value, 32);
+        }
+        target = out->relative ? out->base + value : value;
+        if (target % INSN_LENGTH_BYTES != 0 || target < s->pc || target - s->pc >= s->len) {
+            return LA_SWITCH_BAD_TABLE;
+        }
+        out->targets[k] = target;
+    }
+    out->num_cases = num_cases;
+    return LA_SWITCH_RESOLVED;
+}
+
+enum la_switch_result la_switch_resolve(
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    size_t site,
+    const struct la_switch_config *config,
+    struct la_switch *out,
+    struct la_switch_stats *stats
+) {
+    static const struct la_switch_config defaults = { 0 };
+    struct slicer s;
+    size_t num_insns = len / INSN_LENGTH_BYTES;
+
+    if (config == NULL) {
+        config = &defaults;
+    }
+    if (site >= num_insns) {
+        return LA_SWITCH_NO_LOAD;
+    }
+
+    unsigned window = config->window != 0 ? config->window : LA_SWITCH_WINDOW_DEFAULT;
+    s.buf = buf;
+    s.len = len;
+    s.pc = pc;
+    s.lo = site > window ? site - window : 0;
+    s.steps = 0;
+    s.max_steps = config->max_steps != 0 ? config->max_steps : LA_SWITCH_STEPS_DEFAULT;
+    s.out_of_budget = false;
+    out->num_cases = 0;
+
+    enum la_switch_result result = resolve(&s, config, site, out);
+    if (result != LA_SWITCH_RESOLVED && s.out_of_budget) {
+        result = LA_SWITCH_BUDGET;
+    }
+
+    if (stats != NULL) {
+        stats->sites++;
+        stats->results[result]++;
+        stats->steps += s.steps;
+        if (result == LA_SWITCH_RESOLVED) {
+            stats->cases += out->num_cases;
+        }
+    }
+    return result;
+}
+
+const char *la_switch_result_name(enum la_switch_result result) {
+    switch (result) {
+    case LA_SWITCH_RESOLVED:  return "resolved";
+    case LA_SWITCH_NO_LOAD:   return "no load";
+    case LA_SWITCH_NO_INDEX:  return "no index";
+    case LA_SWITCH_NO_BASE:   return "no base";
+    case LA_SWITCH_NO_BOUND:  return "no bound";
+    case LA_SWITCH_BAD_TABLE: return "bad table";
+    case LA_SWITCH_BUDGET:    return "budget";
+    default:                  return "?";
+    }
+}
@@ -0,0 +1,527 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "r_loongarch.h"
+
+/*
+ * Xref index file.
+ *
+ * All xrefs sorted by (target, src, kind) and cut into groups of
+ * GROUP_XREFS. The file is
+ *
+ *   header
+ *   group table: the first target of every group and the offset of its
+ *                encoding in the data, 2 x 8 bytes per group
+ *   data:        the groups back to back
+ *
+ * with every integer little-endian. In a group, each xref is a varint of
+ * its target delta to the previous one (0 for the first, whose target is in
+ * the table) shifted left by 2 with the kind in the low bits -- or of
+ * DELTA_ESCAPE shifted so, and then the delta, if it is too large for that
+ * -- and a varint of its src: the delta to the previous src if the target
+ * did not change, and the zigzagged distance to its target otherwise. Most
+ * xrefs take 4 to 6 bytes this way.
+ *
+ * A lookup is a binary search over the group table and a decode of one or
+ * two groups.
+ */
+
+#define XREF_MAGIC "LAXREF\0\0"
+#define XREF_VERSION 1
+#define GROUP_XREFS 64
+/* target deltas from here on do not fit next to the kind */
+#define DELTA_ESCAPE ((1ULL << 62) - 1)
+/* 10 bytes for each of up to three varints */
+#define XREF_ENCODED_MAX 30
+#define HEADER_SIZE 48
+#define GROUP_ENTRY_SIZE 16
+/* insns decoded at a time when collecting */
+#define COLLECT_CHUNK 1024
+
+struct la_xref_index {
+    const uint8_t *map;
+    size_t map_size;
+    uint64_t num_xrefs;
+    uint64_t num_groups;
+    const uint8_t *groups;
+    const uint8_t *data;
+    size_t data_size;
+};
+
+static inline uint64_t get_le64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static inline void put_le64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = v >> (8 * i);
+    }
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+/* returns NULL on running past `end` or an overlong varint */
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return NULL;
+        }
+        uint8_t b = *p++;
+        result |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static int compare_xrefs(const void *a, const void *b) {
+    const struct la_xref *x = a;
+    const struct la_xref *y = b;
+
+    if (x->target != y->target) {
+        return x->target < y->target ? -1 : 1;
+    }
+    if (x->src != y->src) {
+        return x->src < y->src ? -1 : 1;
+    }
+    return (int)x->kind - (int)y->kind;
+}
+
+/*
+ * Xref lists.
+ */
+
+void la_xref_list_init(struct la_xref_list *list) {
+    memset(list, 0, sizeof(*list));
+}
+
+void la_xref_list_fini(struct la_xref_list *list) {
+    free(list->xrefs);
+    la_xref_list_init(list);
+}
+
+bool la_xref_list_add(struct la_xref_list *list, uint64_t src, uint64_t target, enum la_xref_kind kind) {
+    if (list->num_xrefs == list->capacity) {
+        size_t capacity = list->capacity != 0 ? list->capacity * 2 : 1024;
+        struct la_xref *xrefs = realloc(list->xrefs, capacity * sizeof(*xrefs));
+        if (xrefs == NULL) {
+            return false;
+        }
+        list->xrefs = xrefs;
+        list->capacity = capacity;
+    }
+
+    struct la_xref *x = &list->xrefs[list->num_xrefs++];
+    x->target = target;
+    x->src = src;
+    x->kind = kind;
+    return true;
+}
+
+bool la_xref_collect(struct la_xref_list *list, const uint8_t *buf, size_t len, uint64_t pc) {
+    struct la_op ops[COLLECT_CHUNK];
+    struct la_resolver resolver;
+    size_t num_insns = len / INSN_LENGTH_BYTES;
+
+    la_resolver_init(&resolver, 0);
+    for (size_t base = 0; base < num_insns; base += COLLECT_CHUNK) {
+        size_t n = la_decode_block(
+            buf + base * INSN_LENGTH_BYTES,
+            (num_insns - base) * INSN_LENGTH_BYTES,
+            ops,
+            COLLECT_CHUNK
+        );
+
+        for (size_t i = 0; i < n; i++) {
+            const struct la_op *op = &ops[i];
+            uint64_t src = pc + (base + i) * INSN_LENGTH_BYTES;
+            struct la_resolved resolved;
+            uint64_t target;
+            bool ok = true;
+
+            if (la_op_jump_target(op, src, &target)) {
+                enum la_xref_kind kind = LA_XREF_BRANCH;
+                if (op->id == LA_INSN_JAL) {
+                    kind = LA_XREF_CALL;
+                } else if (op->id == LA_INSN_J) {
+                    kind = LA_XREF_JUMP;
+                }
+                ok = la_xref_list_add(list, src, target, kind);
+            }
+
+            /* jalr to an address put together by aui/auipc */
+            if (
+                la_resolver_step(&resolver, op, src, &resolved)
+                && resolved.kind == LA_RESOLVED_JUMP
+            ) {
+                enum la_xref_kind kind = la_op_rd(op) != LA_REG_ZERO ? LA_XREF_CALL : LA_XREF_JUMP;
+                ok = la_xref_list_add(list, src, resolved.value, kind);
+            }
+            if (!ok) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Writing.
+ */
+
+static bool write_all(FILE *f, const void *buf, size_t len) {
+    return len == 0 || fwrite(buf, len, 1, f) == 1;
+}
+
+static bool write_index(FILE *f, const struct la_xref *xrefs, size_t num_xrefs) {
+    size_t num_groups = (num_xrefs + GROUP_XREFS - 1) / GROUP_XREFS;
+    uint8_t header[HEADER_SIZE] = { 0 };
+    uint8_t *groups = malloc(num_groups * GROUP_ENTRY_SIZE + 1);
+    uint8_t *data = malloc(num_xrefs * XREF_ENCODED_MAX + 1);
+    uint8_t *p = data;
+    bool ok = false;
+
+    if (groups == NULL || data == NULL) {
+        goto out;
+    }
+
+    for (size_t g = 0; g < num_groups; g++) {
+        const struct la_xref *x = &xrefs[g * GROUP_XREFS];
+        size_t n = num_xrefs - g * GROUP_XREFS < GROUP_XREFS ? num_xrefs - g * GROUP_XREFS : GROUP_XREFS;
+
+        put_le64(groups + g * GROUP_ENTRY_SIZE, x[0].target);
+        put_le64(groups + g * GROUP_ENTRY_SIZE + 8, p - data);
+        for (size_t i = 0; i < n; i++) {
+            uint64_t target_delta = i != 0 ? x[i].target - x[i - 1].target : 0;
+            if (target_delta < DELTA_ESCAPE) {
+                p = put_varint(p, target_delta << 2 | x[i].kind);
+            } else {
+                p = put_varint(p, DELTA_ESCAPE << 2 | x[i].kind);
+                p = put_varint(p, target_delta);
+            }
+            if (i != 0 && target_delta == 0) {
+                p = put_varint(p, x[i].src - x[i - 1].src);
+            } else {
+                p = put_varint(p, zigzag(x[i].src - x[i].target));
+            }
+        }
+    }
+
+    memcpy(header, XREF_MAGIC, 8);
+    put_le64(header + 8, XREF_VERSION);
+    put_le64(header + 16, GROUP_XREFS);
+    put_le64(header + 24, num_xrefs);
+    put_le64(header + 32, num_groups);
+    put_le64(header + 40, p - data);
+
+    ok = write_all(f, header, sizeof(header))
+        && write_all(f, groups, num_groups * GROUP_ENTRY_SIZE)
+        && write_all(f, data, p - data);
+
+out:
+    free(data);
+    free(groups);
+    return ok;
+}
+
+/* drop duplicates, e.g. a jal that was also collected from a resolved jalr */
+static size_t sort_unique(struct la_xref *xrefs, size_t num_xrefs) {
+    size_t n = 0;
+
+    qsort(xrefs, num_xrefs, sizeof(*xrefs), compare_xrefs);
+    for (size_t i = 0; i < num_xrefs; i++) {
+        if (n == 0 || compare_xrefs(&xrefs[n - 1], &xrefs[i]) != 0) {
+            xrefs[n++] = xrefs[i];
+        }
+    }
+    return n;
+}
+
+bool la_xref_index_write(const char *path, struct la_xref_list *list) {
+    char tmp_path[4096];
+
+    list->num_xrefs = sort_unique(list->xrefs, list->num_xrefs);
+
+    /* replace the file atomically, so readers never see half of it */
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+
+    bool ok = write_index(f, list->xrefs, list->num_xrefs);
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (ok && rename(tmp_path, path) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        int saved_errno = errno;
+        unlink(tmp_path);
+        errno = saved_errno;
+    }
+    return ok;
+}
+
+/*
+ * Reading.
+ */
+
+struct la_xref_index *la_xref_index_open(const char *path) {
+    struct la_xref_index *idx = NULL;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < HEADER_SIZE) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    idx = calloc(1, sizeof(*idx));
+    if (idx == NULL) {
+        goto fail;
+    }
+    idx->map_size = st.st_size;
+    idx->map = mmap(NULL, idx->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (idx->map == MAP_FAILED) {
+        idx->map = NULL;
+        goto fail;
+    }
+    close(fd);
+    fd = -1;
+
+    const uint8_t *h = idx->map;
+    idx->num_xrefs = get_le64(h + 24);
+    idx->num_groups = get_le64(h + 32);
+    idx->data_size = get_le64(h + 40);
+    idx->groups = h + HEADER_SIZE;
+    idx->data = idx->groups + idx->num_groups * GROUP_ENTRY_SIZE;
+
+    size_t payload = idx->map_size - HEADER_SIZE;
+    if (
+        memcmp(h, XREF_MAGIC, 8) != 0
+        || get_le64(h + 8) != XREF_VERSION
+        || get_le64(h + 16) != GROUP_XREFS
+        || idx->num_groups != (idx->num_xrefs + GROUP_XREFS - 1) / GROUP_XREFS
+        || idx->num_groups > payload / GROUP_ENTRY_SIZE
+        || idx->data_size != payload - idx->num_groups * GROUP_ENTRY_SIZE
+    ) {
+        errno = EINVAL;
+        goto fail;
+    }
+    return idx;
+
+fail:
+    if (fd >= 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+    }
+    la_xref_index_close(idx);
+    return NULL;
+}
+
+void la_xref_index_close(struct la_xref_index *idx) {
+    if (idx == NULL) {
+        return;
+    }
+
+    if (idx->map != NULL) {
+        munmap((void *)idx->map, idx->map_size);
+    }
+    free(idx);
+}
+
+uint64_t la_xref_index_num_xrefs(const struct la_xref_index *idx) {
+    return idx->num_xrefs;
+}
+
+size_t la_xref_index_file_size(const struct la_xref_index *idx) {
+    return idx->map_size;
+}
+
+/*
+ * Decode group `g` into `out`, which has room for GROUP_XREFS xrefs.
+ *
+ * Returns the number of xrefs decoded, 0 if the group is corrupt.
+ */
+static size_t decode_group(const struct la_xref_index *idx, uint64_t g, struct la_xref *out) {
+    const uint8_t *entry = idx->groups + g * GROUP_ENTRY_SIZE;
+    uint64_t offset = get_le64(entry + 8);
+    const uint8_t *end = idx->data + idx->data_size;
+    size_t n = g + 1 < idx->num_groups ? GROUP_XREFS : idx->num_xrefs - g * GROUP_XREFS;
+
+    if (offset >= idx->data_size) {
+        return 0;
+    }
+
+    const uint8_t *p = idx->data + offset;
+    uint64_t target = get_le64(entry);
+    uint64_t src = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t head;
+        uint64_t v;
+        if ((p = get_varint(p, end, &head)) == NULL) {
+            return 0;
+        }
+        uint64_t target_delta = head >> 2;
+        if (target_delta == DELTA_ESCAPE && (p = get_varint(p, end, &target_delta)) == NULL) {
+            return 0;
+        }
+        if ((p = get_varint(p, end, &v)) == NULL) {
+            return 0;
+        }
+        target += target_delta;
+        if (i != 0 && target_delta == 0) {
+            src += v;
+        } else {
+            src = target + unzigzag(v);
+        }
+        out[i].target = target;
+        out[i].src = src;
+        out[i].kind = head & 3;
+    }
+    return n;
+}
+
+size_t la_xref_index_lookup(
+    const struct la_xref_index *idx,
+    uint64_t target,
+    struct la_xref *out,
+    size_t max_out
+) {
+    struct la_xref group[GROUP_XREFS];
+    size_t lo = 0;
+    size_t hi = idx->num_groups;
+    size_t found = 0;
+
+    if (idx->num_groups == 0) {
+        return 0;
+    }
+
+    /* the last group starting below `target`, its tail may hold some */
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (get_le64(idx->groups + mid * GROUP_ENTRY_SIZE) < target) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (uint64_t g = lo; g < idx->num_groups; g++) {
+        if (get_le64(idx->groups + g * GROUP_ENTRY_SIZE) > target) {
+            break;
+        }
+
+        size_t n = decode_group(idx, g, group);
+        for (size_t i = 0; i < n && group[i].target <= target; i++) {
+            if (group[i].target == target) {
+                if (found < max_out) {
+                    out[found] = group[i];
+                }
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+bool la_xref_index_read_all(const struct la_xref_index *idx, struct la_xref_list *list) {
+    struct la_xref group[GROUP_XREFS];
+
+    for (uint64_t g = 0; g < idx->num_groups; g++) {
+        size_t n = decode_group(idx, g, group);
+        if (n == 0) {
+            errno = EINVAL;
+            return false;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (!la_xref_list_add(list, group[i].src, group[i].target, group[i].kind)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool la_xref_index_update(const char *path, uint64_t from, uint64_t to, struct la_xref_list *list) {
+    struct la_xref_list merged;
+    struct la_xref_index *idx = la_xref_index_open(path);
+
+    /* nothing to update yet */
+    if (idx == NULL && errno == ENOENT) {
+        return la_xref_index_write(path, list);
+    }
+    if (idx == NULL) {
+        return false;
+    }
+
+    la_xref_list_init(&merged);
+    bool ok = la_xref_index_read_all(idx, &merged);
+    la_xref_index_close(idx);
+
+    /* drop what the range had, keep the rest */
+    size_t n = 0;
+    for (size_t i = 0; ok && i < merged.num_xrefs; i++) {
+        if (merged.xrefs[i].src < from || merged.xrefs[i].src >= to) {
+            merged.xrefs[n++] = merged.xrefs[i];
+        }
+    }
+    merged.num_xrefs = n;
+
+    for (size_t i = 0; ok && i < list->num_xrefs; i++) {
+        ok = la_xref_list_add(&merged, list->xrefs[i].src, list->xrefs[i].target, list->xrefs[i].kind);
+    }
+    if (ok) {
+        ok = la_xref_index_write(path, &merged);
+    }
+    la_xref_list_fini(&merged);
+    return ok;
+}
+
+const char *la_xref_kind_name(enum la_xref_kind kind) {
+    switch (kind) {
+    case LA_XREF_BRANCH: return "branch";
+    case LA_XREF_JUMP:   return "jump";
+    case LA_XREF_CALL:   return "call";
+    default:             return "?";
+    }
+}
@@ -2,14 +2,34 @@
 #define _R_LOONGARCH_H_
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* generated from insns.txt */
+#include "loongarch_insn_ids.h"
 
 #define INSN_LENGTH_BYTES 4
 
+/* rendered insn text never exceeds this, including the terminating NUL */
+#define LA_INSN_TEXT_MAX 64
+/* longest mnemonic allowed in insns.txt */
+#define LA_MNEMONIC_MAX 15
+
 typedef uint32_t la_insn_t;
 typedef uint32_t la_opcode_t;
 typedef uint32_t la_sel_t;
 typedef uint8_t la_reg_t;
 
+/* returned for register operands a format does not have */
+#define LA_REG_NONE 0xff
+#define LA_REG_ZERO 0
+#define LA_REG_RA 1
+#define LA_REG_TP 2
+#define LA_REG_SP 3
+#define LA_REG_A0 4     /* a0 .. a7 are 4 .. 11 */
+#define LA_REG_GP 21
+#define LA_REG_S9 22    /* the frame pointer, if any */
+
 enum la_insn_format_t {
     LA_INSN_FORMAT_UNKNOWN,
     LA_INSN_FORMAT_RR,
@@ -37,6 +57,45 @@ typedef uint32_t la_render_flag_t;
 #define RENDER_FLAG_RK_IS_FPR       0x40
 #define RENDER_FLAG_LOAD_STORE      0x80
 
+/* register slots, rd, rj, rk and ra are at bits 0, 5, 10 and 15 of the word */
+#define LA_REG_SLOT_RD      0x1
+#define LA_REG_SLOT_RJ      0x2
+#define LA_REG_SLOT_RK      0x4
+#define LA_REG_SLOT_RA      0x8
+/* ra is written without being named, by calls */
+#define LA_REG_SLOT_LINK    0x10
+
+struct la_disasm_matcher {
+    const char *mnemonic;
+    enum la_insn_format_t fmt;
+    la_insn_t match;
+    la_insn_t mask;
+    uint8_t reads;      /* LA_REG_SLOT_* */
+    uint8_t writes;
+    uint8_t fprs;       /* of the slots, those holding FPRs, even if rendered as GPRs */
+    la_render_flag_t render_flags;
+};
+
+/*
+ * Decode tree.
+ *
+ * Walking the whole matcher table for every word gets slower as the table
+ * grows, so gen_match_masks.py compiles the table into a small decision tree.
+ * The root is keyed on the major opcode (bits 31..26), and each inner node
+ * below selects on the highest run of bits that every remaining candidate
+ * fixes in its mask -- these turn out to be the per-format SEL_* fields.
+ * Leaves keep their candidates in table order and are matched as before, so
+ * the first-match-wins semantics of the table are preserved. Built with an
+ * insn frequency profile, the tree is shaped to keep hot insns near the root
+ * instead, see gen_match_masks.py.
+ */
+struct la_decode_node {
+    uint8_t shift;      /* selector field position */
+    uint8_t width;      /* selector field width, 0 for leaves */
+    uint16_t base;      /* first child node, or first candidate for leaves */
+    uint16_t count;     /* number of candidates in a leaf */
+};
+
 struct _la_format_rr {
     la_opcode_t opcode;
     la_sel_t sel;
@@ -130,6 +189,7 @@ struct _la_format_i25 {
 
 struct la_op {
     const char *mnemonic;
+    enum la_insn_id id;
     enum la_insn_format_t fmt;
     la_render_flag_t render_flags;
     union {
@@ -150,4 +210,1250 @@ struct la_op {
 #undef FMT
     } insn;
 };
+
+/* read one little-endian insn word */
+static inline la_insn_t la_read_insn_word(const uint8_t *buf) {
+    return (
+        (la_insn_t)buf[0]
+        | ((la_insn_t)buf[1] << 8)
+        | ((la_insn_t)buf[2] << 16)
+        | ((la_insn_t)buf[3] << 24)
+    );
+}
+
+/**
+ * Try to match one insn against list of known insns.
+ *
+ * Returns zero on failure, number of eaten bytes on success.
+ */
+int la_match_insn(la_insn_t insn_word, struct la_op *out);
+
+/**
+ * Decode `insn_word` as insn `id` without matching it, e.g. to expand insns
+ * stored by id. `id` must be what la_match_insn gives for the word, which
+ * may be LA_INSN_UNK.
+ *
+ * Returns zero on failure, number of eaten bytes on success.
+ */
+int la_decode_as(enum la_insn_id id, la_insn_t insn_word, struct la_op *out);
+
+/**
+ * Get the matcher table in decode priority order, without the sentinel.
+ */
+const struct la_disasm_matcher *la_matcher_table(size_t *num_matchers);
+
+/**
+ * Hash the matcher table, to tell whether data derived from decoded insns
+ * was produced by this very table.
+ */
+uint64_t la_matcher_table_hash(void);
+
+/**
+ * Compute the branch target of a matched insn located at `pc`.
+ *
+ * Returns false if the insn has no pc-relative target.
+ */
+bool la_op_jump_target(const struct la_op *op, uint64_t pc, uint64_t *target);
+
+/*
+ * Operand accessors, uniform across insn formats.
+ */
+
+/* returns LA_REG_NONE if the format has no such register */
+la_reg_t la_op_rd(const struct la_op *op);
+la_reg_t la_op_rj(const struct la_op *op);
+la_reg_t la_op_rk(const struct la_op *op);
+
+/**
+ * Get the name of GPR or FPR `reg` as rendered, e.g. "sp" or "fs0".
+ */
+const char *la_reg_name(la_reg_t reg, bool fpr);
+
+/**
+ * Get the immediate of a matched insn as it is rendered, i.e. sign-extended
+ * unless printed in hex, and with the M32 and SHL2 adjustments applied.
+ *
+ * Returns false if the insn has no single plain immediate (none at all, two
+ * of them, or a branch offset, see la_op_jump_target).
+ */
+bool la_op_imm(const struct la_op *op, int64_t *imm);
+
+/**
+ * Get the `disp(base)` memory operand of a load or store.
+ *
+ * Returns false if the insn is not a load or store.
+ */
+bool la_op_mem_operand(const struct la_op *op, la_reg_t *base, int32_t *disp);
+
+/**
+ * Render a matched insn located at `pc` into `buf`.
+ *
+ * Output is truncated to `buflen` like snprintf, but nothing is allocated
+ * or parsed; a `buflen` of at least LA_INSN_TEXT_MAX renders in place.
+ *
+ * Returns the length of the full text, like snprintf.
+ */
+int la_print_insn(char *buf, int buflen, const struct la_op *op, uint64_t pc);
+
+/*
+ * Register use/def.
+ *
+ * Register sets are 64-bit masks, GPR n at bit n and FPR n at bit 32 + n.
+ * zero is never in a set: reading it reads a constant, and writes to it are
+ * dropped. Stores read rd, branches read all of their registers, and calls
+ * write ra; syscall's implicit operands are not modelled. Fields insns.txt
+ * names F* hold FPRs, whether or not the insn renders them so.
+ */
+
+typedef uint64_t la_regset_t;
+
+#define LA_REGSET_GPR(n) ((la_regset_t)1 << (n))
+#define LA_REGSET_FPR(n) ((la_regset_t)1 << (32 + (n)))
+
+/**
+ * Get the registers read (`use`) and written (`def`) by insn `id` encoded as
+ * `insn_word`, e.g. as classified by la_classify_block().
+ */
+void la_insn_regs(enum la_insn_id id, la_insn_t insn_word, la_regset_t *use, la_regset_t *def);
+
+/**
+ * Get the registers read (`use`) and written (`def`) by a matched insn.
+ */
+void la_op_regs(const struct la_op *op, la_regset_t *use, la_regset_t *def);
+
+/* the GPRs arguments are passed in, a0 .. a7, and results returned in, a0 and a1 */
+#define LA_ABI_ARGS ((la_regset_t)0xff << LA_REG_A0)
+#define LA_ABI_RESULTS (LA_REGSET_GPR(LA_REG_A0) | LA_REGSET_GPR(LA_REG_A0 + 1))
+/* the GPRs a call leaves as they were: the callee-saved ones but ra, and sp, tp and gp */
+#define LA_ABI_CALL_PRESERVED ((LA_FRAME_CALLEE_SAVED & ~LA_REGSET_GPR(LA_REG_RA)) | LA_REGSET_GPR(LA_REG_SP) | \
+                               LA_REGSET_GPR(LA_REG_TP) | LA_REGSET_GPR(LA_REG_GP))
+/* the GPRs a call may change */
+#define LA_ABI_CALL_CLOBBERED ((la_regset_t)0xfffffffe & ~LA_ABI_CALL_PRESERVED)
+
+/**
+ * Like la_insn_regs(), adding what the calling convention implies: calls
+ * (jal, and jalr not linking to zero) read the argument GPRs and write the
+ * ones they do not preserve, and returns (jalr zero, ra) read the results
+ * and the GPRs the caller expects preserved. FPRs are not passed or saved
+ * by any convention known here.
+ */
+void la_insn_abi_regs(enum la_insn_id id, la_insn_t insn_word, la_regset_t *use, la_regset_t *def);
+
+/*
+ * ESIL.
+ *
+ * Every insn id has a pre-split ESIL template with slots for its operands,
+ * so rendering the ESIL of an insn is filling in the slots.
+ */
+
+#define LA_ESIL_TEXT_MAX 192
+
+/**
+ * Render the ESIL of a matched insn located at `pc` into `buf`, the empty
+ * string for insns whose semantic is not known.
+ *
+ * Output is truncated to `buflen` like snprintf; a `buflen` of at least
+ * LA_ESIL_TEXT_MAX renders in place.
+ *
+ * Returns the length of the full text, like snprintf.
+ */
+int la_esil_insn(char *buf, int buflen, const struct la_op *op, uint64_t pc);
+
+/**
+ * Get the ESIL template of insn `id`, or of its variant for rd = zero, for
+ * reference. Slots are {d}, {j}, {k}, {i}, {t}, {n} and {p}: rd, rj, rk,
+ * the immediate, the branch target, and the addresses of the next insn and
+ * of the insn.
+ *
+ * Returns NULL if there is none.
+ */
+const char *la_esil_template(enum la_insn_id id, bool rd_zero);
+
+/*
+ * Block API.
+ *
+ * Decoding and rendering are separate steps: passes that only look at
+ * mnemonics, formats, operands or branch targets should stick to
+ * la_decode_block() and only render the insns that are actually shown.
+ */
+
+/**
+ * Decode the insns in `buf` into `ops`, without rendering them.
+ *
+ * At most `max_ops` insns are decoded.
+ *
+ * Returns the number of insns decoded.
+ */
+size_t la_decode_block(
+    const uint8_t *buf,
+    size_t len,
+    struct la_op *ops,
+    size_t max_ops
+);
+
+/**
+ * Render `num_ops` decoded insns, the first one located at `pc`.
+ *
+ * Insn `i` is rendered into `text + i * text_stride`; a stride of
+ * LA_INSN_TEXT_MAX is always enough.
+ */
+void la_render_block(
+    const struct la_op *ops,
+    size_t num_ops,
+    uint64_t pc,
+    char *text,
+    size_t text_stride
+);
+
+/**
+ * Decode the insns in `buf`, starting at address `pc`, into `ops`, and
+ * render them into `text` unless it is NULL.
+ *
+ * This is la_decode_block() followed by la_render_block().
+ *
+ * Returns the number of insns decoded.
+ */
+size_t la_disasm_block(
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    struct la_op *ops,
+    size_t max_ops,
+    char *text,
+    size_t text_stride
+);
+
+/*
+ * Decoder statistics.
+ *
+ * Built with -DLA_DECODE_STATS (`make LA_STATS=1`), la_match_insn() and
+ * la_print_insn() count, per thread, which insn each word matched, how many
+ * candidates were compared to match it, and how long rendering took per
+ * insn format, timing a sample of the renders. Without it the counting
+ * compiles to nothing. The bulk classifier and la_decode_as() are not
+ * counted.
+ */
+
+/* words that needed this many candidate compares or more share a bucket */
+#define LA_STATS_PROBES_MAX 15
+
+/* one in this many renders of each format is timed */
+#define LA_STATS_RENDER_SAMPLE 64
+
+/* environment variable naming where la_decode_stats_dump_env() writes */
+#define LA_STATS_ENV "R2_LOONGARCH_STATS"
+
+struct la_decode_stats {
+    uint64_t hits[LA_INSN_LAST];            /* by insn id, unk included */
+    uint64_t probes[LA_STATS_PROBES_MAX + 1];   /* words by candidates compared */
+    uint64_t render_count[LA_INSN_FORMAT_LAST];
+    uint64_t render_timed[LA_INSN_FORMAT_LAST];
+    uint64_t render_ns[LA_INSN_FORMAT_LAST];   /* of the timed renders */
+};
+
+enum la_stats_format {
+    LA_STATS_TEXT,
+    LA_STATS_CSV,
+    LA_STATS_JSON,
+};
+
+/**
+ * Sum the statistics of all threads so far into `out`.
+ *
+ * Returns false, with `out` zeroed, if statistics are not compiled in.
+ */
+bool la_decode_stats_get(struct la_decode_stats *out);
+
+void la_decode_stats_reset(void);
+
+/**
+ * Format the statistics of all threads as text, CSV or JSON.
+ *
+ * Returns a malloc()ed string, or NULL on allocation failure.
+ */
+char *la_decode_stats_dump(enum la_stats_format format);
+
+/**
+ * Write the statistics to the file named by LA_STATS_ENV, as JSON or CSV
+ * for names ending in .json or .csv and as text otherwise, or to stderr
+ * for "-". Does nothing if the variable is unset.
+ *
+ * Returns false if writing failed.
+ */
+bool la_decode_stats_dump_env(void);
+
+#ifdef LA_DECODE_STATS
+/* for the hooks in the decoder */
+extern __attribute__((tls_model("initial-exec")))
+_Thread_local struct la_decode_stats *la_stats_local;
+struct la_decode_stats *la_stats_register(void);
+uint64_t la_stats_ticks(void);
+#endif
+
+/*
+ * Bulk classifier.
+ *
+ * For whole-image passes that only need to know which insn each word is and
+ * its operand fields, la_classify_block() decodes many words at a time with
+ * SIMD kernels where available. The results are exactly those of
+ * la_match_insn(); the best kernel the CPU supports is picked at load time.
+ */
+
+enum la_classify_kernel {
+    LA_CLASSIFY_SCALAR,
+    LA_CLASSIFY_SSE2,
+    LA_CLASSIFY_AVX2,
+    LA_CLASSIFY_KERNEL_LAST
+};
+
+/**
+ * Output arrays of la_classify_block(), one element per insn.
+ *
+ * `rd`, `rj` and `rk` are LA_REG_NONE where the format has no such register.
+ * `imm` is the immediate field as in struct la_op, unadjusted; for RRI6I6
+ * it is imm1 | imm2 << 6, for FFFF it holds ra, for I25 the sel bit is at
+ * bit 25, and it is 0 for formats without one.
+ */
+struct la_classify_out {
+    uint8_t *ids;       /* enum la_insn_id */
+    uint8_t *rd;
+    uint8_t *rj;
+    uint8_t *rk;
+    uint32_t *imm;
+};
+
+/* here, in packed insns, snapshots and the CFG, ids are stored in a byte */
+_Static_assert(LA_INSN_LAST <= UINT8_MAX + 1, "insn ids must fit in uint8_t");
+
+/**
+ * Classify the insns in `buf`, at most `max_insns` of them.
+ *
+ * Returns the number of insns classified.
+ */
+size_t la_classify_block(
+    const uint8_t *buf,
+    size_t len,
+    const struct la_classify_out *out,
+    size_t max_insns
+);
+
+/**
+ * Force a kernel, e.g. to compare them.
+ *
+ * Returns false, leaving the current kernel in place, if the CPU does not
+ * support it.
+ */
+bool la_classify_use_kernel(enum la_classify_kernel kernel);
+
+enum la_classify_kernel la_classify_current_kernel(void);
+
+const char *la_classify_kernel_name(enum la_classify_kernel kernel);
+
+/*
+ * Packed insns.
+ *
+ * A decoded image kept as the la_classify_block() output arrays takes 8
+ * bytes per insn instead of a whole struct la_op, and passes that look at
+ * one or two fields only touch those arrays. Nothing is lost, the insn word
+ * and the struct la_op of every insn can be rebuilt from them.
+ */
+
+/* id, rd, rj, rk and imm */
+#define LA_PACKED_INSN_SIZE (4 * sizeof(uint8_t) + sizeof(uint32_t))
+
+struct la_packed_insns {
+    /* as filled in by la_classify_block(), except that for unk insns `imm`
+     * holds the whole insn word */
+    struct la_classify_out insns;
+    size_t num_insns;
+    size_t capacity;
+};
+
+/**
+ * Allocate room for `capacity` packed insns.
+ *
+ * Returns NULL on allocation failure.
+ */
+struct la_packed_insns *la_packed_new(size_t capacity);
+
+void la_packed_free(struct la_packed_insns *packed);
+
+/**
+ * Classify the insns in `buf` and append them, as many as there is room for.
+ *
+ * Returns the number of insns appended.
+ */
+size_t la_packed_append(struct la_packed_insns *packed, const uint8_t *buf, size_t len);
+
+/**
+ * Get back the word of insn `i`.
+ */
+la_insn_t la_packed_insn_word(const struct la_packed_insns *packed, size_t i);
+
+/**
+ * Expand insn `i` into `out`, which is then exactly what la_match_insn gives
+ * for its word.
+ *
+ * Returns zero on failure, number of eaten bytes on success.
+ */
+int la_packed_expand(const struct la_packed_insns *packed, size_t i, struct la_op *out);
+
+/*
+ * Pattern search.
+ *
+ * Patterns are written like the insns they find, e.g. "syscall",
+ * "ld *, *(gp)", "addi sp, sp, -16" or "jal 0x120001000", and compiled into
+ * mask/match pairs like those of the matcher table, with the fixed register
+ * operands folded in. Operands are `*` for anything, a register, a number
+ * (the immediate as rendered, or the target of a branch), or `DISP(BASE)`
+ * for loads and stores; trailing ones may be left out. A pattern may also be
+ * a raw "MATCH/MASK" pair. All patterns are tested together in one pass with
+ * SIMD kernels where available, and only words some pair matches are
+ * decoded, to check immediates and branch targets.
+ */
+
+#define LA_SEARCH_PATTERNS_MAX 64
+#define LA_SEARCH_CHECKS_MAX 2
+
+enum la_search_error {
+    LA_SEARCH_OK,
+    LA_SEARCH_BAD_MNEMONIC,
+    LA_SEARCH_BAD_OPERAND,
+    LA_SEARCH_TOO_MANY_OPERANDS,
+    LA_SEARCH_TOO_MANY_PATTERNS,
+    LA_SEARCH_ERROR_LAST
+};
+
+/* operands that cannot be folded into the mask, checked on decoded insns */
+enum la_search_check_kind {
+    LA_SEARCH_CHECK_IMM,
+    LA_SEARCH_CHECK_IMM2,       /* the second immediate of RRI6I6 */
+    LA_SEARCH_CHECK_TARGET,
+    LA_SEARCH_CHECK_DISP,
+};
+
+struct la_search_pair {
+    unsigned pattern;   /* index of the pattern it was compiled from */
+    enum la_insn_id id; /* LA_INSN_UNK for raw pairs */
+    /* an earlier matcher takes some of the words, which must be decoded */
+    bool verify;
+    unsigned num_checks;
+    struct {
+        enum la_search_check_kind kind;
+        int64_t value;
+    } checks[LA_SEARCH_CHECKS_MAX];
+};
+
+struct la_search {
+    /* pairs sorted by mask, so the kernels mask once per distinct mask */
+    la_insn_t masks[LA_SEARCH_PATTERNS_MAX];
+    la_insn_t matches[LA_SEARCH_PATTERNS_MAX];
+    struct la_search_pair pairs[LA_SEARCH_PATTERNS_MAX];
+    size_t num_pairs;
+    size_t num_patterns;
+};
+
+/* called for every hit, in address order */
+typedef void (*la_search_hit_fn)(void *user, uint64_t pc, la_insn_t insn_word, unsigned pattern);
+
+void la_search_init(struct la_search *search);
+
+/**
+ * Compile `pattern` and add it as pattern number search->num_patterns.
+ *
+ * Returns LA_SEARCH_OK, or why the pattern was refused, leaving `search` as
+ * it was.
+ */
+enum la_search_error la_search_add(struct la_search *search, const char *pattern);
+
+/**
+ * Search the insns in `buf`, the first one located at `pc`.
+ *
+ * Returns the number of hits.
+ */
+size_t la_search_block(
+    const struct la_search *search,
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    la_search_hit_fn hit,
+    void *user
+);
+
+/**
+ * Force a kernel as la_classify_use_kernel() does, e.g. to compare them.
+ *
+ * Returns false, leaving the current kernel in place, if the CPU does not
+ * support it.
+ */
+bool la_search_use_kernel(enum la_classify_kernel kernel);
+
+enum la_classify_kernel la_search_current_kernel(void);
+
+const char *la_search_error_name(enum la_search_error error);
+
+/*
+ * Address resolver.
+ *
+ * Addresses and wide constants are built by aui/auipc, optionally widened by
+ * ahi/ati, and finished by an addi/addiw/ori or used as the base of a load,
+ * store or jalr a few insns later. The resolver follows the values of such
+ * registers along a linear stream of insns, one insn at a time, and reports
+ * what each consumer computes, without emulating anything else.
+ *
+ * A value is forgotten when its register is overwritten, when it was set
+ * more than `window` insns ago, after an unconditional jump or call, and
+ * whenever the stream is not contiguous.
+ */
+
+#define LA_RESOLVE_WINDOW_DEFAULT 16
+
+enum la_resolved_kind {
+    LA_RESOLVED_CONST,  /* a register is set to a constant */
+    LA_RESOLVED_ADDR,   /* a register is set to a pc-relative address */
+    LA_RESOLVED_LOAD,   /* a load from a known address */
+    LA_RESOLVED_STORE,  /* a store to a known address */
+    LA_RESOLVED_JUMP,   /* a jalr to a known address */
+};
+
+struct la_resolved {
+    enum la_resolved_kind kind;
+    uint64_t value;     /* the constant or address */
+    uint64_t origin;    /* address of the aui/auipc it derives from */
+    la_reg_t reg;       /* the register set, or the base register */
+};
+
+struct la_resolver {
+    uint64_t value[32];
+    uint64_t origin[32];
+    uint64_t set_at[32];    /* insn count when the register was set */
+    uint32_t known;         /* registers with a tracked value */
+    uint32_t pc_relative;   /* ... that derive from auipc */
+    uint64_t count;
+    uint64_t next_pc;
+    unsigned window;
+};
+
+/**
+ * Start with nothing known; a `window` of 0 picks the default.
+ */
+void la_resolver_init(struct la_resolver *r, unsigned window);
+
+/**
+ * Forget all tracked values, e.g. at a known block boundary.
+ */
+void la_resolver_reset(struct la_resolver *r);
+
+/**
+ * Feed the matched insn at `pc`, which is treated as the start of a new
+ * stream unless it directly follows the previous one.
+ *
+ * Returns true and fills in `out` if the insn consumes a tracked value.
+ */
+bool la_resolver_step(
+    struct la_resolver *r,
+    const struct la_op *op,
+    uint64_t pc,
+    struct la_resolved *out
+);
+
+/*
+ * Micro-emulator.
+ *
+ * Runs code of the integer, shift, load/store and branch subset of the
+ * table on a private register file and sparse, paged memory, e.g. to unpack
+ * or decrypt data in place. Code is predecoded into basic blocks once and
+ * cached, so hot loops run at native-ish speed. FP arithmetic and the
+ * remaining insns stop the run as unsupported; FP loads and stores move the
+ * bits without interpreting them. Guest memory is little-endian.
+ */
+
+struct la_emu_regs {
+    uint64_t gpr[32 + 1];   /* the last one absorbs writes to zero */
+    uint64_t fpr[32];
+    uint64_t pc;
+};
+
+enum la_emu_stop {
+    LA_EMU_BUDGET,          /* ran `max_insns` insns */
+    LA_EMU_FAULT,           /* access to unmapped memory, see la_emu_fault_addr */
+    LA_EMU_UNSUPPORTED,     /* pc is at an insn the emulator does not run */
+    LA_EMU_SYSCALL,         /* pc is after the syscall */
+    LA_EMU_HOOK,            /* the memory hook asked to stop */
+};
+
+struct la_emu_stats {
+    uint64_t insns;
+    uint64_t blocks;        /* blocks predecoded */
+    uint64_t flushes;       /* block cache flushes on self-modifying code */
+};
+
+/* return false to stop before the access, with pc at the insn making it */
+typedef bool (*la_emu_mem_hook)(void *user, uint64_t addr, unsigned size, bool write, uint64_t value);
+typedef void (*la_emu_trace_fn)(void *user, uint64_t pc, la_insn_t insn_word);
+
+struct la_emu;
+
+/**
+ * Create an emulator with no memory mapped and all registers zero.
+ *
+ * Returns NULL on allocation failure.
+ */
+struct la_emu *la_emu_new(void);
+
+void la_emu_free(struct la_emu *emu);
+
+/* the registers, to set up and inspect between runs */
+struct la_emu_regs *la_emu_regs(struct la_emu *emu);
+
+/**
+ * Map zero-filled memory covering [addr, addr + size); pages already mapped
+ * are kept as they are.
+ *
+ * Returns false on allocation failure.
+ */
+bool la_emu_map(struct la_emu *emu, uint64_t addr, uint64_t size);
+
+/**
+ * Copy into or out of guest memory, bypassing the memory hook.
+ *
+ * Returns false if part of the range is not mapped.
+ */
+bool la_emu_mem_write(struct la_emu *emu, uint64_t addr, const void *buf, size_t len);
+bool la_emu_mem_read(struct la_emu *emu, uint64_t addr, void *buf, size_t len);
+
+/* call `hook` on every guest load and store, NULL to stop */
+void la_emu_set_mem_hook(struct la_emu *emu, la_emu_mem_hook hook, void *user);
+
+/* call `trace` before every insn, NULL to stop */
+void la_emu_set_trace(struct la_emu *emu, la_emu_trace_fn trace, void *user);
+
+/**
+ * Run from the current pc for at most `max_insns` insns.
+ *
+ * Returns why it stopped; the registers are up to date either way.
+ */
+enum la_emu_stop la_emu_run(struct la_emu *emu, uint64_t max_insns);
+
+/* address of the access that stopped the last run with LA_EMU_FAULT/_HOOK */
+uint64_t la_emu_fault_addr(const struct la_emu *emu);
+
+const char *la_emu_stop_name(enum la_emu_stop stop);
+
+void la_emu_get_stats(const struct la_emu *emu, struct la_emu_stats *stats);
+
+/*
+ * Jump tables.
+ *
+ * A switch compiles to a bounds check of the index (sltiu and beqz/bnez, or
+ * bgtu/bleu against a constant), the index scaled by slli, added to a table
+ * base built by aui/auipc and addi, an ld or lw of the entry, an add of the
+ * base for tables of offsets, and a jalr zero through the result. The
+ * recognizer slices backward from the jalr over the insns before it, never
+ * past another jump or a syscall, follows each register to the insn defining
+ * it, and reads the table once all parts were found. A call in between is
+ * taken to write the registers it does not preserve. Every site gets a
+ * budget of insns decoded while slicing, so hopeless sites are given up
+ * quickly.
+ */
+
+#define LA_SWITCH_WINDOW_DEFAULT 32
+#define LA_SWITCH_STEPS_DEFAULT 128
+#define LA_SWITCH_CASES_MAX 512
+
+enum la_switch_result {
+    LA_SWITCH_RESOLVED,
+    LA_SWITCH_NO_LOAD,      /* the target is not loaded from memory */
+    LA_SWITCH_NO_INDEX,     /* the load address is not base + scaled index */
+    LA_SWITCH_NO_BASE,      /* the table base is not a known address */
+    LA_SWITCH_NO_BOUND,     /* the index is not bounds-checked */
+    LA_SWITCH_BAD_TABLE,    /* too many cases, unreadable, or a case outside the code */
+    LA_SWITCH_BUDGET,       /* the site used up its budget */
+    LA_SWITCH_RESULT_LAST,
+};
+
+/* read `len` bytes at `addr`, return false if they are not all readable */
+typedef bool (*la_switch_read_fn)(void *user, uint64_t addr, uint8_t *buf, size_t len);
+
+struct la_switch_config {
+    unsigned window;        /* insns sliced back at most, 0 for the default */
+    unsigned max_steps;     /* insns decoded per site, 0 for the default */
+    unsigned max_cases;     /* 0 or more than LA_SWITCH_CASES_MAX for that */
+    la_switch_read_fn read; /* NULL to read tables from the code only */
+    void *user;
+};
+
+struct la_switch {
+    uint64_t site;          /* address of the jalr */
+    uint64_t table;
+    uint64_t base;          /* entries are offsets from it, if relative */
+    uint8_t entry_size;     /* 4 or 8 */
+    bool relative;
+    la_reg_t index;         /* the register bounds-checked */
+    size_t num_cases;
+    uint64_t targets[LA_SWITCH_CASES_MAX];
+};
+
+struct la_switch_stats {
+    uint64_t sites;         /* jalr zero, rj other than returns */
+    uint64_t results[LA_SWITCH_RESULT_LAST];
+    uint64_t cases;         /* of resolved sites */
+    uint64_t steps;         /* insns decoded while slicing */
+};
+
+/**
+ * Recover the jump table of the jalr at insn `site` of the insns in `buf`,
+ * the first one located at `pc`. Cases must lie within `buf`.
+ *
+ * Returns LA_SWITCH_RESOLVED and fills in `out`, or why it gave up. Either
+ * way the site is counted in `stats` unless it is NULL.
+ */
+enum la_switch_result la_switch_resolve(
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    size_t site,
+    const struct la_switch_config *config,
+    struct la_switch *out,
+    struct la_switch_stats *stats
+);
+
+const char *la_switch_result_name(enum la_switch_result result);
+
+/*
+ * CFG builder.
+ *
+ * Cuts a whole image into basic blocks in a linear sweep: every insn that a
+ * branch, jump or call in the image targets, or that follows a branch, jump
+ * or jalr without link, starts a block. Calls do not end blocks. Cases of
+ * jump tables recovered behind jalr zero, rj start blocks too. Blocks and
+ * edges are kept in flat arrays in address order, and the edges of a block
+ * are contiguous.
+ */
+
+#define LA_CFG_NO_BLOCK UINT32_MAX
+
+enum la_cfg_edge_kind {
+    LA_CFG_EDGE_FALLTHROUGH,    /* into the next block */
+    LA_CFG_EDGE_TAKEN,          /* a conditional branch taken */
+    LA_CFG_EDGE_JUMP,           /* j */
+    LA_CFG_EDGE_CALL,           /* jal, from the block making the call */
+    LA_CFG_EDGE_SWITCH,         /* a case of a recovered jump table */
+};
+
+/* how a block ends */
+enum la_cfg_block_end {
+    LA_CFG_END_FALLTHROUGH,     /* the next insn starts a block */
+    LA_CFG_END_BRANCH,          /* a conditional branch */
+    LA_CFG_END_JUMP,            /* j */
+    LA_CFG_END_RETURN,          /* jalr zero, ra */
+    LA_CFG_END_INDIRECT,        /* other jalr zero, rj */
+    LA_CFG_END_SWITCH,          /* jalr zero, rj through a recovered jump table */
+    LA_CFG_END_IMAGE,           /* the end of the image */
+};
+
+struct la_cfg_edge {
+    uint64_t src;       /* address of the insn the edge leaves from */
+    uint64_t target;
+    uint32_t from;      /* block index */
+    uint32_t to;        /* block index, LA_CFG_NO_BLOCK outside the image */
+    uint8_t kind;       /* enum la_cfg_edge_kind */
+};
+
+struct la_cfg_block {
+    uint64_t addr;
+    uint32_t num_insns;
+    uint32_t first_edge;
+    uint32_t num_edges;
+    uint8_t end;        /* enum la_cfg_block_end */
+};
+
+struct la_cfg {
+    uint64_t pc;
+    size_t num_insns;
+    uint64_t *leaders;  /* one bit per insn, set where a block starts */
+    struct la_cfg_block *blocks;
+    size_t num_blocks;
+    struct la_cfg_edge *edges;
+    size_t num_edges;
+};
+
+/**
+ * Build the CFG of the insns in `buf`, the first one located at `pc`.
+ *
+ * Returns NULL on allocation failure, or if the image has 2^31 insns or more.
+ */
+struct la_cfg *la_cfg_build(const uint8_t *buf, size_t len, uint64_t pc);
+
+/**
+ * Build the CFG like la_cfg_build(), recovering jump tables as set up by
+ * `config` (NULL for the defaults) and counting the sites in `stats` unless
+ * it is NULL.
+ */
+struct la_cfg *la_cfg_build_switches(
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    const struct la_switch_config *config,
+    struct la_switch_stats *stats
+);
+
+void la_cfg_free(struct la_cfg *cfg);
+
+/**
+ * Find the block containing `addr`.
+ *
+ * Returns its index, or LA_CFG_NO_BLOCK if `addr` is outside the image.
+ */
+uint32_t la_cfg_block_at(const struct la_cfg *cfg, uint64_t addr);
+
+const char *la_cfg_edge_kind_name(enum la_cfg_edge_kind kind);
+const char *la_cfg_block_end_name(enum la_cfg_block_end end);
+
+/*
+ * Liveness.
+ *
+ * Registers live on entry to and exit from every block of a CFG, from the
+ * use/def sets of its insns as given by la_insn_abi_regs(): calls read the
+ * arguments and kill what they clobber, and returns keep the results and
+ * the preserved GPRs live. Blocks ending in a return or an indirect jump
+ * have nothing live on exit.
+ */
+
+struct la_liveness {
+    la_regset_t *live_in;       /* by block index */
+    la_regset_t *live_out;
+    size_t num_blocks;
+    unsigned num_passes;        /* over all blocks, until nothing changed */
+};
+
+/**
+ * Compute liveness over `cfg`, built from `buf`.
+ *
+ * Returns NULL on allocation failure.
+ */
+struct la_liveness *la_liveness_compute(const struct la_cfg *cfg, const uint8_t *buf);
+
+void la_liveness_free(struct la_liveness *live);
+
+/**
+ * Get the registers live right before the insn at `addr`, 0 outside the
+ * image.
+ */
+la_regset_t la_liveness_before(
+    const struct la_liveness *live,
+    const struct la_cfg *cfg,
+    const uint8_t *buf,
+    uint64_t addr
+);
+
+/*
+ * Stack frames.
+ *
+ * The frame of a function is recovered in one forward pass over its insns,
+ * without emulation: addi/addiw sp, sp, imm move sp, addi s9, sp, imm makes
+ * s9 the frame pointer, and loads and stores based on sp or s9 access the
+ * frame. Offsets are relative to sp on entry, so locals and save slots are
+ * below 0 and stack arguments at 0 and up. Code following a return or an
+ * unconditional jump is taken to run with the whole frame set up, which
+ * holds for the usual single prologue with several epilogues.
+ */
+
+#define LA_FRAME_VARS_MAX 64
+
+/* the GPRs a callee keeps for its caller, ra and s9, s0 .. s8 */
+#define LA_FRAME_CALLEE_SAVED (LA_REGSET_GPR(LA_REG_RA) | 0xffc00000ULL)
+
+enum la_frame_access {
+    LA_FRAME_READ = 1,
+    LA_FRAME_WRITE = 2,
+};
+
+struct la_frame_var {
+    int32_t offset;     /* from sp on entry */
+    uint8_t size;       /* of the widest access, in bytes */
+    uint8_t access;     /* enum la_frame_access */
+};
+
+struct la_frame {
+    uint64_t addr;          /* entry */
+    uint32_t size;          /* bytes sp is lowered by at most */
+    uint32_t saved;         /* of LA_FRAME_CALLEE_SAVED, those stored before being written */
+    int32_t save_offset[32];    /* where each saved GPR is stored */
+    struct la_frame_var vars[LA_FRAME_VARS_MAX];    /* by offset */
+    size_t num_vars;
+    size_t num_dropped;     /* vars beyond LA_FRAME_VARS_MAX */
+    bool uses_fp;           /* s9 is set from sp */
+    int32_t fp_offset;      /* where s9 points then */
+    bool sp_lost;           /* sp was set some other way, and accesses ignored */
+
+    /* tracking state */
+    int64_t sp;             /* from sp on entry */
+    int64_t fp;
+    bool sp_known;
+    bool fp_known;
+    uint32_t written;       /* GPRs written so far */
+};
+
+/**
+ * Start the frame of the function at `entry`.
+ */
+void la_frame_init(struct la_frame *frame, uint64_t entry);
+
+/**
+ * Feed the next matched insn of the function.
+ */
+void la_frame_step(struct la_frame *frame, const struct la_op *op);
+
+/**
+ * Sort the vars by offset once all insns were fed.
+ */
+void la_frame_finish(struct la_frame *frame);
+
+/**
+ * Recover the frame of the function whose insns are in `buf`, the first one
+ * located at `pc`, its entry.
+ */
+void la_frame_analyze(struct la_frame *frame, const uint8_t *buf, size_t len, uint64_t pc);
+
+/*
+ * Function starts.
+ *
+ * Stripped images say nothing about where functions start, so starts are
+ * guessed from the raw words with la_search: jal targets, prologues (addi
+ * sp, sp, -N with an sd ra, off(sp) a few insns later) and whatever follows
+ * a return (jalr zero, ra), zero words and nops skipped. Every kind of
+ * evidence adds to the score of a candidate, see la_func_score(), and those
+ * scoring at least `min_score` are taken. A scan only reports candidates
+ * found in its own range, so the ranges of an image can be scanned in
+ * parallel and their lists merged.
+ */
+
+#define LA_FUNCS_WINDOW_DEFAULT 8
+#define LA_FUNCS_MIN_SCORE_DEFAULT 3
+
+enum la_func_evidence {
+    LA_FUNC_CALLED = 0x1,       /* the target of a jal */
+    LA_FUNC_PROLOGUE = 0x2,     /* lowers sp and saves ra */
+    LA_FUNC_FRAME = 0x4,        /* lowers sp, but does not save ra soon */
+    LA_FUNC_AFTER_RETURN = 0x8, /* the first insn after a return */
+};
+
+struct la_funcs_config {
+    /* insns after lowering sp in which ra must be saved, 0 for the default */
+    unsigned window;
+    /* 0 for the default; every candidate scores at least 1 */
+    int min_score;
+};
+
+struct la_func_start {
+    uint64_t addr;
+    uint32_t evidence;  /* enum la_func_evidence */
+    uint32_t calls;     /* jal to it */
+};
+
+struct la_func_list {
+    struct la_func_start *starts;
+    size_t num_starts;
+    size_t capacity;
+};
+
+void la_func_list_init(struct la_func_list *list);
+void la_func_list_fini(struct la_func_list *list);
+
+/**
+ * Scan `size` bytes at `offset` into `buf`, the `len` bytes of an image
+ * whose first insn is located at `pc`, and append the candidates found;
+ * the insns around the range are looked at, but not scanned. `config` may
+ * be NULL for the defaults.
+ *
+ * Candidates are not merged yet: a function called twice is there twice.
+ * Call targets may be anywhere, also outside the image.
+ *
+ * Returns false on allocation failure, or if the scanner's own patterns
+ * fail to compile against the insn table.
+ */
+bool la_funcs_scan(
+    struct la_func_list *list,
+    const uint8_t *buf,
+    size_t len,
+    uint64_t pc,
+    size_t offset,
+    size_t size,
+    const struct la_funcs_config *config
+);
+
+/**
+ * Move the candidates of `src` to the end of `dst`, leaving `src` empty.
+ *
+ * Returns false on allocation failure, with both lists unchanged.
+ */
+bool la_func_list_merge(struct la_func_list *dst, struct la_func_list *src);
+
+/**
+ * Sort the candidates by address, merge those at the same address and drop
+ * those scoring less than `config->min_score`.
+ */
+void la_funcs_finish(struct la_func_list *list, const struct la_funcs_config *config);
+
+int la_func_score(const struct la_func_start *start);
+
+struct la_funcs_region {
+    uint64_t addr;
+    const uint8_t *buf;
+    size_t len;
+};
+
+struct la_funcs_stats {
+    size_t candidates;  /* before merging and scoring */
+    unsigned threads;   /* that scanned, the calling one included */
+};
+
+/**
+ * Find the function starts of an image made of `regions`: split them into
+ * 1 MiB ranges scanned on `num_threads` threads, the calling one included
+ * (0 for one per core), merge the candidates into the empty `list`, finish
+ * it as la_funcs_finish() does and drop the starts outside the regions.
+ * `config` may be NULL for the defaults, `stats` if not wanted.
+ *
+ * Returns false on allocation failure.
+ */
+bool la_funcs_scan_regions(
+    struct la_func_list *list,
+    const struct la_funcs_region *regions,
+    size_t num_regions,
+    unsigned num_threads,
+    const struct la_funcs_config *config,
+    struct la_funcs_stats *stats
+);
+
+/*
+ * Xref index.
+ *
+ * The branch, jump and call xrefs of an image (every pc-relative target, and
+ * jalr targets resolved from aui/auipc) are collected once and written to
+ * a compressed index file sorted by target. Later sessions mmap the file
+ * and find the xrefs to an address with a binary search, without analyzing
+ * anything again. See loongarch_xref.c for the file format.
+ */
+
+enum la_xref_kind {
+    LA_XREF_BRANCH,     /* conditional */
+    LA_XREF_JUMP,       /* j, or jalr without link */
+    LA_XREF_CALL,       /* jal, or jalr with link */
+};
+
+struct la_xref {
+    uint64_t target;
+    uint64_t src;
+    uint8_t kind;       /* enum la_xref_kind */
+};
+
+struct la_xref_list {
+    struct la_xref *xrefs;
+    size_t num_xrefs;
+    size_t capacity;
+};
+
+struct la_xref_index;
+
+void la_xref_list_init(struct la_xref_list *list);
+void la_xref_list_fini(struct la_xref_list *list);
+
+/**
+ * Returns false on allocation failure.
+ */
+bool la_xref_list_add(struct la_xref_list *list, uint64_t src, uint64_t target, enum la_xref_kind kind);
+
+/**
+ * Append the xrefs from the insns in `buf`, the first one located at `pc`.
+ *
+ * Returns false on allocation failure.
+ */
+bool la_xref_collect(struct la_xref_list *list, const uint8_t *buf, size_t len, uint64_t pc);
+
+/**
+ * Write the xrefs in `list` to a new index file at `path`, replacing any
+ * existing one atomically. `list` is sorted and deduplicated in place.
+ *
+ * Returns false with errno set on failure.
+ */
+bool la_xref_index_write(const char *path, struct la_xref_list *list);
+
+/**
+ * Replace the xrefs from sources in [from, to) in the index file at `path`
+ * with those in `list`, e.g. after that range was analyzed again; creates
+ * the file if there is none.
+ *
+ * Returns false with errno set on failure.
+ */
+bool la_xref_index_update(const char *path, uint64_t from, uint64_t to, struct la_xref_list *list);
+
+/**
+ * Map the index file at `path`.
+ *
+ * Returns NULL with errno set on failure, EINVAL if it is not an index.
+ */
+struct la_xref_index *la_xref_index_open(const char *path);
+
+void la_xref_index_close(struct la_xref_index *idx);
+
+/**
+ * Find the xrefs to `target`, storing the first `max_out` of them in `out`
+ * by source address.
+ *
+ * Returns the number of xrefs to `target`, which may exceed `max_out`.
+ */
+size_t la_xref_index_lookup(
+    const struct la_xref_index *idx,
+    uint64_t target,
+    struct la_xref *out,
+    size_t max_out
+);
+
+/**
+ * Append every xref in the index to `list`.
+ *
+ * Returns false with errno set on failure.
+ */
+bool la_xref_index_read_all(const struct la_xref_index *idx, struct la_xref_list *list);
+
+uint64_t la_xref_index_num_xrefs(const struct la_xref_index *idx);
+size_t la_xref_index_file_size(const struct la_xref_index *idx);
+
+const char *la_xref_kind_name(enum la_xref_kind kind);
+
+/*
+ * Decoded-image snapshots.
+ *
+ * The packed insns and block leaders of an image's regions are written to a
+ * snapshot file that later sessions mmap instead of decoding everything
+ * again. A region is only used if the bytes it was decoded from hash the
+ * same as those at hand, its data checksum is verified lazily on first use,
+ * and a whole snapshot written with a different matcher table is refused.
+ * Refreshing a snapshot only decodes again the regions that changed.
+ */
+
+struct la_snapshot_region {
+    uint64_t addr;
+    const uint8_t *buf;
+    size_t len;
+};
+
+struct la_snapshot;
+
+/**
+ * Hash `len` bytes, as the snapshot does to detect changed regions.
+ */
+uint64_t la_snapshot_hash(const void *data, size_t len);
+
+/**
+ * Write a snapshot of `regions` to `path`, replacing any file there
+ * atomically. Regions `old` (may be NULL) has valid data for, decoded
+ * from the same bytes at the same address, are copied from it instead of
+ * being decoded; `old` may be a mapping of `path` itself. The number of
+ * regions decoded is stored in `num_rebuilt` unless it is NULL.
+ *
+ * Returns false with errno set on failure.
+ */
+bool la_snapshot_write(
+    const char *path,
+    const struct la_snapshot_region *regions,
+    size_t num_regions,
+    const struct la_snapshot *old,
+    size_t *num_rebuilt
+);
+
+/**
+ * Map the snapshot at `path`, checking its header and region table only.
+ *
+ * Returns NULL with errno set on failure: EINVAL if it is not a snapshot
+ * or is corrupt, ESTALE if it was written with another matcher table.
+ */
+struct la_snapshot *la_snapshot_open(const char *path);
+
+void la_snapshot_close(struct la_snapshot *snap);
+
+size_t la_snapshot_num_regions(const struct la_snapshot *snap);
+
+void la_snapshot_region_info(const struct la_snapshot *snap, size_t i, uint64_t *addr, size_t *num_insns);
+
+/**
+ * Check whether region `i` was decoded from `len` bytes at `buf` located
+ * at `addr`, by hashing them.
+ */
+bool la_snapshot_region_matches(const struct la_snapshot *snap, size_t i, uint64_t addr, const uint8_t *buf, size_t len);
+
+/**
+ * Get region `i` as read-only packed insns pointing into the mapping, and
+ * its leader bitmap as in struct la_cfg; either may be NULL. The first call
+ * for a region verifies its checksum, so a snapshot is not thread-safe
+ * until every region used was loaded once.
+ *
+ * Returns false if the region data is corrupt.
+ */
+bool la_snapshot_region_load(
+    const struct la_snapshot *snap,
+    size_t i,
+    struct la_packed_insns *insns,
+    const uint64_t **leaders
+);
+
+/*
+ * Insn cache.
+ *
+ * Keeps decoded and rendered insns keyed by (pc, insn word), for clients
+ * like the r2 plugins that are asked about the same addresses over and
+ * over. Patched bytes change the word and so never hit a stale entry.
+ * A cache is not thread-safe.
+ */
+
+struct la_cached_insn {
+    uint64_t pc;
+    la_insn_t insn_word;
+    int text_len;
+    struct la_op op;
+    char text[LA_INSN_TEXT_MAX];
+};
+
+struct la_insn_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;     /* misses that replaced another pc */
+    uint64_t stale;         /* misses on a pc cached with a different word */
+    uint64_t invalidations;
+    size_t capacity;        /* in insns */
+    size_t mem_size;        /* in bytes */
+};
+
+struct la_insn_cache;
+
+/**
+ * Create a cache using at most `max_bytes` of memory (but at least room
+ * for a couple of insns).
+ *
+ * Returns NULL on allocation failure.
+ */
+struct la_insn_cache *la_insn_cache_new(size_t max_bytes);
+
+void la_insn_cache_free(struct la_insn_cache *cache);
+
+/**
+ * Get the insn `insn_word` located at `pc`, decoding and rendering it on
+ * a miss.
+ *
+ * The entry stays valid until the next call on the same cache.
+ */
+const struct la_cached_insn *la_insn_cache_lookup(
+    struct la_insn_cache *cache,
+    uint64_t pc,
+    la_insn_t insn_word
+);
+
+/* drop the entries of insns located in [from, to) */
+void la_insn_cache_invalidate(struct la_insn_cache *cache, uint64_t from, uint64_t to);
+
+void la_insn_cache_clear(struct la_insn_cache *cache);
+
+void la_insn_cache_get_stats(const struct la_insn_cache *cache, struct la_insn_cache_stats *stats);
 #endif  /* _R_LOONGARCH_H_ */